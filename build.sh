@@ -1,3 +1,14 @@
 #!/bin/bash
 
 g++ -g3 --std=c++20 tests/dumper.cpp -I. -o dumper
+g++ -O2 --std=c++20 tests/async_bench.cpp -I. -o async_bench -pthread
+g++ -O2 --std=c++20 tests/encode_bench.cpp -I. -o encode_bench -pthread
+g++ -O2 --std=c++20 tests/validate_bench.cpp -I. -o validate_bench
+g++ -O2 --std=c++20 tests/catalog.cpp -I. -o catalog -pthread
+g++ -O2 --std=c++20 tests/bench.cpp -I. -o bench
+g++ -O2 --std=c++20 tests/cache_test.cpp -I. -o cache_test
+
+# The fuzz harness needs libFuzzer, which only clang provides.
+if command -v clang++ >/dev/null; then
+  clang++ -g -O1 -fsanitize=fuzzer,address,undefined --std=c++20 tests/fuzz.cpp -I. -o fuzz
+fi
@@ -1,12 +1,21 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
 #include <array>
+#include <iterator>
 #include <vector>
 #include <stdexcept>
 #include <optional>
 #include <span>
+#include <string>
+#include <string_view>
 #include <tuple>
+#include <variant>
+
+#include "libvtf++/instrument.hpp"
 
 #ifndef _MSC_VER
 # define PACKED_STRUCT(name) struct __attribute__((packed)) name
@@ -168,8 +177,8 @@ namespace libvtf {
       { "NV_NULL",                    4,  8, 8, 8, 8, 0, 0, false, false, false },
 
       // Vendor-dependent compressed formats typically used for normal map compression
-      { "ATI1N",                      0, 0, 0, 0, 0, 0, 0, true, false, false },
       { "ATI2N",                      0, 0, 0, 0, 0, 0, 0, true, false, false },
+      { "ATI1N",                      0, 0, 0, 0, 0, 0, 0, true, false, false },
 
       { "RGBA1010102",                4, 10, 10, 10, 2, 0, 0, false, false, false },
       { "BGRA1010102",                4, 10, 10, 10, 2, 0, 0, false, false, false },
@@ -223,13 +232,19 @@ namespace libvtf {
 
   constexpr const ImageFormats::ImageFormatInfo* getImageFormatInfo(ImageFormat format) {
     uint32_t index = static_cast<uint32_t>(static_cast<int32_t>(format) + 1);
-    if (index < 0 || index >= std::size(ImageFormats::ImageFormatInfos))
+    if (index >= std::size(ImageFormats::ImageFormatInfos))
       return nullptr;
 
     return &ImageFormats::ImageFormatInfos[index];
   }
 
+  static_assert(std::size(ImageFormats::ImageFormatInfos) == ImageFormats::VITAMIN_FORMAT_LAST + 2,
+    "ImageFormatInfos must have an entry for every image format.");
+
   constexpr std::tuple<uint16_t, uint16_t, uint16_t> adjustImageSizeByMip(uint16_t width, uint16_t height, uint16_t depth, uint8_t mipLevel) {
+    if (mipLevel >= 16)
+      return { 1u, 1u, 1u };
+
     return std::tuple<uint16_t, uint16_t, uint16_t> {
       std::max<uint16_t>(width  >> mipLevel, 1u),
       std::max<uint16_t>(height >> mipLevel, 1u),
@@ -237,23 +252,24 @@ namespace libvtf {
     };
   }
 
-  constexpr uint32_t getMemoryRequiredForMip(uint16_t width, uint16_t height, uint16_t depth, ImageFormat imageFormat) {
-    const auto *fmt = getImageFormatInfo(imageFormat);
-    if (!fmt || !width || !height || !depth)
-      return 0;
-    if (!fmt->isCompressed)
-      return width * height * depth * fmt->numBytes;
-
-    width  = std::max<uint16_t>(width  >> 2, 1u);
-    height = std::max<uint16_t>(height >> 2, 1u);
+  // The unit a format is stored in: 4x4 blocks for block compressed formats,
+  // single pixels otherwise. Volumes are compressed slice by slice, blocks
+  // are always one deep. bytesPerBlock is 0 for formats that can't be stored.
+  struct ImageFormatBlockInfo {
+    uint8_t blockWidth;
+    uint8_t blockHeight;
+    uint8_t bytesPerBlock;
+  };
 
-    uint32_t numBlocks = width * height * depth;
-    switch (imageFormat) {
+  constexpr ImageFormatBlockInfo getImageFormatBlockInfo(ImageFormat format) {
+    switch (format) {
       case ImageFormats::DXT1:
+      case ImageFormats::DXT1_ONEBITALPHA:
       case ImageFormats::DXT1_RUNTIME:
       case ImageFormats::LINEAR_DXT1:
       case ImageFormats::ATI1N:
-        return numBlocks * 8;
+      case ImageFormats::VITAMIN_BC4:
+        return { 4, 4, 8 };
 
       case ImageFormats::DXT3:
       case ImageFormats::DXT3_RUNTIME:
@@ -262,14 +278,92 @@ namespace libvtf {
       case ImageFormats::LINEAR_DXT3:
       case ImageFormats::LINEAR_DXT5:
       case ImageFormats::ATI2N:
-        return numBlocks * 16;
+      case ImageFormats::VITAMIN_BC5:
+      case ImageFormats::VITAMIN_BC6H:
+      case ImageFormats::VITAMIN_BC7:
+        return { 4, 4, 16 };
 
       default:
-        // Unknown type.
         break;
     }
 
-    return 0;
+    const auto *fmt = getImageFormatInfo(format);
+    if (!fmt || fmt->isCompressed)
+      return { 1, 1, 0 };
+    return { 1, 1, fmt->numBytes };
+  }
+
+  // Partial blocks at the right and bottom edges take a whole block.
+  constexpr uint64_t getMemoryRequiredForMip(uint32_t width, uint32_t height, uint32_t depth, ImageFormat imageFormat) {
+    const ImageFormatBlockInfo block = getImageFormatBlockInfo(imageFormat);
+    const uint64_t blocksX = (uint64_t(width)  + block.blockWidth  - 1) / block.blockWidth;
+    const uint64_t blocksY = (uint64_t(height) + block.blockHeight - 1) / block.blockHeight;
+    return blocksX * blocksY * depth * block.bytesPerBlock;
+  }
+
+  // Size of the high-res image data of a VTF: every mip, frame, face and
+  // slice. Large volume textures don't fit in 32 bits.
+  constexpr uint64_t getImageDataSize(uint16_t width, uint16_t height, uint16_t depth, uint16_t numFrames, uint32_t numFaces,
+                                      uint8_t numMipLevels, ImageFormat imageFormat) {
+    uint64_t size = 0;
+    for (uint8_t mipLevel = 0; mipLevel < numMipLevels; mipLevel++) {
+      auto [mipWidth, mipHeight, mipDepth] = adjustImageSizeByMip(width, height, depth, mipLevel);
+      size += getMemoryRequiredForMip(mipWidth, mipHeight, mipDepth, imageFormat);
+    }
+    return size * numFrames * numFaces;
+  }
+
+  namespace detail {
+
+    struct ImageSizeTest {
+      ImageFormat format;
+      uint32_t    width;
+      uint32_t    height;
+      uint32_t    depth;
+      uint64_t    size;
+    };
+
+    static constexpr ImageSizeTest ImageSizeTests[] = {
+      { ImageFormats::RGBA8888,         1,     1,     1,    4 },
+      { ImageFormats::RGB888,           3,     5,     1,    45 },
+      { ImageFormats::RGBA32323232F,    7,     3,     2,    672 },
+      { ImageFormats::DXT1,             1,     1,     1,    8 },
+      { ImageFormats::DXT1,             6,     6,     1,    32 },
+      { ImageFormats::DXT1_ONEBITALPHA, 4,     4,     1,    8 },
+      { ImageFormats::DXT5,             5,     9,     1,    96 },
+      { ImageFormats::DXT5,             8,     8,     3,    192 },
+      { ImageFormats::ATI1N,            12,    4,     1,    24 },
+      { ImageFormats::ATI2N,            2,     2,     1,    16 },
+      { ImageFormats::VITAMIN_BC4,      4,     8,     1,    16 },
+      { ImageFormats::VITAMIN_BC6H,     13,    13,    1,    256 },
+      { ImageFormats::VITAMIN_BC7,      16,    16,    1,    256 },
+      { ImageFormats::UNKNOWN,          16,    16,    1,    0 },
+      { ImageFormats::RGBA32323232F,    65535, 65535, 1,    uint64_t(65535) * 65535 * 16 },
+      { ImageFormats::DXT1,             65535, 65535, 4096, uint64_t(16384) * 16384 * 4096 * 8 },
+    };
+
+    constexpr bool checkImageSizes() {
+      for (const ImageSizeTest& test : ImageSizeTests) {
+        if (getMemoryRequiredForMip(test.width, test.height, test.depth, test.format) != test.size)
+          return false;
+      }
+
+      // Every compressed format has a block size, every other one a pixel size.
+      for (int32_t format = ImageFormats::SOURCE_FORMAT_FIRST; format <= ImageFormats::VITAMIN_FORMAT_LAST; format++) {
+        const ImageFormatBlockInfo block = getImageFormatBlockInfo(ImageFormat(format));
+        const bool compressed = getImageFormatInfo(ImageFormat(format))->isCompressed;
+        if (!block.bytesPerBlock || (compressed ? block.blockWidth != 4 : block.blockWidth != 1))
+          return false;
+      }
+
+      // 64x64 DXT1 chain: 2048 + 512 + 128 + 32 + 8 + 8 + 8, two frames of a cube map.
+      return getImageDataSize(64, 64, 1, 2, 6, 7, ImageFormats::DXT1) == (2048 + 512 + 128 + 32 + 8 + 8 + 8) * 12 &&
+             getImageDataSize(16384, 16384, 1, 1, 1, 15, ImageFormats::RGBA32323232F) > UINT32_MAX &&
+             getImageFormatInfo(ImageFormats::ATI2N)->name == "ATI2N";
+    }
+
+    static_assert(checkImageSizes(), "Image size table mismatch.");
+
   }
 
   namespace meta {
@@ -379,40 +473,35 @@ namespace libvtf {
       VTFHeader_7_5(const VTFHeader_7_4& header) : VTFHeader_7_4(header) { }
     };
 
-    PACKED_STRUCT(VTFHeader_X360) : public VTFBaseHeader {
-      static constexpr std::array<int32_t, 2> Version = { 0x0360, 8 };
-
+    // Common header of Xbox 360 and PS3 VTFs. Everything but the signature
+    // is stored big endian and the resource directory follows the header.
+    // There is no mip count: all mips down to 1x1 are stored unless NOMIP
+    // is set, and mipSkipCount top mips were already dropped when the file
+    // was built (width/height/depth are those of the first stored mip).
+    PACKED_STRUCT(VTFHeader_Console) : public VTFBaseHeader {
       uint32_t flags{};
       uint16_t width{};
       uint16_t height{};
       uint16_t depth{};
       uint16_t numFrames{};
-      uint16_t preloadDataSize{};
+      uint16_t preloadDataSize{};   // Bytes at the start of the file loaded up front
       uint8_t mipSkipCount{};
       uint8_t numResources{};
       std::array<float, 3> reflectivity{{1.0f, 1.0f, 1.0f}};
       float bumpScale{};
       ImageFormat imageFormat{ImageFormat::UNKNOWN};
-      std::array<uint8_t, 4> lowResImageSample{};
-      uint32_t compressedSize{};
+      std::array<uint8_t, 4> lowResImageSample{}; // Average color, RGBA8
+      uint32_t compressedSize{};    // Size of the LZMA compressed image data, 0 if uncompressed
     };
 
-    PACKED_STRUCT(VTFHeader_PS3) : public VTFBaseHeader {
-      static constexpr std::array<int32_t, 2> Version = { 0x0333, 8 };
+    PACKED_STRUCT(VTFHeader_X360) : public VTFHeader_Console {
+      static constexpr std::array<char, 4> ValidSignature = { 'V', 'T', 'F', 'X' };
+      static constexpr std::array<int32_t, 2> Version = { 0x0360, 8 };
+    };
 
-      uint32_t flags{};
-      uint16_t width{};
-      uint16_t height{};
-      uint16_t depth{};
-      uint16_t numFrames{};
-      uint16_t preloadDataSize{};
-      uint8_t mipSkipCount{};
-      uint8_t numResources{};
-      std::array<float, 3> reflectivity{{1.0f, 1.0f, 1.0f}};
-      float bumpScale{};
-      ImageFormat imageFormat{ImageFormat::UNKNOWN};
-      std::array<uint8_t, 4> lowResImageSample{};
-      uint32_t compressedSize{};
+    PACKED_STRUCT(VTFHeader_PS3) : public VTFHeader_Console {
+      static constexpr std::array<char, 4> ValidSignature = { 'V', 'T', 'F', '3' };
+      static constexpr std::array<int32_t, 2> Version = { 0x0333, 8 };
     };
 
     PACKED_STRUCT(VTFHeader) : public VTFHeader_7_5 {
@@ -449,9 +538,40 @@ namespace libvtf {
       // Data follows...
     };
 
+    namespace TextureSheetFlags {
+      static constexpr uint32_t Clamp   = 0x1; // Stop on the last frame instead of looping
+      static constexpr uint32_t NoAlpha = 0x2;
+      static constexpr uint32_t NoColor = 0x4;
+    }
+
     PACKED_STRUCT(TextureSheet) {
       static constexpr uint32_t ResourceID = MakeVTFResourceID(0x10, 0, 0);
-      // Data follows...
+
+      uint32_t size;    // Of what follows
+      int32_t  version; // 0: one rect per frame, 1: four
+      int32_t  numSequences;
+      // Sequences follow...
+    };
+
+    PACKED_STRUCT(TextureSheetSequenceHeader) {
+      int32_t  sequenceNumber;
+      uint32_t flags; // TextureSheetFlags
+      int32_t  numFrames;
+      float    totalTime;
+      // Frames follow...
+    };
+
+    PACKED_STRUCT(TextureSheetFrameHeader) {
+      float duration;
+      // Rects follow...
+    };
+
+    // Texture coordinates of a frame's image, in 0 - 1.
+    PACKED_STRUCT(TextureSheetRect) {
+      float u0;
+      float v0;
+      float u1;
+      float v1;
     };
 
     PACKED_STRUCT(TextureLODControlSettings) {
@@ -479,54 +599,314 @@ namespace libvtf {
 
   }
 
+  namespace detail {
+
+    constexpr uint16_t byteSwap16(uint16_t value) {
+      return uint16_t((value >> 8) | (value << 8));
+    }
+
+    constexpr uint32_t byteSwap32(uint32_t value) {
+      return (value >> 24) | ((value >> 8) & 0xFF00u) | ((value << 8) & 0xFF0000u) | (value << 24);
+    }
+
+    inline float byteSwapFloat(float value) {
+      uint32_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      bits = byteSwap32(bits);
+      std::memcpy(&value, &bits, sizeof(bits));
+      return value;
+    }
+
+    // Size of the units the 360 GPU byte swaps a format in: 16-bit words
+    // for block compressed and 16-bit channel formats, 32-bit words for
+    // 32-bit pixels and floats. 1 means no swapping.
+    constexpr uint32_t getX360SwapUnit(ImageFormat format) {
+      const ImageFormats::ImageFormatInfo* info = getImageFormatInfo(format);
+      if (!info)
+        return 1;
+      if (info->isCompressed)
+        return 2;
+
+      switch (format) {
+        case ImageFormats::RGBA16161616F:
+        case ImageFormats::RGBA16161616:
+        case ImageFormats::LINEAR_RGBA16161616:
+        case ImageFormats::RG1616F:
+        case ImageFormats::R16F:
+          return 2;
+        case ImageFormats::RGB323232F:
+          return 4;
+        default:
+          return info->numBytes == 2 || info->numBytes == 4 ? info->numBytes : 1;
+      }
+    }
+
+  }
+
+  namespace detail {
+
+    // Maps 24-bit resource types to their index in the resource directory.
+    // Open addressed, sized for Source's directory limit so it never fills
+    // past half. Duplicate types keep the first entry.
+    class ResourceIndex {
+    public:
+      static constexpr uint32_t MaxResources = 32;
+
+      ResourceIndex() {
+        m_slots.fill(EmptySlot);
+      }
+
+      void insert(uint32_t type, uint8_t index) {
+        for (uint32_t slot = hash(type);; slot = (slot + 1) % Capacity) {
+          if (m_slots[slot] == EmptySlot) {
+            m_slots[slot] = type | (uint32_t(index) << 24);
+            return;
+          }
+          if ((m_slots[slot] & 0xFFFFFFu) == type)
+            return;
+        }
+      }
+
+      std::optional<uint8_t> find(uint32_t type) const {
+        for (uint32_t slot = hash(type);; slot = (slot + 1) % Capacity) {
+          if (m_slots[slot] == EmptySlot)
+            return std::nullopt;
+          if ((m_slots[slot] & 0xFFFFFFu) == type)
+            return uint8_t(m_slots[slot] >> 24);
+        }
+      }
+
+    private:
+      static constexpr uint32_t Capacity  = MaxResources * 2;
+      static constexpr uint32_t EmptySlot = ~0u;
+
+      static constexpr uint32_t hash(uint32_t type) {
+        return (type * 0x9E3779B1u) >> 26;
+      }
+
+      std::array<uint32_t, Capacity> m_slots;
+    };
+
+  }
+
+  // A resource directory entry and the bytes it refers to.
+  struct VTFResource {
+    uint32_t type;
+    uint8_t  flags;
+    uint32_t offset; // Offset in bytes from the beginning of the file to the data
+    uint32_t size;
+    // The data, cut short if it runs past the end of the buffer. Resources
+    // without a data chunk point at the 4 bytes stored in the directory.
+    std::span<const uint8_t> data;
+
+    bool hasDataChunk() const {
+      return !(flags & meta::ResourceEntryTypeFlags::HasNoDataChunk);
+    }
+  };
+
+  enum class VTFError : uint8_t {
+    Truncated,
+    BadSignature,
+    UnsupportedVersion,
+    BadHeaderSize,
+    TooManyResources,
+    BadFormat,
+    BadDimensions,
+    ImageTooLarge,
+    MissingImageData,
+    ResourceOutOfBounds,
+  };
+
+  constexpr std::string_view getErrorMessage(VTFError error) {
+    switch (error) {
+      case VTFError::Truncated:           return "VTF data is truncated.";
+      case VTFError::BadSignature:        return "Not a VTF file.";
+      case VTFError::UnsupportedVersion:  return "Unhandled VTF header version.";
+      case VTFError::BadHeaderSize:       return "VTF header size is invalid.";
+      case VTFError::TooManyResources:    return "Too many VTF resources.";
+      case VTFError::BadFormat:           return "VTF image format is invalid.";
+      case VTFError::BadDimensions:       return "VTF image dimensions are invalid.";
+      case VTFError::ImageTooLarge:       return "VTF image is too large.";
+      case VTFError::MissingImageData:    return "VTF has no image data.";
+      case VTFError::ResourceOutOfBounds: return "VTF resource data is out of bounds.";
+    }
+    return "Unknown VTF error.";
+  }
+
+  // Either a value or an error, along the lines of C++23's std::expected.
+  template <typename T, typename E>
+  class Expected {
+  public:
+    Expected(T value) : m_storage{ std::in_place_index<0>, std::move(value) } { }
+    Expected(E error) : m_storage{ std::in_place_index<1>, error } { }
+
+    bool has_value() const { return m_storage.index() == 0; }
+    explicit operator bool() const { return has_value(); }
+
+    // Throws the error's message if there is no value.
+    T& value() & { check(); return *std::get_if<0>(&m_storage); }
+    const T& value() const & { check(); return *std::get_if<0>(&m_storage); }
+    T&& value() && { check(); return std::move(*std::get_if<0>(&m_storage)); }
+
+    T& operator*() { return *std::get_if<0>(&m_storage); }
+    const T& operator*() const { return *std::get_if<0>(&m_storage); }
+    T* operator->() { return std::get_if<0>(&m_storage); }
+    const T* operator->() const { return std::get_if<0>(&m_storage); }
+
+    E error() const { return *std::get_if<1>(&m_storage); }
+
+  private:
+    void check() const {
+      if (!has_value())
+        throw std::runtime_error(std::string(getErrorMessage(error())));
+    }
+
+    std::variant<T, E> m_storage;
+  };
+
+  struct SubresourceLayout {
+    uint32_t offset; // Offset in bytes from the beginning of the high-res image data
+    uint32_t size;
+    uint16_t frame;
+    uint16_t face;
+    uint16_t slice;
+    uint8_t  mipLevel;
+  };
+
   class VTFData {
   public:
+    // Checks the header and resource directory, throwing on errors. The
+    // buffer may end after the directory, in which case the image data
+    // accessors return nothing.
     VTFData(std::span<const uint8_t> buffer)
-      : m_buffer{ buffer }
-      , m_header{ readHeader(buffer) } {
+      : VTFData{ buffer, requireValidHeader(buffer) } {
+    }
+
+    // Checks the whole file: header, resource directory, and that every
+    // resource and the image data lie within the buffer. Once this has
+    // succeeded the unchecked accessors are safe to use.
+    static Expected<VTFData, VTFError> create(std::span<const uint8_t> buffer) {
+      if (const std::optional<VTFError> error = validateHeader(buffer, true))
+        return *error;
+
+      VTFData data{ buffer, HeaderValidated{} };
+      if (const std::optional<VTFError> error = data.validateData())
+        return *error;
+      return data;
+    }
+
+    // Whether `buffer` starts with the signature of a PC, Xbox 360 or PS3
+    // VTF. The same signatures create() and the constructor accept.
+    static bool hasValidSignature(std::span<const uint8_t> buffer) {
+      if (buffer.size() < sizeof(meta::VTFBaseHeader))
+        return false;
+
+      const meta::VTFBaseHeader* baseHeader = reinterpret_cast<const meta::VTFBaseHeader*>(buffer.data());
+      return baseHeader->signature == meta::VTFBaseHeader::ValidSignature
+          || baseHeader->signature == meta::VTFHeader_X360::ValidSignature
+          || baseHeader->signature == meta::VTFHeader_PS3::ValidSignature;
+    }
+
+    // Offset of the end of the resource directory, from the first bytes of a
+    // file: how much of it a header-only load needs. nullopt if `prefix` is
+    // too short to tell or has no valid signature.
+    static std::optional<size_t> getDirectoryEndOffset(std::span<const uint8_t> prefix) {
+      if (!hasValidSignature(prefix))
+        return std::nullopt;
+
+      if (const std::optional<meta::VTFHeader_Console> console = prefix.size() >= sizeof(meta::VTFHeader_Console)
+            ? readConsoleHeader(prefix) : std::nullopt)
+        return std::max<size_t>(size_t(std::max<int32_t>(console->headerSize, 0)),
+                                sizeof(meta::VTFHeader_Console) + console->numResources * sizeof(meta::ResourceEntryInfo));
+
+      const meta::VTFBaseHeader* baseHeader = reinterpret_cast<const meta::VTFBaseHeader*>(prefix.data());
+      if (baseHeader->signature != meta::VTFBaseHeader::ValidSignature)
+        return std::nullopt;
+      return size_t(std::max<int32_t>(baseHeader->headerSize, 0));
     }
 
     const meta::VTFHeader& getHeader() const { return m_header; }
 
-    const uint8_t* imageData() const {
-      if (m_header.numResources) {
-        const meta::TextureLegacyImage* image = getResourcePointer<meta::TextureLegacyImage>();
-        return reinterpret_cast<const uint8_t*>(image);
-      }
+    // The original header of Xbox 360 and PS3 files, byte swapped, or
+    // nullptr for PC files. getHeader() holds the same texture described as
+    // a 7.5 header, with the console version.
+    const meta::VTFHeader_Console* consoleHeader() const {
+      return m_consoleHeader ? &*m_consoleHeader : nullptr;
+    }
 
-      // Legacy path (7.0 - 7.2)
-      uint32_t lowResImageSize = 0;
-      if (m_header.lowResImageWidth != 0 && m_header.lowResImageHeight != 0) {
-        lowResImageSize = getMemoryRequiredForMip(
-          m_header.lowResImageWidth, m_header.lowResImageHeight, 1u, m_header.lowResImageFormat);
-      }
+    // Console image data may be LZMA compressed, in which case imageData()
+    // returns nothing. See ConsoleImageReader.
+    bool isImageDataCompressed() const {
+      return m_consoleHeader && m_consoleHeader->compressedSize;
+    }
 
-      return &m_buffer[m_header.headerSize + lowResImageSize];
+    // Xbox 360 image data of most formats is stored byte swapped for its
+    // GPU, in which case imageData() returns nothing as well.
+    // ConsoleImageReader swaps it back.
+    bool isImageDataByteSwapped() const {
+      return m_consoleHeader && m_header.version == meta::VTFHeader_X360::Version && detail::getX360SwapUnit(m_header.format) != 1;
+    }
+
+    std::span<const uint8_t> buffer() const { return m_buffer; }
+
+    // Offset in bytes from the beginning of the file to the high-res image data.
+    // Only needs the header and resource directory to be present in the buffer.
+    std::optional<uint32_t> imageDataOffset() const {
+      return m_imageDataOffset;
+    }
+
+    // Null unless the whole high-res image is in the buffer, uncompressed
+    // and in PC byte order.
+    const uint8_t* imageData() const {
+      return m_imageDataSwapped ? nullptr : m_imageData;
     }
 
     std::span<const uint8_t> imageData(uint16_t frame, uint16_t face, uint8_t mipLevel) const {
-      const uint8_t* data = imageData();
-      if (!data)
+      if (!imageData() || frame >= m_header.numFrames || face >= faceCount() || mipLevel >= m_header.numMipLevels)
         return std::span<const uint8_t>{};
 
-      const uint32_t offset = imageOffset(frame, face, mipLevel);
-      const uint32_t size   = imageMipSize(mipLevel);
-      return std::span<const uint8_t>{data + offset, size};
+      return imageDataUnchecked(frame, face, mipLevel);
     }
 
-    std::span<const uint8_t> lowResImageData() const {
+    std::span<const uint8_t> imageData(const SubresourceLayout& subresource) const {
+      if (!imageData() || subresource.offset > m_imageTotalSize || subresource.size > m_imageTotalSize - subresource.offset)
+        return std::span<const uint8_t>{};
+
+      return imageDataUnchecked(subresource);
+    }
+
+    // No checks at all, for VTFData from create() or whose image data is
+    // otherwise known to be present. The subresource must be one of this
+    // file's subresources(). Data is returned as stored, byte swapped if
+    // isImageDataByteSwapped().
+    std::span<const uint8_t> imageDataUnchecked(uint16_t frame, uint16_t face, uint8_t mipLevel) const {
+      LIBVTF_INSTRUMENT_COUNT(ImageData, imageMipSize(mipLevel));
+      return std::span<const uint8_t>{ m_imageData + imageOffset(frame, face, mipLevel), imageMipSize(mipLevel) };
+    }
+
+    std::span<const uint8_t> imageDataUnchecked(const SubresourceLayout& subresource) const {
+      LIBVTF_INSTRUMENT_COUNT(ImageData, subresource.size);
+      return std::span<const uint8_t>{ m_imageData + subresource.offset, subresource.size };
+    }
+
+    uint32_t lowResImageSize() const {
       if (m_header.lowResImageWidth == 0 || m_header.lowResImageHeight == 0)
-        return std::span<const uint8_t>();
+        return 0;
 
-      const uint32_t size = getMemoryRequiredForMip(
-        m_header.lowResImageWidth, m_header.lowResImageHeight, 1u, m_header.lowResImageFormat);
+      return uint32_t(getMemoryRequiredForMip(
+        m_header.lowResImageWidth, m_header.lowResImageHeight, 1u, m_header.lowResImageFormat));
+    }
 
-      if (m_header.numResources) {
-        const meta::TextureLegacyLowResImage* image = getResourcePointer<meta::TextureLegacyLowResImage>();
-        return std::span<const uint8_t>{reinterpret_cast<const uint8_t*>(image), size};
-      }
+    // Offset in bytes from the beginning of the file to the low-res image data.
+    std::optional<uint32_t> lowResImageDataOffset() const {
+      return m_lowResImageDataOffset;
+    }
 
-      return std::span{&m_buffer[m_header.headerSize], size};
+    std::span<const uint8_t> lowResImageData() const {
+      if (!m_lowResImageDataOffset || !containsRange(*m_lowResImageDataOffset, lowResImageSize()))
+        return std::span<const uint8_t>();
+
+      return std::span{ m_buffer.data() + *m_lowResImageDataOffset, lowResImageSize() };
     }
 
     std::optional<uint32_t> crc32() const {
@@ -545,70 +925,399 @@ namespace libvtf {
       return getResourcePointer<meta::TextureSettingsEx>();
     }
 
+    class ResourceIterator {
+    public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type        = VTFResource;
+      using difference_type   = std::ptrdiff_t;
+      using pointer           = void;
+      using reference         = VTFResource;
+
+      ResourceIterator() = default;
+      ResourceIterator(const VTFData* data, uint32_t index) : m_data{ data }, m_index{ index } { }
+
+      VTFResource operator*() const { return m_data->resource(m_index); }
+      ResourceIterator& operator++() { m_index++; return *this; }
+      ResourceIterator operator++(int) { ResourceIterator it = *this; m_index++; return it; }
+      bool operator==(const ResourceIterator& other) const { return m_index == other.m_index; }
+
+    private:
+      const VTFData* m_data  = nullptr;
+      uint32_t       m_index = 0;
+    };
+
+    struct ResourceRange {
+      ResourceIterator first;
+      ResourceIterator last;
+
+      ResourceIterator begin() const { return first; }
+      ResourceIterator end() const { return last; }
+    };
+
+    // Every entry of the resource directory in file order, including types
+    // this library doesn't know. 7.0 - 7.2 files have no directory.
+    ResourceRange resources() const {
+      return ResourceRange{ ResourceIterator{ this, 0 }, ResourceIterator{ this, m_header.numResources } };
+    }
+
+    VTFResource resource(uint32_t index) const {
+      LIBVTF_INSTRUMENT_COUNT(ResourceLookup, 0);
+      const meta::ResourceEntryInfo& entry = resourceEntries()[index];
+
+      VTFResource resource{
+        .type   = entry.type,
+        .flags  = uint8_t(entry.flags),
+        .offset = entry.offset,
+        .size   = 0,
+        .data   = {},
+      };
+
+      if (!resource.hasDataChunk()) {
+        resource.offset = uint32_t(resourceDirectoryOffset() + index * sizeof(meta::ResourceEntryInfo) + offsetof(meta::ResourceEntryInfo, offset));
+        resource.size   = sizeof(entry.offset);
+        resource.data   = std::span{ reinterpret_cast<const uint8_t*>(&entry.offset), sizeof(entry.offset) };
+        return resource;
+      }
+
+      if (resource.type == meta::TextureLegacyImage::ResourceID)
+        resource.size = isImageDataCompressed() ? m_consoleHeader->compressedSize : m_imageTotalSize;
+      else if (resource.type == meta::TextureLegacyLowResImage::ResourceID)
+        resource.size = lowResImageSize();
+      else if (size_t(resource.offset) + sizeof(uint32_t) <= m_buffer.size()) {
+        // Other resources start with the size of what follows.
+        uint32_t size;
+        std::memcpy(&size, &m_buffer[resource.offset], sizeof(size));
+        resource.size = uint32_t(std::min<uint64_t>(uint64_t(size) + sizeof(size), UINT32_MAX));
+      }
+
+      if (resource.offset < m_buffer.size())
+        resource.data = m_buffer.subspan(resource.offset, std::min<size_t>(resource.size, m_buffer.size() - resource.offset));
+      return resource;
+    }
+
+    // The first resource of a type, if the file has one.
+    std::optional<VTFResource> findResource(uint32_t type) const {
+      const std::optional<uint8_t> index = m_resourceIndex.find(type);
+      if (!index)
+        return std::nullopt;
+
+      return resource(*index);
+    }
+
     uint32_t faceCount() const {
       return (!!(m_header.flags & meta::VTFFlags::ENVMAP)) ? 6u : 1u;
     }
 
-  private:
+    // Every (mip, frame, face, slice) of the high-res image, in file order
+    // (smallest mip first).
+    std::span<const SubresourceLayout> subresources() const {
+      return m_subresources;
+    }
+
+    const SubresourceLayout& subresource(uint16_t frame, uint16_t face, uint8_t mipLevel, uint16_t slice = 0) const {
+      const MipLayout& mip = m_mips[mipLevel];
+      return m_subresources[mip.firstSubresource + (frame * faceCount() + face) * mip.depth + slice];
+    }
 
+    // Size of a single frame/face of a mip, including all of its slices.
     uint32_t imageMipSize(uint8_t mipLevel) const {
-      auto [width, height, depth] = adjustImageSizeByMip(m_header.width, m_header.height, m_header.depth, mipLevel);
+      return m_mips[mipLevel].size;
+    }
 
-      return getMemoryRequiredForMip(width, height, depth, m_header.format);
+    uint32_t imageTotalSize() const {
+      return m_imageTotalSize;
     }
 
-    uint32_t imageMipOffset(uint8_t mipLevel) const {
-      uint32_t offset = 0;
-      for (int8_t i = int8_t(m_header.numMipLevels) - 1; i > int8_t(mipLevel); i--)
-        offset += imageMipSize(i) * m_header.numFrames * faceCount();
-      return offset;
+  private:
+
+    struct HeaderValidated { };
+
+    VTFData(std::span<const uint8_t> buffer, HeaderValidated)
+      : m_buffer{ buffer }
+      , m_consoleHeader{ readConsoleHeader(buffer) }
+      , m_header{ m_consoleHeader ? convertConsoleHeader(*m_consoleHeader) : readHeader(buffer) } {
+      if (m_consoleHeader)
+        readConsoleResources();
+      buildResourceIndex();
+      buildLayout();
+      m_imageDataOffset       = findImageDataOffset();
+      m_lowResImageDataOffset = findLowResImageDataOffset();
+      if (m_imageDataOffset && !isImageDataCompressed() && containsRange(*m_imageDataOffset, m_imageTotalSize))
+        m_imageData = m_buffer.data() + *m_imageDataOffset;
+      m_imageDataSwapped = isImageDataByteSwapped();
+    }
+
+    static HeaderValidated requireValidHeader(std::span<const uint8_t> buffer) {
+      if (const std::optional<VTFError> error = validateHeader(buffer))
+        throw std::runtime_error(std::string(getErrorMessage(*error)));
+      return HeaderValidated{};
     }
 
-    uint32_t totalImageFaceSize() const {
-      uint32_t size = 0;
-      for (uint8_t i = 0; i < m_header.numMipLevels; i++) {
-        auto [width, height, depth] = adjustImageSizeByMip(m_header.width, m_header.height, m_header.depth, i);
-        size += getMemoryRequiredForMip(width, height, depth, m_header.format);
+    // Everything needed to build the layout safely: the header fields and
+    // the resource directory, but none of the data they point to. With
+    // `wholeFile` the image data must also fit in the buffer, so a tiny
+    // file can't have a layout larger than itself.
+    static std::optional<VTFError> validateHeader(std::span<const uint8_t> buffer, bool wholeFile = false) {
+      LIBVTF_INSTRUMENT_SCOPE(Validate, 0);
+      if (buffer.size() < sizeof(meta::VTFBaseHeader))
+        return VTFError::Truncated;
+
+      const meta::VTFBaseHeader* baseHeader = reinterpret_cast<const meta::VTFBaseHeader*>(buffer.data());
+      const bool x360 = baseHeader->signature == meta::VTFHeader_X360::ValidSignature;
+      const bool ps3  = baseHeader->signature == meta::VTFHeader_PS3::ValidSignature;
+      if (x360 || ps3) {
+        if (buffer.size() < sizeof(meta::VTFHeader_Console))
+          return VTFError::Truncated;
+
+        const meta::VTFHeader_Console console = *readConsoleHeader(buffer);
+        if (console.version != (x360 ? meta::VTFHeader_X360::Version : meta::VTFHeader_PS3::Version))
+          return VTFError::UnsupportedVersion;
+        if (console.numResources > detail::ResourceIndex::MaxResources)
+          return VTFError::TooManyResources;
+        if (buffer.size() < sizeof(meta::VTFHeader_Console) + console.numResources * sizeof(meta::ResourceEntryInfo))
+          return VTFError::Truncated;
+
+        const meta::VTFHeader header = convertConsoleHeader(console);
+        if (const std::optional<VTFError> error = validateDimensions(header))
+          return error;
+        return wholeFile ? validateImageDataSize(header, buffer.size(), console.compressedSize != 0) : std::nullopt;
       }
-      return size;
+
+      if (baseHeader->signature != meta::VTFBaseHeader::ValidSignature)
+        return VTFError::BadSignature;
+
+      const std::optional<size_t> structSize = getHeaderStructSize(baseHeader->version);
+      if (!structSize)
+        return VTFError::UnsupportedVersion;
+      if (buffer.size() < *structSize)
+        return VTFError::Truncated;
+
+      const meta::VTFHeader header = readHeader(buffer);
+      if (header.headerSize < 0 || size_t(header.headerSize) < *structSize + header.numResources * sizeof(meta::ResourceEntryInfo))
+        return VTFError::BadHeaderSize;
+      if (header.numResources > detail::ResourceIndex::MaxResources)
+        return VTFError::TooManyResources;
+      if (size_t(header.headerSize) > buffer.size())
+        return VTFError::Truncated;
+
+      if (const std::optional<VTFError> error = validateDimensions(header))
+        return error;
+      return wholeFile ? validateImageDataSize(header, buffer.size(), false) : std::nullopt;
     }
 
-    uint32_t imageTotalSize() const {
-      return m_header.numFrames * this->faceCount() * totalImageFaceSize();
+    static std::optional<size_t> getHeaderStructSize(const std::array<int32_t, 2>& version) {
+      if (version == meta::VTFHeader_7_5::Version || version == meta::VTFHeader_7_4::Version || version == meta::VTFHeader_7_3::Version)
+        return sizeof(meta::VTFHeader_7_3);
+      if (version == meta::VTFHeader_7_2::Version)
+        return sizeof(meta::VTFHeader_7_2);
+      if (version == meta::VTFHeader_7_1::Version || version == meta::VTFHeader_7_0::Version)
+        return sizeof(meta::VTFHeader_7_0);
+      return std::nullopt;
     }
 
-    uint32_t imageOffset(uint16_t frame, uint16_t face, uint8_t mipLevel) const {
-      const uint32_t faceSize  = imageMipSize(mipLevel);
-      const uint32_t frameSize = faceCount() * faceSize;
+    static std::optional<VTFError> validateDimensions(const meta::VTFHeader& header) {
+      if (!getMemoryRequiredForMip(1, 1, 1, header.format))
+        return VTFError::BadFormat;
+      if (header.lowResImageWidth && header.lowResImageHeight && !getMemoryRequiredForMip(1, 1, 1, header.lowResImageFormat))
+        return VTFError::BadFormat;
+
+      if (!header.width || !header.height || !header.depth || !header.numFrames || !header.numMipLevels)
+        return VTFError::BadDimensions;
 
-      const uint32_t frameOffset = frame * frameSize;
-      const uint32_t faceOffset  = face * faceSize;
-      const uint32_t mipOffset   = imageMipOffset(mipLevel);
+      uint8_t maxMipLevels = 1;
+      for (uint16_t size = std::max({ header.width, header.height, header.depth }); size > 1; size >>= 1)
+        maxMipLevels++;
+      if (header.numMipLevels > maxMipLevels)
+        return VTFError::BadDimensions;
 
-      return faceOffset + frameOffset + mipOffset;
+      // The layout uses 32-bit offsets.
+      const uint32_t faces = (header.flags & meta::VTFFlags::ENVMAP) ? 6u : 1u;
+      if (getImageDataSize(header.width, header.height, header.depth, header.numFrames, faces, header.numMipLevels, header.format) > UINT32_MAX)
+        return VTFError::ImageTooLarge;
+
+      // Bounds the subresource table when only the header is at hand.
+      if (getSubresourceCount(header) > MaxSubresources)
+        return VTFError::ImageTooLarge;
+
+      return std::nullopt;
     }
 
-    template <typename T>
-    const T* getResourcePointer() const {
-      const meta::ResourceEntryInfo* resources = this->resourceEntries();
-      for (uint32_t i = 0; i < m_header.numResources; i++) {
-        if (resources[i].type != T::ResourceID)
+    // Every subresource takes at least one byte, so neither they nor the
+    // image data can outgrow the file. Compressed image data is only
+    // bounded by validateData().
+    static std::optional<VTFError> validateImageDataSize(const meta::VTFHeader& header, size_t bufferSize, bool compressed) {
+      const uint32_t faces = (header.flags & meta::VTFFlags::ENVMAP) ? 6u : 1u;
+      if (getSubresourceCount(header) > bufferSize)
+        return VTFError::Truncated;
+      if (!compressed && getImageDataSize(header.width, header.height, header.depth, header.numFrames, faces, header.numMipLevels, header.format) > bufferSize)
+        return VTFError::Truncated;
+      return std::nullopt;
+    }
+
+    static constexpr uint64_t MaxSubresources = uint64_t(1) << 20;
+
+    static uint64_t getSubresourceCount(const meta::VTFHeader& header) {
+      const uint32_t faces = (header.flags & meta::VTFFlags::ENVMAP) ? 6u : 1u;
+      uint64_t slices = 0;
+      for (uint8_t i = 0; i < header.numMipLevels; i++)
+        slices += std::get<2>(adjustImageSizeByMip(header.width, header.height, header.depth, i));
+      return slices * header.numFrames * faces;
+    }
+
+    // What the header points at: resource data chunks, the low-res image
+    // and the high-res image must all be in the buffer.
+    std::optional<VTFError> validateData() const {
+      LIBVTF_INSTRUMENT_SCOPE(Validate, m_buffer.size());
+      for (const VTFResource resource : resources()) {
+        if (!resource.hasDataChunk())
           continue;
 
-        if (resources[i].flags & meta::ResourceEntryTypeFlags::HasNoDataChunk) {
-          return reinterpret_cast<const T*>(&resources[i].offset);
-        } else {
-          return reinterpret_cast<const T*>(&m_buffer[resources[i].offset]);
+        if (resource.type != meta::TextureLegacyImage::ResourceID && resource.type != meta::TextureLegacyLowResImage::ResourceID &&
+            !containsRange(resource.offset, sizeof(uint32_t)))
+          return VTFError::ResourceOutOfBounds;
+        if (!containsRange(resource.offset, resource.size))
+          return VTFError::ResourceOutOfBounds;
+      }
+
+      if (!m_imageDataOffset)
+        return VTFError::MissingImageData;
+      if (!isImageDataCompressed() && !m_imageData)
+        return VTFError::Truncated;
+      if (isImageDataCompressed() && !containsRange(*m_imageDataOffset, m_consoleHeader->compressedSize))
+        return VTFError::Truncated;
+
+      if (m_lowResImageDataOffset && !containsRange(*m_lowResImageDataOffset, lowResImageSize()))
+        return VTFError::Truncated;
+
+      return std::nullopt;
+    }
+
+    bool containsRange(uint32_t offset, uint32_t size) const {
+      return offset <= m_buffer.size() && size <= m_buffer.size() - offset;
+    }
+
+    struct MipLayout {
+      uint32_t firstSubresource;
+      uint32_t offset;
+      uint32_t size;
+      uint16_t depth;
+    };
+
+    void buildLayout() {
+      LIBVTF_INSTRUMENT_SCOPE(Layout, 0);
+      const uint32_t faces = faceCount();
+      m_mips.resize(m_header.numMipLevels);
+      m_subresources.reserve(size_t(getSubresourceCount(m_header)));
+
+      uint32_t offset = 0;
+      for (int32_t i = int32_t(m_header.numMipLevels) - 1; i >= 0; i--) {
+        const uint8_t mipLevel = uint8_t(i);
+        auto [width, height, depth] = adjustImageSizeByMip(m_header.width, m_header.height, m_header.depth, mipLevel);
+        const uint32_t sliceSize = uint32_t(getMemoryRequiredForMip(width, height, 1u, m_header.format));
+
+        m_mips[mipLevel] = MipLayout {
+          .firstSubresource = uint32_t(m_subresources.size()),
+          .offset           = offset,
+          .size             = sliceSize * depth,
+          .depth            = depth,
+        };
+
+        for (uint16_t frame = 0; frame < m_header.numFrames; frame++) {
+          for (uint16_t face = 0; face < faces; face++) {
+            for (uint16_t slice = 0; slice < depth; slice++) {
+              m_subresources.push_back(SubresourceLayout {
+                .offset   = offset,
+                .size     = sliceSize,
+                .frame    = frame,
+                .face     = face,
+                .slice    = slice,
+                .mipLevel = mipLevel,
+              });
+              offset += sliceSize;
+            }
+          }
         }
       }
 
-      return nullptr;
+      m_imageTotalSize = offset;
+    }
+
+    uint32_t imageOffset(uint16_t frame, uint16_t face, uint8_t mipLevel) const {
+      return subresource(frame, face, mipLevel).offset;
+    }
+
+    std::optional<uint32_t> findImageDataOffset() const {
+      if (m_header.numResources)
+        return getResourceOffset<meta::TextureLegacyImage>();
+
+      // Legacy path (7.0 - 7.2)
+      return m_header.headerSize + lowResImageSize();
+    }
+
+    std::optional<uint32_t> findLowResImageDataOffset() const {
+      if (!lowResImageSize())
+        return std::nullopt;
+
+      if (m_header.numResources)
+        return getResourceOffset<meta::TextureLegacyLowResImage>();
+
+      return m_header.headerSize;
+    }
+
+    // Resources with a data chunk that runs past the end of the buffer are
+    // treated as missing.
+    template <typename T>
+    const T* getResourcePointer() const {
+      LIBVTF_INSTRUMENT_COUNT(ResourceLookup, 0);
+      const std::optional<uint8_t> index = m_resourceIndex.find(T::ResourceID);
+      if (!index)
+        return nullptr;
+
+      const meta::ResourceEntryInfo& entry = resourceEntries()[*index];
+      if (entry.flags & meta::ResourceEntryTypeFlags::HasNoDataChunk)
+        return reinterpret_cast<const T*>(&entry.offset);
+
+      if (size_t(entry.offset) + sizeof(T) > m_buffer.size())
+        return nullptr;
+      return reinterpret_cast<const T*>(&m_buffer[entry.offset]);
+    }
+
+    template <typename T>
+    std::optional<uint32_t> getResourceOffset() const {
+      LIBVTF_INSTRUMENT_COUNT(ResourceLookup, 0);
+      const std::optional<uint8_t> index = m_resourceIndex.find(T::ResourceID);
+      if (!index)
+        return std::nullopt;
+
+      const meta::ResourceEntryInfo& entry = resourceEntries()[*index];
+      if (entry.flags & meta::ResourceEntryTypeFlags::HasNoDataChunk)
+        return std::nullopt;
+
+      return entry.offset;
+    }
+
+    size_t resourceDirectoryOffset() const {
+      if (m_consoleHeader)
+        return sizeof(meta::VTFHeader_Console);
+      return size_t(m_header.headerSize) - m_header.numResources * sizeof(meta::ResourceEntryInfo);
     }
 
     const meta::ResourceEntryInfo* resourceEntries() const {
       if (!m_header.numResources)
         return nullptr;
-      return reinterpret_cast<const meta::ResourceEntryInfo*>(&m_buffer[m_header.headerSize - m_header.numResources * sizeof(meta::ResourceEntryInfo)]);
+      if (m_consoleHeader)
+        return m_consoleResources.data();
+      return reinterpret_cast<const meta::ResourceEntryInfo*>(&m_buffer[resourceDirectoryOffset()]);
+    }
+
+    void buildResourceIndex() {
+      LIBVTF_INSTRUMENT_SCOPE(Parse, 0);
+      if (!m_header.numResources)
+        return;
+
+      const meta::ResourceEntryInfo* resources = resourceEntries();
+      for (uint32_t i = 0; i < m_header.numResources; i++)
+        m_resourceIndex.insert(resources[i].type, uint8_t(i));
     }
 
     template <typename T>
@@ -619,28 +1328,109 @@ namespace libvtf {
       return reinterpret_cast<const T*>(data.data());
     }
 
+    // Copies instead of casting, for types that need more than byte
+    // alignment. Buffers can start anywhere, eg. inside a VPK archive.
+    template <typename T>
+    static T spanRead(std::span<const uint8_t> data) {
+      if (data.size() < sizeof(T))
+        throw std::runtime_error("Cannot read type from data span (EOF)");
+
+      T value;
+      std::memcpy(static_cast<void*>(&value), data.data(), sizeof(T));
+      return value;
+    }
+
     static meta::VTFHeader readHeader(std::span<const uint8_t> data) {
       const meta::VTFBaseHeader* baseHeader =
         spanGet<meta::VTFBaseHeader>(data);
 
       if (baseHeader->version == meta::VTFHeader_7_5::Version)
-        return meta::VTFHeader{ *spanGet<meta::VTFHeader_7_5>(data) };
+        return meta::VTFHeader{ spanRead<meta::VTFHeader_7_5>(data) };
       else if (baseHeader->version == meta::VTFHeader_7_4::Version)
-        return meta::VTFHeader{ *spanGet<meta::VTFHeader_7_4>(data) };
+        return meta::VTFHeader{ spanRead<meta::VTFHeader_7_4>(data) };
       else if (baseHeader->version == meta::VTFHeader_7_3::Version)
-        return meta::VTFHeader{ *spanGet<meta::VTFHeader_7_3>(data) };
+        return meta::VTFHeader{ spanRead<meta::VTFHeader_7_3>(data) };
       else if (baseHeader->version == meta::VTFHeader_7_2::Version)
-        return meta::VTFHeader{ *spanGet<meta::VTFHeader_7_2>(data) };
+        return meta::VTFHeader{ spanRead<meta::VTFHeader_7_2>(data) };
       else if (baseHeader->version == meta::VTFHeader_7_1::Version)
-        return meta::VTFHeader{ *spanGet<meta::VTFHeader_7_1>(data) };
+        return meta::VTFHeader{ spanRead<meta::VTFHeader_7_1>(data) };
       else if (baseHeader->version == meta::VTFHeader_7_0::Version)
-        return meta::VTFHeader{ *spanGet<meta::VTFHeader_7_0>(data) };
+        return meta::VTFHeader{ spanRead<meta::VTFHeader_7_0>(data) };
       else
         throw std::runtime_error("Unhandled VTF header version.");
     }
 
-    std::span<const uint8_t> m_buffer;
-    meta::VTFHeader          m_header;
+    static std::optional<meta::VTFHeader_Console> readConsoleHeader(std::span<const uint8_t> data) {
+      const meta::VTFBaseHeader* baseHeader = spanGet<meta::VTFBaseHeader>(data);
+      const bool x360 = baseHeader->signature == meta::VTFHeader_X360::ValidSignature;
+      const bool ps3  = baseHeader->signature == meta::VTFHeader_PS3::ValidSignature;
+      if (!x360 && !ps3)
+        return std::nullopt;
+
+      meta::VTFHeader_Console header = *spanGet<meta::VTFHeader_Console>(data);
+      header.version         = { int32_t(detail::byteSwap32(uint32_t(header.version[0]))), int32_t(detail::byteSwap32(uint32_t(header.version[1]))) };
+      header.headerSize      = int32_t(detail::byteSwap32(uint32_t(header.headerSize)));
+      header.flags           = detail::byteSwap32(header.flags);
+      header.width           = detail::byteSwap16(header.width);
+      header.height          = detail::byteSwap16(header.height);
+      header.depth           = detail::byteSwap16(header.depth);
+      header.numFrames       = detail::byteSwap16(header.numFrames);
+      header.preloadDataSize = detail::byteSwap16(header.preloadDataSize);
+      header.reflectivity    = { detail::byteSwapFloat(header.reflectivity[0]), detail::byteSwapFloat(header.reflectivity[1]), detail::byteSwapFloat(header.reflectivity[2]) };
+      header.bumpScale       = detail::byteSwapFloat(header.bumpScale);
+      header.imageFormat     = ImageFormat(detail::byteSwap32(uint32_t(header.imageFormat)));
+      header.compressedSize  = detail::byteSwap32(header.compressedSize);
+      return header;
+    }
+
+    static meta::VTFHeader convertConsoleHeader(const meta::VTFHeader_Console& console) {
+      meta::VTFHeader header;
+      header.signature    = console.signature;
+      header.version      = console.version;
+      header.headerSize   = console.headerSize;
+      header.width        = console.width;
+      header.height       = console.height;
+      header.flags        = console.flags;
+      header.numFrames    = console.numFrames;
+      header.reflectivity = console.reflectivity;
+      header.bumpScale    = console.bumpScale;
+      header.format       = console.imageFormat;
+      header.depth        = std::max<uint16_t>(console.depth, 1);
+      header.numResources = console.numResources;
+
+      header.numMipLevels = 1;
+      if (!(console.flags & meta::VTFFlags::NOMIP)) {
+        for (uint16_t size = std::max({ header.width, header.height, header.depth }); size > 1; size >>= 1)
+          header.numMipLevels++;
+      }
+      return header;
+    }
+
+    // The directory follows the console header, big endian like the rest.
+    void readConsoleResources() {
+      std::span<const uint8_t> directory = m_buffer.subspan(sizeof(meta::VTFHeader_Console));
+      m_consoleResources.resize(m_header.numResources);
+      for (uint32_t i = 0; i < m_header.numResources; i++) {
+        uint32_t words[2];
+        std::memcpy(words, &directory[i * sizeof(meta::ResourceEntryInfo)], sizeof(words));
+        words[0] = detail::byteSwap32(words[0]);
+        words[1] = detail::byteSwap32(words[1]);
+        std::memcpy(&m_consoleResources[i], words, sizeof(words));
+      }
+    }
+
+    std::span<const uint8_t>               m_buffer;
+    std::optional<meta::VTFHeader_Console> m_consoleHeader;
+    std::vector<meta::ResourceEntryInfo>   m_consoleResources;
+    meta::VTFHeader                        m_header;
+    detail::ResourceIndex                  m_resourceIndex;
+    std::vector<MipLayout>                 m_mips;
+    std::vector<SubresourceLayout>         m_subresources;
+    uint32_t                               m_imageTotalSize = 0;
+    std::optional<uint32_t>                m_imageDataOffset;
+    std::optional<uint32_t>                m_lowResImageDataOffset;
+    const uint8_t*                         m_imageData = nullptr; // As stored, see imageData()
+    bool                                   m_imageDataSwapped = false;
   };
 
 }
@@ -0,0 +1,570 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "ranged.hpp"
+#include "threading.hpp"
+
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+# define LIBVTF_HAS_IO_URING 1
+# include <fcntl.h>
+# include <linux/io_uring.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+#endif
+
+namespace libvtf {
+
+  enum class AsyncBackend {
+    Auto,       // io_uring when available, thread pool otherwise
+    IoUring,
+    ThreadPool,
+  };
+
+  enum class AsyncLoadMode {
+    Full,       // Whole file
+    HeaderOnly, // Header and resource directory only
+  };
+
+  struct AsyncLoaderOptions {
+    AsyncBackend  backend          = AsyncBackend::Auto;
+    AsyncLoadMode mode             = AsyncLoadMode::Full;
+    uint32_t      queueDepth       = 64;        // Files in flight
+    size_t        initialReadSize  = 64 * 1024; // First read of each file, the header is parsed from it
+    size_t        maxRetainedSize  = 16 << 20;  // Larger buffers are freed instead of recycled
+    Executor*     executor         = nullptr;   // Thread pool backend only, nullptr = shared pool
+  };
+
+  struct AsyncLoadResult {
+    size_t                       index; // Index into the list of paths
+    const std::filesystem::path& path;
+    // Null if loading failed. Points into a recycled buffer, so it is only
+    // valid for the duration of the callback. In HeaderOnly mode only the
+    // header, layout and non-image resources may be used.
+    const VTFData*               data;
+    std::span<const uint8_t>     bytes;
+    std::exception_ptr           error;
+  };
+
+  // With io_uring the callback runs on the thread that called loadAll(),
+  // with the thread pool backend it can run concurrently on several threads.
+  using AsyncLoadCallback = std::function<void(const AsyncLoadResult&)>;
+
+  namespace detail {
+
+    struct PooledBuffer {
+      std::unique_ptr<uint8_t[]> data;
+      size_t                     capacity = 0;
+
+      // Uninitialized on purpose, every byte that is used gets read into.
+      void reserve(size_t size) {
+        if (size <= capacity)
+          return;
+        data.reset(new uint8_t[size]);
+        capacity = size;
+      }
+    };
+
+    // Recycles read buffers between files. The number of live buffers is
+    // bounded by the number of files in flight.
+    class BufferPool {
+    public:
+      explicit BufferPool(size_t maxRetainedSize)
+        : m_maxRetainedSize{ maxRetainedSize } {
+      }
+
+      PooledBuffer acquire() {
+        std::unique_lock lock{ m_mutex };
+        if (m_free.empty())
+          return PooledBuffer{};
+
+        PooledBuffer buffer = std::move(m_free.back());
+        m_free.pop_back();
+        return buffer;
+      }
+
+      void release(PooledBuffer buffer) {
+        if (buffer.capacity > m_maxRetainedSize)
+          return;
+
+        std::unique_lock lock{ m_mutex };
+        m_free.push_back(std::move(buffer));
+      }
+
+    private:
+      std::mutex                m_mutex;
+      std::vector<PooledBuffer> m_free;
+      size_t                    m_maxRetainedSize;
+    };
+
+    // Size that has to be read for a load, given the first bytes of the file.
+    inline size_t getRequiredReadSize(std::span<const uint8_t> prefix, uint64_t fileSize, AsyncLoadMode mode) {
+      if (mode == AsyncLoadMode::Full)
+        return size_t(fileSize);
+
+      return size_t(std::min<uint64_t>(fileSize, VTFData::getDirectoryEndOffset(prefix).value_or(0)));
+    }
+
+    inline void deliverLoad(const AsyncLoadCallback& callback, size_t index, const std::filesystem::path& path, std::span<const uint8_t> bytes) {
+      std::optional<VTFData> data;
+      std::exception_ptr     error;
+      try {
+        if (!VTFData::hasValidSignature(bytes))
+          throw std::runtime_error("Invalid VTF signature.");
+        data.emplace(bytes);
+      } catch (...) {
+        error = std::current_exception();
+      }
+
+      callback(AsyncLoadResult{ index, path, data ? &*data : nullptr, bytes, error });
+    }
+
+    inline void deliverError(const AsyncLoadCallback& callback, size_t index, const std::filesystem::path& path, std::exception_ptr error) {
+      callback(AsyncLoadResult{ index, path, nullptr, {}, error });
+    }
+
+#ifdef LIBVTF_HAS_IO_URING
+
+    // Minimal raw io_uring wrapper, enough for open/read/close chains
+    // without depending on liburing.
+    class IoUring {
+    public:
+      explicit IoUring(uint32_t entries) {
+        io_uring_params params{};
+        m_fd = int(::syscall(__NR_io_uring_setup, entries, &params));
+        if (m_fd < 0)
+          throw std::runtime_error("io_uring_setup failed.");
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMap)
+          m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+
+        m_sqRing = ::mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        m_cqRing = singleMap
+          ? m_sqRing
+          : ::mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+        if (m_sqRing == MAP_FAILED || m_cqRing == MAP_FAILED || m_sqes == MAP_FAILED) {
+          destroy();
+          throw std::runtime_error("Could not map io_uring rings.");
+        }
+
+        auto* sq = static_cast<uint8_t*>(m_sqRing);
+        auto* cq = static_cast<uint8_t*>(m_cqRing);
+        m_sqHead    = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+        m_sqTail    = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+        m_sqMask    = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+        m_sqArray   = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+        m_sqEntries = params.sq_entries;
+        m_cqHead    = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+        m_cqTail    = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+        m_cqMask    = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+        m_cqes      = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        m_localTail = *m_sqTail;
+      }
+
+      ~IoUring() {
+        destroy();
+      }
+
+      IoUring(const IoUring&) = delete;
+      IoUring& operator=(const IoUring&) = delete;
+
+      bool supportsOps(std::initializer_list<uint8_t> ops) const {
+        static constexpr uint32_t MaxOps = 256;
+        std::vector<uint8_t> storage(sizeof(io_uring_probe) + MaxOps * sizeof(io_uring_probe_op));
+        auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, MaxOps) < 0)
+          return false;
+
+        for (uint8_t op : ops) {
+          if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            return false;
+        }
+        return true;
+      }
+
+      // Returns null if the submission queue is full, submit() and retry.
+      io_uring_sqe* getSqe() {
+        const uint32_t head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+        if (m_localTail - head >= m_sqEntries)
+          return nullptr;
+
+        const uint32_t index = m_localTail & m_sqMask;
+        io_uring_sqe* sqe = &m_sqes[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        m_sqArray[index] = index;
+        m_localTail++;
+        return sqe;
+      }
+
+      // Submits queued entries and waits for at least minComplete completions.
+      void submit(uint32_t minComplete) {
+        const uint32_t toSubmit = m_localTail - *m_sqTail;
+        __atomic_store_n(m_sqTail, m_localTail, __ATOMIC_RELEASE);
+
+        const uint32_t flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+        for (;;) {
+          if (::syscall(__NR_io_uring_enter, m_fd, toSubmit, minComplete, flags, nullptr, 0) >= 0)
+            return;
+          if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            throw std::runtime_error("io_uring_enter failed.");
+        }
+      }
+
+      bool peek(io_uring_cqe& cqe) {
+        const uint32_t head = *m_cqHead;
+        if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+          return false;
+
+        cqe = m_cqes[head & m_cqMask];
+        __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+        return true;
+      }
+
+    private:
+      void destroy() {
+        if (m_sqes && m_sqes != MAP_FAILED)
+          ::munmap(m_sqes, m_sqesSize);
+        if (m_cqRing && m_cqRing != MAP_FAILED && m_cqRing != m_sqRing)
+          ::munmap(m_cqRing, m_cqRingSize);
+        if (m_sqRing && m_sqRing != MAP_FAILED)
+          ::munmap(m_sqRing, m_sqRingSize);
+        if (m_fd >= 0)
+          ::close(m_fd);
+        m_sqes   = nullptr;
+        m_cqRing = nullptr;
+        m_sqRing = nullptr;
+        m_fd     = -1;
+      }
+
+      int            m_fd         = -1;
+      void*          m_sqRing     = nullptr;
+      void*          m_cqRing     = nullptr;
+      io_uring_sqe*  m_sqes       = nullptr;
+      size_t         m_sqRingSize = 0;
+      size_t         m_cqRingSize = 0;
+      size_t         m_sqesSize   = 0;
+      uint32_t*      m_sqHead     = nullptr;
+      uint32_t*      m_sqTail     = nullptr;
+      uint32_t*      m_sqArray    = nullptr;
+      uint32_t       m_sqMask     = 0;
+      uint32_t       m_sqEntries  = 0;
+      uint32_t       m_localTail  = 0;
+      uint32_t*      m_cqHead     = nullptr;
+      uint32_t*      m_cqTail     = nullptr;
+      uint32_t       m_cqMask     = 0;
+      io_uring_cqe*  m_cqes       = nullptr;
+    };
+
+    inline std::unique_ptr<IoUring> createIoUring(uint32_t entries) {
+      try {
+        auto ring = std::make_unique<IoUring>(entries);
+        if (!ring->supportsOps({ IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE }))
+          return nullptr;
+        return ring;
+      } catch (const std::exception&) {
+        return nullptr;
+      }
+    }
+
+    // Every file goes through open -> first read -> (remaining read) -> close,
+    // with up to queueDepth files in flight. The header is checked as soon as
+    // the first read lands, so non-VTF files never get read in full.
+    class IoUringLoader {
+    public:
+      IoUringLoader(IoUring& ring, const AsyncLoaderOptions& options, BufferPool& buffers, std::span<const std::filesystem::path> paths, const AsyncLoadCallback& callback)
+        : m_ring{ ring }
+        , m_options{ options }
+        , m_buffers{ buffers }
+        , m_paths{ paths }
+        , m_callback{ callback }
+        , m_slots(std::max<uint32_t>(1, options.queueDepth)) {
+      }
+
+      void run() {
+        for (uint32_t i = 0; i < m_slots.size(); i++)
+          startNext(i);
+
+        while (m_active) {
+          m_ring.submit(1);
+
+          io_uring_cqe cqe;
+          while (m_ring.peek(cqe)) {
+            if (cqe.user_data & CloseTag)
+              continue;
+            complete(uint32_t(cqe.user_data), cqe.res);
+          }
+        }
+        // Flush any close that is still queued.
+        m_ring.submit(0);
+
+        if (m_exception)
+          std::rethrow_exception(m_exception);
+      }
+
+    private:
+      static constexpr uint64_t CloseTag = uint64_t(1) << 63;
+
+      enum class SlotState {
+        Idle,
+        Opening,
+        ReadingHeader,
+        ReadingBody,
+      };
+
+      struct Slot {
+        SlotState    state = SlotState::Idle;
+        size_t       index = 0;
+        int          fd    = -1;
+        PooledBuffer buffer;
+        size_t       bytesRead = 0;
+        size_t       requiredSize = 0;
+      };
+
+      io_uring_sqe* getSqe() {
+        io_uring_sqe* sqe;
+        while (!(sqe = m_ring.getSqe()))
+          m_ring.submit(0);
+        return sqe;
+      }
+
+      void startNext(uint32_t slotIndex) {
+        if (m_exception || m_nextPath >= m_paths.size())
+          return;
+
+        Slot& slot = m_slots[slotIndex];
+        slot.state     = SlotState::Opening;
+        slot.index     = m_nextPath++;
+        slot.fd        = -1;
+        slot.bytesRead = 0;
+        slot.buffer    = m_buffers.acquire();
+        m_active++;
+
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode     = IORING_OP_OPENAT;
+        sqe->fd         = AT_FDCWD;
+        sqe->addr       = reinterpret_cast<uint64_t>(m_paths[slot.index].c_str());
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data  = slotIndex;
+      }
+
+      void submitRead(uint32_t slotIndex, size_t size) {
+        Slot& slot = m_slots[slotIndex];
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode    = IORING_OP_READ;
+        sqe->fd        = slot.fd;
+        sqe->addr      = reinterpret_cast<uint64_t>(slot.buffer.data.get() + slot.bytesRead);
+        sqe->len       = uint32_t(std::min<size_t>(size, 1u << 30));
+        sqe->off       = slot.bytesRead;
+        sqe->user_data = slotIndex;
+      }
+
+      void finish(uint32_t slotIndex, std::exception_ptr error) {
+        Slot& slot = m_slots[slotIndex];
+
+        try {
+          if (error)
+            deliverError(m_callback, slot.index, m_paths[slot.index], error);
+          else
+            deliverLoad(m_callback, slot.index, m_paths[slot.index], std::span<const uint8_t>{ slot.buffer.data.get(), slot.bytesRead });
+        } catch (...) {
+          if (!m_exception)
+            m_exception = std::current_exception();
+        }
+
+        if (slot.fd >= 0) {
+          io_uring_sqe* sqe = getSqe();
+          sqe->opcode    = IORING_OP_CLOSE;
+          sqe->fd        = slot.fd;
+          sqe->user_data = CloseTag | slotIndex;
+        }
+
+        m_buffers.release(std::move(slot.buffer));
+        slot.state = SlotState::Idle;
+        m_active--;
+
+        startNext(slotIndex);
+      }
+
+      void complete(uint32_t slotIndex, int32_t result) {
+        Slot& slot = m_slots[slotIndex];
+        const std::filesystem::path& path = m_paths[slot.index];
+
+        if (result < 0) {
+          const char* operation = slot.state == SlotState::Opening ? "Could not open file: " : "Could not read file: ";
+          finish(slotIndex, std::make_exception_ptr(std::runtime_error(operation + path.string())));
+          return;
+        }
+        if (slot.state != SlotState::Opening)
+          LIBVTF_INSTRUMENT_COUNT(Read, result);
+
+        switch (slot.state) {
+          case SlotState::Opening: {
+            slot.fd    = result;
+            slot.state = SlotState::ReadingHeader;
+            slot.buffer.reserve(m_options.initialReadSize);
+            submitRead(slotIndex, m_options.initialReadSize);
+            break;
+          }
+
+          case SlotState::ReadingHeader: {
+            slot.bytesRead += size_t(result);
+            const std::span<const uint8_t> prefix{ slot.buffer.data.get(), slot.bytesRead };
+            if (!VTFData::hasValidSignature(prefix)) {
+              finish(slotIndex, std::make_exception_ptr(std::runtime_error("Invalid VTF signature: " + path.string())));
+              return;
+            }
+
+            // A short first read means we already have the whole file.
+            uint64_t fileSize = slot.bytesRead;
+            if (slot.bytesRead == m_options.initialReadSize) {
+              struct stat info{};
+              if (::fstat(slot.fd, &info) == 0)
+                fileSize = uint64_t(info.st_size);
+            }
+
+            slot.requiredSize = getRequiredReadSize(prefix, fileSize, m_options.mode);
+            if (slot.bytesRead >= slot.requiredSize) {
+              slot.bytesRead = slot.requiredSize;
+              finish(slotIndex, nullptr);
+              return;
+            }
+
+            if (slot.buffer.capacity < slot.requiredSize) {
+              PooledBuffer grown;
+              grown.reserve(slot.requiredSize);
+              std::memcpy(grown.data.get(), slot.buffer.data.get(), slot.bytesRead);
+              slot.buffer = std::move(grown);
+            }
+
+            slot.state = SlotState::ReadingBody;
+            submitRead(slotIndex, slot.requiredSize - slot.bytesRead);
+            break;
+          }
+
+          case SlotState::ReadingBody: {
+            slot.bytesRead += size_t(result);
+            if (result == 0 || slot.bytesRead >= slot.requiredSize)
+              finish(slotIndex, nullptr);
+            else
+              submitRead(slotIndex, slot.requiredSize - slot.bytesRead);
+            break;
+          }
+
+          case SlotState::Idle:
+            break;
+        }
+      }
+
+      IoUring&                                m_ring;
+      const AsyncLoaderOptions&               m_options;
+      BufferPool&                             m_buffers;
+      std::span<const std::filesystem::path>  m_paths;
+      const AsyncLoadCallback&                m_callback;
+      std::vector<Slot>                       m_slots;
+      size_t                                  m_nextPath = 0;
+      uint32_t                                m_active   = 0;
+      std::exception_ptr                      m_exception;
+    };
+
+#endif
+
+  }
+
+  // Loads many VTF files with lots of reads in flight, handing each parsed
+  // VTFData to a callback as soon as its file has been read. Read buffers
+  // are recycled between files, so memory stays bounded by queueDepth.
+  class AsyncVTFLoader {
+  public:
+    explicit AsyncVTFLoader(const AsyncLoaderOptions& options = {})
+      : m_options{ options }
+      , m_buffers{ options.maxRetainedSize } {
+      m_options.initialReadSize = std::max(m_options.initialReadSize, sizeof(meta::VTFHeader));
+#ifdef LIBVTF_HAS_IO_URING
+      if (m_options.backend != AsyncBackend::ThreadPool)
+        m_ring = detail::createIoUring(std::max<uint32_t>(1, m_options.queueDepth) * 2);
+#endif
+      if (m_options.backend == AsyncBackend::IoUring && !usingIoUring())
+        throw std::runtime_error("io_uring is not available.");
+    }
+
+    bool usingIoUring() const {
+#ifdef LIBVTF_HAS_IO_URING
+      return m_ring != nullptr;
+#else
+      return false;
+#endif
+    }
+
+    // Blocks until every file has been delivered to the callback. Per-file
+    // failures are reported through AsyncLoadResult::error, an exception
+    // thrown by the callback stops the batch and is rethrown here.
+    void loadAll(std::span<const std::filesystem::path> paths, const AsyncLoadCallback& callback) {
+#ifdef LIBVTF_HAS_IO_URING
+      if (m_ring) {
+        detail::IoUringLoader{ *m_ring, m_options, m_buffers, paths, callback }.run();
+        return;
+      }
+#endif
+      loadAllThreadPool(paths, callback);
+    }
+
+  private:
+    void loadAllThreadPool(std::span<const std::filesystem::path> paths, const AsyncLoadCallback& callback) {
+      parallelFor(paths.size(), [&](size_t index) {
+        const std::filesystem::path& path = paths[index];
+
+        detail::PooledBuffer buffer = m_buffers.acquire();
+        std::span<const uint8_t> bytes;
+        try {
+          FileHandle file{ path };
+
+          const size_t initialSize = size_t(std::min<uint64_t>(file.size(), m_options.initialReadSize));
+          buffer.reserve(initialSize);
+          file.readAt(0, std::span<uint8_t>{ buffer.data.get(), initialSize });
+
+          const std::span<const uint8_t> prefix{ buffer.data.get(), initialSize };
+          if (!VTFData::hasValidSignature(prefix))
+            throw std::runtime_error("Invalid VTF signature: " + path.string());
+
+          const size_t requiredSize = detail::getRequiredReadSize(prefix, file.size(), m_options.mode);
+          if (requiredSize > initialSize) {
+            detail::PooledBuffer grown;
+            grown.reserve(requiredSize);
+            std::memcpy(grown.data.get(), buffer.data.get(), initialSize);
+            buffer = std::move(grown);
+            file.readAt(initialSize, std::span<uint8_t>{ buffer.data.get() + initialSize, requiredSize - initialSize });
+          }
+          bytes = std::span<const uint8_t>{ buffer.data.get(), requiredSize };
+        } catch (...) {
+          m_buffers.release(std::move(buffer));
+          detail::deliverError(callback, index, path, std::current_exception());
+          return;
+        }
+
+        detail::deliverLoad(callback, index, path, bytes);
+        m_buffers.release(std::move(buffer));
+      }, ParallelOptions{ m_options.executor, std::max<uint32_t>(1, m_options.queueDepth) });
+    }
+
+    AsyncLoaderOptions              m_options;
+    detail::BufferPool              m_buffers;
+#ifdef LIBVTF_HAS_IO_URING
+    std::unique_ptr<detail::IoUring> m_ring;
+#endif
+  };
+
+}
@@ -0,0 +1,338 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "convert.hpp"
+#include "decode.hpp"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace libvtf {
+
+  // One 2D slice of a subresource, decoded into a tightly packed image.
+  struct DecodedImage {
+    uint32_t             width  = 0;
+    uint32_t             height = 0;
+    ImageFormat          format = ImageFormats::UNKNOWN;
+    std::vector<uint8_t> pixels;
+  };
+
+  // Decodes one 2D slice of a subresource into `format`, which must be a
+  // convertible format (see isConvertible). Block compressed images are
+  // decoded to RGBA8888 (RGBA16161616F for BC6H) and converted from there.
+  inline DecodedImage decodeSubresource(const VTFData& vtf, const SubresourceLayout& subresource, ImageFormat format = ImageFormats::RGBA8888) {
+    if (!isConvertible(format))
+      throw std::runtime_error("Image format is not a convertible uncompressed format.");
+
+    const std::span<const uint8_t> src = vtf.imageData(subresource);
+    if (src.empty())
+      throw std::runtime_error("Subresource image data is not available.");
+
+    auto [width, height] = getSubresourceSize(vtf, subresource);
+    DecodedImage image{
+      .width  = width,
+      .height = height,
+      .format = format,
+      .pixels = std::vector<uint8_t>(size_t(getMemoryRequiredForMip(width, height, 1u, format))),
+    };
+
+    const ImageFormat srcFormat = vtf.getHeader().format;
+    if (!isDecodable(srcFormat)) {
+      convertImage(srcFormat, src, format, image.pixels, width, height);
+      return image;
+    }
+
+    const ImageFormat decodedFormat = getDecodedFormat(srcFormat) == DecodedFormat::RGBA16F
+      ? ImageFormats::RGBA16161616F
+      : ImageFormats::RGBA8888;
+    if (decodedFormat == format) {
+      decodeImage(srcFormat, src, width, height, image.pixels);
+      return image;
+    }
+
+    std::vector<uint8_t> decoded(size_t(width) * height * getDecodedPixelSize(srcFormat));
+    decodeImage(srcFormat, src, width, height, decoded);
+    convertImage(decodedFormat, decoded, format, image.pixels, width, height);
+    return image;
+  }
+
+  struct DecodedTextureKey {
+    uint64_t    fileId; // Picked by the caller, eg. a hash of the path and modification time
+    uint16_t    frame;
+    uint16_t    face;
+    uint16_t    slice;
+    uint8_t     mipLevel;
+    ImageFormat format;
+
+    bool operator==(const DecodedTextureKey&) const = default;
+  };
+
+  struct DecodedTextureCacheOptions {
+    // Bytes of decoded pixels the cache holds on to. Images still referenced
+    // by callers after being evicted don't count.
+    size_t   budget     = size_t(256) << 20;
+    uint32_t shardCount = 16;
+    // Share of the budget for entries that were hit at least once since
+    // being inserted. The rest holds new entries, so a scan over many
+    // textures only pushes out other entries that were never reused.
+    float    protectedShare = 0.8f;
+  };
+
+  struct DecodedTextureCacheStats {
+    uint64_t hits      = 0;
+    uint64_t misses    = 0;
+    uint64_t evictions = 0;
+    uint64_t entries   = 0;
+    uint64_t bytes     = 0;
+  };
+
+  namespace detail {
+
+    inline uint64_t hashDecodedTextureKey(const DecodedTextureKey& key) {
+      uint64_t hash = key.fileId * 0x9E3779B97F4A7C15ull;
+      hash ^= (uint64_t(key.frame) << 40) | (uint64_t(key.face) << 24) | (uint64_t(key.slice) << 8) | key.mipLevel;
+      hash *= 0xBF58476D1CE4E5B9ull;
+      hash ^= uint32_t(key.format);
+      hash *= 0x94D049BB133111EBull;
+      return hash ^ (hash >> 31);
+    }
+
+    struct DecodedTextureKeyHash {
+      size_t operator()(const DecodedTextureKey& key) const {
+        return size_t(hashDecodedTextureKey(key));
+      }
+    };
+
+  }
+
+  // Thread-safe cache of decoded subresources with a byte budget.
+  //
+  // Entries are spread over independently locked shards, each running a
+  // segmented LRU: new entries go into a probationary segment and move to
+  // the protected segment when they are hit again. Eviction takes from the
+  // probationary segment first, so one-off reads can't flush the hot set.
+  //
+  // The budget is shared by every shard, so a single image can use all of
+  // it. Inserting evicts from the inserting shard first, then from the
+  // others.
+  //
+  // Lookups hand out shared ownership of the image, eviction only drops the
+  // cache's reference and never frees pixels that are still in use.
+  class DecodedTextureCache {
+  public:
+    using Handle = std::shared_ptr<const DecodedImage>;
+
+    explicit DecodedTextureCache(const DecodedTextureCacheOptions& options = {})
+      : m_shardCount{ std::max(options.shardCount, 1u) }
+      , m_shards{ new Shard[m_shardCount] }
+      , m_budget{ options.budget }
+      , m_protectedBudget{ size_t(double(m_budget) * std::clamp(options.protectedShare, 0.0f, 1.0f)) } {
+    }
+
+    // Null on a miss.
+    Handle find(const DecodedTextureKey& key) {
+      Shard& shard = getShard(key);
+      std::lock_guard lock{ shard.mutex };
+
+      auto it = shard.map.find(key);
+      if (it == shard.map.end()) {
+        shard.misses++;
+        return nullptr;
+      }
+
+      shard.hits++;
+      touch(shard, it->second);
+      return it->second->image;
+    }
+
+    // Adds an image, or returns the one already cached under the key if
+    // another thread got there first. Images larger than the whole budget
+    // are returned without being cached.
+    Handle insert(const DecodedTextureKey& key, DecodedImage image) {
+      Handle handle = std::make_shared<const DecodedImage>(std::move(image));
+      const size_t size = handle->pixels.size();
+
+      if (size > m_budget)
+        return handle;
+
+      Shard& shard = getShard(key);
+      {
+        std::lock_guard lock{ shard.mutex };
+        auto it = shard.map.find(key);
+        if (it != shard.map.end())
+          return it->second->image;
+
+        shard.probation.push_front(Entry{ key, handle, size, false });
+        shard.probationBytes += size;
+        shard.map.emplace(key, shard.probation.begin());
+        m_bytes += size;
+        evict(shard, 1);
+      }
+
+      // Only one shard is locked at a time, so inserts into different
+      // shards can't deadlock evicting from each other.
+      for (uint32_t i = 1; i < m_shardCount && m_bytes > m_budget; i++) {
+        Shard& other = m_shards[(size_t(&shard - m_shards.get()) + i) % m_shardCount];
+        std::lock_guard lock{ other.mutex };
+        evict(other, 0);
+      }
+      return handle;
+    }
+
+    // Returns the cached image for the subresource, decoding and inserting
+    // it on a miss. Decoding happens outside of any lock, concurrent misses
+    // on the same key may decode twice but share the first image inserted.
+    Handle get(uint64_t fileId, const VTFData& vtf, const SubresourceLayout& subresource, ImageFormat format = ImageFormats::RGBA8888) {
+      const DecodedTextureKey key{
+        .fileId   = fileId,
+        .frame    = subresource.frame,
+        .face     = subresource.face,
+        .slice    = subresource.slice,
+        .mipLevel = subresource.mipLevel,
+        .format   = format,
+      };
+
+      if (Handle handle = find(key))
+        return handle;
+      return insert(key, decodeSubresource(vtf, subresource, format));
+    }
+
+    // Drops every entry of a file, eg. after it changed on disk.
+    void erase(uint64_t fileId) {
+      for (uint32_t i = 0; i < m_shardCount; i++) {
+        Shard& shard = m_shards[i];
+        std::lock_guard lock{ shard.mutex };
+        for (auto it = shard.map.begin(); it != shard.map.end();) {
+          if (it->first.fileId == fileId) {
+            remove(shard, it->second);
+            it = shard.map.erase(it);
+          } else {
+            ++it;
+          }
+        }
+      }
+    }
+
+    void clear() {
+      for (uint32_t i = 0; i < m_shardCount; i++) {
+        Shard& shard = m_shards[i];
+        std::lock_guard lock{ shard.mutex };
+        m_bytes          -= shard.probationBytes + shard.protectedBytes;
+        m_protectedBytes -= shard.protectedBytes;
+        shard.map.clear();
+        shard.probation.clear();
+        shard.protectedEntries.clear();
+        shard.probationBytes = 0;
+        shard.protectedBytes = 0;
+      }
+    }
+
+    DecodedTextureCacheStats stats() const {
+      DecodedTextureCacheStats stats;
+      for (uint32_t i = 0; i < m_shardCount; i++) {
+        const Shard& shard = m_shards[i];
+        std::lock_guard lock{ shard.mutex };
+        stats.hits      += shard.hits;
+        stats.misses    += shard.misses;
+        stats.evictions += shard.evictions;
+        stats.entries   += shard.map.size();
+        stats.bytes     += shard.probationBytes + shard.protectedBytes;
+      }
+      return stats;
+    }
+
+    size_t budget() const {
+      return m_budget;
+    }
+
+  private:
+    struct Entry {
+      DecodedTextureKey key;
+      Handle            image;
+      size_t            size;
+      bool              isProtected;
+    };
+    using EntryList = std::list<Entry>;
+
+    // Lists are most recently used first.
+    struct Shard {
+      mutable std::mutex mutex;
+      std::unordered_map<DecodedTextureKey, EntryList::iterator, detail::DecodedTextureKeyHash> map;
+      EntryList probation;
+      EntryList protectedEntries;
+      size_t    probationBytes = 0;
+      size_t    protectedBytes = 0;
+      uint64_t  hits      = 0;
+      uint64_t  misses    = 0;
+      uint64_t  evictions = 0;
+    };
+
+    Shard& getShard(const DecodedTextureKey& key) {
+      return m_shards[(detail::hashDecodedTextureKey(key) >> 32) % m_shardCount];
+    }
+
+    void touch(Shard& shard, EntryList::iterator entry) {
+      if (entry->isProtected) {
+        shard.protectedEntries.splice(shard.protectedEntries.begin(), shard.protectedEntries, entry);
+        return;
+      }
+
+      entry->isProtected = true;
+      shard.probationBytes -= entry->size;
+      shard.protectedBytes += entry->size;
+      m_protectedBytes     += entry->size;
+      shard.protectedEntries.splice(shard.protectedEntries.begin(), shard.probation, entry);
+
+      // Overflow of the protected segment gets a second chance in probation.
+      // Only this shard is demoted from, the segment evens out as others are
+      // hit.
+      while (m_protectedBytes > m_protectedBudget && shard.protectedEntries.size() > 1) {
+        const EntryList::iterator last = std::prev(shard.protectedEntries.end());
+        last->isProtected = false;
+        shard.protectedBytes -= last->size;
+        shard.probationBytes += last->size;
+        m_protectedBytes     -= last->size;
+        shard.probation.splice(shard.probation.begin(), shard.protectedEntries, last);
+      }
+    }
+
+    // Evicts from a shard until the cache is within budget or the shard has
+    // only `keep` entries left. The entry just inserted at the front of
+    // probation goes last.
+    void evict(Shard& shard, size_t keep) {
+      while (m_bytes > m_budget && shard.map.size() > keep) {
+        EntryList& list = shard.probation.size() > 1 || shard.protectedEntries.empty()
+          ? shard.probation
+          : shard.protectedEntries;
+        const EntryList::iterator last = std::prev(list.end());
+        shard.map.erase(last->key);
+        remove(shard, last);
+        shard.evictions++;
+      }
+    }
+
+    void remove(Shard& shard, EntryList::iterator entry) {
+      m_bytes -= entry->size;
+      if (entry->isProtected) {
+        shard.protectedBytes -= entry->size;
+        m_protectedBytes     -= entry->size;
+        shard.protectedEntries.erase(entry);
+      } else {
+        shard.probationBytes -= entry->size;
+        shard.probation.erase(entry);
+      }
+    }
+
+    uint32_t                 m_shardCount;
+    std::unique_ptr<Shard[]> m_shards;
+    size_t                   m_budget;
+    size_t                   m_protectedBudget;
+    std::atomic<size_t>      m_bytes          = 0; // Of every shard
+    std::atomic<size_t>      m_protectedBytes = 0;
+  };
+
+}
@@ -0,0 +1,686 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "cpu.hpp"
+#include "mapped.hpp"
+#include "threading.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace libvtf {
+
+  // Columns of a catalog, one value per texture.
+  enum class CatalogColumn : uint32_t {
+    FileSize,       // uint64_t
+    ModifiedTime,   // uint64_t, ticks of std::filesystem::file_time_type
+    PathOffset,     // uint64_t, into the string section
+    PathLength,     // uint32_t
+    Version,        // uint32_t, major << 16 | minor
+    Width,          // uint16_t
+    Height,         // uint16_t
+    Depth,          // uint16_t
+    NumFrames,      // uint16_t
+    Flags,          // uint32_t
+    Format,         // uint8_t, ImageFormat
+    NumMipLevels,   // uint8_t
+    LowResFormat,   // uint8_t, ImageFormat
+    LowResWidth,    // uint8_t
+    LowResHeight,   // uint8_t
+    Reflectivity,   // float[3]
+    BumpScale,      // float
+    HasCRC32,       // uint8_t
+    CRC32,          // uint32_t
+    ResourceCount,  // uint8_t
+    ResourceStart,  // uint32_t, into the resource section
+    Count,
+  };
+
+  static constexpr uint32_t CatalogColumnCount = uint32_t(CatalogColumn::Count);
+
+  constexpr uint32_t getCatalogColumnSize(CatalogColumn column) {
+    switch (column) {
+      case CatalogColumn::FileSize:
+      case CatalogColumn::ModifiedTime:
+      case CatalogColumn::PathOffset:
+        return 8;
+      case CatalogColumn::PathLength:
+      case CatalogColumn::Version:
+      case CatalogColumn::Flags:
+      case CatalogColumn::BumpScale:
+      case CatalogColumn::CRC32:
+      case CatalogColumn::ResourceStart:
+        return 4;
+      case CatalogColumn::Width:
+      case CatalogColumn::Height:
+      case CatalogColumn::Depth:
+      case CatalogColumn::NumFrames:
+        return 2;
+      case CatalogColumn::Reflectivity:
+        return 12;
+      default:
+        return 1;
+    }
+  }
+
+  // Float columns can be read but not filtered on.
+  constexpr bool isCatalogColumnFilterable(CatalogColumn column) {
+    return column != CatalogColumn::Reflectivity && column != CatalogColumn::BumpScale && column < CatalogColumn::Count;
+  }
+
+  namespace meta {
+
+#ifdef _MSC_VER
+#pragma pack(push, 1)
+#endif
+
+    // A catalog file is this header, then each column as a tightly packed
+    // array, then the resource types of every texture as uint32_t, then
+    // the paths. Sections are 64 byte aligned so a mapped catalog can be
+    // read in place.
+    PACKED_STRUCT(CatalogHeader) {
+      static constexpr std::array<char, 4> ValidSignature = { 'V', 'T', 'F', 'C' };
+      static constexpr uint32_t CurrentVersion = 1;
+
+      std::array<char, 4> signature{};
+      uint32_t version{};
+      uint32_t columnCount{};
+      uint32_t reserved{};
+      uint64_t entryCount{};
+      uint64_t resourceCount{};
+      uint64_t stringsSize{};
+      uint64_t resourcesOffset{};
+      uint64_t stringsOffset{};
+      std::array<uint64_t, CatalogColumnCount> columnOffsets{};
+    };
+
+#ifdef _MSC_VER
+#pragma pack(pop)
+#endif
+
+  }
+
+  // One texture of a catalog. `header` only has the fields the catalog
+  // stores, the rest are left at their defaults.
+  struct CatalogEntry {
+    std::string             path;
+    uint64_t                fileSize     = 0;
+    uint64_t                modifiedTime = 0;
+    meta::VTFHeader         header;
+    std::optional<uint32_t> crc32;
+    std::vector<uint32_t>   resources;
+  };
+
+  // Reads the header fields, resource types and CRC of a VTF file. Only
+  // the header and resource directory are read.
+  inline CatalogEntry scanCatalogEntry(const std::filesystem::path& path) {
+    const MappedFile file{ path };
+    const VTFData    data{ file.data() };
+
+    CatalogEntry entry;
+    entry.path         = path.generic_string();
+    entry.fileSize     = file.data().size();
+    entry.modifiedTime = uint64_t(std::filesystem::last_write_time(path).time_since_epoch().count());
+    entry.header       = data.getHeader();
+    entry.crc32        = data.crc32();
+    for (const VTFResource resource : data.resources())
+      entry.resources.push_back(resource.type);
+    return entry;
+  }
+
+  // Read-only view of a catalog file, mapped or in memory. Everything is
+  // read in place.
+  class Catalog {
+  public:
+    explicit Catalog(const std::filesystem::path& path)
+      : m_file{ path } {
+      init(m_file.data());
+    }
+
+    // `data` must be 8 byte aligned and outlive the catalog.
+    explicit Catalog(std::span<const uint8_t> data) {
+      init(data);
+    }
+
+    size_t size() const { return size_t(m_header.entryCount); }
+
+    template <typename T>
+    std::span<const T> column(CatalogColumn column) const {
+      if (column >= CatalogColumn::Count || sizeof(T) != getCatalogColumnSize(column))
+        throw std::runtime_error("Catalog column type mismatch.");
+      return { reinterpret_cast<const T*>(m_data.data() + m_header.columnOffsets[uint32_t(column)]), size() };
+    }
+
+    // Raw bytes of a column, size() * getCatalogColumnSize(column).
+    std::span<const uint8_t> columnData(CatalogColumn column) const {
+      return m_data.subspan(size_t(m_header.columnOffsets[uint32_t(column)]), size() * getCatalogColumnSize(column));
+    }
+
+    std::string_view path(size_t row) const {
+      const uint64_t offset = column<uint64_t>(CatalogColumn::PathOffset)[row];
+      const uint32_t length = column<uint32_t>(CatalogColumn::PathLength)[row];
+      return { reinterpret_cast<const char*>(m_data.data() + m_header.stringsOffset + offset), length };
+    }
+
+    std::span<const uint32_t> resources(size_t row) const {
+      const uint32_t start = column<uint32_t>(CatalogColumn::ResourceStart)[row];
+      const uint8_t  count = column<uint8_t>(CatalogColumn::ResourceCount)[row];
+      return { reinterpret_cast<const uint32_t*>(m_data.data() + m_header.resourcesOffset) + start, count };
+    }
+
+    CatalogEntry entry(size_t row) const {
+      CatalogEntry entry;
+      entry.path         = std::string{ path(row) };
+      entry.fileSize     = column<uint64_t>(CatalogColumn::FileSize)[row];
+      entry.modifiedTime = column<uint64_t>(CatalogColumn::ModifiedTime)[row];
+
+      meta::VTFHeader& header = entry.header;
+      const uint32_t version = column<uint32_t>(CatalogColumn::Version)[row];
+      header.version           = { int32_t(version >> 16), int32_t(version & 0xFFFF) };
+      header.width             = column<uint16_t>(CatalogColumn::Width)[row];
+      header.height            = column<uint16_t>(CatalogColumn::Height)[row];
+      header.depth             = column<uint16_t>(CatalogColumn::Depth)[row];
+      header.numFrames         = column<uint16_t>(CatalogColumn::NumFrames)[row];
+      header.flags             = column<uint32_t>(CatalogColumn::Flags)[row];
+      header.format            = ImageFormat(int8_t(column<uint8_t>(CatalogColumn::Format)[row]));
+      header.numMipLevels      = column<uint8_t>(CatalogColumn::NumMipLevels)[row];
+      header.lowResImageFormat = ImageFormat(int8_t(column<uint8_t>(CatalogColumn::LowResFormat)[row]));
+      header.lowResImageWidth  = column<uint8_t>(CatalogColumn::LowResWidth)[row];
+      header.lowResImageHeight = column<uint8_t>(CatalogColumn::LowResHeight)[row];
+      header.reflectivity      = column<std::array<float, 3>>(CatalogColumn::Reflectivity)[row];
+      header.bumpScale         = column<float>(CatalogColumn::BumpScale)[row];
+
+      if (column<uint8_t>(CatalogColumn::HasCRC32)[row])
+        entry.crc32 = column<uint32_t>(CatalogColumn::CRC32)[row];
+      const std::span<const uint32_t> types = resources(row);
+      entry.resources.assign(types.begin(), types.end());
+      header.numResources = uint32_t(types.size());
+      return entry;
+    }
+
+  private:
+    void init(std::span<const uint8_t> data) {
+      if (reinterpret_cast<uintptr_t>(data.data()) % 8)
+        throw std::runtime_error("Catalog buffer is not 8 byte aligned.");
+      if (data.size() < sizeof(meta::CatalogHeader))
+        throw std::runtime_error("Catalog is truncated.");
+
+      std::memcpy(static_cast<void*>(&m_header), data.data(), sizeof(m_header));
+      if (m_header.signature != meta::CatalogHeader::ValidSignature)
+        throw std::runtime_error("Invalid catalog signature.");
+      if (m_header.version != meta::CatalogHeader::CurrentVersion || m_header.columnCount != CatalogColumnCount)
+        throw std::runtime_error("Unhandled catalog version.");
+
+      auto checkSection = [&](uint64_t offset, uint64_t count, uint64_t elementSize) {
+        if (offset % 8 || offset > data.size() || (elementSize && count > (data.size() - offset) / elementSize))
+          throw std::runtime_error("Catalog section is out of bounds.");
+      };
+      for (uint32_t i = 0; i < CatalogColumnCount; i++)
+        checkSection(m_header.columnOffsets[i], m_header.entryCount, getCatalogColumnSize(CatalogColumn(i)));
+      checkSection(m_header.resourcesOffset, m_header.resourceCount, sizeof(uint32_t));
+      checkSection(m_header.stringsOffset, m_header.stringsSize, 1);
+      m_data = data;
+
+      // Rows only point inside their sections.
+      const std::span<const uint64_t> pathOffsets   = column<uint64_t>(CatalogColumn::PathOffset);
+      const std::span<const uint32_t> pathLengths   = column<uint32_t>(CatalogColumn::PathLength);
+      const std::span<const uint32_t> resourceStart = column<uint32_t>(CatalogColumn::ResourceStart);
+      const std::span<const uint8_t>  resourceCount = column<uint8_t>(CatalogColumn::ResourceCount);
+      for (size_t row = 0; row < size(); row++) {
+        if (pathOffsets[row] > m_header.stringsSize || pathLengths[row] > m_header.stringsSize - pathOffsets[row] ||
+            resourceStart[row] > m_header.resourceCount || resourceCount[row] > m_header.resourceCount - resourceStart[row]) {
+          m_data = {};
+          throw std::runtime_error("Catalog entry is out of bounds.");
+        }
+      }
+    }
+
+    MappedFile               m_file;
+    std::span<const uint8_t> m_data;
+    meta::CatalogHeader      m_header{};
+  };
+
+  // Builds a catalog file one row at a time.
+  class CatalogWriter {
+  public:
+    void add(const CatalogEntry& entry) {
+      if (entry.resources.size() > UINT8_MAX)
+        throw std::runtime_error("Too many resources for a catalog entry.");
+
+      const meta::VTFHeader& header = entry.header;
+      append<uint64_t>(CatalogColumn::FileSize, entry.fileSize);
+      append<uint64_t>(CatalogColumn::ModifiedTime, entry.modifiedTime);
+      append<uint32_t>(CatalogColumn::Version, (uint32_t(header.version[0]) << 16) | (uint32_t(header.version[1]) & 0xFFFF));
+      append<uint16_t>(CatalogColumn::Width, header.width);
+      append<uint16_t>(CatalogColumn::Height, header.height);
+      append<uint16_t>(CatalogColumn::Depth, header.depth);
+      append<uint16_t>(CatalogColumn::NumFrames, header.numFrames);
+      append<uint32_t>(CatalogColumn::Flags, header.flags);
+      append<uint8_t>(CatalogColumn::Format, uint8_t(header.format));
+      append<uint8_t>(CatalogColumn::NumMipLevels, header.numMipLevels);
+      append<uint8_t>(CatalogColumn::LowResFormat, uint8_t(header.lowResImageFormat));
+      append<uint8_t>(CatalogColumn::LowResWidth, header.lowResImageWidth);
+      append<uint8_t>(CatalogColumn::LowResHeight, header.lowResImageHeight);
+      append<std::array<float, 3>>(CatalogColumn::Reflectivity, header.reflectivity);
+      append<float>(CatalogColumn::BumpScale, header.bumpScale);
+      append<uint8_t>(CatalogColumn::HasCRC32, entry.crc32.has_value());
+      append<uint32_t>(CatalogColumn::CRC32, entry.crc32.value_or(0));
+      addPathAndResources(entry.path, entry.resources);
+    }
+
+    // Copies a row of another catalog as is.
+    void add(const Catalog& catalog, size_t row) {
+      for (uint32_t i = 0; i < CatalogColumnCount; i++) {
+        const CatalogColumn column = CatalogColumn(i);
+        if (column == CatalogColumn::PathOffset || column == CatalogColumn::PathLength ||
+            column == CatalogColumn::ResourceStart || column == CatalogColumn::ResourceCount)
+          continue;
+
+        const uint32_t size = getCatalogColumnSize(column);
+        const uint8_t* value = catalog.columnData(column).data() + row * size;
+        m_columns[i].insert(m_columns[i].end(), value, value + size);
+      }
+      addPathAndResources(catalog.path(row), catalog.resources(row));
+    }
+
+    size_t size() const { return m_count; }
+
+    std::vector<uint8_t> write() const {
+      meta::CatalogHeader header{};
+      header.signature     = meta::CatalogHeader::ValidSignature;
+      header.version       = meta::CatalogHeader::CurrentVersion;
+      header.columnCount   = CatalogColumnCount;
+      header.entryCount    = m_count;
+      header.resourceCount = m_resources.size();
+      header.stringsSize   = m_strings.size();
+
+      uint64_t offset = alignSection(sizeof(header));
+      for (uint32_t i = 0; i < CatalogColumnCount; i++) {
+        header.columnOffsets[i] = offset;
+        offset = alignSection(offset + m_columns[i].size());
+      }
+      header.resourcesOffset = offset;
+      offset = alignSection(offset + m_resources.size() * sizeof(uint32_t));
+      header.stringsOffset = offset;
+      offset += m_strings.size();
+
+      std::vector<uint8_t> file(size_t(offset), 0);
+      std::memcpy(file.data(), &header, sizeof(header));
+      for (uint32_t i = 0; i < CatalogColumnCount; i++) {
+        if (!m_columns[i].empty())
+          std::memcpy(file.data() + header.columnOffsets[i], m_columns[i].data(), m_columns[i].size());
+      }
+      if (!m_resources.empty())
+        std::memcpy(file.data() + header.resourcesOffset, m_resources.data(), m_resources.size() * sizeof(uint32_t));
+      if (!m_strings.empty())
+        std::memcpy(file.data() + header.stringsOffset, m_strings.data(), m_strings.size());
+      return file;
+    }
+
+    // Writes to a temporary file next to `path` and renames it over, so a
+    // catalog that is still mapped (eg. the previous one during an
+    // incremental rebuild) is never modified in place.
+    void write(const std::filesystem::path& path) const {
+      const std::vector<uint8_t> file = write();
+
+      std::filesystem::path temporary = path;
+      temporary += ".tmp";
+      {
+        std::ofstream stream{ temporary, std::ios::binary | std::ios::trunc };
+        stream.write(reinterpret_cast<const char*>(file.data()), std::streamsize(file.size()));
+        if (!stream)
+          throw std::runtime_error("Could not write catalog: " + temporary.string());
+      }
+      std::filesystem::rename(temporary, path);
+    }
+
+  private:
+    static constexpr uint64_t alignSection(uint64_t offset) {
+      return (offset + 63) & ~uint64_t(63);
+    }
+
+    template <typename T>
+    void append(CatalogColumn column, const T& value) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      std::vector<uint8_t>& data = m_columns[uint32_t(column)];
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+      data.insert(data.end(), bytes, bytes + sizeof(T));
+    }
+
+    void addPathAndResources(std::string_view path, std::span<const uint32_t> resources) {
+      append<uint64_t>(CatalogColumn::PathOffset, m_strings.size());
+      append<uint32_t>(CatalogColumn::PathLength, uint32_t(path.size()));
+      append<uint32_t>(CatalogColumn::ResourceStart, uint32_t(m_resources.size()));
+      append<uint8_t>(CatalogColumn::ResourceCount, uint8_t(resources.size()));
+      m_strings.insert(m_strings.end(), path.begin(), path.end());
+      m_resources.insert(m_resources.end(), resources.begin(), resources.end());
+      m_count++;
+    }
+
+    std::array<std::vector<uint8_t>, CatalogColumnCount> m_columns;
+    std::vector<uint32_t> m_resources;
+    std::vector<char>     m_strings;
+    size_t                m_count = 0;
+  };
+
+  struct CatalogBuildOptions {
+    // Rows of files whose path, size and modification time are unchanged
+    // are copied from here instead of being scanned again.
+    const Catalog*  previous = nullptr;
+    ParallelOptions parallel;
+  };
+
+  struct CatalogBuildStats {
+    uint64_t reused  = 0;
+    uint64_t scanned = 0;
+    uint64_t failed  = 0; // Missing or not valid VTFs, left out of the catalog
+  };
+
+  // Scans `files` in parallel and writes a catalog of them to `output`.
+  // Rows keep the order of `files`.
+  inline CatalogBuildStats buildCatalog(std::span<const std::filesystem::path> files, const std::filesystem::path& output, const CatalogBuildOptions& options = {}) {
+    std::unordered_map<std::string_view, size_t> previousRows;
+    if (options.previous) {
+      previousRows.reserve(options.previous->size());
+      for (size_t row = 0; row < options.previous->size(); row++)
+        previousRows.emplace(options.previous->path(row), row);
+    }
+
+    struct Result {
+      std::optional<CatalogEntry> entry;
+      std::optional<size_t>       previousRow;
+    };
+    std::vector<Result> results(files.size());
+
+    parallelFor(files.size(), [&](size_t index) {
+      const std::filesystem::path& path = files[index];
+      Result& result = results[index];
+      try {
+        if (options.previous) {
+          const std::string key = path.generic_string();
+          const auto it = previousRows.find(key);
+          if (it != previousRows.end()) {
+            const uint64_t fileSize     = std::filesystem::file_size(path);
+            const uint64_t modifiedTime = uint64_t(std::filesystem::last_write_time(path).time_since_epoch().count());
+            if (options.previous->column<uint64_t>(CatalogColumn::FileSize)[it->second] == fileSize &&
+                options.previous->column<uint64_t>(CatalogColumn::ModifiedTime)[it->second] == modifiedTime) {
+              result.previousRow = it->second;
+              return;
+            }
+          }
+        }
+        result.entry = scanCatalogEntry(path);
+      } catch (const std::exception&) {
+        // Left out, see CatalogBuildStats::failed.
+      }
+    }, options.parallel);
+
+    CatalogBuildStats stats;
+    CatalogWriter writer;
+    for (const Result& result : results) {
+      if (result.previousRow) {
+        writer.add(*options.previous, *result.previousRow);
+        stats.reused++;
+      } else if (result.entry) {
+        writer.add(*result.entry);
+        stats.scanned++;
+      } else {
+        stats.failed++;
+      }
+    }
+    writer.write(output);
+    return stats;
+  }
+
+  enum class CatalogCompare : uint8_t {
+    Equal,
+    NotEqual,
+    AtLeast,
+    AtMost,
+    AllBits, // (value & operand) == operand
+    NoBits,  // (value & operand) == 0
+  };
+
+  namespace detail {
+
+    template <typename T>
+    constexpr bool compareCatalogValue(T value, CatalogCompare compare, T operand) {
+      switch (compare) {
+        case CatalogCompare::Equal:    return value == operand;
+        case CatalogCompare::NotEqual: return value != operand;
+        case CatalogCompare::AtLeast:  return value >= operand;
+        case CatalogCompare::AtMost:   return value <= operand;
+        case CatalogCompare::AllBits:  return (value & operand) == operand;
+        case CatalogCompare::NoBits:   return (value & operand) == 0;
+      }
+      return false;
+    }
+
+    // Bit i of the result is set if row i of a run of `count` (at most 64)
+    // rows matches.
+    template <typename T>
+    inline uint64_t compareCatalogRowsScalar(const T* values, size_t count, CatalogCompare compare, T operand) {
+      uint64_t mask = 0;
+      for (size_t i = 0; i < count; i++)
+        mask |= uint64_t(compareCatalogValue(values[i], compare, operand)) << i;
+      return mask;
+    }
+
+#if defined(LIBVTF_X86)
+
+    // SSE2 compares of each lane width. Unsigned order compares flip the
+    // sign bits and use the signed compare.
+    template <typename T> struct CatalogLanesSSE2;
+
+    template <> struct CatalogLanesSSE2<uint8_t> {
+      static __m128i set1(uint8_t value) { return _mm_set1_epi8(char(value)); }
+      static __m128i equal(__m128i a, __m128i b) { return _mm_cmpeq_epi8(a, b); }
+      static __m128i greater(__m128i a, __m128i b) { return _mm_cmpgt_epi8(a, b); }
+      static constexpr uint8_t SignBit = 0x80;
+    };
+
+    template <> struct CatalogLanesSSE2<uint16_t> {
+      static __m128i set1(uint16_t value) { return _mm_set1_epi16(short(value)); }
+      static __m128i equal(__m128i a, __m128i b) { return _mm_cmpeq_epi16(a, b); }
+      static __m128i greater(__m128i a, __m128i b) { return _mm_cmpgt_epi16(a, b); }
+      static constexpr uint16_t SignBit = 0x8000;
+    };
+
+    template <> struct CatalogLanesSSE2<uint32_t> {
+      static __m128i set1(uint32_t value) { return _mm_set1_epi32(int(value)); }
+      static __m128i equal(__m128i a, __m128i b) { return _mm_cmpeq_epi32(a, b); }
+      static __m128i greater(__m128i a, __m128i b) { return _mm_cmpgt_epi32(a, b); }
+      static constexpr uint32_t SignBit = 0x80000000u;
+    };
+
+    template <typename T, CatalogCompare Compare>
+    inline __m128i compareCatalogVectorSSE2(__m128i values, __m128i operand, __m128i flippedOperand) {
+      using Lanes = CatalogLanesSSE2<T>;
+      const __m128i ones = _mm_set1_epi32(-1);
+      const __m128i sign = Lanes::set1(Lanes::SignBit);
+      if constexpr (Compare == CatalogCompare::Equal)
+        return Lanes::equal(values, operand);
+      else if constexpr (Compare == CatalogCompare::NotEqual)
+        return _mm_xor_si128(Lanes::equal(values, operand), ones);
+      else if constexpr (Compare == CatalogCompare::AtLeast)
+        return _mm_xor_si128(Lanes::greater(flippedOperand, _mm_xor_si128(values, sign)), ones);
+      else if constexpr (Compare == CatalogCompare::AtMost)
+        return _mm_xor_si128(Lanes::greater(_mm_xor_si128(values, sign), flippedOperand), ones);
+      else if constexpr (Compare == CatalogCompare::AllBits)
+        return Lanes::equal(_mm_and_si128(values, operand), operand);
+      else
+        return Lanes::equal(_mm_and_si128(values, operand), _mm_setzero_si128());
+    }
+
+    // 16 rows at a time: the compare results are narrowed to bytes with
+    // saturating packs, which keep 0 and -1, and gathered with movemask.
+    template <typename T, CatalogCompare Compare>
+    inline uint32_t compareCatalogRows16SSE2(const T* values, __m128i operand, __m128i flippedOperand) {
+      auto load = [&](uint32_t i) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values) + i);
+        return compareCatalogVectorSSE2<T, Compare>(v, operand, flippedOperand);
+      };
+
+      if constexpr (sizeof(T) == 1) {
+        return uint32_t(_mm_movemask_epi8(load(0)));
+      } else if constexpr (sizeof(T) == 2) {
+        return uint32_t(_mm_movemask_epi8(_mm_packs_epi16(load(0), load(1))));
+      } else {
+        const __m128i lo = _mm_packs_epi32(load(0), load(1));
+        const __m128i hi = _mm_packs_epi32(load(2), load(3));
+        return uint32_t(_mm_movemask_epi8(_mm_packs_epi16(lo, hi)));
+      }
+    }
+
+    template <typename T, CatalogCompare Compare>
+    inline void filterCatalogColumnSSE2(const T* values, size_t count, T operand, uint64_t* selection) {
+      using Lanes = CatalogLanesSSE2<T>;
+      const __m128i operandVector  = Lanes::set1(operand);
+      const __m128i flippedOperand = Lanes::set1(T(operand ^ Lanes::SignBit));
+
+      const size_t fullWords = count / 64;
+      for (size_t word = 0; word < fullWords; word++) {
+        // Rows already filtered out by an earlier condition are skipped.
+        if (!selection[word])
+          continue;
+
+        const T* rows = values + word * 64;
+        const uint64_t mask =
+          uint64_t(compareCatalogRows16SSE2<T, Compare>(rows +  0, operandVector, flippedOperand))       |
+          uint64_t(compareCatalogRows16SSE2<T, Compare>(rows + 16, operandVector, flippedOperand)) << 16 |
+          uint64_t(compareCatalogRows16SSE2<T, Compare>(rows + 32, operandVector, flippedOperand)) << 32 |
+          uint64_t(compareCatalogRows16SSE2<T, Compare>(rows + 48, operandVector, flippedOperand)) << 48;
+        selection[word] &= mask;
+      }
+
+      if (count % 64)
+        selection[fullWords] &= compareCatalogRowsScalar(values + fullWords * 64, count % 64, Compare, operand);
+    }
+
+#endif
+
+    template <typename T>
+    inline void filterCatalogColumn(std::span<const T> values, CatalogCompare compare, T operand, std::span<uint64_t> selection) {
+#if defined(LIBVTF_X86)
+      if constexpr (sizeof(T) <= 4) {
+        switch (compare) {
+          case CatalogCompare::Equal:    return filterCatalogColumnSSE2<T, CatalogCompare::Equal>(values.data(), values.size(), operand, selection.data());
+          case CatalogCompare::NotEqual: return filterCatalogColumnSSE2<T, CatalogCompare::NotEqual>(values.data(), values.size(), operand, selection.data());
+          case CatalogCompare::AtLeast:  return filterCatalogColumnSSE2<T, CatalogCompare::AtLeast>(values.data(), values.size(), operand, selection.data());
+          case CatalogCompare::AtMost:   return filterCatalogColumnSSE2<T, CatalogCompare::AtMost>(values.data(), values.size(), operand, selection.data());
+          case CatalogCompare::AllBits:  return filterCatalogColumnSSE2<T, CatalogCompare::AllBits>(values.data(), values.size(), operand, selection.data());
+          case CatalogCompare::NoBits:   return filterCatalogColumnSSE2<T, CatalogCompare::NoBits>(values.data(), values.size(), operand, selection.data());
+        }
+      }
+#endif
+      for (size_t word = 0; word < selection.size(); word++) {
+        if (selection[word])
+          selection[word] &= compareCatalogRowsScalar(values.data() + word * 64, std::min<size_t>(64, values.size() - word * 64), compare, operand);
+      }
+    }
+
+  }
+
+  // Filters the rows of a catalog. Every condition narrows a bitmap of
+  // selected rows with one pass over a single column, 64 rows per word.
+  class CatalogQuery {
+  public:
+    explicit CatalogQuery(const Catalog& catalog)
+      : m_catalog{ &catalog }
+      , m_selection((catalog.size() + 63) / 64, ~uint64_t(0)) {
+      if (catalog.size() % 64)
+        m_selection.back() = (uint64_t(1) << (catalog.size() % 64)) - 1;
+    }
+
+    // `operand` is compared as the column's type. Operands that don't fit
+    // in it compare as if the column were 64 bits wide.
+    CatalogQuery& where(CatalogColumn column, CatalogCompare compare, uint64_t operand) {
+      if (!isCatalogColumnFilterable(column))
+        throw std::runtime_error("Catalog column can't be filtered on.");
+
+      switch (getCatalogColumnSize(column)) {
+        case 1: filter<uint8_t>(column, compare, operand);  break;
+        case 2: filter<uint16_t>(column, compare, operand); break;
+        case 4: filter<uint32_t>(column, compare, operand); break;
+        case 8: filter<uint64_t>(column, compare, operand); break;
+      }
+      return *this;
+    }
+
+    CatalogQuery& format(ImageFormat format) {
+      return where(CatalogColumn::Format, CatalogCompare::Equal, uint8_t(format));
+    }
+
+    CatalogQuery& hasFlags(uint32_t flags) {
+      return where(CatalogColumn::Flags, CatalogCompare::AllBits, flags);
+    }
+
+    CatalogQuery& hasResource(uint32_t type) {
+      for (size_t word = 0; word < m_selection.size(); word++) {
+        for (uint64_t bits = m_selection[word]; bits; bits &= bits - 1) {
+          const size_t row = word * 64 + size_t(std::countr_zero(bits));
+          const std::span<const uint32_t> resources = m_catalog->resources(row);
+          if (std::find(resources.begin(), resources.end(), type) == resources.end())
+            m_selection[word] &= ~(uint64_t(1) << (row % 64));
+        }
+      }
+      return *this;
+    }
+
+    size_t count() const {
+      size_t count = 0;
+      for (uint64_t word : m_selection)
+        count += size_t(std::popcount(word));
+      return count;
+    }
+
+    // Calls fn(row) for every selected row, in order.
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+      for (size_t word = 0; word < m_selection.size(); word++) {
+        for (uint64_t bits = m_selection[word]; bits; bits &= bits - 1)
+          fn(word * 64 + size_t(std::countr_zero(bits)));
+      }
+    }
+
+    std::vector<size_t> rows() const {
+      std::vector<size_t> rows;
+      rows.reserve(count());
+      forEach([&](size_t row) { rows.push_back(row); });
+      return rows;
+    }
+
+  private:
+    template <typename T>
+    void filter(CatalogColumn column, CatalogCompare compare, uint64_t operand) {
+      const std::span<const T> values = m_catalog->column<T>(column);
+      if (operand <= std::numeric_limits<T>::max()) {
+        detail::filterCatalogColumn<T>(values, compare, T(operand), m_selection);
+        return;
+      }
+
+      for (size_t word = 0; word < m_selection.size(); word++) {
+        for (uint64_t bits = m_selection[word]; bits; bits &= bits - 1) {
+          const size_t row = word * 64 + size_t(std::countr_zero(bits));
+          if (!detail::compareCatalogValue<uint64_t>(values[row], compare, operand))
+            m_selection[word] &= ~(uint64_t(1) << (row % 64));
+        }
+      }
+    }
+
+    const Catalog*        m_catalog;
+    std::vector<uint64_t> m_selection;
+  };
+
+}
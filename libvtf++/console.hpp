@@ -0,0 +1,131 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "lzma.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+namespace libvtf {
+
+  namespace detail {
+
+    inline void swapBytes(const uint8_t* src, uint8_t* dst, size_t size, uint32_t unit) {
+      if (unit == 2) {
+        for (size_t i = 0; i + 1 < size; i += 2) {
+          const uint8_t a = src[i];
+          dst[i]     = src[i + 1];
+          dst[i + 1] = a;
+        }
+      } else if (unit == 4) {
+        for (size_t i = 0; i + 3 < size; i += 4) {
+          uint32_t word;
+          std::memcpy(&word, src + i, sizeof(word));
+          word = byteSwap32(word);
+          std::memcpy(dst + i, &word, sizeof(word));
+        }
+      } else if (src != dst) {
+        std::memcpy(dst, src, size);
+      }
+    }
+
+  }
+
+  // Size of the preload section of a console VTF: the header, resource
+  // directory and whatever the file put in front of the bulk of the image
+  // data. Only needs the header. A VTFData over just this many bytes has
+  // the full layout and lowResImageSample for thumbnails, and
+  // ConsoleImageReader can pull any mips that fall inside it.
+  inline uint32_t getConsolePreloadSize(std::span<const uint8_t> header) {
+    if (header.size() < sizeof(meta::VTFHeader_Console))
+      throw std::runtime_error("Cannot read type from data span (EOF)");
+
+    meta::VTFHeader_Console console;
+    std::memcpy(&console, header.data(), sizeof(console));
+    if (console.signature != meta::VTFHeader_X360::ValidSignature && console.signature != meta::VTFHeader_PS3::ValidSignature)
+      throw std::runtime_error("Not a console VTF.");
+
+    const uint32_t directoryEnd = uint32_t(sizeof(meta::VTFHeader_Console) + console.numResources * sizeof(meta::ResourceEntryInfo));
+    return std::max<uint32_t>(detail::byteSwap16(console.preloadDataSize), directoryEnd);
+  }
+
+  // Reads the image data of Xbox 360 and PS3 VTFs in PC byte order.
+  //
+  // 360 image data is stored the way its GPU reads it and is swapped back
+  // here (see getX360SwapUnit), PS3 data is stored as on PC. Compressed
+  // payloads are inflated on demand, only as far as the subresource being
+  // read, so small mips are cheap. The inflate buffer is reused when the
+  // reader is reset for another texture.
+  //
+  // Reads past the end of the VTFData's buffer throw, which makes reading
+  // mips out of just the preload section safe.
+  class ConsoleImageReader {
+  public:
+    ConsoleImageReader() = default;
+
+    explicit ConsoleImageReader(const VTFData& vtf) {
+      reset(vtf);
+    }
+
+    // `vtf` must outlive the reader or the next reset.
+    void reset(const VTFData& vtf) {
+      const meta::VTFHeader_Console* console = vtf.consoleHeader();
+      if (!console)
+        throw std::runtime_error("Not a console VTF.");
+
+      const std::optional<uint32_t> offset = vtf.imageDataOffset();
+      if (!offset)
+        throw std::runtime_error("VTF has no image data.");
+
+      std::span<const uint8_t> buffer = vtf.buffer();
+      m_payload  = buffer.subspan(std::min<size_t>(*offset, buffer.size()));
+      m_swapUnit = vtf.getHeader().version == meta::VTFHeader_X360::Version
+        ? detail::getX360SwapUnit(vtf.getHeader().format)
+        : 1;
+
+      m_compressed = vtf.isImageDataCompressed();
+      if (m_compressed) {
+        m_payload = m_payload.first(std::min<size_t>(m_payload.size(), console->compressedSize));
+        m_decoder.reset(m_payload, vtf.imageTotalSize());
+        if (m_decoder.totalSize() < vtf.imageTotalSize())
+          throw std::runtime_error("Compressed image data is smaller than the image.");
+      }
+    }
+
+    // Copies a subresource to dst, which must hold subresource.size bytes.
+    void read(const SubresourceLayout& subresource, std::span<uint8_t> dst) {
+      if (dst.size() < subresource.size)
+        throw std::runtime_error("Destination buffer is too small for the subresource.");
+
+      std::span<const uint8_t> data = rawImageData(subresource);
+      detail::swapBytes(data.data(), dst.data(), data.size(), m_swapUnit);
+    }
+
+    // A subresource as stored, without byte swapping. Compressed payloads
+    // are inflated up to its end. Valid until the next read or reset.
+    std::span<const uint8_t> rawImageData(const SubresourceLayout& subresource) {
+      const size_t end = size_t(subresource.offset) + subresource.size;
+      if (!m_compressed) {
+        if (end > m_payload.size())
+          throw std::runtime_error("Subresource is not in the loaded part of the file.");
+        return m_payload.subspan(subresource.offset, subresource.size);
+      }
+
+      if (m_decoder.decodedSize() < end)
+        m_decoder.decodeTo(end);
+      return m_decoder.output().subspan(subresource.offset, subresource.size);
+    }
+
+    // Bytes of the payload inflated so far.
+    size_t decodedSize() const {
+      return m_compressed ? m_decoder.decodedSize() : m_payload.size();
+    }
+
+  private:
+    std::span<const uint8_t> m_payload;
+    LZMADecoder              m_decoder;
+    bool                     m_compressed = false;
+    uint32_t                 m_swapUnit   = 1;
+  };
+
+}
@@ -0,0 +1,791 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "decode.hpp"
+
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+
+namespace libvtf {
+
+  enum class ConvertBackend {
+    Auto,
+    Scalar,
+  };
+
+  namespace detail {
+
+    enum class PixelEncoding : uint8_t {
+      None,
+      Bytes,   // One byte per channel
+      Packed,  // Bitfields in a 16 or 32-bit little endian word
+      UNorm16,
+      Half,
+      Float,
+    };
+
+    // Where each of R, G, B and A lives in a pixel. Missing color
+    // channels read as 0 and a missing alpha as opaque.
+    struct PixelLayout {
+      PixelEncoding encoding    = PixelEncoding::None;
+      uint8_t       size        = 0;                    // Bytes per pixel
+      int8_t        elements[4] = { -1, -1, -1, -1 };   // Byte or element index of R, G, B, A, -1 = missing
+      uint8_t       shifts[4]   = {};                   // Packed only
+      uint8_t       bits[4]     = {};                   // Packed only, 0 = missing
+      bool          luminance   = false;                // R = G = B, packing stores luma
+      bool          bluescreen  = false;                // Pure blue means transparent
+      uint8_t       signedMask  = 0;                    // Bytes only, bit c set = channel c is two's complement
+    };
+
+    constexpr PixelLayout makeElementLayout(PixelEncoding encoding, uint8_t size, int8_t r, int8_t g, int8_t b, int8_t a) {
+      PixelLayout layout;
+      layout.encoding = encoding;
+      layout.size     = size;
+      layout.elements[0] = r;
+      layout.elements[1] = g;
+      layout.elements[2] = b;
+      layout.elements[3] = a;
+      return layout;
+    }
+
+    constexpr PixelLayout makeBytesLayout(uint8_t size, int8_t r, int8_t g, int8_t b, int8_t a) {
+      return makeElementLayout(PixelEncoding::Bytes, size, r, g, b, a);
+    }
+
+    constexpr PixelLayout makeLuminanceLayout(uint8_t size, int8_t a) {
+      PixelLayout layout = makeBytesLayout(size, 0, 0, 0, a);
+      layout.luminance = true;
+      return layout;
+    }
+
+    constexpr PixelLayout makeBluescreenLayout(int8_t r, int8_t g, int8_t b) {
+      PixelLayout layout = makeBytesLayout(3, r, g, b, -1);
+      layout.bluescreen = true;
+      return layout;
+    }
+
+    // Signed bytes go to and from the pivot biased by 128, like a normal
+    // map stored as UNORM: -128 reads as 0, 0 as 128 and 127 as 255.
+    constexpr PixelLayout makeSignedLayout(uint8_t size, int8_t r, int8_t g, int8_t b, int8_t a, uint8_t signedMask) {
+      PixelLayout layout = makeBytesLayout(size, r, g, b, a);
+      layout.signedMask = signedMask;
+      return layout;
+    }
+
+    // Shift/bit pairs of R, G, B, A from the least significant bit.
+    constexpr PixelLayout makePackedLayout(uint8_t size, std::array<uint8_t, 2> r, std::array<uint8_t, 2> g, std::array<uint8_t, 2> b, std::array<uint8_t, 2> a = {}) {
+      PixelLayout layout;
+      layout.encoding = PixelEncoding::Packed;
+      layout.size     = size;
+      const std::array<uint8_t, 2> channels[4] = { r, g, b, a };
+      for (uint32_t c = 0; c < 4; c++) {
+        layout.shifts[c] = channels[c][0];
+        layout.bits[c]   = channels[c][1];
+      }
+      return layout;
+    }
+
+    // Channel names list components from the lowest address (or the least
+    // significant bit for packed formats) up, so RGB565 has red in bits
+    // 0-4 and BGRA8888 has blue in the first byte. The LE_ formats are the
+    // 360's little endian copies and have the same memory layout. The
+    // bump map formats are signed, except for the L of UVLX8888.
+    constexpr PixelLayout getPixelLayout(ImageFormat format) {
+      using enum ImageFormats::ImageFormat;
+      switch (format) {
+        case RGBA8888:
+        case LINEAR_RGBA8888:
+          return makeBytesLayout(4, 0, 1, 2, 3);
+        case ABGR8888:
+        case LINEAR_ABGR8888:
+          return makeBytesLayout(4, 3, 2, 1, 0);
+        case ARGB8888:
+        case LINEAR_ARGB8888:
+          return makeBytesLayout(4, 1, 2, 3, 0);
+        case BGRA8888:
+        case LINEAR_BGRA8888:
+        case LE_BGRA8888:
+          return makeBytesLayout(4, 2, 1, 0, 3);
+        case BGRX8888:
+        case LINEAR_BGRX8888:
+        case LE_BGRX8888:
+          return makeBytesLayout(4, 2, 1, 0, -1);
+        case RGBX8888:
+          return makeBytesLayout(4, 0, 1, 2, -1);
+        case RGB888:
+        case LINEAR_RGB888:
+          return makeBytesLayout(3, 0, 1, 2, -1);
+        case BGR888:
+        case LINEAR_BGR888:
+          return makeBytesLayout(3, 2, 1, 0, -1);
+        case RGB888_BLUESCREEN:
+          return makeBluescreenLayout(0, 1, 2);
+        case BGR888_BLUESCREEN:
+          return makeBluescreenLayout(2, 1, 0);
+        case UV88:
+          return makeSignedLayout(2, 0, 1, -1, -1, 0b0011);
+        case UVWQ8888:
+          return makeSignedLayout(4, 0, 1, 2, 3, 0b1111);
+        case UVLX8888:
+          return makeSignedLayout(4, 0, 1, 2, -1, 0b0011);
+        case I8:
+        case LINEAR_I8:
+          return makeLuminanceLayout(1, -1);
+        case IA88:
+          return makeLuminanceLayout(2, 1);
+        case A8:
+        case LINEAR_A8:
+          return makeBytesLayout(1, -1, -1, -1, 0);
+
+        case RGB565:
+          return makePackedLayout(2, { 0, 5 }, { 5, 6 }, { 11, 5 });
+        case BGR565:
+          return makePackedLayout(2, { 11, 5 }, { 5, 6 }, { 0, 5 });
+        case BGRX5551:
+        case LINEAR_BGRX5551:
+          return makePackedLayout(2, { 10, 5 }, { 5, 5 }, { 0, 5 });
+        case BGRA5551:
+          return makePackedLayout(2, { 10, 5 }, { 5, 5 }, { 0, 5 }, { 15, 1 });
+        case BGRA4444:
+          return makePackedLayout(2, { 8, 4 }, { 4, 4 }, { 0, 4 }, { 12, 4 });
+        case RGBA1010102:
+          return makePackedLayout(4, { 0, 10 }, { 10, 10 }, { 20, 10 }, { 30, 2 });
+        case BGRA1010102:
+          return makePackedLayout(4, { 20, 10 }, { 10, 10 }, { 0, 10 }, { 30, 2 });
+
+        case RGBA16161616:
+        case LINEAR_RGBA16161616:
+          return makeElementLayout(PixelEncoding::UNorm16, 8, 0, 1, 2, 3);
+
+        case RGBA16161616F:
+          return makeElementLayout(PixelEncoding::Half, 8, 0, 1, 2, 3);
+        case RG1616F:
+          return makeElementLayout(PixelEncoding::Half, 4, 0, 1, -1, -1);
+        case R16F:
+          return makeElementLayout(PixelEncoding::Half, 2, 0, -1, -1, -1);
+
+        case R32F:
+          return makeElementLayout(PixelEncoding::Float, 4, 0, -1, -1, -1);
+        case RG3232F:
+          return makeElementLayout(PixelEncoding::Float, 8, 0, 1, -1, -1);
+        case RGB323232F:
+          return makeElementLayout(PixelEncoding::Float, 12, 0, 1, 2, -1);
+        case RGBA32323232F:
+          return makeElementLayout(PixelEncoding::Float, 16, 0, 1, 2, 3);
+
+        default:
+          return PixelLayout{};
+      }
+    }
+
+    // The format every row is unpacked to on its way between two formats.
+    // Formats with at most 8 bits per channel go through RGBA8888, the
+    // rest through RGBA32323232F.
+    enum class PixelPivot : uint8_t {
+      None,
+      RGBA8,
+      RGBA32F,
+    };
+
+    constexpr PixelPivot getPixelPivot(const PixelLayout& layout) {
+      switch (layout.encoding) {
+        case PixelEncoding::None:
+          return PixelPivot::None;
+        case PixelEncoding::Bytes:
+          return PixelPivot::RGBA8;
+        case PixelEncoding::Packed:
+          return std::max({ layout.bits[0], layout.bits[1], layout.bits[2], layout.bits[3] }) <= 8 ? PixelPivot::RGBA8 : PixelPivot::RGBA32F;
+        default:
+          return PixelPivot::RGBA32F;
+      }
+    }
+
+    using ConvertRowFn = void (*)(const uint8_t* src, uint32_t width, uint8_t* dst);
+
+    // Scalar kernels
+
+    inline float halfToFloat(uint16_t half) {
+      const uint32_t sign     = uint32_t(half & 0x8000u) << 16;
+      uint32_t       exponent = (half >> 10) & 0x1Fu;
+      uint32_t       mantissa = half & 0x3FFu;
+
+      uint32_t bits;
+      if (exponent == 0x1F) {
+        // NaNs come out quiet, like F16C.
+        bits = sign | 0x7F800000u | ((mantissa ? mantissa | 0x200u : 0u) << 13);
+      } else if (exponent) {
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+      } else if (mantissa) {
+        // Denormal, renormalize into a float.
+        exponent = 113;
+        while (!(mantissa & 0x400u)) {
+          mantissa <<= 1;
+          exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3FFu) << 13);
+      } else {
+        bits = sign;
+      }
+      return std::bit_cast<float>(bits);
+    }
+
+    // Rounds to nearest even and keeps NaN payloads, like F16C.
+    inline uint16_t floatToHalf(float value) {
+      const uint32_t bits    = std::bit_cast<uint32_t>(value);
+      const uint16_t sign    = uint16_t((bits >> 16) & 0x8000u);
+      const uint32_t absBits = bits & 0x7FFFFFFFu;
+
+      if (absBits > 0x7F800000u)
+        return uint16_t(sign | 0x7E00u | ((absBits >> 13) & 0x3FFu));
+      if (absBits >= 0x47800000u)
+        return uint16_t(sign | 0x7C00u);
+
+      auto roundShift = [](uint32_t mantissa, uint32_t shift) {
+        const uint32_t halfway   = 1u << (shift - 1);
+        const uint32_t remainder = mantissa & ((1u << shift) - 1);
+        uint32_t result = mantissa >> shift;
+        if (remainder > halfway || (remainder == halfway && (result & 1)))
+          result++;
+        return result;
+      };
+
+      if (absBits < 0x38800000u) {
+        if (absBits < 0x33000000u)
+          return sign;
+        return uint16_t(sign | roundShift((absBits & 0x7FFFFFu) | 0x800000u, 126 - (absBits >> 23)));
+      }
+      // Rebias the exponent, a carry out of the mantissa rounds up into it.
+      return uint16_t(sign | roundShift(absBits - 0x38000000u, 13));
+    }
+
+    // Widens a `bits` wide value to 8 bits by repeating its bit pattern.
+    constexpr uint8_t expandBits(uint32_t value, uint32_t bits) {
+      uint32_t result = 0;
+      for (int32_t position = 8 - int32_t(bits); position > -int32_t(bits); position -= int32_t(bits))
+        result |= position >= 0 ? value << position : value >> -position;
+      return uint8_t(result);
+    }
+
+    constexpr uint32_t quantizeBits(uint8_t value, uint32_t bits) {
+      const uint32_t max = (1u << bits) - 1;
+      return (value * max + 127) / 255;
+    }
+
+    inline uint32_t loadPackedWord(const uint8_t* src, uint32_t size) {
+      return size == 2 ? loadU16(src) : loadU32(src);
+    }
+
+    inline void storePackedWord(uint8_t* dst, uint32_t size, uint32_t word) {
+      if (size == 2) {
+        dst[0] = uint8_t(word);
+        dst[1] = uint8_t(word >> 8);
+      } else {
+        storeU32(dst, word);
+      }
+    }
+
+    inline uint8_t floatToUNorm8(float value) {
+      return uint8_t(std::nearbyint(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+    }
+
+    // Flips the sign bit of signed channels, which adds the bias of 128.
+    constexpr uint8_t getSignBias(const PixelLayout& layout, uint32_t channel) {
+      return (layout.signedMask >> channel) & 1 ? 0x80 : 0x00;
+    }
+
+    template <ImageFormat Format>
+    void unpackRowRGBA8(const uint8_t* src, uint32_t width, uint8_t* dst) {
+      static constexpr PixelLayout Layout = getPixelLayout(Format);
+      for (uint32_t x = 0; x < width; x++, src += Layout.size, dst += 4) {
+        if constexpr (Layout.encoding == PixelEncoding::Bytes) {
+          for (uint32_t c = 0; c < 4; c++)
+            dst[c] = Layout.elements[c] >= 0 ? src[Layout.elements[c]] ^ getSignBias(Layout, c) : (c == 3 ? 255 : 0);
+          if constexpr (Layout.bluescreen) {
+            if (dst[0] == 0 && dst[1] == 0 && dst[2] == 255)
+              dst[2] = dst[3] = 0;
+          }
+        } else {
+          const uint32_t word = loadPackedWord(src, Layout.size);
+          for (uint32_t c = 0; c < 4; c++) {
+            dst[c] = Layout.bits[c]
+              ? expandBits((word >> Layout.shifts[c]) & ((1u << Layout.bits[c]) - 1), Layout.bits[c])
+              : (c == 3 ? 255 : 0);
+          }
+        }
+      }
+    }
+
+    template <ImageFormat Format>
+    void packRowRGBA8(const uint8_t* src, uint32_t width, uint8_t* dst) {
+      static constexpr PixelLayout Layout = getPixelLayout(Format);
+      for (uint32_t x = 0; x < width; x++, src += 4, dst += Layout.size) {
+        if constexpr (Layout.encoding == PixelEncoding::Bytes) {
+          // Bytes no channel maps to (the X in BGRX) are written as 0xFF.
+          std::memset(dst, 0xFF, Layout.size);
+          if constexpr (Layout.luminance) {
+            dst[0] = uint8_t((77u * src[0] + 150u * src[1] + 29u * src[2] + 128u) >> 8);
+            if constexpr (Layout.elements[3] >= 0)
+              dst[Layout.elements[3]] = src[3];
+          } else {
+            for (uint32_t c = 0; c < 4; c++) {
+              if (Layout.elements[c] >= 0)
+                dst[Layout.elements[c]] = src[c] ^ getSignBias(Layout, c);
+            }
+            if constexpr (Layout.bluescreen) {
+              if (src[3] < 128) {
+                dst[Layout.elements[0]] = 0;
+                dst[Layout.elements[1]] = 0;
+                dst[Layout.elements[2]] = 255;
+              }
+            }
+          }
+        } else {
+          uint32_t word = 0, usedBits = 0;
+          for (uint32_t c = 0; c < 4; c++) {
+            if (!Layout.bits[c])
+              continue;
+            word     |= quantizeBits(src[c], Layout.bits[c]) << Layout.shifts[c];
+            usedBits |= ((1u << Layout.bits[c]) - 1) << Layout.shifts[c];
+          }
+          storePackedWord(dst, Layout.size, word | ~usedBits);
+        }
+      }
+    }
+
+    template <ImageFormat Format>
+    void unpackRowRGBA32F(const uint8_t* src, uint32_t width, uint8_t* dst) {
+      static constexpr PixelLayout Layout = getPixelLayout(Format);
+      for (uint32_t x = 0; x < width; x++, src += Layout.size, dst += 16) {
+        float pixel[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+        if constexpr (Layout.encoding == PixelEncoding::Packed) {
+          const uint32_t word = loadPackedWord(src, Layout.size);
+          for (uint32_t c = 0; c < 4; c++) {
+            const uint32_t max = (1u << Layout.bits[c]) - 1;
+            if (Layout.bits[c])
+              pixel[c] = float((word >> Layout.shifts[c]) & max) / float(max);
+          }
+        } else {
+          for (uint32_t c = 0; c < 4; c++) {
+            if (Layout.elements[c] < 0)
+              continue;
+            if constexpr (Layout.encoding == PixelEncoding::UNorm16)
+              pixel[c] = float(loadU16(src + 2 * Layout.elements[c])) / 65535.0f;
+            else if constexpr (Layout.encoding == PixelEncoding::Half)
+              pixel[c] = halfToFloat(loadU16(src + 2 * Layout.elements[c]));
+            else
+              std::memcpy(&pixel[c], src + 4 * Layout.elements[c], sizeof(float));
+          }
+        }
+        std::memcpy(dst, pixel, sizeof(pixel));
+      }
+    }
+
+    template <ImageFormat Format>
+    void packRowRGBA32F(const uint8_t* src, uint32_t width, uint8_t* dst) {
+      static constexpr PixelLayout Layout = getPixelLayout(Format);
+      for (uint32_t x = 0; x < width; x++, src += 16, dst += Layout.size) {
+        float pixel[4];
+        std::memcpy(pixel, src, sizeof(pixel));
+        if constexpr (Layout.encoding == PixelEncoding::Packed) {
+          uint32_t word = 0;
+          for (uint32_t c = 0; c < 4; c++) {
+            const uint32_t max = (1u << Layout.bits[c]) - 1;
+            if (Layout.bits[c])
+              word |= uint32_t(std::nearbyint(std::clamp(pixel[c], 0.0f, 1.0f) * float(max))) << Layout.shifts[c];
+          }
+          storePackedWord(dst, Layout.size, word);
+        } else {
+          for (uint32_t c = 0; c < 4; c++) {
+            if (Layout.elements[c] < 0)
+              continue;
+            uint8_t* element = dst + (Layout.encoding == PixelEncoding::Float ? 4 : 2) * Layout.elements[c];
+            if constexpr (Layout.encoding == PixelEncoding::UNorm16) {
+              const uint32_t value = uint32_t(std::nearbyint(std::clamp(pixel[c], 0.0f, 1.0f) * 65535.0f));
+              storePackedWord(element, 2, value);
+            } else if constexpr (Layout.encoding == PixelEncoding::Half) {
+              storePackedWord(element, 2, floatToHalf(pixel[c]));
+            } else {
+              std::memcpy(element, &pixel[c], sizeof(float));
+            }
+          }
+        }
+      }
+    }
+
+    inline void convertRowRGBA8ToRGBA32F(const uint8_t* src, uint32_t width, uint8_t* dst) {
+      uint32_t x = 0;
+#ifdef LIBVTF_X86
+      const __m128i zero  = _mm_setzero_si128();
+      const __m128  scale = _mm_set1_ps(1.0f / 255.0f);
+      for (; x + 4 <= width; x += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        const __m128i lo     = _mm_unpacklo_epi8(pixels, zero);
+        const __m128i hi     = _mm_unpackhi_epi8(pixels, zero);
+        const __m128i words[4] = {
+          _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+          _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero),
+        };
+        for (uint32_t i = 0; i < 4; i++)
+          _mm_storeu_ps(reinterpret_cast<float*>(dst + (x + i) * 16), _mm_mul_ps(_mm_cvtepi32_ps(words[i]), scale));
+      }
+#endif
+      for (; x < width; x++) {
+        float pixel[4];
+        for (uint32_t c = 0; c < 4; c++)
+          pixel[c] = float(src[x * 4 + c]) * (1.0f / 255.0f);
+        std::memcpy(dst + x * 16, pixel, sizeof(pixel));
+      }
+    }
+
+    inline void convertRowRGBA32FToRGBA8(const uint8_t* src, uint32_t width, uint8_t* dst) {
+      uint32_t x = 0;
+#ifdef LIBVTF_X86
+      const __m128 zero  = _mm_setzero_ps();
+      const __m128 one   = _mm_set1_ps(1.0f);
+      const __m128 scale = _mm_set1_ps(255.0f);
+      for (; x + 4 <= width; x += 4) {
+        __m128i words[4];
+        for (uint32_t i = 0; i < 4; i++) {
+          const __m128 pixel = _mm_loadu_ps(reinterpret_cast<const float*>(src + (x + i) * 16));
+          words[i] = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(pixel, zero), one), scale));
+        }
+        const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(words[0], words[1]), _mm_packs_epi32(words[2], words[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), packed);
+      }
+#endif
+      for (; x < width; x++) {
+        float pixel[4];
+        std::memcpy(pixel, src + x * 16, sizeof(pixel));
+        for (uint32_t c = 0; c < 4; c++)
+          dst[x * 4 + c] = floatToUNorm8(pixel[c]);
+      }
+    }
+
+    // SIMD kernels
+
+#ifdef LIBVTF_X86
+
+    struct ByteShuffle {
+      alignas(16) uint8_t shuffle[16];
+      alignas(16) uint8_t fill[16];
+      alignas(16) uint8_t bias[16];     // Sign bits to flip in the RGBA8 pixels
+      uint32_t            pixels;       // Pixels per 16 byte register
+    };
+
+    // Byte formats to RGBA8: four pixels per shuffle, missing channels
+    // come from `fill`.
+    constexpr ByteShuffle makeUnpackShuffle(const PixelLayout& layout) {
+      ByteShuffle result{};
+      result.pixels = 4;
+      for (uint32_t p = 0; p < 4; p++) {
+        for (uint32_t c = 0; c < 4; c++) {
+          const bool present = layout.elements[c] >= 0;
+          result.shuffle[p * 4 + c] = present ? uint8_t(p * layout.size + layout.elements[c]) : 0x80;
+          result.fill[p * 4 + c]    = !present && c == 3 ? 0xFF : 0x00;
+          result.bias[p * 4 + c]    = present ? getSignBias(layout, c) : 0x00;
+        }
+      }
+      return result;
+    }
+
+    // RGBA8 to byte formats: four pixels per shuffle, the low
+    // 4 * size bytes of the result are valid.
+    constexpr ByteShuffle makePackShuffle(const PixelLayout& layout) {
+      ByteShuffle result{};
+      result.pixels = 4;
+      for (uint32_t i = 0; i < 16; i++) {
+        result.shuffle[i] = 0x80;
+        result.fill[i]    = i < 4u * layout.size ? 0xFF : 0x00;
+      }
+      for (uint32_t p = 0; p < 4; p++) {
+        for (uint32_t c = 0; c < 4; c++) {
+          if (layout.elements[c] < 0)
+            continue;
+          const uint32_t byte = p * layout.size + layout.elements[c];
+          result.shuffle[byte]   = uint8_t(p * 4 + c);
+          result.fill[byte]      = 0x00;
+          result.bias[p * 4 + c] = getSignBias(layout, c);
+        }
+      }
+      return result;
+    }
+
+    template <ImageFormat Format>
+    LIBVTF_TARGET_SSSE3 void unpackRowRGBA8SSSE3(const uint8_t* src, uint32_t width, uint8_t* dst) {
+      static constexpr PixelLayout Layout  = getPixelLayout(Format);
+      static constexpr ByteShuffle Shuffle = makeUnpackShuffle(Layout);
+      const __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(Shuffle.shuffle));
+      const __m128i fill    = _mm_load_si128(reinterpret_cast<const __m128i*>(Shuffle.fill));
+      const __m128i bias    = _mm_load_si128(reinterpret_cast<const __m128i*>(Shuffle.bias));
+      const __m128i blue    = _mm_set1_epi32(int32_t(0xFFFF0000u));
+
+      // Loads are 16 bytes wide, stop while a whole register of source is left.
+      uint32_t x = 0;
+      for (; x + 4 <= width && (width - x) * Layout.size >= 16; x += 4) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * Layout.size));
+        pixels = _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), fill);
+        if constexpr (Layout.signedMask != 0)
+          pixels = _mm_xor_si128(pixels, bias);
+        if constexpr (Layout.bluescreen)
+          pixels = _mm_andnot_si128(_mm_cmpeq_epi32(pixels, blue), pixels);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), pixels);
+      }
+      unpackRowRGBA8<Format>(src + x * Layout.size, width - x, dst + x * 4);
+    }
+
+    template <ImageFormat Format>
+    LIBVTF_TARGET_SSSE3 void packRowRGBA8SSSE3(const uint8_t* src, uint32_t width, uint8_t* dst) {
+      static constexpr PixelLayout Layout  = getPixelLayout(Format);
+      static constexpr ByteShuffle Shuffle = makePackShuffle(Layout);
+      const __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(Shuffle.shuffle));
+      const __m128i fill    = _mm_load_si128(reinterpret_cast<const __m128i*>(Shuffle.fill));
+      const __m128i bias    = _mm_load_si128(reinterpret_cast<const __m128i*>(Shuffle.bias));
+
+      uint32_t x = 0;
+      for (; x + 4 <= width; x += 4) {
+        __m128i rgba = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+        if constexpr (Layout.signedMask != 0)
+          rgba = _mm_xor_si128(rgba, bias);
+        const __m128i pixels = _mm_or_si128(_mm_shuffle_epi8(rgba, shuffle), fill);
+        uint8_t* out = dst + x * Layout.size;
+        if constexpr (Layout.size == 4) {
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(out), pixels);
+        } else if constexpr (Layout.size == 3) {
+          _mm_storel_epi64(reinterpret_cast<__m128i*>(out), pixels);
+          storeU32(out + 8, uint32_t(_mm_cvtsi128_si32(_mm_srli_si128(pixels, 8))));
+        } else if constexpr (Layout.size == 2) {
+          _mm_storel_epi64(reinterpret_cast<__m128i*>(out), pixels);
+        } else {
+          storeU32(out, uint32_t(_mm_cvtsi128_si32(pixels)));
+        }
+      }
+      packRowRGBA8<Format>(src + x * 4, width - x, dst + x * Layout.size);
+    }
+
+    // Widens 8 lanes of `bits` wide values to 8 bits, like expandBits.
+    inline __m128i expandBitsSSE2(__m128i value, uint32_t bits) {
+      __m128i result = _mm_setzero_si128();
+      for (int32_t position = 8 - int32_t(bits); position > -int32_t(bits); position -= int32_t(bits)) {
+        result = _mm_or_si128(result, position >= 0
+          ? _mm_sll_epi16(value, _mm_cvtsi32_si128(position))
+          : _mm_srl_epi16(value, _mm_cvtsi32_si128(-position)));
+      }
+      return result;
+    }
+
+    // 16-bit packed formats to RGBA8, eight pixels at a time.
+    template <ImageFormat Format>
+    void unpackRowRGBA8PackedSSE2(const uint8_t* src, uint32_t width, uint8_t* dst) {
+      static constexpr PixelLayout Layout = getPixelLayout(Format);
+      static_assert(Layout.encoding == PixelEncoding::Packed && Layout.size == 2);
+
+      uint32_t x = 0;
+      for (; x + 8 <= width; x += 8) {
+        const __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 2));
+        __m128i channels[4];
+        for (uint32_t c = 0; c < 4; c++) {
+          if (!Layout.bits[c]) {
+            channels[c] = c == 3 ? _mm_set1_epi16(0xFF) : _mm_setzero_si128();
+            continue;
+          }
+          const __m128i value = _mm_and_si128(_mm_srl_epi16(words, _mm_cvtsi32_si128(Layout.shifts[c])), _mm_set1_epi16(int16_t((1u << Layout.bits[c]) - 1)));
+          channels[c] = expandBitsSSE2(value, Layout.bits[c]);
+        }
+        const __m128i rg = _mm_or_si128(channels[0], _mm_slli_epi16(channels[1], 8));
+        const __m128i ba = _mm_or_si128(channels[2], _mm_slli_epi16(channels[3], 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4),      _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+      }
+      unpackRowRGBA8<Format>(src + x * 2, width - x, dst + x * 4);
+    }
+
+    LIBVTF_TARGET_F16C inline void unpackRowRGBA16FToRGBA32FF16C(const uint8_t* src, uint32_t width, uint8_t* dst) {
+      uint32_t x = 0;
+      for (; x + 2 <= width; x += 2) {
+        const __m128i halves = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 8));
+        _mm_storeu_ps(reinterpret_cast<float*>(dst + x * 16),      _mm_cvtph_ps(halves));
+        _mm_storeu_ps(reinterpret_cast<float*>(dst + x * 16 + 16), _mm_cvtph_ps(_mm_srli_si128(halves, 8)));
+      }
+      unpackRowRGBA32F<ImageFormats::RGBA16161616F>(src + x * 8, width - x, dst + x * 16);
+    }
+
+    LIBVTF_TARGET_F16C inline void packRowRGBA32FToRGBA16FF16C(const uint8_t* src, uint32_t width, uint8_t* dst) {
+      uint32_t x = 0;
+      for (; x + 2 <= width; x += 2) {
+        const __m128i lo = _mm_cvtps_ph(_mm_loadu_ps(reinterpret_cast<const float*>(src + x * 16)),      _MM_FROUND_TO_NEAREST_INT);
+        const __m128i hi = _mm_cvtps_ph(_mm_loadu_ps(reinterpret_cast<const float*>(src + x * 16 + 16)), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 8), _mm_unpacklo_epi64(lo, hi));
+      }
+      packRowRGBA32F<ImageFormats::RGBA16161616F>(src + x * 16, width - x, dst + x * 8);
+    }
+
+#endif
+
+    struct PixelFormatKernels {
+      ConvertRowFn       unpack       = nullptr; // To the pivot, nullptr when the format is the pivot
+      ConvertRowFn       pack         = nullptr; // From the pivot
+      ConvertRowFn       unpackSIMD   = nullptr;
+      ConvertRowFn       packSIMD     = nullptr;
+      bool CPUFeatures::*simdFeature  = nullptr; // What the SIMD kernels need
+      PixelPivot         pivot        = PixelPivot::None;
+      uint8_t            pixelSize    = 0;
+    };
+
+    template <ImageFormat Format>
+    constexpr PixelFormatKernels makePixelFormatKernels() {
+      constexpr PixelLayout Layout = getPixelLayout(Format);
+      constexpr PixelPivot  Pivot  = getPixelPivot(Layout);
+
+      PixelFormatKernels kernels;
+      kernels.pivot     = Pivot;
+      kernels.pixelSize = Layout.size;
+
+      if constexpr (Format == ImageFormats::RGBA8888 || Format == ImageFormats::RGBA32323232F || Pivot == PixelPivot::None) {
+        return kernels;
+      } else if constexpr (Pivot == PixelPivot::RGBA8) {
+        kernels.unpack = unpackRowRGBA8<Format>;
+        kernels.pack   = packRowRGBA8<Format>;
+#ifdef LIBVTF_X86
+        if constexpr (Layout.encoding == PixelEncoding::Bytes) {
+          kernels.unpackSIMD  = unpackRowRGBA8SSSE3<Format>;
+          kernels.packSIMD    = Layout.luminance || Layout.bluescreen ? nullptr : packRowRGBA8SSSE3<Format>;
+          kernels.simdFeature = &CPUFeatures::ssse3;
+        } else if constexpr (Layout.size == 2) {
+          kernels.unpackSIMD  = unpackRowRGBA8PackedSSE2<Format>;
+          kernels.simdFeature = &CPUFeatures::sse2;
+        }
+#endif
+        return kernels;
+      } else {
+        kernels.unpack = unpackRowRGBA32F<Format>;
+        kernels.pack   = packRowRGBA32F<Format>;
+#ifdef LIBVTF_X86
+        if constexpr (Format == ImageFormats::RGBA16161616F) {
+          kernels.unpackSIMD  = unpackRowRGBA16FToRGBA32FF16C;
+          kernels.packSIMD    = packRowRGBA32FToRGBA16FF16C;
+          kernels.simdFeature = &CPUFeatures::f16c;
+        }
+#endif
+        return kernels;
+      }
+    }
+
+    template <size_t... Formats>
+    constexpr std::array<PixelFormatKernels, sizeof...(Formats)> makePixelFormatKernelTable(std::index_sequence<Formats...>) {
+      return { makePixelFormatKernels<ImageFormat(Formats)>()... };
+    }
+
+    // Kernels of every format, indexed by ImageFormat.
+    inline constexpr std::array<PixelFormatKernels, ImageFormats::SOURCE_FORMAT_LAST + 1> PixelFormatKernelTable =
+      makePixelFormatKernelTable(std::make_index_sequence<ImageFormats::SOURCE_FORMAT_LAST + 1>());
+
+    constexpr const PixelFormatKernels* getPixelFormatKernels(ImageFormat format) {
+      if (format < 0 || uint32_t(format) >= PixelFormatKernelTable.size())
+        return nullptr;
+      const PixelFormatKernels& kernels = PixelFormatKernelTable[format];
+      return kernels.pivot != PixelPivot::None ? &kernels : nullptr;
+    }
+
+  }
+
+  // Whether an uncompressed format can be converted to and from. Block
+  // compressed, depth and paletted formats can't.
+  constexpr bool isConvertible(ImageFormat format) {
+    return detail::getPixelFormatKernels(format) != nullptr;
+  }
+
+  // Converts rows of pixels between two uncompressed formats. Rows go
+  // through RGBA8888 or RGBA32323232F in chunks small enough to stay in
+  // cache, so converting a row never touches more memory than its source
+  // and destination. Kernels are picked once on construction.
+  class PixelConverter {
+  public:
+    PixelConverter(ImageFormat srcFormat, ImageFormat dstFormat, ConvertBackend backend = ConvertBackend::Auto) {
+      const detail::PixelFormatKernels* src = detail::getPixelFormatKernels(srcFormat);
+      const detail::PixelFormatKernels* dst = detail::getPixelFormatKernels(dstFormat);
+      if (!src || !dst)
+        throw std::runtime_error("Image format is not a convertible uncompressed format.");
+
+      m_srcPixelSize = src->pixelSize;
+      m_dstPixelSize = dst->pixelSize;
+      if (srcFormat == dstFormat)
+        return;
+
+      const bool simd = backend == ConvertBackend::Auto;
+      auto select = [simd](const detail::PixelFormatKernels& kernels, detail::ConvertRowFn scalar, detail::ConvertRowFn fast) {
+        return simd && fast && detail::getCPUFeatures().*kernels.simdFeature ? fast : scalar;
+      };
+
+      if (src->unpack)
+        m_stages[m_numStages++] = select(*src, src->unpack, src->unpackSIMD);
+      if (src->pivot == detail::PixelPivot::RGBA8 && dst->pivot == detail::PixelPivot::RGBA32F)
+        m_stages[m_numStages++] = detail::convertRowRGBA8ToRGBA32F;
+      if (src->pivot == detail::PixelPivot::RGBA32F && dst->pivot == detail::PixelPivot::RGBA8)
+        m_stages[m_numStages++] = detail::convertRowRGBA32FToRGBA8;
+      if (dst->pack)
+        m_stages[m_numStages++] = select(*dst, dst->pack, dst->packSIMD);
+    }
+
+    uint32_t srcPixelSize() const { return m_srcPixelSize; }
+    uint32_t dstPixelSize() const { return m_dstPixelSize; }
+
+    void convertRow(const uint8_t* src, uint8_t* dst, uint32_t width) const {
+      if (!m_numStages) {
+        std::memcpy(dst, src, size_t(width) * m_srcPixelSize);
+        return;
+      }
+
+      alignas(16) uint8_t scratch[2][ChunkPixels * 16];
+      for (uint32_t x = 0; x < width; x += ChunkPixels) {
+        const uint32_t count = std::min(ChunkPixels, width - x);
+        const uint8_t* in = src + size_t(x) * m_srcPixelSize;
+        for (uint32_t stage = 0; stage < m_numStages; stage++) {
+          uint8_t* out = stage + 1 == m_numStages ? dst + size_t(x) * m_dstPixelSize : scratch[stage & 1];
+          m_stages[stage](in, count, out);
+          in = out;
+        }
+      }
+    }
+
+  private:
+    // 4KB of RGBA32F per chunk.
+    static constexpr uint32_t ChunkPixels = 256;
+
+    std::array<detail::ConvertRowFn, 3> m_stages{};
+    uint32_t                            m_numStages    = 0;
+    uint32_t                            m_srcPixelSize = 0;
+    uint32_t                            m_dstPixelSize = 0;
+  };
+
+  // Converts a width x height image between two uncompressed formats,
+  // pitches are in bytes (0 = tightly packed).
+  inline void convertImage(
+          ImageFormat              srcFormat,
+          std::span<const uint8_t> src,
+          ImageFormat              dstFormat,
+          std::span<uint8_t>       dst,
+          uint32_t                 width,
+          uint32_t                 height,
+          size_t                   srcPitch = 0,
+          size_t                   dstPitch = 0,
+          ConvertBackend           backend  = ConvertBackend::Auto) {
+    const PixelConverter converter(srcFormat, dstFormat, backend);
+    if (!srcPitch)
+      srcPitch = size_t(width) * converter.srcPixelSize();
+    if (!dstPitch)
+      dstPitch = size_t(width) * converter.dstPixelSize();
+
+    if (height && src.size() < srcPitch * (height - 1) + size_t(width) * converter.srcPixelSize())
+      throw std::runtime_error("Source buffer is too small for image dimensions.");
+    if (height && dst.size() < dstPitch * (height - 1) + size_t(width) * converter.dstPixelSize())
+      throw std::runtime_error("Destination buffer is too small for image dimensions.");
+
+    LIBVTF_INSTRUMENT_SCOPE(Convert, size_t(width) * height * converter.srcPixelSize());
+    for (uint32_t y = 0; y < height; y++)
+      converter.convertRow(src.data() + y * srcPitch, dst.data() + y * dstPitch, width);
+  }
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+# define LIBVTF_X86 1
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+#  define LIBVTF_TARGET_SSSE3
+#  define LIBVTF_TARGET_F16C
+#  define LIBVTF_TARGET_AVX2
+#  define LIBVTF_TARGET_PCLMUL
+# else
+#  define LIBVTF_TARGET_SSSE3  __attribute__((target("ssse3")))
+#  define LIBVTF_TARGET_F16C   __attribute__((target("f16c")))
+#  define LIBVTF_TARGET_AVX2   __attribute__((target("avx2")))
+#  define LIBVTF_TARGET_PCLMUL __attribute__((target("pclmul")))
+# endif
+#endif
+
+namespace libvtf {
+
+  namespace detail {
+
+    // Instruction set extensions the SIMD kernels can use, detected once.
+    struct CPUFeatures {
+      bool sse2   = false;
+      bool ssse3  = false;
+      bool f16c   = false;
+      bool avx2   = false;
+      bool pclmul = false;
+    };
+
+    inline const CPUFeatures& getCPUFeatures() {
+      static const CPUFeatures features = [] {
+        CPUFeatures result{};
+#if defined(LIBVTF_X86)
+        result.sse2 = true;
+# ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        const int maxLeaf = info[0];
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx     = (info[2] & (1 << 28)) != 0;
+        const bool ymm     = osxsave && avx && (_xgetbv(0) & 0x6) == 0x6;
+        result.ssse3  = (info[2] & (1 << 9)) != 0;
+        result.pclmul = (info[2] & (1 << 1)) != 0;
+        result.f16c   = ymm && (info[2] & (1 << 29)) != 0;
+        if (maxLeaf >= 7 && ymm) {
+          __cpuidex(info, 7, 0);
+          result.avx2 = (info[1] & (1 << 5)) != 0;
+        }
+# else
+        __builtin_cpu_init();
+        result.ssse3  = __builtin_cpu_supports("ssse3");
+        result.f16c   = __builtin_cpu_supports("f16c");
+        result.avx2   = __builtin_cpu_supports("avx2");
+        result.pclmul = __builtin_cpu_supports("pclmul");
+# endif
+#endif
+        return result;
+      }();
+      return features;
+    }
+
+  }
+
+}
@@ -0,0 +1,274 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "cpu.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <span>
+
+namespace libvtf {
+
+  namespace detail {
+
+    // Reflected CRC-32 polynomial used by zlib and the VTF CRC resource.
+    // (The SSE4.2 crc32 instruction computes CRC-32C, which is different.)
+    static constexpr uint32_t CRC32Polynomial = 0xEDB88320u;
+
+    // Slicing-by-8 tables: table[k][b] is the CRC of byte b followed by k
+    // zero bytes.
+    constexpr std::array<std::array<uint32_t, 256>, 8> makeCRC32Tables() {
+      std::array<std::array<uint32_t, 256>, 8> tables{};
+      for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+          crc = (crc >> 1) ^ (CRC32Polynomial & (0u - (crc & 1u)));
+        tables[0][i] = crc;
+      }
+      for (uint32_t k = 1; k < 8; k++) {
+        for (uint32_t i = 0; i < 256; i++)
+          tables[k][i] = (tables[k - 1][i] >> 8) ^ tables[0][tables[k - 1][i] & 0xFFu];
+      }
+      return tables;
+    }
+
+    inline constexpr std::array<std::array<uint32_t, 256>, 8> CRC32Tables = makeCRC32Tables();
+
+    // Works on the inverted CRC state, like the SIMD version.
+    inline uint32_t crc32Scalar(const uint8_t* data, size_t size, uint32_t crc) {
+      for (; size >= 8; size -= 8, data += 8) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, data, sizeof(lo));
+        std::memcpy(&hi, data + 4, sizeof(hi));
+        lo ^= crc;
+        crc = CRC32Tables[7][lo & 0xFFu] ^ CRC32Tables[6][(lo >> 8) & 0xFFu] ^
+              CRC32Tables[5][(lo >> 16) & 0xFFu] ^ CRC32Tables[4][lo >> 24] ^
+              CRC32Tables[3][hi & 0xFFu] ^ CRC32Tables[2][(hi >> 8) & 0xFFu] ^
+              CRC32Tables[1][(hi >> 16) & 0xFFu] ^ CRC32Tables[0][hi >> 24];
+      }
+      for (; size; size--, data++)
+        crc = CRC32Tables[0][(crc ^ *data) & 0xFFu] ^ (crc >> 8);
+      return crc;
+    }
+
+#if defined(LIBVTF_X86)
+    LIBVTF_TARGET_PCLMUL inline __m128i foldCRC32(__m128i x, __m128i k, __m128i next) {
+      const __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+      const __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+      return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+    }
+
+    // Folds 64 bytes at a time with carry-less multiplies, then reduces to
+    // 32 bits with Barrett reduction ("Fast CRC Computation for Generic
+    // Polynomials Using PCLMULQDQ", Intel 2009). Handles a multiple of 16
+    // bytes, at least 64.
+    LIBVTF_TARGET_PCLMUL inline uint32_t crc32PCLMUL(const uint8_t* data, size_t size, uint32_t crc) {
+      const __m128i k1k2 = _mm_set_epi64x(0x01C6E41596, 0x0154442BD4);
+      const __m128i k3k4 = _mm_set_epi64x(0x00CCAA009E, 0x01751997D0);
+      const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163CD6124);
+      const __m128i poly = _mm_set_epi64x(0x01F7011641, 0x01DB710641);
+      const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+      __m128i x1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), _mm_cvtsi32_si128(int(crc)));
+      __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16));
+      __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32));
+      __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48));
+      data += 64;
+      size -= 64;
+
+      for (; size >= 64; size -= 64, data += 64) {
+        x1 = foldCRC32(x1, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+        x2 = foldCRC32(x2, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16)));
+        x3 = foldCRC32(x3, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32)));
+        x4 = foldCRC32(x4, k1k2, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48)));
+      }
+
+      x1 = foldCRC32(x1, k3k4, x2);
+      x1 = foldCRC32(x1, k3k4, x3);
+      x1 = foldCRC32(x1, k3k4, x4);
+      for (; size >= 16; size -= 16, data += 16)
+        x1 = foldCRC32(x1, k3k4, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+
+      // 128 -> 64 bits.
+      __m128i x2r = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+      x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2r);
+      x2r = _mm_srli_si128(x1, 4);
+      x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask), k5k0, 0x00), x2r);
+
+      // Barrett reduction to 32 bits.
+      x2r = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), poly, 0x10);
+      x2r = _mm_clmulepi64_si128(_mm_and_si128(x2r, mask), poly, 0x00);
+      x1 = _mm_xor_si128(x1, x2r);
+      return uint32_t(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+    }
+#endif
+
+    // a * b modulo the CRC polynomial, in the reflected domain.
+    constexpr uint32_t crc32MultiplyModP(uint32_t a, uint32_t b) {
+      uint32_t product = 0;
+      for (uint32_t m = 1u << 31; m; m >>= 1) {
+        if (a & m)
+          product ^= b;
+        b = (b & 1) ? (b >> 1) ^ CRC32Polynomial : b >> 1;
+      }
+      return product;
+    }
+
+    // table[k] = x^(2^k) modulo the CRC polynomial.
+    constexpr std::array<uint32_t, 64> makeCRC32PowerTable() {
+      std::array<uint32_t, 64> table{};
+      uint32_t power = 1u << 30; // x^1
+      for (uint32_t& entry : table) {
+        entry = power;
+        power = crc32MultiplyModP(power, power);
+      }
+      return table;
+    }
+
+    inline constexpr std::array<uint32_t, 64> CRC32PowerTable = makeCRC32PowerTable();
+
+  }
+
+  // Standard (zlib) CRC-32. Pass the previous result as `crc` to continue
+  // a checksum over several buffers.
+  inline uint32_t crc32(std::span<const uint8_t> data, uint32_t crc = 0) {
+    const uint8_t* bytes = data.data();
+    size_t size = data.size();
+    crc = ~crc;
+
+#if defined(LIBVTF_X86)
+    if (size >= 64 && detail::getCPUFeatures().pclmul) {
+      const size_t simdSize = size & ~size_t(15);
+      crc = detail::crc32PCLMUL(bytes, simdSize, crc);
+      bytes += simdSize;
+      size -= simdSize;
+    }
+#endif
+
+    return ~detail::crc32Scalar(bytes, size, crc);
+  }
+
+  // CRC-32 of A followed by B, from the CRCs of both and B's size.
+  inline uint32_t crc32Combine(uint32_t crcA, uint32_t crcB, uint64_t sizeB) {
+    // Shift crcA by sizeB zero bytes: multiply by x^(8 * sizeB).
+    uint32_t shift = 1u << 31; // x^0
+    for (uint32_t k = 3; sizeB; sizeB >>= 1, k++) {
+      if (sizeB & 1)
+        shift = detail::crc32MultiplyModP(detail::CRC32PowerTable[k], shift);
+    }
+    return detail::crc32MultiplyModP(shift, crcA) ^ crcB;
+  }
+
+  // CRC-32 of the high-res image data, as stored in the CRC resource.
+  inline uint32_t computeImageCRC32(const VTFData& vtf) {
+    const uint8_t* data = vtf.imageData();
+    if (!data && vtf.imageTotalSize())
+      throw std::runtime_error("Image data is not available.");
+
+    return crc32(std::span{ data, vtf.imageTotalSize() });
+  }
+
+  // Whether the image data matches the CRC resource, nullopt if there is none.
+  inline std::optional<bool> verifyImageCRC32(const VTFData& vtf) {
+    const std::optional<uint32_t> expected = vtf.crc32();
+    if (!expected)
+      return std::nullopt;
+
+    return computeImageCRC32(vtf) == *expected;
+  }
+
+  // Checks the CRC resource while the file streams in, in any order.
+  //
+  // Feed it every chunk of the file as it arrives, by file offset. Parts of
+  // chunks outside the high-res image data are ignored. Chunks may come out
+  // of order but must not overlap. Contiguous data is checksummed as it
+  // comes, separate runs are joined with crc32Combine, so nothing is
+  // buffered.
+  class CRC32Verifier {
+  public:
+    // `vtf` only needs the header and resource directory.
+    explicit CRC32Verifier(const VTFData& vtf)
+      : m_expected{ vtf.crc32() }
+      , m_imageOffset{ vtf.imageDataOffset().value_or(0) }
+      , m_imageSize{ vtf.imageTotalSize() } {
+      if (!vtf.imageDataOffset())
+        throw std::runtime_error("VTF has no image data.");
+    }
+
+    void update(uint64_t fileOffset, std::span<const uint8_t> data) {
+      const uint64_t begin = std::max(fileOffset, m_imageOffset);
+      const uint64_t end   = std::min(fileOffset + data.size(), m_imageOffset + m_imageSize);
+      if (begin >= end)
+        return;
+
+      const uint64_t offset = begin - m_imageOffset;
+      const uint64_t size   = end - begin;
+      data = data.subspan(size_t(begin - fileOffset), size_t(size));
+
+      // Extend the run ending where this chunk starts, or start a new one.
+      auto next = m_runs.upper_bound(offset);
+      auto run  = next;
+      if (next != m_runs.begin()) {
+        auto previous = std::prev(next);
+        const uint64_t previousEnd = previous->first + previous->second.size;
+        if (previousEnd > offset)
+          throw std::runtime_error("CRC32 chunks overlap.");
+        if (previousEnd == offset)
+          run = previous;
+      }
+      if (next != m_runs.end() && next->first < offset + size)
+        throw std::runtime_error("CRC32 chunks overlap.");
+
+      if (run == next)
+        run = m_runs.emplace_hint(next, offset, Run{ 0, 0 });
+      run->second.crc   = crc32(data, run->second.crc);
+      run->second.size += size;
+
+      if (next != m_runs.end() && next->first == offset + size) {
+        run->second.crc   = crc32Combine(run->second.crc, next->second.crc, next->second.size);
+        run->second.size += next->second.size;
+        m_runs.erase(next);
+      }
+    }
+
+    // Whether all of the image data has been seen.
+    bool complete() const {
+      if (!m_imageSize)
+        return true;
+      return m_runs.size() == 1 && m_runs.begin()->first == 0 && m_runs.begin()->second.size == m_imageSize;
+    }
+
+    std::optional<uint32_t> expected() const { return m_expected; }
+
+    // CRC-32 of the image data, once complete.
+    std::optional<uint32_t> computed() const {
+      if (!complete())
+        return std::nullopt;
+      return m_runs.empty() ? 0u : m_runs.begin()->second.crc;
+    }
+
+    // nullopt until complete, or if the file has no CRC resource.
+    std::optional<bool> result() const {
+      const std::optional<uint32_t> crc = computed();
+      if (!crc || !m_expected)
+        return std::nullopt;
+      return *crc == *m_expected;
+    }
+
+  private:
+    struct Run {
+      uint32_t crc;
+      uint64_t size;
+    };
+
+    std::optional<uint32_t>  m_expected;
+    uint64_t                 m_imageOffset;
+    uint64_t                 m_imageSize;
+    std::map<uint64_t, Run>  m_runs;
+  };
+
+}
@@ -0,0 +1,1276 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "cpu.hpp"
+#include "threading.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+namespace libvtf {
+
+  // What a block-compressed format decodes to.
+  // Everything decodes to RGBA8 except BC6H which decodes to RGBA16F (half floats).
+  enum class DecodedFormat {
+    RGBA8,
+    RGBA16F,
+  };
+
+  enum class DecodeBackend {
+    Auto,
+    Scalar,
+    SSE2,
+    AVX2,
+  };
+
+  namespace detail {
+
+    enum class BlockCodec {
+      None,
+      BC1,
+      BC2,
+      BC3,
+      BC4,
+      BC5,
+      ATI2N, // BC5 with the channel order of the original ATI2 FourCC (Y block first)
+      BC6H,
+      BC7,
+    };
+
+    constexpr BlockCodec getBlockCodec(ImageFormat format) {
+      switch (format) {
+        case ImageFormats::DXT1:
+        case ImageFormats::DXT1_ONEBITALPHA:
+        case ImageFormats::DXT1_RUNTIME:
+        case ImageFormats::LINEAR_DXT1:
+          return BlockCodec::BC1;
+
+        case ImageFormats::DXT3:
+        case ImageFormats::DXT3_RUNTIME:
+        case ImageFormats::LINEAR_DXT3:
+          return BlockCodec::BC2;
+
+        case ImageFormats::DXT5:
+        case ImageFormats::DXT5_RUNTIME:
+        case ImageFormats::LINEAR_DXT5:
+          return BlockCodec::BC3;
+
+        case ImageFormats::ATI1N:
+        case ImageFormats::VITAMIN_BC4:
+          return BlockCodec::BC4;
+
+        case ImageFormats::ATI2N:
+          return BlockCodec::ATI2N;
+
+        case ImageFormats::VITAMIN_BC5:
+          return BlockCodec::BC5;
+
+        case ImageFormats::VITAMIN_BC6H:
+          return BlockCodec::BC6H;
+
+        case ImageFormats::VITAMIN_BC7:
+          return BlockCodec::BC7;
+
+        default:
+          return BlockCodec::None;
+      }
+    }
+
+    constexpr uint32_t getBlockCodecBlockSize(BlockCodec codec) {
+      switch (codec) {
+        case BlockCodec::BC1:
+        case BlockCodec::BC4:
+          return 8;
+        case BlockCodec::None:
+          return 0;
+        default:
+          return 16;
+      }
+    }
+
+    inline uint16_t loadU16(const uint8_t* data) {
+      uint16_t value;
+      std::memcpy(&value, data, sizeof(value));
+      return value;
+    }
+
+    inline uint32_t loadU32(const uint8_t* data) {
+      uint32_t value;
+      std::memcpy(&value, data, sizeof(value));
+      return value;
+    }
+
+    inline uint64_t loadU64(const uint8_t* data) {
+      uint64_t value;
+      std::memcpy(&value, data, sizeof(value));
+      return value;
+    }
+
+    inline void storeU32(uint8_t* data, uint32_t value) {
+      std::memcpy(data, &value, sizeof(value));
+    }
+
+    constexpr uint32_t packRGBA8(uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+      return r | (g << 8u) | (b << 16u) | (a << 24u);
+    }
+
+    constexpr uint32_t expand565(uint16_t color, uint32_t alpha) {
+      const uint32_t r = (color >> 11) & 0x1f;
+      const uint32_t g = (color >> 5)  & 0x3f;
+      const uint32_t b =  color        & 0x1f;
+      return packRGBA8((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), alpha);
+    }
+
+    //
+    // Shared palette setup. The SIMD kernels only vectorize the
+    // per-pixel index expansion and stores, so every backend produces
+    // bit-identical output.
+    //
+
+    struct ColorBlockPalette {
+      uint32_t colors[4];
+      uint32_t indices; // 2 bits per pixel, row-major
+    };
+
+    // BC1 allows the 3-colour + transparent mode when c0 <= c1,
+    // BC2/BC3 colour blocks are always decoded in 4-colour mode.
+    inline ColorBlockPalette decodeColorPalette(const uint8_t* block, bool allowPunchthrough) {
+      ColorBlockPalette palette;
+
+      const uint16_t c0 = loadU16(block + 0);
+      const uint16_t c1 = loadU16(block + 2);
+      palette.indices = loadU32(block + 4);
+
+      const uint32_t color0 = expand565(c0, 0xff);
+      const uint32_t color1 = expand565(c1, 0xff);
+      palette.colors[0] = color0;
+      palette.colors[1] = color1;
+
+      auto channel = [](uint32_t color, uint32_t shift) { return (color >> shift) & 0xff; };
+
+      if (c0 > c1 || !allowPunchthrough) {
+        uint32_t color2 = 0xff000000u, color3 = 0xff000000u;
+        for (uint32_t shift = 0; shift < 24; shift += 8) {
+          const uint32_t a = channel(color0, shift);
+          const uint32_t b = channel(color1, shift);
+          color2 |= ((2 * a + b) / 3) << shift;
+          color3 |= ((a + 2 * b) / 3) << shift;
+        }
+        palette.colors[2] = color2;
+        palette.colors[3] = color3;
+      } else {
+        uint32_t color2 = 0xff000000u;
+        for (uint32_t shift = 0; shift < 24; shift += 8)
+          color2 |= ((channel(color0, shift) + channel(color1, shift)) / 2) << shift;
+        palette.colors[2] = color2;
+        palette.colors[3] = 0;
+      }
+
+      return palette;
+    }
+
+    struct ChannelBlockPalette {
+      uint8_t  values[8];
+      uint64_t indices; // 3 bits per pixel, row-major
+    };
+
+    // Shared by the BC3 alpha block and BC4/BC5 channel blocks.
+    inline ChannelBlockPalette decodeChannelPalette(const uint8_t* block) {
+      ChannelBlockPalette palette;
+
+      const uint32_t a0 = block[0];
+      const uint32_t a1 = block[1];
+      palette.indices = loadU64(block) >> 16;
+      palette.values[0] = uint8_t(a0);
+      palette.values[1] = uint8_t(a1);
+
+      if (a0 > a1) {
+        for (uint32_t i = 1; i < 7; i++)
+          palette.values[i + 1] = uint8_t((a0 * (7 - i) + a1 * i) / 7);
+      } else {
+        for (uint32_t i = 1; i < 5; i++)
+          palette.values[i + 1] = uint8_t((a0 * (5 - i) + a1 * i) / 5);
+        palette.values[6] = 0;
+        palette.values[7] = 255;
+      }
+
+      return palette;
+    }
+
+    inline void expandChannelBlock(const uint8_t* block, uint8_t (&values)[16]) {
+      const ChannelBlockPalette palette = decodeChannelPalette(block);
+      for (uint32_t i = 0; i < 16; i++)
+        values[i] = palette.values[(palette.indices >> (3 * i)) & 0x7];
+    }
+
+    inline void expandExplicitAlphaBlock(const uint8_t* block, uint8_t (&values)[16]) {
+      const uint64_t bits = loadU64(block);
+      for (uint32_t i = 0; i < 16; i++)
+        values[i] = uint8_t(((bits >> (4 * i)) & 0xf) * 17);
+    }
+
+    //
+    // Scalar block decoders. All of them write a full 4x4 block to dst.
+    //
+
+    inline void decodeBC1Block(const uint8_t* block, uint8_t* dst, size_t pitch) {
+      const ColorBlockPalette palette = decodeColorPalette(block, true);
+      for (uint32_t y = 0; y < 4; y++) {
+        for (uint32_t x = 0; x < 4; x++) {
+          const uint32_t index = (palette.indices >> (2 * (y * 4 + x))) & 0x3;
+          storeU32(dst + y * pitch + x * 4, palette.colors[index]);
+        }
+      }
+    }
+
+    inline void decodeColorWithAlphaBlock(const uint8_t* colorBlock, const uint8_t (&alpha)[16], uint8_t* dst, size_t pitch) {
+      const ColorBlockPalette palette = decodeColorPalette(colorBlock, false);
+      for (uint32_t y = 0; y < 4; y++) {
+        for (uint32_t x = 0; x < 4; x++) {
+          const uint32_t i     = y * 4 + x;
+          const uint32_t index = (palette.indices >> (2 * i)) & 0x3;
+          storeU32(dst + y * pitch + x * 4, (palette.colors[index] & 0x00ffffffu) | (uint32_t(alpha[i]) << 24u));
+        }
+      }
+    }
+
+    inline void decodeBC2Block(const uint8_t* block, uint8_t* dst, size_t pitch) {
+      uint8_t alpha[16];
+      expandExplicitAlphaBlock(block, alpha);
+      decodeColorWithAlphaBlock(block + 8, alpha, dst, pitch);
+    }
+
+    inline void decodeBC3Block(const uint8_t* block, uint8_t* dst, size_t pitch) {
+      uint8_t alpha[16];
+      expandChannelBlock(block, alpha);
+      decodeColorWithAlphaBlock(block + 8, alpha, dst, pitch);
+    }
+
+    inline void decodeBC4Block(const uint8_t* block, uint8_t* dst, size_t pitch) {
+      uint8_t red[16];
+      expandChannelBlock(block, red);
+      for (uint32_t y = 0; y < 4; y++) {
+        for (uint32_t x = 0; x < 4; x++)
+          storeU32(dst + y * pitch + x * 4, packRGBA8(red[y * 4 + x], 0, 0, 0xff));
+      }
+    }
+
+    template <bool SwapChannels>
+    inline void decodeBC5BlockImpl(const uint8_t* block, uint8_t* dst, size_t pitch) {
+      uint8_t first[16], second[16];
+      expandChannelBlock(block + 0, first);
+      expandChannelBlock(block + 8, second);
+      const uint8_t* red   = SwapChannels ? second : first;
+      const uint8_t* green = SwapChannels ? first  : second;
+      for (uint32_t y = 0; y < 4; y++) {
+        for (uint32_t x = 0; x < 4; x++)
+          storeU32(dst + y * pitch + x * 4, packRGBA8(red[y * 4 + x], green[y * 4 + x], 0, 0xff));
+      }
+    }
+
+    inline void decodeBC5Block(const uint8_t* block, uint8_t* dst, size_t pitch) {
+      decodeBC5BlockImpl<false>(block, dst, pitch);
+    }
+
+    inline void decodeATI2NBlock(const uint8_t* block, uint8_t* dst, size_t pitch) {
+      decodeBC5BlockImpl<true>(block, dst, pitch);
+    }
+
+    //
+    // BC6H/BC7 common tables.
+    //
+
+    // Subset 1 mask for each 2-subset partition (bit i = pixel i).
+    static constexpr uint16_t BC7Partitions2[64] = {
+      0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+      0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+      0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+      0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+      0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+      0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+      0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+      0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+    };
+
+    static constexpr uint8_t BC7Partitions3[64][16] = {
+      { 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 1, 2, 2, 2, 2 },
+      { 0, 0, 0, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 2, 1 },
+      { 0, 0, 0, 0, 2, 0, 0, 1, 2, 2, 1, 1, 2, 2, 1, 1 },
+      { 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 0, 1, 1, 1 },
+      { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2 },
+      { 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 2, 2 },
+      { 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1 },
+      { 0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1 },
+      { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2 },
+      { 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2 },
+      { 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2 },
+      { 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2 },
+      { 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2 },
+      { 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2 },
+      { 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2, 1, 2, 2, 2 },
+      { 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0, 2, 2, 2, 0 },
+      { 0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2 },
+      { 0, 1, 1, 1, 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0 },
+      { 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2 },
+      { 0, 0, 2, 2, 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1 },
+      { 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2, 0, 2, 2, 2 },
+      { 0, 0, 0, 1, 0, 0, 0, 1, 2, 2, 2, 1, 2, 2, 2, 1 },
+      { 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2 },
+      { 0, 0, 0, 0, 1, 1, 0, 0, 2, 2, 1, 0, 2, 2, 1, 0 },
+      { 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1, 0, 0, 0, 0 },
+      { 0, 0, 1, 2, 0, 0, 1, 2, 1, 1, 2, 2, 2, 2, 2, 2 },
+      { 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1, 0, 1, 1, 0 },
+      { 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1 },
+      { 0, 0, 2, 2, 1, 1, 0, 2, 1, 1, 0, 2, 0, 0, 2, 2 },
+      { 0, 1, 1, 0, 0, 1, 1, 0, 2, 0, 0, 2, 2, 2, 2, 2 },
+      { 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1 },
+      { 0, 0, 0, 0, 2, 0, 0, 0, 2, 2, 1, 1, 2, 2, 2, 1 },
+      { 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 2, 2, 2 },
+      { 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 2, 0, 0, 1, 1 },
+      { 0, 0, 1, 1, 0, 0, 1, 2, 0, 0, 2, 2, 0, 2, 2, 2 },
+      { 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0 },
+      { 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0 },
+      { 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0 },
+      { 0, 1, 2, 0, 2, 0, 1, 2, 1, 2, 0, 1, 0, 1, 2, 0 },
+      { 0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1 },
+      { 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0, 1, 1 },
+      { 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2 },
+      { 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1 },
+      { 0, 0, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2, 1, 1, 2, 2 },
+      { 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 1, 1 },
+      { 0, 2, 2, 0, 1, 2, 2, 1, 0, 2, 2, 0, 1, 2, 2, 1 },
+      { 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 0, 1, 0, 1 },
+      { 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1 },
+      { 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 },
+      { 0, 2, 2, 2, 0, 1, 1, 1, 0, 2, 2, 2, 0, 1, 1, 1 },
+      { 0, 0, 0, 2, 1, 1, 1, 2, 0, 0, 0, 2, 1, 1, 1, 2 },
+      { 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2 },
+      { 0, 2, 2, 2, 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2 },
+      { 0, 0, 0, 2, 1, 1, 1, 2, 1, 1, 1, 2, 0, 0, 0, 2 },
+      { 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2 },
+      { 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2 },
+      { 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2, 2, 2, 2, 2 },
+      { 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2 },
+      { 0, 0, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2 },
+      { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2 },
+      { 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 1 },
+      { 0, 2, 2, 2, 1, 2, 2, 2, 0, 2, 2, 2, 1, 2, 2, 2 },
+      { 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2 },
+      { 0, 1, 1, 1, 2, 0, 1, 1, 2, 2, 0, 1, 2, 2, 2, 0 },
+    };
+
+    // Anchor index of subset 1 for 2-subset partitions.
+    static constexpr uint8_t BC7Anchors2[64] = {
+      15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+      15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+      15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+       6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+    };
+
+    // Anchor indices of subsets 1 and 2 for 3-subset partitions.
+    static constexpr uint8_t BC7Anchors3a[64] = {
+       3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+       3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+       8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+       3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+    };
+
+    static constexpr uint8_t BC7Anchors3b[64] = {
+      15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+      15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+      15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+      15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+    };
+
+    static constexpr uint8_t BCWeights2[4]  = { 0, 21, 43, 64 };
+    static constexpr uint8_t BCWeights3[8]  = { 0, 9, 18, 27, 37, 46, 55, 64 };
+    static constexpr uint8_t BCWeights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    constexpr const uint8_t* getBCWeights(uint32_t indexBits) {
+      return indexBits == 2 ? BCWeights2 : (indexBits == 3 ? BCWeights3 : BCWeights4);
+    }
+
+    constexpr uint32_t getBC7Subset(uint32_t numSubsets, uint32_t partition, uint32_t pixel) {
+      if (numSubsets == 2)
+        return (BC7Partitions2[partition] >> pixel) & 1;
+      if (numSubsets == 3)
+        return BC7Partitions3[partition][pixel];
+      return 0;
+    }
+
+    constexpr bool isBC7Anchor(uint32_t numSubsets, uint32_t partition, uint32_t pixel) {
+      if (pixel == 0)
+        return true;
+      if (numSubsets == 2)
+        return pixel == BC7Anchors2[partition];
+      if (numSubsets == 3)
+        return pixel == BC7Anchors3a[partition] || pixel == BC7Anchors3b[partition];
+      return false;
+    }
+
+    class BlockBitReader {
+    public:
+      explicit BlockBitReader(const uint8_t* block)
+        : m_lo{ loadU64(block) }
+        , m_hi{ loadU64(block + 8) } {
+      }
+
+      uint32_t read(uint32_t count) {
+        uint64_t value;
+        if (m_position >= 64)
+          value = m_hi >> (m_position - 64);
+        else if (m_position == 0)
+          value = m_lo;
+        else
+          value = (m_lo >> m_position) | (m_hi << (64 - m_position));
+        m_position += count;
+        return uint32_t(value & ((uint64_t(1) << count) - 1));
+      }
+
+      uint32_t position() const { return m_position; }
+      void seek(uint32_t position) { m_position = position; }
+
+    private:
+      uint64_t m_lo;
+      uint64_t m_hi;
+      uint32_t m_position = 0;
+    };
+
+    //
+    // BC7
+    //
+
+    struct BC7ModeInfo {
+      uint8_t numSubsets;
+      uint8_t partitionBits;
+      uint8_t rotationBits;
+      uint8_t indexSelectionBits;
+      uint8_t colorBits;
+      uint8_t alphaBits;
+      uint8_t endpointPBits;
+      uint8_t sharedPBits;
+      uint8_t indexBits;
+      uint8_t indexBits2;
+    };
+
+    static constexpr BC7ModeInfo BC7Modes[8] = {
+      { 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+      { 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+      { 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+      { 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+      { 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+      { 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+      { 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+      { 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+    };
+
+    constexpr uint32_t unquantizeBC7(uint32_t value, uint32_t bits) {
+      value <<= (8 - bits);
+      return value | (value >> bits);
+    }
+
+    inline void decodeBC7Block(const uint8_t* block, uint8_t* dst, size_t pitch) {
+      uint32_t mode = 0;
+      while (mode < 8 && !(block[0] & (1u << mode)))
+        mode++;
+
+      if (mode == 8) {
+        // Reserved mode, decodes to transparent black.
+        for (uint32_t y = 0; y < 4; y++)
+          std::memset(dst + y * pitch, 0, 16);
+        return;
+      }
+
+      const BC7ModeInfo& info = BC7Modes[mode];
+      BlockBitReader bits{ block };
+      bits.seek(mode + 1);
+
+      const uint32_t partition      = bits.read(info.partitionBits);
+      const uint32_t rotation       = bits.read(info.rotationBits);
+      const uint32_t indexSelection = bits.read(info.indexSelectionBits);
+
+      const uint32_t numEndpoints = info.numSubsets * 2;
+      uint32_t endpoints[6][4] = {};
+      for (uint32_t c = 0; c < 3; c++) {
+        for (uint32_t e = 0; e < numEndpoints; e++)
+          endpoints[e][c] = bits.read(info.colorBits);
+      }
+      for (uint32_t e = 0; e < numEndpoints; e++)
+        endpoints[e][3] = info.alphaBits ? bits.read(info.alphaBits) : 255;
+
+      uint32_t pbits[6] = {};
+      if (info.endpointPBits) {
+        for (uint32_t e = 0; e < numEndpoints; e++)
+          pbits[e] = bits.read(1);
+      } else if (info.sharedPBits) {
+        for (uint32_t s = 0; s < info.numSubsets; s++)
+          pbits[s * 2] = pbits[s * 2 + 1] = bits.read(1);
+      }
+
+      const bool     hasPBits   = info.endpointPBits || info.sharedPBits;
+      const uint32_t colorBits  = info.colorBits + (hasPBits ? 1 : 0);
+      const uint32_t alphaBits  = info.alphaBits + (hasPBits ? 1 : 0);
+      for (uint32_t e = 0; e < numEndpoints; e++) {
+        for (uint32_t c = 0; c < 3; c++) {
+          uint32_t value = endpoints[e][c];
+          if (hasPBits)
+            value = (value << 1) | pbits[e];
+          endpoints[e][c] = unquantizeBC7(value, colorBits);
+        }
+        if (info.alphaBits) {
+          uint32_t value = endpoints[e][3];
+          if (hasPBits)
+            value = (value << 1) | pbits[e];
+          endpoints[e][3] = unquantizeBC7(value, alphaBits);
+        }
+      }
+
+      uint32_t indices[16];
+      for (uint32_t i = 0; i < 16; i++)
+        indices[i] = bits.read(info.indexBits - (isBC7Anchor(info.numSubsets, partition, i) ? 1 : 0));
+
+      uint32_t indices2[16] = {};
+      if (info.indexBits2) {
+        for (uint32_t i = 0; i < 16; i++)
+          indices2[i] = bits.read(info.indexBits2 - (i == 0 ? 1 : 0));
+      }
+
+      const uint8_t* colorWeights = getBCWeights(info.indexBits);
+      const uint8_t* alphaWeights = colorWeights;
+      const uint32_t* colorIndices = indices;
+      const uint32_t* alphaIndices = indices;
+      if (info.indexBits2) {
+        alphaWeights = getBCWeights(info.indexBits2);
+        alphaIndices = indices2;
+        if (indexSelection) {
+          std::swap(colorWeights, alphaWeights);
+          std::swap(colorIndices, alphaIndices);
+        }
+      }
+
+      for (uint32_t i = 0; i < 16; i++) {
+        const uint32_t subset = getBC7Subset(info.numSubsets, partition, i);
+        const uint32_t* e0 = endpoints[subset * 2 + 0];
+        const uint32_t* e1 = endpoints[subset * 2 + 1];
+
+        uint32_t rgba[4];
+        const uint32_t cw = colorWeights[colorIndices[i]];
+        const uint32_t aw = alphaWeights[alphaIndices[i]];
+        for (uint32_t c = 0; c < 3; c++)
+          rgba[c] = (e0[c] * (64 - cw) + e1[c] * cw + 32) >> 6;
+        rgba[3] = (e0[3] * (64 - aw) + e1[3] * aw + 32) >> 6;
+
+        if (rotation)
+          std::swap(rgba[3], rgba[rotation - 1]);
+
+        storeU32(dst + (i / 4) * pitch + (i % 4) * 4, packRGBA8(rgba[0], rgba[1], rgba[2], rgba[3]));
+      }
+    }
+
+    //
+    // BC6H (unsigned half floats)
+    //
+
+    enum BC6HComponent : uint8_t {
+      BC6H_RW, BC6H_GW, BC6H_BW,
+      BC6H_RX, BC6H_GX, BC6H_BX,
+      BC6H_RY, BC6H_GY, BC6H_BY,
+      BC6H_RZ, BC6H_GZ, BC6H_BZ,
+    };
+
+    struct BC6HField {
+      BC6HComponent component;
+      uint8_t       firstBit;
+      uint8_t       numBits;
+      bool          reversed = false;
+    };
+
+    struct BC6HModeInfo {
+      std::span<const BC6HField> fields;
+      bool    transformed;
+      uint8_t endpointBits;
+      uint8_t deltaBits[3];
+      bool    twoSubsets;
+    };
+
+    static constexpr BC6HField BC6HMode1[] = {
+      { BC6H_GY, 4, 1 }, { BC6H_BY, 4, 1 }, { BC6H_BZ, 4, 1 }, { BC6H_RW, 0, 10 }, { BC6H_GW, 0, 10 }, { BC6H_BW, 0, 10 },
+      { BC6H_RX, 0, 5 }, { BC6H_GZ, 4, 1 }, { BC6H_GY, 0, 4 }, { BC6H_GX, 0, 5 }, { BC6H_BZ, 0, 1 }, { BC6H_GZ, 0, 4 },
+      { BC6H_BX, 0, 5 }, { BC6H_BZ, 1, 1 }, { BC6H_BY, 0, 4 }, { BC6H_RY, 0, 5 }, { BC6H_BZ, 2, 1 }, { BC6H_RZ, 0, 5 },
+      { BC6H_BZ, 3, 1 },
+    };
+    static constexpr BC6HField BC6HMode2[] = {
+      { BC6H_GY, 5, 1 }, { BC6H_GZ, 4, 1 }, { BC6H_GZ, 5, 1 }, { BC6H_RW, 0, 7 }, { BC6H_BZ, 0, 1 }, { BC6H_BZ, 1, 1 },
+      { BC6H_BY, 4, 1 }, { BC6H_GW, 0, 7 }, { BC6H_BY, 5, 1 }, { BC6H_BZ, 2, 1 }, { BC6H_GY, 4, 1 }, { BC6H_BW, 0, 7 },
+      { BC6H_BZ, 3, 1 }, { BC6H_BZ, 5, 1 }, { BC6H_BZ, 4, 1 }, { BC6H_RX, 0, 6 }, { BC6H_GY, 0, 4 }, { BC6H_GX, 0, 6 },
+      { BC6H_GZ, 0, 4 }, { BC6H_BX, 0, 6 }, { BC6H_BY, 0, 4 }, { BC6H_RY, 0, 6 }, { BC6H_RZ, 0, 6 },
+    };
+    static constexpr BC6HField BC6HMode3[] = {
+      { BC6H_RW, 0, 10 }, { BC6H_GW, 0, 10 }, { BC6H_BW, 0, 10 }, { BC6H_RX, 0, 5 }, { BC6H_RW, 10, 1 }, { BC6H_GY, 0, 4 },
+      { BC6H_GX, 0, 4 }, { BC6H_GW, 10, 1 }, { BC6H_BZ, 0, 1 }, { BC6H_GZ, 0, 4 }, { BC6H_BX, 0, 4 }, { BC6H_BW, 10, 1 },
+      { BC6H_BZ, 1, 1 }, { BC6H_BY, 0, 4 }, { BC6H_RY, 0, 5 }, { BC6H_BZ, 2, 1 }, { BC6H_RZ, 0, 5 }, { BC6H_BZ, 3, 1 },
+    };
+    static constexpr BC6HField BC6HMode4[] = {
+      { BC6H_RW, 0, 10 }, { BC6H_GW, 0, 10 }, { BC6H_BW, 0, 10 }, { BC6H_RX, 0, 4 }, { BC6H_RW, 10, 1 }, { BC6H_GZ, 4, 1 },
+      { BC6H_GY, 0, 4 }, { BC6H_GX, 0, 5 }, { BC6H_GW, 10, 1 }, { BC6H_GZ, 0, 4 }, { BC6H_BX, 0, 4 }, { BC6H_BW, 10, 1 },
+      { BC6H_BZ, 1, 1 }, { BC6H_BY, 0, 4 }, { BC6H_RY, 0, 4 }, { BC6H_BZ, 0, 1 }, { BC6H_BZ, 2, 1 }, { BC6H_RZ, 0, 4 },
+      { BC6H_GY, 4, 1 }, { BC6H_BZ, 3, 1 },
+    };
+    static constexpr BC6HField BC6HMode5[] = {
+      { BC6H_RW, 0, 10 }, { BC6H_GW, 0, 10 }, { BC6H_BW, 0, 10 }, { BC6H_RX, 0, 4 }, { BC6H_RW, 10, 1 }, { BC6H_BY, 4, 1 },
+      { BC6H_GY, 0, 4 }, { BC6H_GX, 0, 4 }, { BC6H_GW, 10, 1 }, { BC6H_BZ, 0, 1 }, { BC6H_GZ, 0, 4 }, { BC6H_BX, 0, 5 },
+      { BC6H_BW, 10, 1 }, { BC6H_BY, 0, 4 }, { BC6H_RY, 0, 4 }, { BC6H_BZ, 1, 1 }, { BC6H_BZ, 2, 1 }, { BC6H_RZ, 0, 4 },
+      { BC6H_BZ, 4, 1 }, { BC6H_BZ, 3, 1 },
+    };
+    static constexpr BC6HField BC6HMode6[] = {
+      { BC6H_RW, 0, 9 }, { BC6H_BY, 4, 1 }, { BC6H_GW, 0, 9 }, { BC6H_GY, 4, 1 }, { BC6H_BW, 0, 9 }, { BC6H_BZ, 4, 1 },
+      { BC6H_RX, 0, 5 }, { BC6H_GZ, 4, 1 }, { BC6H_GY, 0, 4 }, { BC6H_GX, 0, 5 }, { BC6H_BZ, 0, 1 }, { BC6H_GZ, 0, 4 },
+      { BC6H_BX, 0, 5 }, { BC6H_BZ, 1, 1 }, { BC6H_BY, 0, 4 }, { BC6H_RY, 0, 5 }, { BC6H_BZ, 2, 1 }, { BC6H_RZ, 0, 5 },
+      { BC6H_BZ, 3, 1 },
+    };
+    static constexpr BC6HField BC6HMode7[] = {
+      { BC6H_RW, 0, 8 }, { BC6H_GZ, 4, 1 }, { BC6H_BY, 4, 1 }, { BC6H_GW, 0, 8 }, { BC6H_BZ, 2, 1 }, { BC6H_GY, 4, 1 },
+      { BC6H_BW, 0, 8 }, { BC6H_BZ, 3, 1 }, { BC6H_BZ, 4, 1 }, { BC6H_RX, 0, 6 }, { BC6H_GY, 0, 4 }, { BC6H_GX, 0, 5 },
+      { BC6H_BZ, 0, 1 }, { BC6H_GZ, 0, 4 }, { BC6H_BX, 0, 5 }, { BC6H_BZ, 1, 1 }, { BC6H_BY, 0, 4 }, { BC6H_RY, 0, 6 },
+      { BC6H_RZ, 0, 6 },
+    };
+    static constexpr BC6HField BC6HMode8[] = {
+      { BC6H_RW, 0, 8 }, { BC6H_BZ, 0, 1 }, { BC6H_BY, 4, 1 }, { BC6H_GW, 0, 8 }, { BC6H_GY, 5, 1 }, { BC6H_GY, 4, 1 },
+      { BC6H_BW, 0, 8 }, { BC6H_GZ, 5, 1 }, { BC6H_BZ, 4, 1 }, { BC6H_RX, 0, 5 }, { BC6H_GZ, 4, 1 }, { BC6H_GY, 0, 4 },
+      { BC6H_GX, 0, 6 }, { BC6H_GZ, 0, 4 }, { BC6H_BX, 0, 5 }, { BC6H_BZ, 1, 1 }, { BC6H_BY, 0, 4 }, { BC6H_RY, 0, 5 },
+      { BC6H_BZ, 2, 1 }, { BC6H_RZ, 0, 5 }, { BC6H_BZ, 3, 1 },
+    };
+    static constexpr BC6HField BC6HMode9[] = {
+      { BC6H_RW, 0, 8 }, { BC6H_BZ, 1, 1 }, { BC6H_BY, 4, 1 }, { BC6H_GW, 0, 8 }, { BC6H_BY, 5, 1 }, { BC6H_GY, 4, 1 },
+      { BC6H_BW, 0, 8 }, { BC6H_BZ, 5, 1 }, { BC6H_BZ, 4, 1 }, { BC6H_RX, 0, 5 }, { BC6H_GZ, 4, 1 }, { BC6H_GY, 0, 4 },
+      { BC6H_GX, 0, 5 }, { BC6H_BZ, 0, 1 }, { BC6H_GZ, 0, 4 }, { BC6H_BX, 0, 6 }, { BC6H_BY, 0, 4 }, { BC6H_RY, 0, 5 },
+      { BC6H_BZ, 2, 1 }, { BC6H_RZ, 0, 5 }, { BC6H_BZ, 3, 1 },
+    };
+    static constexpr BC6HField BC6HMode10[] = {
+      { BC6H_RW, 0, 6 }, { BC6H_GZ, 4, 1 }, { BC6H_BZ, 0, 1 }, { BC6H_BZ, 1, 1 }, { BC6H_BY, 4, 1 }, { BC6H_GW, 0, 6 },
+      { BC6H_GY, 5, 1 }, { BC6H_BY, 5, 1 }, { BC6H_BZ, 2, 1 }, { BC6H_GY, 4, 1 }, { BC6H_BW, 0, 6 }, { BC6H_GZ, 5, 1 },
+      { BC6H_BZ, 3, 1 }, { BC6H_BZ, 5, 1 }, { BC6H_BZ, 4, 1 }, { BC6H_RX, 0, 6 }, { BC6H_GY, 0, 4 }, { BC6H_GX, 0, 6 },
+      { BC6H_GZ, 0, 4 }, { BC6H_BX, 0, 6 }, { BC6H_BY, 0, 4 }, { BC6H_RY, 0, 6 }, { BC6H_RZ, 0, 6 },
+    };
+    static constexpr BC6HField BC6HMode11[] = {
+      { BC6H_RW, 0, 10 }, { BC6H_GW, 0, 10 }, { BC6H_BW, 0, 10 }, { BC6H_RX, 0, 10 }, { BC6H_GX, 0, 10 }, { BC6H_BX, 0, 10 },
+    };
+    static constexpr BC6HField BC6HMode12[] = {
+      { BC6H_RW, 0, 10 }, { BC6H_GW, 0, 10 }, { BC6H_BW, 0, 10 }, { BC6H_RX, 0, 9 }, { BC6H_RW, 10, 1 }, { BC6H_GX, 0, 9 },
+      { BC6H_GW, 10, 1 }, { BC6H_BX, 0, 9 }, { BC6H_BW, 10, 1 },
+    };
+    static constexpr BC6HField BC6HMode13[] = {
+      { BC6H_RW, 0, 10 }, { BC6H_GW, 0, 10 }, { BC6H_BW, 0, 10 }, { BC6H_RX, 0, 8 }, { BC6H_RW, 10, 2, true }, { BC6H_GX, 0, 8 },
+      { BC6H_GW, 10, 2, true }, { BC6H_BX, 0, 8 }, { BC6H_BW, 10, 2, true },
+    };
+    static constexpr BC6HField BC6HMode14[] = {
+      { BC6H_RW, 0, 10 }, { BC6H_GW, 0, 10 }, { BC6H_BW, 0, 10 }, { BC6H_RX, 0, 4 }, { BC6H_RW, 10, 6, true }, { BC6H_GX, 0, 4 },
+      { BC6H_GW, 10, 6, true }, { BC6H_BX, 0, 4 }, { BC6H_BW, 10, 6, true },
+    };
+
+    // Indexed by the 5-bit mode value (2-bit for modes 1 and 2).
+    inline const BC6HModeInfo* getBC6HMode(uint32_t mode) {
+      static constexpr BC6HModeInfo Modes[] = {
+        { BC6HMode1,  true,  10, {  5,  5,  5 }, true  },
+        { BC6HMode2,  true,   7, {  6,  6,  6 }, true  },
+        { BC6HMode3,  true,  11, {  5,  4,  4 }, true  },
+        { BC6HMode4,  true,  11, {  4,  5,  4 }, true  },
+        { BC6HMode5,  true,  11, {  4,  4,  5 }, true  },
+        { BC6HMode6,  true,   9, {  5,  5,  5 }, true  },
+        { BC6HMode7,  true,   8, {  6,  5,  5 }, true  },
+        { BC6HMode8,  true,   8, {  5,  6,  5 }, true  },
+        { BC6HMode9,  true,   8, {  5,  5,  6 }, true  },
+        { BC6HMode10, false,  6, {  6,  6,  6 }, true  },
+        { BC6HMode11, false, 10, { 10, 10, 10 }, false },
+        { BC6HMode12, true,  11, {  9,  9,  9 }, false },
+        { BC6HMode13, true,  12, {  8,  8,  8 }, false },
+        { BC6HMode14, true,  16, {  4,  4,  4 }, false },
+      };
+
+      switch (mode) {
+        case 0x00: return &Modes[0];
+        case 0x01: return &Modes[1];
+        case 0x02: return &Modes[2];
+        case 0x06: return &Modes[3];
+        case 0x0a: return &Modes[4];
+        case 0x0e: return &Modes[5];
+        case 0x12: return &Modes[6];
+        case 0x16: return &Modes[7];
+        case 0x1a: return &Modes[8];
+        case 0x1e: return &Modes[9];
+        case 0x03: return &Modes[10];
+        case 0x07: return &Modes[11];
+        case 0x0b: return &Modes[12];
+        case 0x0f: return &Modes[13];
+        default:   return nullptr;
+      }
+    }
+
+    constexpr int32_t signExtend(uint32_t value, uint32_t bits) {
+      const uint32_t signBit = 1u << (bits - 1);
+      return int32_t((value ^ signBit) - signBit);
+    }
+
+    constexpr int32_t unquantizeBC6H(int32_t value, uint32_t bits) {
+      if (bits >= 15)
+        return value;
+      if (value == 0)
+        return 0;
+      if (value == int32_t((1u << bits) - 1))
+        return 0xffff;
+      return ((value << 16) + 0x8000) >> bits;
+    }
+
+    inline void decodeBC6HBlock(const uint8_t* block, uint8_t* dst, size_t pitch) {
+      BlockBitReader bits{ block };
+      uint32_t mode = bits.read(2);
+      if (mode > 1)
+        mode |= bits.read(3) << 2;
+
+      const BC6HModeInfo* info = getBC6HMode(mode);
+      if (!info) {
+        // Reserved mode, decodes to black.
+        for (uint32_t y = 0; y < 4; y++) {
+          for (uint32_t x = 0; x < 4; x++) {
+            const uint16_t pixel[4] = { 0, 0, 0, 0x3c00 };
+            std::memcpy(dst + y * pitch + x * 8, pixel, sizeof(pixel));
+          }
+        }
+        return;
+      }
+
+      uint32_t components[12] = {};
+      for (const BC6HField& field : info->fields) {
+        for (uint32_t i = 0; i < field.numBits; i++) {
+          const uint32_t bit = field.reversed ? field.firstBit + field.numBits - 1 - i : field.firstBit + i;
+          components[field.component] |= bits.read(1) << bit;
+        }
+      }
+
+      const uint32_t numSubsets   = info->twoSubsets ? 2 : 1;
+      const uint32_t partition    = info->twoSubsets ? bits.read(5) : 0;
+      const uint32_t endpointBits = info->endpointBits;
+      const uint32_t endpointMask = (1u << endpointBits) - 1;
+
+      int32_t endpoints[4][3];
+      for (uint32_t c = 0; c < 3; c++) {
+        endpoints[0][c] = int32_t(components[BC6H_RW + c]);
+        for (uint32_t e = 1; e < numSubsets * 2; e++) {
+          const uint32_t value = components[e * 3 + c];
+          if (info->transformed)
+            endpoints[e][c] = int32_t((uint32_t(endpoints[0][c]) + uint32_t(signExtend(value, info->deltaBits[c]))) & endpointMask);
+          else
+            endpoints[e][c] = int32_t(value);
+        }
+      }
+
+      for (uint32_t e = 0; e < numSubsets * 2; e++) {
+        for (uint32_t c = 0; c < 3; c++)
+          endpoints[e][c] = unquantizeBC6H(endpoints[e][c], endpointBits);
+      }
+
+      const uint32_t indexBits = info->twoSubsets ? 3 : 4;
+      const uint8_t* weights   = getBCWeights(indexBits);
+      for (uint32_t i = 0; i < 16; i++) {
+        const uint32_t index  = bits.read(indexBits - (isBC7Anchor(numSubsets, partition, i) ? 1 : 0));
+        const uint32_t subset = getBC7Subset(numSubsets, partition, i);
+        const int32_t* e0     = endpoints[subset * 2 + 0];
+        const int32_t* e1     = endpoints[subset * 2 + 1];
+        const int32_t  w      = weights[index];
+
+        uint16_t pixel[4];
+        for (uint32_t c = 0; c < 3; c++) {
+          const int32_t value = (e0[c] * (64 - w) + e1[c] * w + 32) >> 6;
+          pixel[c] = uint16_t((value * 31) >> 6);
+        }
+        pixel[3] = 0x3c00;
+        std::memcpy(dst + (i / 4) * pitch + (i % 4) * 8, pixel, sizeof(pixel));
+      }
+    }
+
+    //
+    // Row kernels: decode `numBlocks` horizontally adjacent full blocks.
+    //
+
+    using BlockDecodeFn = void (*)(const uint8_t* block, uint8_t* dst, size_t pitch);
+    using RowKernelFn   = void (*)(const uint8_t* src, uint32_t numBlocks, uint8_t* dst, size_t pitch);
+
+    template <BlockDecodeFn DecodeBlock, uint32_t BlockSize, uint32_t PixelSize>
+    inline void scalarRowKernel(const uint8_t* src, uint32_t numBlocks, uint8_t* dst, size_t pitch) {
+      for (uint32_t i = 0; i < numBlocks; i++)
+        DecodeBlock(src + i * BlockSize, dst + i * 4 * PixelSize, pitch);
+    }
+
+#if defined(LIBVTF_X86)
+
+    inline __m128i expandChannelRowSSE2(const uint8_t* values, uint32_t shift) {
+      const __m128i zero = _mm_setzero_si128();
+      __m128i row = _mm_cvtsi32_si128(int(loadU32(values)));
+      row = _mm_unpacklo_epi8(row, zero);
+      row = _mm_unpacklo_epi16(row, zero);
+      return _mm_sll_epi32(row, _mm_cvtsi32_si128(int(shift)));
+    }
+
+    // Writes a 4x4 block from a colour palette. If alpha is non-null,
+    // it replaces the palette's alpha channel.
+    inline void storeColorBlockSSE2(const ColorBlockPalette& palette, const uint8_t* alpha, uint8_t* dst, size_t pitch) {
+      const __m128i c0 = _mm_set1_epi32(int(palette.colors[0]));
+      const __m128i c1 = _mm_set1_epi32(int(palette.colors[1]));
+      const __m128i c2 = _mm_set1_epi32(int(palette.colors[2]));
+      const __m128i c3 = _mm_set1_epi32(int(palette.colors[3]));
+      const __m128i zero  = _mm_setzero_si128();
+      const __m128i one   = _mm_set1_epi32(1);
+      const __m128i two   = _mm_set1_epi32(2);
+      const __m128i three = _mm_set1_epi32(3);
+      // Moves the 2-bit index of pixel x into bits [6:7] of lane x.
+      const __m128i shifts = _mm_setr_epi32(64, 16, 4, 1);
+      const __m128i rgbMask = _mm_set1_epi32(0x00ffffff);
+
+      for (uint32_t y = 0; y < 4; y++) {
+        const __m128i rowBits = _mm_set1_epi32(int((palette.indices >> (8 * y)) & 0xff));
+        const __m128i index   = _mm_and_si128(_mm_srli_epi32(_mm_mullo_epi16(rowBits, shifts), 6), three);
+
+        __m128i pixels = _mm_and_si128(_mm_cmpeq_epi32(index, zero), c0);
+        pixels = _mm_or_si128(pixels, _mm_and_si128(_mm_cmpeq_epi32(index, one),   c1));
+        pixels = _mm_or_si128(pixels, _mm_and_si128(_mm_cmpeq_epi32(index, two),   c2));
+        pixels = _mm_or_si128(pixels, _mm_and_si128(_mm_cmpeq_epi32(index, three), c3));
+
+        if (alpha)
+          pixels = _mm_or_si128(_mm_and_si128(pixels, rgbMask), expandChannelRowSSE2(alpha + y * 4, 24));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + y * pitch), pixels);
+      }
+    }
+
+    inline void rowKernelBC1SSE2(const uint8_t* src, uint32_t numBlocks, uint8_t* dst, size_t pitch) {
+      for (uint32_t i = 0; i < numBlocks; i++)
+        storeColorBlockSSE2(decodeColorPalette(src + i * 8, true), nullptr, dst + i * 16, pitch);
+    }
+
+    inline void rowKernelBC2SSE2(const uint8_t* src, uint32_t numBlocks, uint8_t* dst, size_t pitch) {
+      for (uint32_t i = 0; i < numBlocks; i++) {
+        uint8_t alpha[16];
+        expandExplicitAlphaBlock(src + i * 16, alpha);
+        storeColorBlockSSE2(decodeColorPalette(src + i * 16 + 8, false), alpha, dst + i * 16, pitch);
+      }
+    }
+
+    inline void rowKernelBC3SSE2(const uint8_t* src, uint32_t numBlocks, uint8_t* dst, size_t pitch) {
+      for (uint32_t i = 0; i < numBlocks; i++) {
+        uint8_t alpha[16];
+        expandChannelBlock(src + i * 16, alpha);
+        storeColorBlockSSE2(decodeColorPalette(src + i * 16 + 8, false), alpha, dst + i * 16, pitch);
+      }
+    }
+
+    inline void rowKernelBC4SSE2(const uint8_t* src, uint32_t numBlocks, uint8_t* dst, size_t pitch) {
+      const __m128i opaque = _mm_set1_epi32(int(0xff000000u));
+      for (uint32_t i = 0; i < numBlocks; i++) {
+        uint8_t red[16];
+        expandChannelBlock(src + i * 8, red);
+        for (uint32_t y = 0; y < 4; y++) {
+          const __m128i pixels = _mm_or_si128(opaque, expandChannelRowSSE2(red + y * 4, 0));
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 16 + y * pitch), pixels);
+        }
+      }
+    }
+
+    template <bool SwapChannels>
+    inline void rowKernelBC5SSE2(const uint8_t* src, uint32_t numBlocks, uint8_t* dst, size_t pitch) {
+      const __m128i opaque = _mm_set1_epi32(int(0xff000000u));
+      for (uint32_t i = 0; i < numBlocks; i++) {
+        uint8_t first[16], second[16];
+        expandChannelBlock(src + i * 16 + 0, first);
+        expandChannelBlock(src + i * 16 + 8, second);
+        const uint8_t* red   = SwapChannels ? second : first;
+        const uint8_t* green = SwapChannels ? first  : second;
+        for (uint32_t y = 0; y < 4; y++) {
+          __m128i pixels = _mm_or_si128(opaque, expandChannelRowSSE2(red + y * 4, 0));
+          pixels = _mm_or_si128(pixels, expandChannelRowSSE2(green + y * 4, 8));
+          _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 16 + y * pitch), pixels);
+        }
+      }
+    }
+
+    //
+    // AVX2 kernels decode two horizontally adjacent blocks per iteration,
+    // so every row is a single contiguous 32-byte store.
+    //
+
+    LIBVTF_TARGET_AVX2 inline __m256i loadColorPalettePairAVX2(const ColorBlockPalette& a, const ColorBlockPalette& b) {
+      return _mm256_setr_epi32(
+        int(a.colors[0]), int(a.colors[1]), int(a.colors[2]), int(a.colors[3]),
+        int(b.colors[0]), int(b.colors[1]), int(b.colors[2]), int(b.colors[3]));
+    }
+
+    // Palette lookup for row y of two colour blocks, lanes 0-3 are block a.
+    LIBVTF_TARGET_AVX2 inline __m256i lookupColorRowAVX2(__m256i palette, uint32_t indicesA, uint32_t indicesB, uint32_t y) {
+      const __m256i shifts = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+      const __m256i offset = _mm256_setr_epi32(0, 0, 0, 0, 4, 4, 4, 4);
+      const __m256i rowBits = _mm256_setr_epi32(
+        int((indicesA >> (8 * y)) & 0xff), int((indicesA >> (8 * y)) & 0xff), int((indicesA >> (8 * y)) & 0xff), int((indicesA >> (8 * y)) & 0xff),
+        int((indicesB >> (8 * y)) & 0xff), int((indicesB >> (8 * y)) & 0xff), int((indicesB >> (8 * y)) & 0xff), int((indicesB >> (8 * y)) & 0xff));
+      __m256i index = _mm256_and_si256(_mm256_srlv_epi32(rowBits, shifts), _mm256_set1_epi32(3));
+      index = _mm256_add_epi32(index, offset);
+      return _mm256_permutevar8x32_epi32(palette, index);
+    }
+
+    LIBVTF_TARGET_AVX2 inline __m256i loadChannelPaletteAVX2(const ChannelBlockPalette& palette, uint32_t shift) {
+      return _mm256_setr_epi32(
+        int(uint32_t(palette.values[0]) << shift), int(uint32_t(palette.values[1]) << shift),
+        int(uint32_t(palette.values[2]) << shift), int(uint32_t(palette.values[3]) << shift),
+        int(uint32_t(palette.values[4]) << shift), int(uint32_t(palette.values[5]) << shift),
+        int(uint32_t(palette.values[6]) << shift), int(uint32_t(palette.values[7]) << shift));
+    }
+
+    // Palette lookup for row y of two BC3/BC4 channel blocks, with the
+    // palette entries pre-shifted into their destination byte.
+    LIBVTF_TARGET_AVX2 inline __m256i lookupChannelRowAVX2(__m256i paletteA, __m256i paletteB, uint64_t indicesA, uint64_t indicesB, uint32_t y) {
+      const __m256i shifts = _mm256_setr_epi32(0, 3, 6, 9, 0, 3, 6, 9);
+      const int rowA = int((indicesA >> (12 * y)) & 0xfff);
+      const int rowB = int((indicesB >> (12 * y)) & 0xfff);
+      const __m256i rowBits = _mm256_setr_epi32(rowA, rowA, rowA, rowA, rowB, rowB, rowB, rowB);
+      const __m256i index = _mm256_and_si256(_mm256_srlv_epi32(rowBits, shifts), _mm256_set1_epi32(7));
+      return _mm256_blend_epi32(
+        _mm256_permutevar8x32_epi32(paletteA, index),
+        _mm256_permutevar8x32_epi32(paletteB, index), 0xf0);
+    }
+
+    LIBVTF_TARGET_AVX2 inline __m256i lookupExplicitAlphaRowAVX2(const uint8_t* blockA, const uint8_t* blockB, uint32_t y) {
+      const __m256i shifts = _mm256_setr_epi32(0, 4, 8, 12, 0, 4, 8, 12);
+      const int rowA = int(loadU16(blockA + y * 2));
+      const int rowB = int(loadU16(blockB + y * 2));
+      const __m256i rowBits = _mm256_setr_epi32(rowA, rowA, rowA, rowA, rowB, rowB, rowB, rowB);
+      const __m256i alpha = _mm256_and_si256(_mm256_srlv_epi32(rowBits, shifts), _mm256_set1_epi32(0xf));
+      return _mm256_slli_epi32(_mm256_or_si256(alpha, _mm256_slli_epi32(alpha, 4)), 24);
+    }
+
+    LIBVTF_TARGET_AVX2 inline void rowKernelBC1AVX2(const uint8_t* src, uint32_t numBlocks, uint8_t* dst, size_t pitch) {
+      uint32_t i = 0;
+      for (; i + 2 <= numBlocks; i += 2) {
+        const ColorBlockPalette a = decodeColorPalette(src + (i + 0) * 8, true);
+        const ColorBlockPalette b = decodeColorPalette(src + (i + 1) * 8, true);
+        const __m256i palette = loadColorPalettePairAVX2(a, b);
+        for (uint32_t y = 0; y < 4; y++)
+          _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 16 + y * pitch), lookupColorRowAVX2(palette, a.indices, b.indices, y));
+      }
+      rowKernelBC1SSE2(src + i * 8, numBlocks - i, dst + i * 16, pitch);
+    }
+
+    LIBVTF_TARGET_AVX2 inline void rowKernelBC2AVX2(const uint8_t* src, uint32_t numBlocks, uint8_t* dst, size_t pitch) {
+      const __m256i rgbMask = _mm256_set1_epi32(0x00ffffff);
+      uint32_t i = 0;
+      for (; i + 2 <= numBlocks; i += 2) {
+        const uint8_t* blockA = src + (i + 0) * 16;
+        const uint8_t* blockB = src + (i + 1) * 16;
+        const ColorBlockPalette a = decodeColorPalette(blockA + 8, false);
+        const ColorBlockPalette b = decodeColorPalette(blockB + 8, false);
+        const __m256i palette = _mm256_and_si256(loadColorPalettePairAVX2(a, b), rgbMask);
+        for (uint32_t y = 0; y < 4; y++) {
+          const __m256i pixels = _mm256_or_si256(
+            lookupColorRowAVX2(palette, a.indices, b.indices, y),
+            lookupExplicitAlphaRowAVX2(blockA, blockB, y));
+          _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 16 + y * pitch), pixels);
+        }
+      }
+      rowKernelBC2SSE2(src + i * 16, numBlocks - i, dst + i * 16, pitch);
+    }
+
+    LIBVTF_TARGET_AVX2 inline void rowKernelBC3AVX2(const uint8_t* src, uint32_t numBlocks, uint8_t* dst, size_t pitch) {
+      const __m256i rgbMask = _mm256_set1_epi32(0x00ffffff);
+      uint32_t i = 0;
+      for (; i + 2 <= numBlocks; i += 2) {
+        const uint8_t* blockA = src + (i + 0) * 16;
+        const uint8_t* blockB = src + (i + 1) * 16;
+        const ChannelBlockPalette alphaA = decodeChannelPalette(blockA);
+        const ChannelBlockPalette alphaB = decodeChannelPalette(blockB);
+        const ColorBlockPalette a = decodeColorPalette(blockA + 8, false);
+        const ColorBlockPalette b = decodeColorPalette(blockB + 8, false);
+        const __m256i palette      = _mm256_and_si256(loadColorPalettePairAVX2(a, b), rgbMask);
+        const __m256i alphaPaletteA = loadChannelPaletteAVX2(alphaA, 24);
+        const __m256i alphaPaletteB = loadChannelPaletteAVX2(alphaB, 24);
+        for (uint32_t y = 0; y < 4; y++) {
+          const __m256i pixels = _mm256_or_si256(
+            lookupColorRowAVX2(palette, a.indices, b.indices, y),
+            lookupChannelRowAVX2(alphaPaletteA, alphaPaletteB, alphaA.indices, alphaB.indices, y));
+          _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 16 + y * pitch), pixels);
+        }
+      }
+      rowKernelBC3SSE2(src + i * 16, numBlocks - i, dst + i * 16, pitch);
+    }
+
+    LIBVTF_TARGET_AVX2 inline void rowKernelBC4AVX2(const uint8_t* src, uint32_t numBlocks, uint8_t* dst, size_t pitch) {
+      const __m256i opaque = _mm256_set1_epi32(int(0xff000000u));
+      uint32_t i = 0;
+      for (; i + 2 <= numBlocks; i += 2) {
+        const ChannelBlockPalette a = decodeChannelPalette(src + (i + 0) * 8);
+        const ChannelBlockPalette b = decodeChannelPalette(src + (i + 1) * 8);
+        const __m256i paletteA = loadChannelPaletteAVX2(a, 0);
+        const __m256i paletteB = loadChannelPaletteAVX2(b, 0);
+        for (uint32_t y = 0; y < 4; y++) {
+          const __m256i pixels = _mm256_or_si256(opaque, lookupChannelRowAVX2(paletteA, paletteB, a.indices, b.indices, y));
+          _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 16 + y * pitch), pixels);
+        }
+      }
+      rowKernelBC4SSE2(src + i * 8, numBlocks - i, dst + i * 16, pitch);
+    }
+
+    template <bool SwapChannels>
+    LIBVTF_TARGET_AVX2 inline void rowKernelBC5AVX2(const uint8_t* src, uint32_t numBlocks, uint8_t* dst, size_t pitch) {
+      const __m256i opaque = _mm256_set1_epi32(int(0xff000000u));
+      const uint32_t redOffset   = SwapChannels ? 8 : 0;
+      const uint32_t greenOffset = SwapChannels ? 0 : 8;
+      uint32_t i = 0;
+      for (; i + 2 <= numBlocks; i += 2) {
+        const uint8_t* blockA = src + (i + 0) * 16;
+        const uint8_t* blockB = src + (i + 1) * 16;
+        const ChannelBlockPalette redA   = decodeChannelPalette(blockA + redOffset);
+        const ChannelBlockPalette redB   = decodeChannelPalette(blockB + redOffset);
+        const ChannelBlockPalette greenA = decodeChannelPalette(blockA + greenOffset);
+        const ChannelBlockPalette greenB = decodeChannelPalette(blockB + greenOffset);
+        const __m256i redPaletteA   = loadChannelPaletteAVX2(redA, 0);
+        const __m256i redPaletteB   = loadChannelPaletteAVX2(redB, 0);
+        const __m256i greenPaletteA = loadChannelPaletteAVX2(greenA, 8);
+        const __m256i greenPaletteB = loadChannelPaletteAVX2(greenB, 8);
+        for (uint32_t y = 0; y < 4; y++) {
+          __m256i pixels = _mm256_or_si256(opaque, lookupChannelRowAVX2(redPaletteA, redPaletteB, redA.indices, redB.indices, y));
+          pixels = _mm256_or_si256(pixels, lookupChannelRowAVX2(greenPaletteA, greenPaletteB, greenA.indices, greenB.indices, y));
+          _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 16 + y * pitch), pixels);
+        }
+      }
+      rowKernelBC5SSE2<SwapChannels>(src + i * 16, numBlocks - i, dst + i * 16, pitch);
+    }
+
+#endif
+
+    struct BlockCodecKernels {
+      BlockDecodeFn decodeBlock;
+      RowKernelFn   scalar;
+      RowKernelFn   sse2;
+      RowKernelFn   avx2;
+      uint32_t      blockSize;
+      uint32_t      pixelSize;
+    };
+
+    inline const BlockCodecKernels* getBlockCodecKernels(BlockCodec codec) {
+#if defined(LIBVTF_X86)
+# define LIBVTF_SIMD_KERNELS(sse2, avx2) sse2, avx2
+#else
+# define LIBVTF_SIMD_KERNELS(sse2, avx2) nullptr, nullptr
+#endif
+      static constexpr BlockCodecKernels Kernels[] = {
+        { decodeBC1Block,   scalarRowKernel<decodeBC1Block,    8, 4>, LIBVTF_SIMD_KERNELS(rowKernelBC1SSE2,        rowKernelBC1AVX2),         8, 4 },
+        { decodeBC2Block,   scalarRowKernel<decodeBC2Block,   16, 4>, LIBVTF_SIMD_KERNELS(rowKernelBC2SSE2,        rowKernelBC2AVX2),        16, 4 },
+        { decodeBC3Block,   scalarRowKernel<decodeBC3Block,   16, 4>, LIBVTF_SIMD_KERNELS(rowKernelBC3SSE2,        rowKernelBC3AVX2),        16, 4 },
+        { decodeBC4Block,   scalarRowKernel<decodeBC4Block,    8, 4>, LIBVTF_SIMD_KERNELS(rowKernelBC4SSE2,        rowKernelBC4AVX2),         8, 4 },
+        { decodeBC5Block,   scalarRowKernel<decodeBC5Block,   16, 4>, LIBVTF_SIMD_KERNELS(rowKernelBC5SSE2<false>, rowKernelBC5AVX2<false>), 16, 4 },
+        { decodeATI2NBlock, scalarRowKernel<decodeATI2NBlock, 16, 4>, LIBVTF_SIMD_KERNELS(rowKernelBC5SSE2<true>,  rowKernelBC5AVX2<true>),  16, 4 },
+        // BC6H and BC7 are dominated by per-block mode decoding, they only have a scalar path.
+        { decodeBC6HBlock,  scalarRowKernel<decodeBC6HBlock,  16, 8>, nullptr, nullptr,                                                      16, 8 },
+        { decodeBC7Block,   scalarRowKernel<decodeBC7Block,   16, 4>, nullptr, nullptr,                                                      16, 4 },
+      };
+#undef LIBVTF_SIMD_KERNELS
+
+      if (codec == BlockCodec::None)
+        return nullptr;
+      return &Kernels[static_cast<uint32_t>(codec) - 1];
+    }
+
+    inline RowKernelFn selectRowKernel(const BlockCodecKernels& kernels, DecodeBackend backend) {
+      const CPUFeatures& cpu = getCPUFeatures();
+
+      if (backend == DecodeBackend::Auto)
+        backend = cpu.avx2 ? DecodeBackend::AVX2 : (cpu.sse2 ? DecodeBackend::SSE2 : DecodeBackend::Scalar);
+
+      if (backend == DecodeBackend::AVX2 && cpu.avx2 && kernels.avx2)
+        return kernels.avx2;
+      if ((backend == DecodeBackend::AVX2 || backend == DecodeBackend::SSE2) && cpu.sse2 && kernels.sse2)
+        return kernels.sse2;
+      return kernels.scalar;
+    }
+
+  }
+
+  constexpr bool isDecodable(ImageFormat format) {
+    return detail::getBlockCodec(format) != detail::BlockCodec::None;
+  }
+
+  constexpr DecodedFormat getDecodedFormat(ImageFormat format) {
+    return detail::getBlockCodec(format) == detail::BlockCodec::BC6H
+      ? DecodedFormat::RGBA16F
+      : DecodedFormat::RGBA8;
+  }
+
+  constexpr uint32_t getDecodedPixelSize(ImageFormat format) {
+    return getDecodedFormat(format) == DecodedFormat::RGBA16F ? 8u : 4u;
+  }
+
+  constexpr uint32_t getBlockCountX(uint32_t width)  { return (width  + 3) / 4; }
+  constexpr uint32_t getBlockCountY(uint32_t height) { return (height + 3) / 4; }
+
+  // Decodes block rows [firstBlockRow, firstBlockRow + numBlockRows) of a
+  // width x height image. `src` is the whole compressed image and `dst` the
+  // whole destination image, `dstPitch` is in bytes (0 = tightly packed).
+  // Does not allocate.
+  inline void decodeBlockRows(
+          ImageFormat              format,
+          std::span<const uint8_t> src,
+          uint32_t                 width,
+          uint32_t                 height,
+          uint32_t                 firstBlockRow,
+          uint32_t                 numBlockRows,
+          std::span<uint8_t>       dst,
+          size_t                   dstPitch = 0,
+          DecodeBackend            backend  = DecodeBackend::Auto) {
+    const detail::BlockCodecKernels* kernels = detail::getBlockCodecKernels(detail::getBlockCodec(format));
+    if (!kernels)
+      throw std::runtime_error("Image format is not a decodable block compressed format.");
+
+    const uint32_t blocksX = getBlockCountX(width);
+    const uint32_t blocksY = getBlockCountY(height);
+    if (!dstPitch)
+      dstPitch = size_t(width) * kernels->pixelSize;
+
+    if (firstBlockRow + numBlockRows > blocksY)
+      throw std::runtime_error("Block row range is out of bounds.");
+    if (src.size() < size_t(blocksX) * blocksY * kernels->blockSize)
+      throw std::runtime_error("Source buffer is too small for image dimensions.");
+    if (height && dst.size() < dstPitch * (height - 1) + size_t(width) * kernels->pixelSize)
+      throw std::runtime_error("Destination buffer is too small for image dimensions.");
+
+    LIBVTF_INSTRUMENT_SCOPE(Decode, size_t(blocksX) * numBlockRows * kernels->blockSize);
+
+    const detail::RowKernelFn rowKernel = detail::selectRowKernel(*kernels, backend);
+    const size_t srcRowSize = size_t(blocksX) * kernels->blockSize;
+
+    for (uint32_t by = firstBlockRow; by < firstBlockRow + numBlockRows; by++) {
+      const uint8_t* srcRow = src.data() + by * srcRowSize;
+      uint8_t*       dstRow = dst.data() + size_t(by) * 4 * dstPitch;
+
+      // Full blocks go straight to the destination, blocks clipped by the
+      // image edge go through a 4x4 scratch block on the stack.
+      const uint32_t rowsInBlock = std::min<uint32_t>(4, height - by * 4);
+      const uint32_t fullBlocks  = rowsInBlock == 4 ? width / 4 : 0;
+      if (fullBlocks)
+        rowKernel(srcRow, fullBlocks, dstRow, dstPitch);
+
+      for (uint32_t bx = fullBlocks; bx < blocksX; bx++) {
+        alignas(16) uint8_t scratch[4 * 4 * 8];
+        const size_t scratchPitch = 4 * kernels->pixelSize;
+        kernels->decodeBlock(srcRow + bx * kernels->blockSize, scratch, scratchPitch);
+
+        const uint32_t columns = std::min<uint32_t>(4, width - bx * 4);
+        for (uint32_t y = 0; y < rowsInBlock; y++)
+          std::memcpy(dstRow + y * dstPitch + bx * 4 * kernels->pixelSize, scratch + y * scratchPitch, columns * kernels->pixelSize);
+      }
+    }
+  }
+
+  inline void decodeImage(
+          ImageFormat              format,
+          std::span<const uint8_t> src,
+          uint32_t                 width,
+          uint32_t                 height,
+          std::span<uint8_t>       dst,
+          size_t                   dstPitch = 0,
+          DecodeBackend            backend  = DecodeBackend::Auto) {
+    decodeBlockRows(format, src, width, height, 0, getBlockCountY(height), dst, dstPitch, backend);
+  }
+
+  inline std::tuple<uint32_t, uint32_t> getSubresourceSize(const VTFData& vtf, const SubresourceLayout& subresource) {
+    const meta::VTFHeader& header = vtf.getHeader();
+    auto [width, height, depth] = adjustImageSizeByMip(header.width, header.height, header.depth, subresource.mipLevel);
+    return { width, height };
+  }
+
+  // Decodes a single 2D slice of a subresource.
+  inline void decodeImage(
+    const VTFData&            vtf,
+    const SubresourceLayout&  subresource,
+          std::span<uint8_t>  dst,
+          size_t              dstPitch = 0,
+          DecodeBackend       backend  = DecodeBackend::Auto) {
+    auto [width, height] = getSubresourceSize(vtf, subresource);
+    decodeImage(vtf.getHeader().format, vtf.imageData(subresource), width, height, dst, dstPitch, backend);
+  }
+
+  // Size of the output of decodeSubresources: every subresource decoded
+  // tightly packed, one after another, in the given order.
+  inline size_t getDecodedSize(const VTFData& vtf, std::span<const SubresourceLayout> subresources) {
+    const uint32_t pixelSize = getDecodedPixelSize(vtf.getHeader().format);
+
+    size_t size = 0;
+    for (const SubresourceLayout& subresource : subresources) {
+      auto [width, height] = getSubresourceSize(vtf, subresource);
+      size += size_t(width) * height * pixelSize;
+    }
+    return size;
+  }
+
+  inline size_t getDecodedSize(const VTFData& vtf) {
+    return getDecodedSize(vtf, vtf.subresources());
+  }
+
+  // Decodes a list of subresources in parallel into dst, laid out as
+  // described by getDecodedSize. Subresources are split into chunks of
+  // block rows so a large top mip is spread over every thread instead of
+  // being one work item.
+  inline void decodeSubresources(
+    const VTFData&                           vtf,
+          std::span<const SubresourceLayout> subresources,
+          std::span<uint8_t>                 dst,
+    const ParallelOptions&                   options = {},
+          DecodeBackend                      backend = DecodeBackend::Auto) {
+    // Roughly 16KB of DXT5 input per work item.
+    static constexpr uint32_t BlocksPerWorkItem = 1024;
+
+    const ImageFormat format    = vtf.getHeader().format;
+    const uint32_t    pixelSize = getDecodedPixelSize(format);
+    if (!isDecodable(format))
+      throw std::runtime_error("Image format is not a decodable block compressed format.");
+    if (dst.size() < getDecodedSize(vtf, subresources))
+      throw std::runtime_error("Destination buffer is too small for decoded subresources.");
+
+    struct WorkItem {
+      uint32_t subresource;
+      uint32_t firstBlockRow;
+      uint32_t numBlockRows;
+    };
+
+    std::vector<WorkItem> workItems;
+    std::vector<size_t>   dstOffsets;
+    dstOffsets.reserve(subresources.size());
+
+    size_t dstOffset = 0;
+    for (uint32_t i = 0; i < subresources.size(); i++) {
+      auto [width, height] = getSubresourceSize(vtf, subresources[i]);
+      const uint32_t blockRows        = getBlockCountY(height);
+      const uint32_t blockRowsPerItem = std::max<uint32_t>(1, BlocksPerWorkItem / getBlockCountX(width));
+      for (uint32_t row = 0; row < blockRows; row += blockRowsPerItem)
+        workItems.push_back(WorkItem{ i, row, std::min(blockRowsPerItem, blockRows - row) });
+
+      dstOffsets.push_back(dstOffset);
+      dstOffset += size_t(width) * height * pixelSize;
+    }
+
+    parallelFor(workItems.size(), [&](size_t index) {
+      const WorkItem&          item        = workItems[index];
+      const SubresourceLayout& subresource = subresources[item.subresource];
+      auto [width, height] = getSubresourceSize(vtf, subresource);
+
+      const size_t decodedSize = size_t(width) * height * pixelSize;
+      decodeBlockRows(format, vtf.imageData(subresource), width, height,
+        item.firstBlockRow, item.numBlockRows,
+        dst.subspan(dstOffsets[item.subresource], decodedSize), 0, backend);
+    }, options);
+  }
+
+  inline void decodeSubresources(
+    const VTFData&            vtf,
+          std::span<uint8_t>  dst,
+    const ParallelOptions&    options = {},
+          DecodeBackend       backend = DecodeBackend::Auto) {
+    decodeSubresources(vtf, vtf.subresources(), dst, options, backend);
+  }
+
+}
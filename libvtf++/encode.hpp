@@ -0,0 +1,1400 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "decode.hpp"
+#include "threading.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace libvtf {
+
+  // Rough single-threaded throughput on a desktop x86 core with SSE2, for
+  // 256x256 synthetic images (see tests/encode_bench.cpp):
+  //
+  //           DXT1-DXT5    ATI1N/ATI2N   BC7
+  //   Fast    10 MPix/s    30-55 MPix/s  5 MPix/s
+  //   Normal  3 MPix/s     20 MPix/s     0.25-0.3 MPix/s
+  //   Slow    0.5 MPix/s   3-4 MPix/s    0.1-0.15 MPix/s
+  enum class EncodeQuality {
+    Fast,   // Range fit, BC7 mode 6 only
+    Normal, // Cluster fit over at most 8 merged colours, BC7 with the most likely partitions
+    Slow,   // Iterated cluster fit over every colour, BC7 with every mode
+  };
+
+  enum class EncodeBackend {
+    Auto,
+    Scalar,
+    SSE2,
+  };
+
+  struct EncodeOptions {
+    EncodeQuality quality = EncodeQuality::Normal;
+    EncodeBackend backend = EncodeBackend::Auto;
+    // DXT1 only: pixels with alpha < 128 become transparent black. Always
+    // on for DXT1_ONEBITALPHA, otherwise DXT1 is encoded opaque.
+    bool          oneBitAlpha = false;
+  };
+
+  namespace detail {
+
+    struct EncodeSettings {
+      EncodeQuality quality;
+      bool          useSSE2;
+      bool          oneBitAlpha;
+    };
+
+    inline EncodeSettings getEncodeSettings(ImageFormat format, const EncodeOptions& options) {
+      const CPUFeatures& cpu = getCPUFeatures();
+      return EncodeSettings {
+        .quality     = options.quality,
+        .useSSE2     = options.backend != EncodeBackend::Scalar && cpu.sse2,
+        .oneBitAlpha = options.oneBitAlpha || format == ImageFormats::DXT1_ONEBITALPHA,
+      };
+    }
+
+    using BlockPixels = uint8_t[16][4];
+
+    // Edge blocks repeat the last row/column of the image.
+    inline void loadBlockPixels(const uint8_t* src, size_t pitch, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, BlockPixels& pixels) {
+      for (uint32_t y = 0; y < 4; y++) {
+        const uint8_t* row = src + std::min(by * 4 + y, height - 1) * pitch;
+        if (bx * 4 + 4 <= width) {
+          std::memcpy(pixels[y * 4], row + bx * 16, 16);
+          continue;
+        }
+        for (uint32_t x = 0; x < 4; x++)
+          std::memcpy(pixels[y * 4 + x], row + std::min(bx * 4 + x, width - 1) * 4, 4);
+      }
+    }
+
+    template <typename T>
+    constexpr T square(T value) { return value * value; }
+
+    // Principal axis of a weighted point set by power iteration on its
+    // covariance matrix. Only the first `channels` components are used.
+    inline void computePrincipalAxis(const float (*points)[4], const float* weights, uint32_t count, uint32_t channels, float (&mean)[4], float (&axis)[4]) {
+      float totalWeight = 0.0f;
+      for (uint32_t c = 0; c < 4; c++)
+        mean[c] = axis[c] = 0.0f;
+
+      for (uint32_t i = 0; i < count; i++) {
+        const float weight = weights ? weights[i] : 1.0f;
+        totalWeight += weight;
+        for (uint32_t c = 0; c < channels; c++)
+          mean[c] += points[i][c] * weight;
+      }
+      if (totalWeight <= 0.0f)
+        return;
+      for (uint32_t c = 0; c < channels; c++)
+        mean[c] /= totalWeight;
+
+      float covariance[4][4] = {};
+      for (uint32_t i = 0; i < count; i++) {
+        const float weight = weights ? weights[i] : 1.0f;
+        for (uint32_t a = 0; a < channels; a++) {
+          for (uint32_t b = a; b < channels; b++)
+            covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]) * weight;
+        }
+      }
+      for (uint32_t a = 0; a < channels; a++) {
+        for (uint32_t b = 0; b < a; b++)
+          covariance[a][b] = covariance[b][a];
+      }
+
+      // Start from the column with the largest variance, (1, 1, 1) can be
+      // orthogonal to the principal axis.
+      uint32_t largest = 0;
+      for (uint32_t c = 1; c < channels; c++) {
+        if (covariance[c][c] > covariance[largest][largest])
+          largest = c;
+      }
+      float vector[4] = {};
+      for (uint32_t c = 0; c < channels; c++)
+        vector[c] = covariance[c][largest];
+
+      for (uint32_t iteration = 0; iteration < 8; iteration++) {
+        float next[4] = {};
+        float maxComponent = 0.0f;
+        for (uint32_t a = 0; a < channels; a++) {
+          for (uint32_t b = 0; b < channels; b++)
+            next[a] += covariance[a][b] * vector[b];
+          maxComponent = std::max(maxComponent, std::abs(next[a]));
+        }
+        if (maxComponent <= 0.0f)
+          break;
+        for (uint32_t c = 0; c < channels; c++)
+          vector[c] = next[c] / maxComponent;
+      }
+
+      float length = 0.0f;
+      for (uint32_t c = 0; c < channels; c++)
+        length += square(vector[c]);
+      if (length <= 0.0f) {
+        for (uint32_t c = 0; c < channels; c++)
+          axis[c] = 1.0f;
+        return;
+      }
+      length = std::sqrt(length);
+      for (uint32_t c = 0; c < channels; c++)
+        axis[c] = vector[c] / length;
+    }
+
+    //
+    // BC1-BC3 colour blocks.
+    //
+
+    // Opaque colours of a block with duplicates merged, in [0, 1].
+    struct ColorFitInput {
+      float    colors[16][4];
+      float    weights[16];
+      uint32_t count = 0;
+    };
+
+    inline uint16_t quantize565(float r, float g, float b) {
+      auto quantize = [](float value, float levels) {
+        return uint32_t(std::clamp(value, 0.0f, 1.0f) * levels + 0.5f);
+      };
+      return uint16_t((quantize(r, 31.0f) << 11) | (quantize(g, 63.0f) << 5) | quantize(b, 31.0f));
+    }
+
+    // Best endpoint pair for a single channel value when every pixel uses
+    // the first interpolated colour. Mirrors the decoder's integer maths.
+    struct SingleColorEntry {
+      uint8_t q0;
+      uint8_t q1;
+    };
+
+    struct SingleColorTables {
+      SingleColorEntry fourColor5[256];
+      SingleColorEntry fourColor6[256];
+      SingleColorEntry threeColor5[256];
+      SingleColorEntry threeColor6[256];
+    };
+
+    inline const SingleColorTables& getSingleColorTables() {
+      static const SingleColorTables tables = [] {
+        SingleColorTables result{};
+        auto build = [](SingleColorEntry (&table)[256], uint32_t bits, bool threeColor) {
+          const uint32_t levels = 1u << bits;
+          auto expand = [bits](uint32_t q) { return bits == 5 ? (q << 3) | (q >> 2) : (q << 2) | (q >> 4); };
+          for (uint32_t value = 0; value < 256; value++) {
+            uint32_t bestError = ~0u;
+            for (uint32_t q0 = 0; q0 < levels; q0++) {
+              for (uint32_t q1 = 0; q1 < levels; q1++) {
+                const uint32_t a = expand(q0), b = expand(q1);
+                const uint32_t interpolated = threeColor ? (a + b) / 2 : (2 * a + b) / 3;
+                const uint32_t error = uint32_t(std::abs(int32_t(interpolated) - int32_t(value)));
+                if (error < bestError) {
+                  bestError = error;
+                  table[value] = SingleColorEntry{ uint8_t(q0), uint8_t(q1) };
+                }
+              }
+            }
+          }
+        };
+        build(result.fourColor5,  5, false);
+        build(result.fourColor6,  6, false);
+        build(result.threeColor5, 5, true);
+        build(result.threeColor6, 6, true);
+        return result;
+      }();
+      return tables;
+    }
+
+    // Orders the endpoints for the requested mode, picks the best index for
+    // every pixel against the exact decoded palette and returns the error.
+    inline uint32_t finalizeColorBlock(uint16_t c0, uint16_t c1, bool threeColor, bool allowPunchthrough, const BlockPixels& pixels, uint32_t transparentMask, uint8_t* block) {
+      if (threeColor ? c0 > c1 : c0 < c1)
+        std::swap(c0, c1);
+
+      std::memcpy(block + 0, &c0, sizeof(c0));
+      std::memcpy(block + 2, &c1, sizeof(c1));
+      const ColorBlockPalette palette = decodeColorPalette(block, allowPunchthrough);
+
+      uint32_t indices = 0;
+      uint32_t error   = 0;
+      for (uint32_t i = 0; i < 16; i++) {
+        uint32_t bestIndex = 3;
+        if (!(transparentMask & (1u << i))) {
+          uint32_t bestError = ~0u;
+          for (uint32_t k = 0; k < 4; k++) {
+            // Transparent black is only for transparent pixels.
+            if (!(palette.colors[k] >> 24))
+              continue;
+
+            uint32_t distance = 0;
+            for (uint32_t c = 0; c < 3; c++)
+              distance += square(int32_t((palette.colors[k] >> (8 * c)) & 0xff) - int32_t(pixels[i][c]));
+            if (distance < bestError) {
+              bestError = distance;
+              bestIndex = k;
+            }
+          }
+          error += bestError;
+        }
+        indices |= bestIndex << (2 * i);
+      }
+
+      storeU32(block + 4, indices);
+      return error;
+    }
+
+    inline void rangeFitColors(const ColorFitInput& input, uint16_t& c0, uint16_t& c1) {
+      float mean[4], axis[4];
+      computePrincipalAxis(input.colors, input.weights, input.count, 3, mean, axis);
+
+      uint32_t minIndex = 0, maxIndex = 0;
+      float minDot = std::numeric_limits<float>::max(), maxDot = -std::numeric_limits<float>::max();
+      for (uint32_t i = 0; i < input.count; i++) {
+        const float dot = input.colors[i][0] * axis[0] + input.colors[i][1] * axis[1] + input.colors[i][2] * axis[2];
+        if (dot < minDot) { minDot = dot; minIndex = i; }
+        if (dot > maxDot) { maxDot = dot; maxIndex = i; }
+      }
+
+      c0 = quantize565(input.colors[maxIndex][0], input.colors[maxIndex][1], input.colors[maxIndex][2]);
+      c1 = quantize565(input.colors[minIndex][0], input.colors[minIndex][1], input.colors[minIndex][2]);
+    }
+
+    // 4-wide float vectors for the cluster fit. Both implementations do the
+    // same IEEE operations in the same order, so they give the same results.
+    struct ScalarVec4 {
+      float v[4];
+
+      ScalarVec4() = default;
+      ScalarVec4(float x, float y, float z, float w) : v{ x, y, z, w } { }
+      explicit ScalarVec4(float s) : v{ s, s, s, s } { }
+
+      ScalarVec4 splatW() const { return ScalarVec4{ v[3] }; }
+      float w() const { return v[3]; }
+      float x() const { return v[0]; }
+      float y() const { return v[1]; }
+      float z() const { return v[2]; }
+      float sumXYZ() const { return v[0] + v[1] + v[2]; }
+
+      ScalarVec4& operator+=(const ScalarVec4& other) { for (uint32_t i = 0; i < 4; i++) v[i] += other.v[i]; return *this; }
+
+      friend ScalarVec4 operator+(ScalarVec4 a, const ScalarVec4& b) { for (uint32_t i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+      friend ScalarVec4 operator-(ScalarVec4 a, const ScalarVec4& b) { for (uint32_t i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+      friend ScalarVec4 operator*(ScalarVec4 a, const ScalarVec4& b) { for (uint32_t i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+
+      // a * b + c and c - a * b
+      friend ScalarVec4 mulAdd(const ScalarVec4& a, const ScalarVec4& b, const ScalarVec4& c) { return a * b + c; }
+      friend ScalarVec4 negMulSub(const ScalarVec4& a, const ScalarVec4& b, const ScalarVec4& c) { return c - a * b; }
+
+      friend ScalarVec4 reciprocal(ScalarVec4 a) { for (uint32_t i = 0; i < 4; i++) a.v[i] = 1.0f / a.v[i]; return a; }
+      friend ScalarVec4 min(ScalarVec4 a, const ScalarVec4& b) { for (uint32_t i = 0; i < 4; i++) a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return a; }
+      friend ScalarVec4 max(ScalarVec4 a, const ScalarVec4& b) { for (uint32_t i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+      friend ScalarVec4 truncate(ScalarVec4 a) { for (uint32_t i = 0; i < 4; i++) a.v[i] = float(int32_t(a.v[i])); return a; }
+    };
+
+#if defined(LIBVTF_X86)
+    struct SSE2Vec4 {
+      __m128 v;
+
+      SSE2Vec4() = default;
+      SSE2Vec4(__m128 value) : v{ value } { }
+      SSE2Vec4(float x, float y, float z, float w) : v{ _mm_setr_ps(x, y, z, w) } { }
+      explicit SSE2Vec4(float s) : v{ _mm_set1_ps(s) } { }
+
+      SSE2Vec4 splatW() const { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)); }
+      float w() const { return _mm_cvtss_f32(splatW().v); }
+      float x() const { return _mm_cvtss_f32(v); }
+      float y() const { return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))); }
+      float z() const { return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))); }
+      float sumXYZ() const { return x() + y() + z(); }
+
+      SSE2Vec4& operator+=(const SSE2Vec4& other) { v = _mm_add_ps(v, other.v); return *this; }
+
+      friend SSE2Vec4 operator+(const SSE2Vec4& a, const SSE2Vec4& b) { return _mm_add_ps(a.v, b.v); }
+      friend SSE2Vec4 operator-(const SSE2Vec4& a, const SSE2Vec4& b) { return _mm_sub_ps(a.v, b.v); }
+      friend SSE2Vec4 operator*(const SSE2Vec4& a, const SSE2Vec4& b) { return _mm_mul_ps(a.v, b.v); }
+
+      friend SSE2Vec4 mulAdd(const SSE2Vec4& a, const SSE2Vec4& b, const SSE2Vec4& c) { return _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v); }
+      friend SSE2Vec4 negMulSub(const SSE2Vec4& a, const SSE2Vec4& b, const SSE2Vec4& c) { return _mm_sub_ps(c.v, _mm_mul_ps(a.v, b.v)); }
+
+      friend SSE2Vec4 reciprocal(const SSE2Vec4& a) { return _mm_div_ps(_mm_set1_ps(1.0f), a.v); }
+      friend SSE2Vec4 min(const SSE2Vec4& a, const SSE2Vec4& b) { return _mm_min_ps(a.v, b.v); }
+      friend SSE2Vec4 max(const SSE2Vec4& a, const SSE2Vec4& b) { return _mm_max_ps(a.v, b.v); }
+      friend SSE2Vec4 truncate(const SSE2Vec4& a) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v)); }
+    };
+#endif
+
+    // Cluster fit: orders the colours along an axis and tries every split
+    // of that order into clusters, solving the endpoints for each split by
+    // least squares on the 565 grid. With iterations > 1 the axis is
+    // re-derived from the best endpoints until the order stops changing.
+    //
+    // Splits only fall between `maxPoints` runs of the order, neighbouring
+    // colours beyond that are merged. The 4-colour search is cubic in the
+    // number of points, 8 points try 165 splits where 16 try 969.
+    template <typename Vec4>
+    inline bool clusterFitColors(const ColorFitInput& input, bool threeColor, uint32_t iterations, uint32_t maxPoints, uint16_t& c0, uint16_t& c1) {
+      const uint32_t count     = input.count;
+      const uint32_t numPoints = std::min(count, maxPoints);
+
+      float mean[4], axis[4];
+      computePrincipalAxis(input.colors, input.weights, count, 3, mean, axis);
+
+      uint8_t order[16], previousOrder[16];
+      auto sortAlong = [&](const float (&direction)[4]) {
+        float dots[16];
+        for (uint32_t i = 0; i < count; i++) {
+          order[i] = uint8_t(i);
+          dots[i]  = input.colors[i][0] * direction[0] + input.colors[i][1] * direction[1] + input.colors[i][2] * direction[2];
+        }
+        std::stable_sort(order, order + count, [&](uint8_t a, uint8_t b) { return dots[a] < dots[b]; });
+      };
+      sortAlong(axis);
+
+      const Vec4 zero{ 0.0f };
+      const Vec4 one{ 1.0f };
+      const Vec4 half{ 0.5f };
+      const Vec4 two{ 2.0f };
+      const Vec4 grid{ 31.0f, 63.0f, 31.0f, 0.0f };
+      const Vec4 gridReciprocal{ 1.0f / 31.0f, 1.0f / 63.0f, 1.0f / 31.0f, 0.0f };
+      // w holds the squared weight of the interpolation factor.
+      const Vec4 oneThird{ 1.0f / 3.0f, 1.0f / 3.0f, 1.0f / 3.0f, 1.0f / 9.0f };
+      const Vec4 twoThirds{ 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 4.0f / 9.0f };
+      const Vec4 twoNinths{ 2.0f / 9.0f };
+      const Vec4 oneHalf{ 0.5f, 0.5f, 0.5f, 0.25f };
+
+      float bestError = std::numeric_limits<float>::max();
+      Vec4  bestStart{ 0.0f }, bestEnd{ 0.0f };
+      bool  found = false;
+
+      for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+        // (w * rgb, w) for every point along the axis.
+        Vec4 points[16];
+        Vec4 total{ 0.0f };
+        for (uint32_t p = 0; p < numPoints; p++) {
+          points[p] = Vec4{ 0.0f };
+          for (uint32_t i = p * count / numPoints; i < (p + 1) * count / numPoints; i++) {
+            const float* color  = input.colors[order[i]];
+            const float  weight = input.weights[order[i]];
+            points[p] += Vec4{ color[0] * weight, color[1] * weight, color[2] * weight, weight };
+          }
+          total += points[p];
+        }
+
+        const float previousError = bestError;
+        auto evaluate = [&](const Vec4& alphaX, const Vec4& betaX, const Vec4& alphaBeta) {
+          const Vec4 alpha2 = alphaX.splatW();
+          const Vec4 beta2  = betaX.splatW();
+
+          // Every point in one cluster, the system is singular.
+          const Vec4 determinant = negMulSub(alphaBeta, alphaBeta, alpha2 * beta2);
+          if (determinant.w() <= 1e-6f)
+            return;
+
+          const Vec4 factor = reciprocal(determinant);
+          Vec4 a = negMulSub(betaX, alphaBeta, alphaX * beta2) * factor;
+          Vec4 b = negMulSub(alphaX, alphaBeta, betaX * alpha2) * factor;
+
+          a = min(one, max(zero, a));
+          b = min(one, max(zero, b));
+          a = truncate(mulAdd(grid, a, half)) * gridReciprocal;
+          b = truncate(mulAdd(grid, b, half)) * gridReciprocal;
+
+          // Squared error without the constant sum of x^2.
+          const Vec4 e1 = mulAdd(a * a, alpha2, b * b * beta2);
+          const Vec4 e2 = negMulSub(a, alphaX, a * b * alphaBeta);
+          const Vec4 e3 = negMulSub(b, betaX, e2);
+          const Vec4 e4 = mulAdd(two, e3, e1);
+          const float error = e4.sumXYZ();
+          if (error < bestError) {
+            bestError = error;
+            bestStart = a;
+            bestEnd   = b;
+            found     = true;
+          }
+        };
+
+        if (threeColor) {
+          // Clusters [0, i) at the start, [i, j) halfway, [j, numPoints) at the end.
+          Vec4 part0{ 0.0f };
+          for (uint32_t i = 0; i <= numPoints; i++) {
+            Vec4 part1{ 0.0f };
+            for (uint32_t j = i; ; j++) {
+              const Vec4 part2 = total - part1 - part0;
+              evaluate(mulAdd(part1, oneHalf, part0), mulAdd(part1, oneHalf, part2), (part1 * oneHalf).splatW());
+              if (j == numPoints)
+                break;
+              part1 += points[j];
+            }
+            if (i < numPoints)
+              part0 += points[i];
+          }
+        } else {
+          // Clusters [0, i), [i, j) at 1/3, [j, k) at 2/3 and [k, numPoints).
+          Vec4 part0{ 0.0f };
+          for (uint32_t i = 0; i <= numPoints; i++) {
+            Vec4 part1{ 0.0f };
+            for (uint32_t j = i; ; j++) {
+              Vec4 part2{ 0.0f };
+              for (uint32_t k = j; ; k++) {
+                const Vec4 part3 = total - part2 - part1 - part0;
+                evaluate(
+                  mulAdd(part2, oneThird, mulAdd(part1, twoThirds, part0)),
+                  mulAdd(part1, oneThird, mulAdd(part2, twoThirds, part3)),
+                  twoNinths * (part1 + part2).splatW());
+                if (k == numPoints)
+                  break;
+                part2 += points[k];
+              }
+              if (j == numPoints)
+                break;
+              part1 += points[j];
+            }
+            if (i < numPoints)
+              part0 += points[i];
+          }
+        }
+
+        if (bestError >= previousError || iteration + 1 == iterations)
+          break;
+
+        // Re-sort along the axis between the best endpoints.
+        std::copy(order, order + count, previousOrder);
+        const float direction[4] = { bestEnd.x() - bestStart.x(), bestEnd.y() - bestStart.y(), bestEnd.z() - bestStart.z(), 0.0f };
+        sortAlong(direction);
+        if (std::equal(order, order + count, previousOrder))
+          break;
+      }
+
+      if (!found)
+        return false;
+
+      c0 = quantize565(bestStart.x(), bestStart.y(), bestStart.z());
+      c1 = quantize565(bestEnd.x(), bestEnd.y(), bestEnd.z());
+      return true;
+    }
+
+    // BC1 allows the 3-colour mode and, with oneBitAlpha, transparent
+    // pixels. The colour block of BC2/BC3 is always decoded in 4-colour mode.
+    inline void encodeColorBlock(const BlockPixels& pixels, bool allowPunchthrough, bool oneBitAlpha, const EncodeSettings& settings, uint8_t* block) {
+      uint32_t transparentMask = 0;
+      ColorFitInput input;
+      for (uint32_t i = 0; i < 16; i++) {
+        if (oneBitAlpha && pixels[i][3] < 128) {
+          transparentMask |= 1u << i;
+          continue;
+        }
+
+        uint32_t match = 0;
+        while (match < input.count &&
+               (input.colors[match][0] != pixels[i][0] / 255.0f ||
+                input.colors[match][1] != pixels[i][1] / 255.0f ||
+                input.colors[match][2] != pixels[i][2] / 255.0f))
+          match++;
+
+        if (match == input.count) {
+          input.colors[match][0] = pixels[i][0] / 255.0f;
+          input.colors[match][1] = pixels[i][1] / 255.0f;
+          input.colors[match][2] = pixels[i][2] / 255.0f;
+          input.colors[match][3] = 0.0f;
+          input.weights[match]   = 0.0f;
+          input.count++;
+        }
+        input.weights[match] += 1.0f;
+      }
+
+      uint8_t  candidate[8] = {};
+      uint32_t bestError    = ~0u;
+      auto tryEndpoints = [&](uint16_t c0, uint16_t c1, bool threeColor) {
+        const uint32_t error = finalizeColorBlock(c0, c1, threeColor, allowPunchthrough, pixels, transparentMask, candidate);
+        if (error < bestError) {
+          bestError = error;
+          std::memcpy(block, candidate, sizeof(candidate));
+        }
+      };
+
+      const bool tryFourColor  = !transparentMask;
+      const bool tryThreeColor = allowPunchthrough && (transparentMask || settings.quality == EncodeQuality::Slow);
+
+      if (input.count == 0) {
+        tryEndpoints(0, 0, true);
+        return;
+      }
+
+      if (input.count == 1) {
+        const SingleColorTables& tables = getSingleColorTables();
+        uint32_t first = 0;
+        while (transparentMask & (1u << first))
+          first++;
+        const uint8_t* color = pixels[first];
+        auto fromTables = [&](const SingleColorEntry (&table5)[256], const SingleColorEntry (&table6)[256], bool threeColor) {
+          const SingleColorEntry& re = table5[color[0]];
+          const SingleColorEntry& ge = table6[color[1]];
+          const SingleColorEntry& be = table5[color[2]];
+          tryEndpoints(uint16_t((re.q0 << 11) | (ge.q0 << 5) | be.q0), uint16_t((re.q1 << 11) | (ge.q1 << 5) | be.q1), threeColor);
+        };
+        if (tryFourColor)
+          fromTables(tables.fourColor5, tables.fourColor6, false);
+        if (tryThreeColor)
+          fromTables(tables.threeColor5, tables.threeColor6, true);
+        return;
+      }
+
+      for (bool threeColor : { false, true }) {
+        if (threeColor ? !tryThreeColor : !tryFourColor)
+          continue;
+
+        uint16_t c0 = 0, c1 = 0;
+        bool fitted = false;
+        if (settings.quality == EncodeQuality::Fast) {
+          rangeFitColors(input, c0, c1);
+          fitted = true;
+        } else {
+          const uint32_t iterations = settings.quality == EncodeQuality::Slow ? 8 : 1;
+          const uint32_t maxPoints  = settings.quality == EncodeQuality::Slow ? 16 : 8;
+#if defined(LIBVTF_X86)
+          if (settings.useSSE2)
+            fitted = clusterFitColors<SSE2Vec4>(input, threeColor, iterations, maxPoints, c0, c1);
+          else
+#endif
+            fitted = clusterFitColors<ScalarVec4>(input, threeColor, iterations, maxPoints, c0, c1);
+        }
+
+        if (!fitted)
+          rangeFitColors(input, c0, c1);
+        tryEndpoints(c0, c1, threeColor);
+      }
+    }
+
+    //
+    // BC3 alpha and BC4/BC5 channel blocks.
+    //
+
+    inline uint32_t evaluateChannelEndpoints(uint8_t a0, uint8_t a1, const uint8_t (&values)[16], uint8_t* block) {
+      block[0] = a0;
+      block[1] = a1;
+      const ChannelBlockPalette palette = decodeChannelPalette(block);
+
+      uint64_t indices = 0;
+      uint32_t error   = 0;
+      for (uint32_t i = 0; i < 16; i++) {
+        uint32_t bestIndex = 0, bestError = ~0u;
+        for (uint32_t k = 0; k < 8; k++) {
+          const uint32_t distance = square(int32_t(palette.values[k]) - int32_t(values[i]));
+          if (distance < bestError) {
+            bestError = distance;
+            bestIndex = k;
+          }
+        }
+        indices |= uint64_t(bestIndex) << (3 * i);
+        error   += bestError;
+      }
+
+      for (uint32_t i = 0; i < 6; i++)
+        block[2 + i] = uint8_t(indices >> (8 * i));
+      return error;
+    }
+
+    // Least-squares endpoints for the indices of an encoded channel block.
+    inline bool refitChannelEndpoints(const uint8_t* block, const uint8_t (&values)[16], uint8_t& a0, uint8_t& a1) {
+      const bool eightValues = block[0] > block[1];
+      const uint64_t indices = loadU64(block) >> 16;
+
+      float s00 = 0.0f, s01 = 0.0f, s11 = 0.0f, b0 = 0.0f, b1 = 0.0f;
+      for (uint32_t i = 0; i < 16; i++) {
+        const uint32_t index = (indices >> (3 * i)) & 0x7;
+        float t;
+        if (index == 0)
+          t = 0.0f;
+        else if (index == 1)
+          t = 1.0f;
+        else if (eightValues)
+          t = float(index - 1) / 7.0f;
+        else if (index < 6)
+          t = float(index - 1) / 5.0f;
+        else
+          continue; // Explicit 0 / 255
+
+        s00 += square(1.0f - t);
+        s01 += t * (1.0f - t);
+        s11 += square(t);
+        b0  += (1.0f - t) * values[i];
+        b1  += t * values[i];
+      }
+
+      const float determinant = s00 * s11 - square(s01);
+      if (std::abs(determinant) < 1e-6f)
+        return false;
+
+      const float e0 = std::clamp((s11 * b0 - s01 * b1) / determinant, 0.0f, 255.0f);
+      const float e1 = std::clamp((s00 * b1 - s01 * b0) / determinant, 0.0f, 255.0f);
+      a0 = uint8_t(e0 + 0.5f);
+      a1 = uint8_t(e1 + 0.5f);
+
+      // Keep the interpolation mode the indices were chosen for.
+      if (eightValues ? a0 < a1 : a0 > a1)
+        std::swap(a0, a1);
+      return eightValues ? a0 != a1 : true;
+    }
+
+    inline void encodeChannelBlock(const uint8_t (&values)[16], EncodeQuality quality, uint8_t* block) {
+      uint8_t minValue = 255, maxValue = 0;
+      uint8_t minInner = 255, maxInner = 0;
+      for (uint8_t value : values) {
+        minValue = std::min(minValue, value);
+        maxValue = std::max(maxValue, value);
+        if (value != 0 && value != 255) {
+          minInner = std::min(minInner, value);
+          maxInner = std::max(maxInner, value);
+        }
+      }
+
+      uint8_t  candidate[8] = {};
+      uint32_t bestError    = ~0u;
+      auto tryEndpoints = [&](uint8_t a0, uint8_t a1) {
+        const uint32_t error = evaluateChannelEndpoints(a0, a1, values, candidate);
+        if (error < bestError) {
+          bestError = error;
+          std::memcpy(block, candidate, sizeof(candidate));
+        }
+      };
+
+      // 8-value mode between the extremes.
+      tryEndpoints(maxValue, minValue);
+      if (quality == EncodeQuality::Fast || !bestError)
+        return;
+
+      // 6-value mode, 0 and 255 come for free.
+      if (minInner <= maxInner)
+        tryEndpoints(minInner, maxInner);
+
+      const uint32_t iterations = quality == EncodeQuality::Slow ? 4 : 1;
+      for (uint32_t iteration = 0; iteration < iterations && bestError; iteration++) {
+        const uint32_t previousError = bestError;
+        uint8_t a0, a1;
+        if (!refitChannelEndpoints(block, values, a0, a1))
+          break;
+        tryEndpoints(a0, a1);
+        if (bestError >= previousError)
+          break;
+      }
+
+      if (quality == EncodeQuality::Slow) {
+        // Small neighbourhood search around the best endpoints.
+        const int32_t base0 = block[0], base1 = block[1];
+        for (int32_t d0 = -2; d0 <= 2; d0++) {
+          for (int32_t d1 = -2; d1 <= 2; d1++) {
+            const int32_t a0 = base0 + d0, a1 = base1 + d1;
+            if ((d0 || d1) && a0 >= 0 && a0 <= 255 && a1 >= 0 && a1 <= 255 && (a0 > a1) == (base0 > base1))
+              tryEndpoints(uint8_t(a0), uint8_t(a1));
+          }
+        }
+      }
+    }
+
+    inline void extractChannel(const BlockPixels& pixels, uint32_t channel, uint8_t (&values)[16]) {
+      for (uint32_t i = 0; i < 16; i++)
+        values[i] = pixels[i][channel];
+    }
+
+    //
+    // Block encoders.
+    //
+
+    inline void encodeBC1Block(const BlockPixels& pixels, const EncodeSettings& settings, uint8_t* block) {
+      encodeColorBlock(pixels, true, settings.oneBitAlpha, settings, block);
+    }
+
+    inline void encodeBC2Block(const BlockPixels& pixels, const EncodeSettings& settings, uint8_t* block) {
+      uint64_t alpha = 0;
+      for (uint32_t i = 0; i < 16; i++)
+        alpha |= uint64_t((pixels[i][3] + 8) / 17) << (4 * i);
+      std::memcpy(block, &alpha, sizeof(alpha));
+      encodeColorBlock(pixels, false, false, settings, block + 8);
+    }
+
+    inline void encodeBC3Block(const BlockPixels& pixels, const EncodeSettings& settings, uint8_t* block) {
+      uint8_t alpha[16];
+      extractChannel(pixels, 3, alpha);
+      encodeChannelBlock(alpha, settings.quality, block);
+      encodeColorBlock(pixels, false, false, settings, block + 8);
+    }
+
+    inline void encodeBC4Block(const BlockPixels& pixels, const EncodeSettings& settings, uint8_t* block) {
+      uint8_t red[16];
+      extractChannel(pixels, 0, red);
+      encodeChannelBlock(red, settings.quality, block);
+    }
+
+    template <bool SwapChannels>
+    inline void encodeBC5BlockImpl(const BlockPixels& pixels, const EncodeSettings& settings, uint8_t* block) {
+      uint8_t red[16], green[16];
+      extractChannel(pixels, 0, red);
+      extractChannel(pixels, 1, green);
+      encodeChannelBlock(SwapChannels ? green : red, settings.quality, block + 0);
+      encodeChannelBlock(SwapChannels ? red : green, settings.quality, block + 8);
+    }
+
+    inline void encodeBC5Block(const BlockPixels& pixels, const EncodeSettings& settings, uint8_t* block) {
+      encodeBC5BlockImpl<false>(pixels, settings, block);
+    }
+
+    inline void encodeATI2NBlock(const BlockPixels& pixels, const EncodeSettings& settings, uint8_t* block) {
+      encodeBC5BlockImpl<true>(pixels, settings, block);
+    }
+
+    //
+    // BC7
+    //
+
+    class BlockBitWriter {
+    public:
+      void write(uint32_t value, uint32_t count) {
+        if (!count)
+          return;
+
+        const uint64_t bits = uint64_t(value) & ((uint64_t(1) << count) - 1);
+        if (m_position >= 64) {
+          m_hi |= bits << (m_position - 64);
+        } else {
+          m_lo |= bits << m_position;
+          if (m_position + count > 64)
+            m_hi |= bits >> (64 - m_position);
+        }
+        m_position += count;
+      }
+
+      void store(uint8_t* block) const {
+        std::memcpy(block + 0, &m_lo, sizeof(m_lo));
+        std::memcpy(block + 8, &m_hi, sizeof(m_hi));
+      }
+
+    private:
+      uint64_t m_lo       = 0;
+      uint64_t m_hi       = 0;
+      uint32_t m_position = 0;
+    };
+
+    struct BC7ModeState {
+      uint32_t mode;
+      uint32_t partition;
+      uint32_t rotation;
+      uint32_t indexSelection;
+      uint8_t  endpoints[6][4]; // Quantized, without p-bits
+      uint8_t  pbits[6];
+      uint8_t  colorIndices[16];
+      uint8_t  alphaIndices[16]; // Modes 4 and 5 only
+      uint32_t error;
+    };
+
+    // Index precision of the colour and alpha indices of a mode.
+    inline std::pair<uint32_t, uint32_t> getBC7IndexBits(const BC7ModeInfo& info, uint32_t indexSelection) {
+      if (!info.indexBits2)
+        return { info.indexBits, info.indexBits };
+      return indexSelection
+        ? std::pair<uint32_t, uint32_t>{ info.indexBits2, info.indexBits }
+        : std::pair<uint32_t, uint32_t>{ info.indexBits, info.indexBits2 };
+    }
+
+    inline uint32_t unquantizeBC7Endpoint(const BC7ModeInfo& info, const BC7ModeState& state, uint32_t endpoint, uint32_t channel) {
+      const uint32_t bits = channel < 3 ? info.colorBits : info.alphaBits;
+      if (!bits)
+        return 255;
+
+      if (info.endpointPBits || info.sharedPBits)
+        return unquantizeBC7((uint32_t(state.endpoints[endpoint][channel]) << 1) | state.pbits[endpoint], bits + 1);
+      return unquantizeBC7(state.endpoints[endpoint][channel], bits);
+    }
+
+    // Quantizes the float endpoints of every subset, choosing p-bits that
+    // minimize the endpoint error.
+    inline void quantizeBC7Endpoints(const BC7ModeInfo& info, const float (&endpoints)[6][4], BC7ModeState& state) {
+      const uint32_t numEndpoints = info.numSubsets * 2u;
+      const uint32_t channels     = info.alphaBits ? 4 : 3;
+
+      auto quantize = [&](float value, uint32_t bits, int32_t pbit) {
+        const int32_t maxValue = (1 << bits) - 1;
+        int32_t q;
+        if (pbit < 0)
+          q = int32_t(std::lround(value * float(maxValue) / 255.0f));
+        else
+          q = int32_t(std::lround((value * float((1 << (bits + 1)) - 1) / 255.0f - float(pbit)) / 2.0f));
+        return uint8_t(std::clamp(q, 0, maxValue));
+      };
+
+      auto quantizeEndpoint = [&](uint32_t e, int32_t pbit) {
+        float error = 0.0f;
+        for (uint32_t c = 0; c < channels; c++) {
+          const uint32_t bits = c < 3 ? info.colorBits : info.alphaBits;
+          state.endpoints[e][c] = quantize(endpoints[e][c], bits, pbit);
+        }
+        state.pbits[e] = uint8_t(std::max(pbit, 0));
+        for (uint32_t c = 0; c < channels; c++)
+          error += square(float(unquantizeBC7Endpoint(info, state, e, c)) - endpoints[e][c]);
+        return error;
+      };
+
+      if (info.endpointPBits) {
+        for (uint32_t e = 0; e < numEndpoints; e++) {
+          const float error0 = quantizeEndpoint(e, 0);
+          const float error1 = quantizeEndpoint(e, 1);
+          if (error0 < error1)
+            quantizeEndpoint(e, 0);
+        }
+      } else if (info.sharedPBits) {
+        for (uint32_t e = 0; e < numEndpoints; e += 2) {
+          const float error0 = quantizeEndpoint(e, 0) + quantizeEndpoint(e + 1, 0);
+          const float error1 = quantizeEndpoint(e, 1) + quantizeEndpoint(e + 1, 1);
+          if (error0 < error1) {
+            quantizeEndpoint(e, 0);
+            quantizeEndpoint(e + 1, 0);
+          }
+        }
+      } else {
+        for (uint32_t e = 0; e < numEndpoints; e++)
+          quantizeEndpoint(e, -1);
+      }
+
+      if (!info.alphaBits) {
+        for (uint32_t e = 0; e < numEndpoints; e++)
+          state.endpoints[e][3] = 0;
+      }
+    }
+
+    // Picks the best index for every pixel and returns the block error.
+    inline uint32_t assignBC7Indices(const BlockPixels& pixels, const BC7ModeInfo& info, BC7ModeState& state) {
+      const auto [colorIndexBits, alphaIndexBits] = getBC7IndexBits(info, state.indexSelection);
+      const uint8_t* colorWeights = getBCWeights(colorIndexBits);
+      const uint8_t* alphaWeights = getBCWeights(alphaIndexBits);
+      const bool     separateAlpha = info.indexBits2 != 0;
+
+      uint32_t palettes[3][16][4];
+      for (uint32_t s = 0; s < info.numSubsets; s++) {
+        uint32_t e0[4], e1[4];
+        for (uint32_t c = 0; c < 4; c++) {
+          e0[c] = unquantizeBC7Endpoint(info, state, s * 2 + 0, c);
+          e1[c] = unquantizeBC7Endpoint(info, state, s * 2 + 1, c);
+        }
+        for (uint32_t k = 0; k < (1u << std::max(colorIndexBits, alphaIndexBits)); k++) {
+          const uint32_t cw = colorWeights[std::min(k, (1u << colorIndexBits) - 1)];
+          const uint32_t aw = alphaWeights[std::min(k, (1u << alphaIndexBits) - 1)];
+          for (uint32_t c = 0; c < 3; c++)
+            palettes[s][k][c] = (e0[c] * (64 - cw) + e1[c] * cw + 32) >> 6;
+          palettes[s][k][3] = (e0[3] * (64 - aw) + e1[3] * aw + 32) >> 6;
+        }
+      }
+
+      uint32_t error = 0;
+      for (uint32_t i = 0; i < 16; i++) {
+        const uint32_t (*palette)[4] = palettes[getBC7Subset(info.numSubsets, state.partition, i)];
+        const uint32_t colorChannels = separateAlpha ? 3 : 4;
+
+        uint32_t bestIndex = 0, bestError = ~0u;
+        for (uint32_t k = 0; k < (1u << colorIndexBits); k++) {
+          uint32_t distance = 0;
+          for (uint32_t c = 0; c < colorChannels; c++)
+            distance += square(int32_t(palette[k][c]) - int32_t(pixels[i][c]));
+          if (distance < bestError) {
+            bestError = distance;
+            bestIndex = k;
+          }
+        }
+        state.colorIndices[i] = uint8_t(bestIndex);
+        error += bestError;
+
+        if (separateAlpha) {
+          bestIndex = 0;
+          bestError = ~0u;
+          for (uint32_t k = 0; k < (1u << alphaIndexBits); k++) {
+            const uint32_t distance = square(int32_t(palette[k][3]) - int32_t(pixels[i][3]));
+            if (distance < bestError) {
+              bestError = distance;
+              bestIndex = k;
+            }
+          }
+          state.alphaIndices[i] = uint8_t(bestIndex);
+          error += bestError;
+        }
+      }
+
+      return error;
+    }
+
+    // Initial endpoints: the extent of every subset along its principal axis.
+    inline void fitBC7Endpoints(const BlockPixels& pixels, const BC7ModeInfo& info, uint32_t partition, float (&endpoints)[6][4]) {
+      const bool     separateAlpha = info.indexBits2 != 0;
+      const uint32_t channels      = separateAlpha || !info.alphaBits ? 3 : 4;
+
+      for (uint32_t s = 0; s < info.numSubsets; s++) {
+        float    points[16][4];
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < 16; i++) {
+          if (getBC7Subset(info.numSubsets, partition, i) != s)
+            continue;
+          for (uint32_t c = 0; c < 4; c++)
+            points[count][c] = pixels[i][c];
+          count++;
+        }
+
+        float mean[4], axis[4];
+        computePrincipalAxis(points, nullptr, count, channels, mean, axis);
+
+        float minDot = std::numeric_limits<float>::max(), maxDot = -std::numeric_limits<float>::max();
+        float minAlpha = 255.0f, maxAlpha = 0.0f;
+        for (uint32_t i = 0; i < count; i++) {
+          float dot = 0.0f;
+          for (uint32_t c = 0; c < channels; c++)
+            dot += (points[i][c] - mean[c]) * axis[c];
+          minDot   = std::min(minDot, dot);
+          maxDot   = std::max(maxDot, dot);
+          minAlpha = std::min(minAlpha, points[i][3]);
+          maxAlpha = std::max(maxAlpha, points[i][3]);
+        }
+
+        for (uint32_t c = 0; c < channels; c++) {
+          endpoints[s * 2 + 0][c] = std::clamp(mean[c] + axis[c] * minDot, 0.0f, 255.0f);
+          endpoints[s * 2 + 1][c] = std::clamp(mean[c] + axis[c] * maxDot, 0.0f, 255.0f);
+        }
+        if (channels == 3) {
+          endpoints[s * 2 + 0][3] = separateAlpha ? minAlpha : 255.0f;
+          endpoints[s * 2 + 1][3] = separateAlpha ? maxAlpha : 255.0f;
+        }
+      }
+    }
+
+    // Least-squares endpoints for the current indices.
+    inline void refitBC7Endpoints(const BlockPixels& pixels, const BC7ModeInfo& info, const BC7ModeState& state, float (&endpoints)[6][4]) {
+      const auto [colorIndexBits, alphaIndexBits] = getBC7IndexBits(info, state.indexSelection);
+      const uint8_t* colorWeights  = getBCWeights(colorIndexBits);
+      const uint8_t* alphaWeights  = getBCWeights(alphaIndexBits);
+      const bool     separateAlpha = info.indexBits2 != 0;
+
+      for (uint32_t s = 0; s < info.numSubsets; s++) {
+        for (uint32_t c = 0; c < 4; c++) {
+          const bool useAlphaIndices = separateAlpha && c == 3;
+          float s00 = 0.0f, s01 = 0.0f, s11 = 0.0f, b0 = 0.0f, b1 = 0.0f;
+          for (uint32_t i = 0; i < 16; i++) {
+            if (getBC7Subset(info.numSubsets, state.partition, i) != s)
+              continue;
+
+            const float t = (useAlphaIndices ? alphaWeights[state.alphaIndices[i]] : colorWeights[state.colorIndices[i]]) / 64.0f;
+            s00 += square(1.0f - t);
+            s01 += t * (1.0f - t);
+            s11 += square(t);
+            b0  += (1.0f - t) * pixels[i][c];
+            b1  += t * pixels[i][c];
+          }
+
+          const float determinant = s00 * s11 - square(s01);
+          if (std::abs(determinant) < 1e-6f) {
+            endpoints[s * 2 + 0][c] = float(unquantizeBC7Endpoint(info, state, s * 2 + 0, c));
+            endpoints[s * 2 + 1][c] = float(unquantizeBC7Endpoint(info, state, s * 2 + 1, c));
+            continue;
+          }
+          endpoints[s * 2 + 0][c] = std::clamp((s11 * b0 - s01 * b1) / determinant, 0.0f, 255.0f);
+          endpoints[s * 2 + 1][c] = std::clamp((s00 * b1 - s01 * b0) / determinant, 0.0f, 255.0f);
+        }
+      }
+    }
+
+    inline void encodeBC7Mode(const BlockPixels& pixels, uint32_t mode, uint32_t partition, uint32_t rotation, uint32_t indexSelection, uint32_t refineIterations, BC7ModeState& state) {
+      const BC7ModeInfo& info = BC7Modes[mode];
+
+      BlockPixels rotated;
+      std::memcpy(rotated, pixels, sizeof(rotated));
+      if (rotation) {
+        for (uint32_t i = 0; i < 16; i++)
+          std::swap(rotated[i][3], rotated[i][rotation - 1]);
+      }
+
+      state = BC7ModeState{};
+      state.mode           = mode;
+      state.partition      = partition;
+      state.rotation       = rotation;
+      state.indexSelection = indexSelection;
+
+      float endpoints[6][4];
+      fitBC7Endpoints(rotated, info, partition, endpoints);
+      quantizeBC7Endpoints(info, endpoints, state);
+      state.error = assignBC7Indices(rotated, info, state);
+
+      for (uint32_t iteration = 0; iteration < refineIterations && state.error; iteration++) {
+        refitBC7Endpoints(rotated, info, state, endpoints);
+
+        BC7ModeState candidate = state;
+        quantizeBC7Endpoints(info, endpoints, candidate);
+        candidate.error = assignBC7Indices(rotated, info, candidate);
+        if (candidate.error >= state.error)
+          break;
+        state = candidate;
+      }
+    }
+
+    inline void packBC7Block(BC7ModeState state, uint8_t* block) {
+      const BC7ModeInfo& info = BC7Modes[state.mode];
+      const auto [colorIndexBits, alphaIndexBits] = getBC7IndexBits(info, state.indexSelection);
+      const bool separateAlpha = info.indexBits2 != 0;
+
+      // The MSB of every anchor index is implicit 0: swap endpoints and
+      // invert the indices of subsets where it is set.
+      for (uint32_t s = 0; s < info.numSubsets; s++) {
+        uint32_t anchor = 0;
+        if (s == 1)
+          anchor = info.numSubsets == 2 ? BC7Anchors2[state.partition] : BC7Anchors3a[state.partition];
+        else if (s == 2)
+          anchor = BC7Anchors3b[state.partition];
+
+        const uint32_t colorMax = (1u << colorIndexBits) - 1;
+        if (state.colorIndices[anchor] > colorMax / 2) {
+          const uint32_t channels = separateAlpha ? 3 : 4;
+          for (uint32_t c = 0; c < channels; c++)
+            std::swap(state.endpoints[s * 2][c], state.endpoints[s * 2 + 1][c]);
+          if (info.endpointPBits)
+            std::swap(state.pbits[s * 2], state.pbits[s * 2 + 1]);
+          for (uint32_t i = 0; i < 16; i++) {
+            if (getBC7Subset(info.numSubsets, state.partition, i) == s)
+              state.colorIndices[i] = uint8_t(colorMax - state.colorIndices[i]);
+          }
+        }
+      }
+
+      // Modes with separate alpha have a single subset.
+      const uint32_t alphaMax = (1u << alphaIndexBits) - 1;
+      if (separateAlpha && state.alphaIndices[0] > alphaMax / 2) {
+        std::swap(state.endpoints[0][3], state.endpoints[1][3]);
+        for (uint32_t i = 0; i < 16; i++)
+          state.alphaIndices[i] = uint8_t(alphaMax - state.alphaIndices[i]);
+      }
+
+      const uint32_t numEndpoints = info.numSubsets * 2u;
+      BlockBitWriter bits;
+      bits.write(1u << state.mode, state.mode + 1);
+      bits.write(state.partition, info.partitionBits);
+      bits.write(state.rotation, info.rotationBits);
+      bits.write(state.indexSelection, info.indexSelectionBits);
+      for (uint32_t c = 0; c < 3; c++) {
+        for (uint32_t e = 0; e < numEndpoints; e++)
+          bits.write(state.endpoints[e][c], info.colorBits);
+      }
+      for (uint32_t e = 0; e < numEndpoints; e++)
+        bits.write(state.endpoints[e][3], info.alphaBits);
+      if (info.endpointPBits) {
+        for (uint32_t e = 0; e < numEndpoints; e++)
+          bits.write(state.pbits[e], 1);
+      } else if (info.sharedPBits) {
+        for (uint32_t s = 0; s < info.numSubsets; s++)
+          bits.write(state.pbits[s * 2], 1);
+      }
+
+      // The first index set has info.indexBits, which is the alpha set
+      // when index selection swaps them.
+      const uint8_t* firstIndices  = separateAlpha && state.indexSelection ? state.alphaIndices : state.colorIndices;
+      const uint8_t* secondIndices = separateAlpha && state.indexSelection ? state.colorIndices : state.alphaIndices;
+      for (uint32_t i = 0; i < 16; i++)
+        bits.write(firstIndices[i], info.indexBits - (isBC7Anchor(info.numSubsets, state.partition, i) ? 1 : 0));
+      if (info.indexBits2) {
+        for (uint32_t i = 0; i < 16; i++)
+          bits.write(secondIndices[i], info.indexBits2 - (i == 0 ? 1 : 0));
+      }
+
+      bits.store(block);
+    }
+
+    // Ranks partitions by how well each subset fits a line: the variance
+    // left over after removing the principal component. Subset covariances
+    // come from sums of per-pixel moments, so scoring a partition is little
+    // more than adding up moment vectors.
+    inline uint32_t selectBC7Partitions(const BlockPixels& pixels, uint32_t numSubsets, uint32_t numPartitions, uint32_t count, uint32_t* partitions) {
+      // 1, x[4], x[a] * x[b] for a <= b, padded to 16.
+      static constexpr uint32_t MomentCount = 16;
+      static constexpr uint8_t ProductChannels[10][2] = {
+        { 0, 0 }, { 0, 1 }, { 0, 2 }, { 0, 3 }, { 1, 1 }, { 1, 2 }, { 1, 3 }, { 2, 2 }, { 2, 3 }, { 3, 3 },
+      };
+
+      float moments[16][MomentCount] = {};
+      float total[MomentCount] = {};
+      for (uint32_t i = 0; i < 16; i++) {
+        moments[i][0] = 1.0f;
+        for (uint32_t c = 0; c < 4; c++)
+          moments[i][1 + c] = pixels[i][c];
+        for (uint32_t p = 0; p < 10; p++)
+          moments[i][5 + p] = float(pixels[i][ProductChannels[p][0]]) * float(pixels[i][ProductChannels[p][1]]);
+        for (uint32_t m = 0; m < MomentCount; m++)
+          total[m] += moments[i][m];
+      }
+
+      std::pair<float, uint32_t> scores[64];
+      for (uint32_t partition = 0; partition < numPartitions; partition++) {
+        float subsets[3][MomentCount] = {};
+        for (uint32_t i = 0; i < 16; i++) {
+          const uint32_t s = getBC7Subset(numSubsets, partition, i);
+          if (!s)
+            continue;
+          for (uint32_t m = 0; m < MomentCount; m++)
+            subsets[s][m] += moments[i][m];
+        }
+        for (uint32_t m = 0; m < MomentCount; m++)
+          subsets[0][m] = total[m] - subsets[1][m] - subsets[2][m];
+
+        float score = 0.0f;
+        for (uint32_t s = 0; s < numSubsets; s++) {
+          const float* subset = subsets[s];
+          float covariance[4][4];
+          for (uint32_t p = 0; p < 10; p++) {
+            const uint32_t a = ProductChannels[p][0], b = ProductChannels[p][1];
+            covariance[a][b] = covariance[b][a] = subset[5 + p] - subset[1 + a] * subset[1 + b] / subset[0];
+          }
+          const float trace = covariance[0][0] + covariance[1][1] + covariance[2][2] + covariance[3][3];
+
+          // Largest eigenvalue by a few power iterations.
+          float vector[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+          float eigenvalue = 0.0f;
+          for (uint32_t iteration = 0; iteration < 4; iteration++) {
+            float next[4] = {};
+            float length = 0.0f, rayleigh = 0.0f, norm = 0.0f;
+            for (uint32_t a = 0; a < 4; a++) {
+              for (uint32_t b = 0; b < 4; b++)
+                next[a] += covariance[a][b] * vector[b];
+              length   += square(next[a]);
+              rayleigh += vector[a] * next[a];
+              norm     += square(vector[a]);
+            }
+            if (length <= 0.0f)
+              break;
+            eigenvalue = rayleigh / norm;
+            length = std::sqrt(length);
+            for (uint32_t a = 0; a < 4; a++)
+              vector[a] = next[a] / length;
+          }
+          score += std::max(trace - eigenvalue, 0.0f);
+        }
+        scores[partition] = { score, partition };
+      }
+
+      count = std::min(count, numPartitions);
+      std::partial_sort(scores, scores + count, scores + numPartitions);
+      for (uint32_t i = 0; i < count; i++)
+        partitions[i] = scores[i].second;
+      return count;
+    }
+
+    inline void encodeBC7Block(const BlockPixels& pixels, const EncodeSettings& settings, uint8_t* block) {
+      bool opaque = true;
+      for (uint32_t i = 0; i < 16; i++)
+        opaque &= pixels[i][3] == 255;
+
+      const uint32_t refineIterations =
+        settings.quality == EncodeQuality::Fast ? 0 : (settings.quality == EncodeQuality::Normal ? 1 : 2);
+
+      BC7ModeState best{};
+      best.error = ~0u;
+      auto tryMode = [&](uint32_t mode, uint32_t partition, uint32_t rotation, uint32_t indexSelection) {
+        if (!best.error)
+          return;
+        BC7ModeState state;
+        encodeBC7Mode(pixels, mode, partition, rotation, indexSelection, refineIterations, state);
+        if (state.error < best.error)
+          best = state;
+      };
+
+      // Modes with the same number of subsets share one ranking of all 64
+      // partitions, mode 0 only has the first 16.
+      uint32_t ranked[2][64];
+      bool     isRanked[2] = {};
+      auto tryPartitionedMode = [&](uint32_t mode, uint32_t count) {
+        const BC7ModeInfo& info = BC7Modes[mode];
+        uint32_t* partitions = ranked[info.numSubsets - 2];
+        if (!isRanked[info.numSubsets - 2]) {
+          selectBC7Partitions(pixels, info.numSubsets, 64, 64, partitions);
+          isRanked[info.numSubsets - 2] = true;
+        }
+        for (uint32_t i = 0; i < 64 && count; i++) {
+          if (partitions[i] < (1u << info.partitionBits)) {
+            tryMode(mode, partitions[i], 0, 0);
+            count--;
+          }
+        }
+      };
+
+      tryMode(6, 0, 0, 0);
+
+      if (settings.quality == EncodeQuality::Normal) {
+        if (opaque) {
+          tryPartitionedMode(1, 4);
+          tryPartitionedMode(3, 4);
+        } else {
+          tryMode(5, 0, 0, 0);
+          tryPartitionedMode(7, 4);
+        }
+      } else if (settings.quality == EncodeQuality::Slow) {
+        for (uint32_t rotation = 0; rotation < 4; rotation++) {
+          tryMode(4, 0, rotation, 0);
+          tryMode(4, 0, rotation, 1);
+          tryMode(5, 0, rotation, 0);
+        }
+        if (opaque) {
+          tryPartitionedMode(0, 2);
+          tryPartitionedMode(1, 4);
+          tryPartitionedMode(2, 2);
+          tryPartitionedMode(3, 4);
+        } else {
+          tryPartitionedMode(7, 4);
+        }
+      }
+
+      packBC7Block(best, block);
+    }
+
+    using BlockEncodeFn = void (*)(const BlockPixels& pixels, const EncodeSettings& settings, uint8_t* block);
+
+    inline BlockEncodeFn getBlockEncoder(BlockCodec codec) {
+      switch (codec) {
+        case BlockCodec::BC1:   return encodeBC1Block;
+        case BlockCodec::BC2:   return encodeBC2Block;
+        case BlockCodec::BC3:   return encodeBC3Block;
+        case BlockCodec::BC4:   return encodeBC4Block;
+        case BlockCodec::BC5:   return encodeBC5Block;
+        case BlockCodec::ATI2N: return encodeATI2NBlock;
+        case BlockCodec::BC7:   return encodeBC7Block;
+        default:                return nullptr;
+      }
+    }
+
+  }
+
+  // BC6H has no encoder, every other decodable format can be encoded.
+  constexpr bool isEncodable(ImageFormat format) {
+    const detail::BlockCodec codec = detail::getBlockCodec(format);
+    return codec != detail::BlockCodec::None && codec != detail::BlockCodec::BC6H;
+  }
+
+  inline size_t getEncodedSize(ImageFormat format, uint32_t width, uint32_t height) {
+    return size_t(getBlockCountX(width)) * getBlockCountY(height) * detail::getBlockCodecBlockSize(detail::getBlockCodec(format));
+  }
+
+  // Encodes block rows [firstBlockRow, firstBlockRow + numBlockRows) of a
+  // width x height RGBA8 image. `src` is the whole source image, `srcPitch`
+  // is in bytes (0 = tightly packed) and `dst` the whole compressed image.
+  // Does not allocate.
+  inline void encodeBlockRows(
+          ImageFormat              format,
+          std::span<const uint8_t> src,
+          uint32_t                 width,
+          uint32_t                 height,
+          uint32_t                 firstBlockRow,
+          uint32_t                 numBlockRows,
+          std::span<uint8_t>       dst,
+          size_t                   srcPitch = 0,
+    const EncodeOptions&           options  = {}) {
+    const detail::BlockCodec    codec       = detail::getBlockCodec(format);
+    const detail::BlockEncodeFn encodeBlock = detail::getBlockEncoder(codec);
+    if (!encodeBlock)
+      throw std::runtime_error("Image format is not an encodable block compressed format.");
+
+    const uint32_t blocksX   = getBlockCountX(width);
+    const uint32_t blocksY   = getBlockCountY(height);
+    const uint32_t blockSize = detail::getBlockCodecBlockSize(codec);
+    if (!srcPitch)
+      srcPitch = size_t(width) * 4;
+
+    if (firstBlockRow + numBlockRows > blocksY)
+      throw std::runtime_error("Block row range is out of bounds.");
+    if (height && src.size() < srcPitch * (height - 1) + size_t(width) * 4)
+      throw std::runtime_error("Source buffer is too small for image dimensions.");
+    if (dst.size() < size_t(blocksX) * blocksY * blockSize)
+      throw std::runtime_error("Destination buffer is too small for image dimensions.");
+
+    LIBVTF_INSTRUMENT_SCOPE(Encode, size_t(blocksX) * numBlockRows * blockSize);
+    const detail::EncodeSettings settings = detail::getEncodeSettings(format, options);
+    for (uint32_t by = firstBlockRow; by < firstBlockRow + numBlockRows; by++) {
+      uint8_t* dstRow = dst.data() + size_t(by) * blocksX * blockSize;
+      for (uint32_t bx = 0; bx < blocksX; bx++) {
+        detail::BlockPixels pixels;
+        detail::loadBlockPixels(src.data(), srcPitch, width, height, bx, by, pixels);
+        encodeBlock(pixels, settings, dstRow + bx * blockSize);
+      }
+    }
+  }
+
+  inline void encodeImage(
+          ImageFormat              format,
+          std::span<const uint8_t> src,
+          uint32_t                 width,
+          uint32_t                 height,
+          std::span<uint8_t>       dst,
+          size_t                   srcPitch = 0,
+    const EncodeOptions&           options  = {}) {
+    encodeBlockRows(format, src, width, height, 0, getBlockCountY(height), dst, srcPitch, options);
+  }
+
+  // Encodes subresources in parallel, straight into the high-res image data
+  // layout of `layout`: subresource i goes to dst[subresources[i].offset].
+  // `src` holds every subresource as tightly packed RGBA8, one after
+  // another in the given order (see getDecodedSize). Work is split into
+  // chunks of block rows, so all mips and large images spread evenly.
+  inline void encodeSubresources(
+    const VTFData&                           layout,
+          std::span<const SubresourceLayout> subresources,
+          std::span<const uint8_t>           src,
+          std::span<uint8_t>                 dst,
+    const EncodeOptions&                     options         = {},
+    const ParallelOptions&                   parallelOptions = {}) {
+    // BC7 blocks are expensive, keep work items small.
+    static constexpr uint32_t BlocksPerWorkItem = 256;
+
+    const ImageFormat format = layout.getHeader().format;
+    if (!isEncodable(format))
+      throw std::runtime_error("Image format is not an encodable block compressed format.");
+    if (dst.size() < layout.imageTotalSize())
+      throw std::runtime_error("Destination buffer is too small for the image data.");
+
+    EncodeOptions blockOptions = options;
+    blockOptions.oneBitAlpha |= bool(layout.getHeader().flags & meta::VTFFlags::ONEBITALPHA);
+
+    struct WorkItem {
+      uint32_t subresource;
+      uint32_t firstBlockRow;
+      uint32_t numBlockRows;
+    };
+
+    std::vector<WorkItem> workItems;
+    std::vector<size_t>   srcOffsets;
+    srcOffsets.reserve(subresources.size());
+
+    size_t srcOffset = 0;
+    for (uint32_t i = 0; i < subresources.size(); i++) {
+      auto [width, height] = getSubresourceSize(layout, subresources[i]);
+      if (getEncodedSize(format, width, height) != subresources[i].size)
+        throw std::runtime_error("Subresource size does not match its block count.");
+
+      const uint32_t blockRows        = getBlockCountY(height);
+      const uint32_t blockRowsPerItem = std::max<uint32_t>(1, BlocksPerWorkItem / getBlockCountX(width));
+      for (uint32_t row = 0; row < blockRows; row += blockRowsPerItem)
+        workItems.push_back(WorkItem{ i, row, std::min(blockRowsPerItem, blockRows - row) });
+
+      srcOffsets.push_back(srcOffset);
+      srcOffset += size_t(width) * height * 4;
+    }
+    if (src.size() < srcOffset)
+      throw std::runtime_error("Source buffer is too small for the subresources.");
+
+    parallelFor(workItems.size(), [&](size_t index) {
+      const WorkItem&          item        = workItems[index];
+      const SubresourceLayout& subresource = subresources[item.subresource];
+      auto [width, height] = getSubresourceSize(layout, subresource);
+
+      encodeBlockRows(format, src.subspan(srcOffsets[item.subresource], size_t(width) * height * 4), width, height,
+        item.firstBlockRow, item.numBlockRows,
+        dst.subspan(subresource.offset, subresource.size), 0, blockOptions);
+    }, parallelOptions);
+  }
+
+  inline void encodeSubresources(
+    const VTFData&                 layout,
+          std::span<const uint8_t> src,
+          std::span<uint8_t>       dst,
+    const EncodeOptions&           options         = {},
+    const ParallelOptions&         parallelOptions = {}) {
+    encodeSubresources(layout, layout.subresources(), src, dst, options, parallelOptions);
+  }
+
+}
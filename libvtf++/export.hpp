@@ -0,0 +1,638 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "convert.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <span>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+# include <cerrno>
+# include <climits>
+# include <sys/uio.h>
+# include <unistd.h>
+#endif
+
+namespace libvtf {
+
+  namespace meta {
+
+#ifdef _MSC_VER
+#pragma pack(push, 1)
+#endif
+
+    PACKED_STRUCT(DDSPixelFormat) {
+      static constexpr uint32_t AlphaPixels = 0x1;
+      static constexpr uint32_t Alpha       = 0x2;
+      static constexpr uint32_t FourCC      = 0x4;
+      static constexpr uint32_t RGB         = 0x40;
+      static constexpr uint32_t Luminance   = 0x20000;
+
+      uint32_t size = 32;
+      uint32_t flags{};
+      uint32_t fourCC{};
+      uint32_t rgbBitCount{};
+      std::array<uint32_t, 4> masks{}; // R, G, B, A
+    };
+
+    PACKED_STRUCT(DDSHeader) {
+      static constexpr uint32_t ValidSignature = 0x20534444; // "DDS "
+
+      static constexpr uint32_t FlagsCaps        = 0x1;
+      static constexpr uint32_t FlagsHeight      = 0x2;
+      static constexpr uint32_t FlagsWidth       = 0x4;
+      static constexpr uint32_t FlagsPitch       = 0x8;
+      static constexpr uint32_t FlagsPixelFormat = 0x1000;
+      static constexpr uint32_t FlagsMipMapCount = 0x20000;
+      static constexpr uint32_t FlagsLinearSize  = 0x80000;
+      static constexpr uint32_t FlagsDepth       = 0x800000;
+
+      static constexpr uint32_t CapsComplex = 0x8;
+      static constexpr uint32_t CapsTexture = 0x1000;
+      static constexpr uint32_t CapsMipMap  = 0x400000;
+
+      static constexpr uint32_t Caps2CubeMap = 0x200 | 0xFC00; // With all six faces
+      static constexpr uint32_t Caps2Volume  = 0x200000;
+
+      uint32_t signature = ValidSignature;
+      uint32_t size = 124;
+      uint32_t flags{};
+      uint32_t height{};
+      uint32_t width{};
+      uint32_t pitchOrLinearSize{};
+      uint32_t depth{};
+      uint32_t mipMapCount{};
+      std::array<uint32_t, 11> reserved1{};
+      DDSPixelFormat pixelFormat;
+      uint32_t caps{};
+      uint32_t caps2{};
+      uint32_t caps3{};
+      uint32_t caps4{};
+      uint32_t reserved2{};
+    };
+
+    PACKED_STRUCT(DDSHeaderDX10) {
+      static constexpr uint32_t FourCC = 0x30315844; // "DX10"
+
+      static constexpr uint32_t Texture2D = 3;
+      static constexpr uint32_t Texture3D = 4;
+
+      static constexpr uint32_t MiscTextureCube = 0x4;
+
+      uint32_t dxgiFormat{};
+      uint32_t resourceDimension{};
+      uint32_t miscFlag{};
+      uint32_t arraySize{};
+      uint32_t miscFlags2{};
+    };
+
+    PACKED_STRUCT(KTX2Header) {
+      static constexpr std::array<uint8_t, 12> ValidIdentifier = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+      std::array<uint8_t, 12> identifier = ValidIdentifier;
+      uint32_t vkFormat{};
+      uint32_t typeSize{};
+      uint32_t pixelWidth{};
+      uint32_t pixelHeight{};
+      uint32_t pixelDepth{};
+      uint32_t layerCount{};
+      uint32_t faceCount{};
+      uint32_t levelCount{};
+      uint32_t supercompressionScheme{};
+
+      uint32_t dfdByteOffset{};
+      uint32_t dfdByteLength{};
+      uint32_t kvdByteOffset{};
+      uint32_t kvdByteLength{};
+      uint64_t sgdByteOffset{};
+      uint64_t sgdByteLength{};
+    };
+
+    PACKED_STRUCT(KTX2LevelIndex) {
+      uint64_t byteOffset{};
+      uint64_t byteLength{};
+      uint64_t uncompressedByteLength{};
+    };
+
+#ifdef _MSC_VER
+#pragma pack(pop)
+#endif
+
+    static_assert(sizeof(DDSHeader) == 128);
+    static_assert(sizeof(KTX2Header) == 80);
+
+  }
+
+  namespace detail {
+
+    constexpr uint32_t makeFourCC(char a, char b, char c, char d) {
+      return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+    }
+
+    // How an image format is spelled in the containers. 0 means there is
+    // no equivalent.
+    struct ExportFormatInfo {
+      uint32_t ddsFourCC      = 0;     // Legacy DDS FourCC or D3DFORMAT
+      bool     ddsMasks       = false; // Legacy DDS bit masks, from the pixel layout
+      uint32_t dxgiFormat     = 0;
+      uint32_t dxgiFormatSRGB = 0;
+      uint32_t vkFormat       = 0;
+      uint32_t vkFormatSRGB   = 0;
+    };
+
+    // I8 and IA88 export as R8 and R8G8 to DXGI and Vulkan, which have no
+    // luminance formats. ATI2N has its blocks in the opposite order of BC5
+    // and only has a DDS equivalent, its own FourCC.
+    constexpr ExportFormatInfo getExportFormatInfo(ImageFormat format) {
+      using enum ImageFormats::ImageFormat;
+      switch (format) {
+        case RGBA8888:
+        case LINEAR_RGBA8888:      return { 0, true, 28, 29, 37, 43 };
+        case BGRA8888:
+        case LINEAR_BGRA8888:
+        case LE_BGRA8888:          return { 0, true, 87, 91, 44, 50 };
+        case BGRX8888:
+        case LINEAR_BGRX8888:
+        case LE_BGRX8888:          return { 0, true, 88, 93, 0, 0 };
+        case ABGR8888:
+        case LINEAR_ABGR8888:
+        case ARGB8888:
+        case LINEAR_ARGB8888:
+        case RGBX8888:
+        case BGRX5551:
+        case LINEAR_BGRX5551:      return { 0, true, 0, 0, 0, 0 };
+        case RGB888:
+        case LINEAR_RGB888:        return { 0, true, 0, 0, 23, 29 };
+        case BGR888:
+        case LINEAR_BGR888:        return { 0, true, 0, 0, 30, 36 };
+        case RGB565:               return { 0, true, 0, 0, 5, 0 };
+        case BGR565:               return { 0, true, 85, 0, 4, 0 };
+        case BGRA5551:             return { 0, true, 86, 0, 8, 0 };
+        case BGRA4444:             return { 0, true, 115, 0, 1000340000, 0 };
+        case RGBA1010102:          return { 0, true, 24, 0, 64, 0 };
+        case BGRA1010102:          return { 0, true, 0, 0, 58, 0 };
+        case I8:
+        case LINEAR_I8:            return { 0, true, 61, 0, 9, 0 };
+        case IA88:                 return { 0, true, 49, 0, 16, 0 };
+        case A8:
+        case LINEAR_A8:            return { 0, true, 65, 0, 0, 0 };
+
+        case RGBA16161616:
+        case LINEAR_RGBA16161616:  return { 36, false, 11, 0, 91, 0 };
+        case RGBA16161616F:        return { 113, false, 10, 0, 97, 0 };
+        case R16F:                 return { 111, false, 54, 0, 76, 0 };
+        case RG1616F:              return { 112, false, 34, 0, 83, 0 };
+        case R32F:                 return { 114, false, 41, 0, 100, 0 };
+        case RG3232F:              return { 115, false, 16, 0, 103, 0 };
+        case RGB323232F:           return { 0, false, 6, 0, 106, 0 };
+        case RGBA32323232F:        return { 116, false, 2, 0, 109, 0 };
+
+        case DXT1:                 return { makeFourCC('D', 'X', 'T', '1'), false, 71, 72, 131, 132 };
+        case DXT1_ONEBITALPHA:     return { makeFourCC('D', 'X', 'T', '1'), false, 71, 72, 133, 134 };
+        case DXT3:                 return { makeFourCC('D', 'X', 'T', '3'), false, 74, 75, 135, 136 };
+        case DXT5:                 return { makeFourCC('D', 'X', 'T', '5'), false, 77, 78, 137, 138 };
+        case ATI2N:                return { makeFourCC('A', 'T', 'I', '2'), false, 0, 0, 0, 0 };
+        case ATI1N:
+        case VITAMIN_BC4:          return { 0, false, 80, 0, 139, 0 };
+        case VITAMIN_BC5:          return { 0, false, 83, 0, 141, 0 };
+        case VITAMIN_BC6H:         return { 0, false, 95, 0, 143, 0 };
+        case VITAMIN_BC7:          return { 0, false, 98, 99, 145, 146 };
+
+        default:                   return {};
+      }
+    }
+
+    constexpr uint32_t getChannelMask(const PixelLayout& layout, uint32_t channel) {
+      if (layout.encoding == PixelEncoding::Packed)
+        return layout.bits[channel] ? ((1u << layout.bits[channel]) - 1u) << layout.shifts[channel] : 0u;
+      return layout.elements[channel] >= 0 ? 0xFFu << (8 * layout.elements[channel]) : 0u;
+    }
+
+    inline meta::DDSPixelFormat makeDDSMaskPixelFormat(ImageFormat format) {
+      const PixelLayout layout = getPixelLayout(format);
+
+      meta::DDSPixelFormat pixelFormat;
+      pixelFormat.rgbBitCount = uint32_t(layout.size) * 8;
+      pixelFormat.masks[3] = getChannelMask(layout, 3);
+      if (layout.luminance) {
+        pixelFormat.flags    = meta::DDSPixelFormat::Luminance;
+        pixelFormat.masks[0] = getChannelMask(layout, 0);
+      } else if (layout.elements[0] >= 0 || layout.bits[0]) {
+        pixelFormat.flags = meta::DDSPixelFormat::RGB;
+        for (uint32_t c = 0; c < 3; c++)
+          pixelFormat.masks[c] = getChannelMask(layout, c);
+      } else {
+        pixelFormat.flags = meta::DDSPixelFormat::Alpha;
+        return pixelFormat;
+      }
+      if (pixelFormat.masks[3])
+        pixelFormat.flags |= meta::DDSPixelFormat::AlphaPixels;
+      return pixelFormat;
+    }
+
+    // Khronos Data Format Descriptor with one basic block, as KTX2 wants
+    // it. Uncompressed samples come from the pixel layout, by bit offset.
+    inline std::vector<uint32_t> makeKTX2DataFormatDescriptor(ImageFormat format, bool srgb) {
+      static constexpr uint32_t ChannelLinear = 0x10;
+      static constexpr uint32_t ChannelSigned = 0x40;
+      static constexpr uint32_t ChannelFloat  = 0x80;
+      static constexpr uint32_t FloatOne      = 0x3F800000;
+      static constexpr uint32_t FloatMinusOne = 0xBF800000;
+
+      struct Sample {
+        uint32_t bitOffset;
+        uint32_t bitLength;
+        uint32_t channel;
+        uint32_t lower;
+        uint32_t upper;
+      };
+      std::vector<Sample> samples;
+      uint32_t model = 1; // RGBSDA
+      std::array<uint32_t, 2> blockSize = { 1, 1 };
+      const uint32_t bytes = uint32_t(getMemoryRequiredForMip(1, 1, 1, format));
+
+      using enum ImageFormats::ImageFormat;
+      switch (format) {
+        case DXT1:             model = 128; samples = { { 0, 64, 0, 0, ~0u } }; break;
+        case DXT1_ONEBITALPHA: model = 128; samples = { { 0, 64, 1, 0, ~0u } }; break;
+        case DXT3:             model = 129; samples = { { 0, 64, 15, 0, ~0u }, { 64, 64, 0, 0, ~0u } }; break;
+        case DXT5:             model = 130; samples = { { 0, 64, 15, 0, ~0u }, { 64, 64, 0, 0, ~0u } }; break;
+        case ATI1N:
+        case VITAMIN_BC4:      model = 131; samples = { { 0, 64, 0, 0, ~0u } }; break;
+        case VITAMIN_BC5:      model = 132; samples = { { 0, 64, 0, 0, ~0u }, { 64, 64, 1, 0, ~0u } }; break;
+        case VITAMIN_BC6H:     model = 133; samples = { { 0, 128, ChannelFloat, 0, FloatOne } }; break;
+        case VITAMIN_BC7:      model = 134; samples = { { 0, 128, 0, 0, ~0u } }; break;
+
+        default: {
+          const PixelLayout layout = getPixelLayout(format);
+          uint32_t elementBits = 8;
+          uint32_t flags = 0;
+          if (layout.encoding == PixelEncoding::UNorm16 || layout.encoding == PixelEncoding::Half)
+            elementBits = 16;
+          else if (layout.encoding == PixelEncoding::Float)
+            elementBits = 32;
+          if (layout.encoding == PixelEncoding::Half || layout.encoding == PixelEncoding::Float)
+            flags = ChannelFloat | ChannelSigned;
+
+          // Luminance is stored as red, a luminance alpha as green.
+          const uint32_t channels = layout.luminance ? 2 : 4;
+          for (uint32_t c = 0; c < channels; c++) {
+            const uint32_t source = layout.luminance && c == 1 ? 3 : c;
+            const uint32_t id = c == 3 ? 15 : c;
+            uint32_t offset, length;
+            if (layout.encoding == PixelEncoding::Packed) {
+              if (!layout.bits[source])
+                continue;
+              offset = layout.shifts[source];
+              length = layout.bits[source];
+            } else {
+              if (layout.elements[source] < 0)
+                continue;
+              offset = uint32_t(layout.elements[source]) * elementBits;
+              length = elementBits;
+            }
+
+            if (flags)
+              samples.push_back({ offset, length, id | flags, FloatMinusOne, FloatOne });
+            else
+              samples.push_back({ offset, length, id | (srgb && id == 15 ? ChannelLinear : 0), 0, length >= 32 ? ~0u : (1u << length) - 1u });
+          }
+          std::sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b) { return a.bitOffset < b.bitOffset; });
+          break;
+        }
+      }
+      if (model != 1) {
+        blockSize = { 4, 4 };
+        if (srgb) {
+          for (Sample& sample : samples) {
+            if (sample.channel == 15)
+              sample.channel |= ChannelLinear;
+          }
+        }
+      }
+
+      const uint32_t blockWords = 6 + 4 * uint32_t(samples.size());
+      std::vector<uint32_t> dfd;
+      dfd.reserve(1 + blockWords);
+      dfd.push_back((1 + blockWords) * 4);                          // dfdTotalSize
+      dfd.push_back(0);                                             // Khronos vendor, basic descriptor type
+      dfd.push_back(2 | ((blockWords * 4) << 16));                  // Version 1.3, block size
+      dfd.push_back(model | (1u << 8) | ((srgb ? 2u : 1u) << 16));  // BT.709 primaries, sRGB or linear transfer
+      dfd.push_back((blockSize[0] - 1) | ((blockSize[1] - 1) << 8));
+      dfd.push_back(bytes);                                         // bytesPlane0
+      dfd.push_back(0);
+      for (const Sample& sample : samples) {
+        dfd.push_back(sample.bitOffset | ((sample.bitLength - 1) << 16) | (sample.channel << 24));
+        dfd.push_back(0);
+        dfd.push_back(sample.lower);
+        dfd.push_back(sample.upper);
+      }
+      return dfd;
+    }
+
+    template <typename T>
+    inline void appendBytes(std::vector<uint8_t>& dst, const T& value) {
+      const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+      dst.insert(dst.end(), bytes, bytes + sizeof(T));
+    }
+
+  }
+
+  // A DDS or KTX2 file laid out over the image data of a VTF, made with
+  // exportDDS() or exportKTX2().
+  //
+  // Only the container headers are owned. The image data is referred to in
+  // place as a list of spans in file order, so compressed blocks are passed
+  // through untouched and the VTF's buffer must stay valid until the file
+  // has been written.
+  class TextureExport {
+  public:
+    TextureExport(TextureExport&&) = default;
+    TextureExport& operator=(TextureExport&&) = default;
+
+    // m_pieces points into m_header.
+    TextureExport(const TextureExport&) = delete;
+    TextureExport& operator=(const TextureExport&) = delete;
+
+    size_t fileSize() const { return m_size; }
+
+    // The file as a list of spans, front to back.
+    std::span<const std::span<const uint8_t>> pieces() const { return m_pieces; }
+
+    // Writes the file into dst, which must hold at least fileSize() bytes.
+    void write(std::span<uint8_t> dst) const {
+      if (dst.size() < m_size)
+        throw std::runtime_error("Output buffer is too small for the exported file.");
+
+      size_t offset = 0;
+      for (std::span<const uint8_t> piece : m_pieces) {
+        std::memcpy(dst.data() + offset, piece.data(), piece.size());
+        offset += piece.size();
+      }
+    }
+
+    std::vector<uint8_t> write() const {
+      std::vector<uint8_t> file(m_size);
+      write(std::span<uint8_t>{ file });
+      return file;
+    }
+
+    // Streams the file front to back through sink(std::span<const uint8_t>).
+    template <typename Sink>
+      requires std::invocable<Sink&, std::span<const uint8_t>>
+    void write(Sink&& sink) const {
+      for (std::span<const uint8_t> piece : m_pieces)
+        sink(piece);
+    }
+
+#ifndef _WIN32
+    // Writes the file to a file descriptor with writev, straight from the
+    // source buffers.
+    void write(int fd) const {
+      std::vector<iovec> iovecs(m_pieces.size());
+      for (size_t i = 0; i < m_pieces.size(); i++)
+        iovecs[i] = { const_cast<uint8_t*>(m_pieces[i].data()), m_pieces[i].size() };
+
+      for (size_t first = 0; first < iovecs.size();) {
+        const int count = int(std::min<size_t>(iovecs.size() - first, IOV_MAX));
+        ssize_t written = ::writev(fd, &iovecs[first], count);
+        if (written < 0) {
+          if (errno == EINTR)
+            continue;
+          throw std::runtime_error("Could not write exported file: " + std::string{ std::strerror(errno) });
+        }
+
+        // Skip what was written, resuming partial writes mid-piece.
+        for (; first < iovecs.size() && size_t(written) >= iovecs[first].iov_len; first++)
+          written -= ssize_t(iovecs[first].iov_len);
+        if (written) {
+          iovecs[first].iov_base = static_cast<uint8_t*>(iovecs[first].iov_base) + written;
+          iovecs[first].iov_len -= size_t(written);
+        }
+      }
+    }
+#endif
+
+    void writeFile(const std::filesystem::path& path) const {
+      std::ofstream file{ path, std::ios::out | std::ios::binary | std::ios::trunc };
+      if (!file)
+        throw std::runtime_error("Could not open file for writing: " + path.string());
+
+      write([&file](std::span<const uint8_t> data) {
+        file.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+      });
+
+      if (!file.flush())
+        throw std::runtime_error("Could not write file: " + path.string());
+    }
+
+  private:
+    friend TextureExport exportDDS(const VTFData& vtf);
+    friend TextureExport exportKTX2(const VTFData& vtf);
+
+    explicit TextureExport(std::vector<uint8_t> header)
+      : m_header{ std::move(header) } {
+      add(m_header);
+    }
+
+    // Adjacent spans are merged, so runs of subresources that are already
+    // in order become one piece.
+    void add(std::span<const uint8_t> data) {
+      if (data.empty())
+        return;
+      if (!m_pieces.empty() && m_pieces.back().data() + m_pieces.back().size() == data.data())
+        m_pieces.back() = { m_pieces.back().data(), m_pieces.back().size() + data.size() };
+      else
+        m_pieces.push_back(data);
+      m_size += data.size();
+    }
+
+    void addPadding(size_t alignment) {
+      static constexpr std::array<uint8_t, 16> Zeros{};
+      const size_t padding = (alignment - m_size % alignment) % alignment;
+      add(std::span{ Zeros }.first(padding));
+    }
+
+    std::vector<uint8_t>                  m_header;
+    std::vector<std::span<const uint8_t>> m_pieces;
+    size_t                                m_size = 0;
+
+    static void validate(const VTFData& vtf) {
+      if (vtf.consoleHeader())
+        throw std::runtime_error("Console VTFs can't be exported.");
+      if (!vtf.imageData())
+        throw std::runtime_error("Image data is not available.");
+    }
+  };
+
+  // Lays out `vtf` as a DDS file. Formats with a legacy DDS equivalent get
+  // the legacy header when it can describe the texture, the rest (BC4 -
+  // BC7, sRGB, animated textures) the DX10 extension header. Each frame is
+  // an array element, faces of each frame follow each other and every face
+  // has its mips largest first.
+  inline TextureExport exportDDS(const VTFData& vtf) {
+    TextureExport::validate(vtf);
+    const meta::VTFHeader& source = vtf.getHeader();
+    const detail::ExportFormatInfo info = detail::getExportFormatInfo(source.format);
+    const bool srgb = (source.flags & meta::VTFFlags::SRGB) && info.dxgiFormatSRGB;
+    const bool cube = vtf.faceCount() == 6;
+    const bool legacy = (info.ddsFourCC || info.ddsMasks) && source.numFrames == 1 && !srgb;
+    if (!legacy && !info.dxgiFormat)
+      throw std::runtime_error("Image format has no DDS equivalent for this texture.");
+    if (!legacy && source.depth > 1 && source.numFrames > 1)
+      throw std::runtime_error("DDS can't hold animated volume textures.");
+
+    meta::DDSHeader header;
+    header.flags       = meta::DDSHeader::FlagsCaps | meta::DDSHeader::FlagsHeight | meta::DDSHeader::FlagsWidth | meta::DDSHeader::FlagsPixelFormat;
+    header.width       = source.width;
+    header.height      = source.height;
+    header.mipMapCount = source.numMipLevels;
+    header.caps        = meta::DDSHeader::CapsTexture;
+    if (getImageFormatInfo(source.format)->isCompressed) {
+      header.flags |= meta::DDSHeader::FlagsLinearSize;
+      header.pitchOrLinearSize = uint32_t(getMemoryRequiredForMip(source.width, source.height, 1, source.format));
+    } else {
+      header.flags |= meta::DDSHeader::FlagsPitch;
+      header.pitchOrLinearSize = uint32_t(getMemoryRequiredForMip(source.width, 1, 1, source.format));
+    }
+    if (source.numMipLevels > 1) {
+      header.flags |= meta::DDSHeader::FlagsMipMapCount;
+      header.caps  |= meta::DDSHeader::CapsMipMap | meta::DDSHeader::CapsComplex;
+    }
+    if (cube) {
+      header.caps  |= meta::DDSHeader::CapsComplex;
+      header.caps2 |= meta::DDSHeader::Caps2CubeMap;
+    }
+    if (source.depth > 1) {
+      header.flags |= meta::DDSHeader::FlagsDepth;
+      header.depth  = source.depth;
+      header.caps  |= meta::DDSHeader::CapsComplex;
+      header.caps2 |= meta::DDSHeader::Caps2Volume;
+    }
+
+    if (legacy && info.ddsFourCC) {
+      header.pixelFormat.flags  = meta::DDSPixelFormat::FourCC;
+      header.pixelFormat.fourCC = info.ddsFourCC;
+    } else if (legacy) {
+      header.pixelFormat = detail::makeDDSMaskPixelFormat(source.format);
+    } else {
+      header.pixelFormat.flags  = meta::DDSPixelFormat::FourCC;
+      header.pixelFormat.fourCC = meta::DDSHeaderDX10::FourCC;
+    }
+
+    std::vector<uint8_t> bytes;
+    detail::appendBytes(bytes, header);
+    if (!legacy) {
+      meta::DDSHeaderDX10 dx10;
+      dx10.dxgiFormat        = srgb ? info.dxgiFormatSRGB : info.dxgiFormat;
+      dx10.resourceDimension = source.depth > 1 ? meta::DDSHeaderDX10::Texture3D : meta::DDSHeaderDX10::Texture2D;
+      dx10.miscFlag          = cube ? meta::DDSHeaderDX10::MiscTextureCube : 0;
+      dx10.arraySize         = source.numFrames;
+      detail::appendBytes(bytes, dx10);
+    }
+
+    TextureExport file{ std::move(bytes) };
+    for (uint16_t frame = 0; frame < source.numFrames; frame++) {
+      for (uint16_t face = 0; face < vtf.faceCount(); face++) {
+        for (uint8_t mip = 0; mip < source.numMipLevels; mip++) {
+          const SubresourceLayout& first = vtf.subresource(frame, face, mip, 0);
+          const uint16_t slices = std::get<2>(adjustImageSizeByMip(source.width, source.height, source.depth, mip));
+          file.add({ vtf.imageData(first).data(), size_t(first.size) * slices });
+        }
+      }
+    }
+    return file;
+  }
+
+  // Lays out `vtf` as a KTX2 file. Frames are array layers. KTX2 stores
+  // mips smallest first and each mip as layers, faces then slices, which is
+  // the order of the VTF itself, so the image data is passed through with
+  // only the alignment KTX2 wants between mips.
+  inline TextureExport exportKTX2(const VTFData& vtf) {
+    TextureExport::validate(vtf);
+    const meta::VTFHeader& source = vtf.getHeader();
+    const detail::ExportFormatInfo info = detail::getExportFormatInfo(source.format);
+    if (!info.vkFormat)
+      throw std::runtime_error("Image format has no KTX2 equivalent.");
+    const bool srgb = (source.flags & meta::VTFFlags::SRGB) && info.vkFormatSRGB;
+
+    const std::vector<uint32_t> dfd = detail::makeKTX2DataFormatDescriptor(source.format, srgb);
+    const uint32_t blockBytes = uint32_t(getMemoryRequiredForMip(1, 1, 1, source.format));
+    const uint32_t alignment  = std::lcm(blockBytes, 4u);
+
+    meta::KTX2Header header;
+    header.vkFormat    = srgb ? info.vkFormatSRGB : info.vkFormat;
+    header.pixelWidth  = source.width;
+    header.pixelHeight = source.height;
+    header.pixelDepth  = source.depth > 1 ? source.depth : 0;
+    header.layerCount  = source.numFrames > 1 ? source.numFrames : 0;
+    header.faceCount   = vtf.faceCount();
+    header.levelCount  = source.numMipLevels;
+    if (getImageFormatInfo(source.format)->isCompressed) {
+      header.typeSize = 1;
+    } else {
+      const detail::PixelLayout layout = detail::getPixelLayout(source.format);
+      switch (layout.encoding) {
+        case detail::PixelEncoding::Packed:  header.typeSize = layout.size; break;
+        case detail::PixelEncoding::UNorm16:
+        case detail::PixelEncoding::Half:    header.typeSize = 2; break;
+        case detail::PixelEncoding::Float:   header.typeSize = 4; break;
+        default:                             header.typeSize = 1; break;
+      }
+    }
+    header.dfdByteOffset = uint32_t(sizeof(header) + source.numMipLevels * sizeof(meta::KTX2LevelIndex));
+    header.dfdByteLength = uint32_t(dfd.size() * sizeof(uint32_t));
+
+    // Key and value, both null terminated.
+    static constexpr char Writer[] = "KTXwriter\0libvtf++";
+    const uint32_t writerLength = uint32_t(sizeof(Writer));
+    header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+    header.kvdByteLength = (sizeof(uint32_t) + writerLength + 3) & ~3u;
+
+    // Level offsets, smallest mip first in the file.
+    std::vector<meta::KTX2LevelIndex> levels(source.numMipLevels);
+    uint64_t offset = header.kvdByteOffset + header.kvdByteLength;
+    for (int mip = source.numMipLevels - 1; mip >= 0; mip--) {
+      offset = (offset + alignment - 1) / alignment * alignment;
+      uint64_t size = 0;
+      for (uint16_t frame = 0; frame < source.numFrames; frame++) {
+        for (uint16_t face = 0; face < vtf.faceCount(); face++)
+          size += uint64_t(vtf.subresource(frame, face, uint8_t(mip), 0).size) * std::get<2>(adjustImageSizeByMip(source.width, source.height, source.depth, uint8_t(mip)));
+      }
+      levels[size_t(mip)] = { offset, size, size };
+      offset += size;
+    }
+
+    std::vector<uint8_t> bytes;
+    detail::appendBytes(bytes, header);
+    for (const meta::KTX2LevelIndex& level : levels)
+      detail::appendBytes(bytes, level);
+    for (uint32_t word : dfd)
+      detail::appendBytes(bytes, word);
+    detail::appendBytes(bytes, writerLength);
+    bytes.insert(bytes.end(), Writer, Writer + sizeof(Writer));
+    bytes.resize((bytes.size() + 3) & ~size_t(3), 0);
+
+    TextureExport file{ std::move(bytes) };
+    for (int mip = source.numMipLevels - 1; mip >= 0; mip--) {
+      file.addPadding(alignment);
+      for (uint16_t frame = 0; frame < source.numFrames; frame++) {
+        for (uint16_t face = 0; face < vtf.faceCount(); face++) {
+          const SubresourceLayout& first = vtf.subresource(frame, face, uint8_t(mip), 0);
+          const uint16_t slices = std::get<2>(adjustImageSizeByMip(source.width, source.height, source.depth, uint8_t(mip)));
+          file.add({ vtf.imageData(first).data(), size_t(first.size) * slices });
+        }
+      }
+    }
+    return file;
+  }
+
+}
@@ -0,0 +1,319 @@
+#pragma once
+
+// Hot path instrumentation, compiled in only when LIBVTF_INSTRUMENTATION is
+// defined before including any libvtf++ header. Without it the hooks below
+// expand to nothing and their arguments are not evaluated.
+//
+// LIBVTF_INSTRUMENT_SCOPE(Stage, bytes) times the rest of the enclosing
+// scope, LIBVTF_INSTRUMENT_COUNT(Stage, bytes) only counts a call. Stage is
+// an InstrumentStage enumerator name.
+//
+// Counters live in thread local storage and are only read when a snapshot
+// is taken, so recording a sample is a few uncontended stores.
+
+#ifdef LIBVTF_INSTRUMENTATION
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace libvtf {
+
+  enum class InstrumentStage : uint8_t {
+    Read,           // File I/O
+    Validate,       // Header, directory and data bounds checks
+    Parse,          // Resource directory index and offsets
+    Layout,         // Subresource layout
+    ImageData,      // Subresource accesses, counted only
+    ResourceLookup, // Resource accesses, counted only
+    Decode,
+    Convert,
+    Encode,
+    Count,
+  };
+
+  static constexpr uint32_t InstrumentStageCount = uint32_t(InstrumentStage::Count);
+
+  constexpr const char* getInstrumentStageName(InstrumentStage stage) {
+    switch (stage) {
+      case InstrumentStage::Read:           return "Read";
+      case InstrumentStage::Validate:       return "Validate";
+      case InstrumentStage::Parse:          return "Parse";
+      case InstrumentStage::Layout:         return "Layout";
+      case InstrumentStage::ImageData:      return "ImageData";
+      case InstrumentStage::ResourceLookup: return "ResourceLookup";
+      case InstrumentStage::Decode:         return "Decode";
+      case InstrumentStage::Convert:        return "Convert";
+      case InstrumentStage::Encode:         return "Encode";
+      default:                              return "?";
+    }
+  }
+
+  // Latency histogram buckets: bucket i counts samples of [2^(i-1), 2^i)
+  // nanoseconds, bucket 0 samples under 1ns.
+  static constexpr uint32_t InstrumentHistogramBuckets = 40;
+
+  struct InstrumentStageStats {
+    uint64_t calls       = 0;
+    uint64_t bytes       = 0;
+    uint64_t nanoseconds = 0; // Timed scopes only
+    std::array<uint64_t, InstrumentHistogramBuckets> histogram{};
+
+    // Upper bound of the bucket holding the given fraction (0 - 1) of the
+    // timed samples, 0 if there are none.
+    uint64_t percentileNanoseconds(double fraction) const {
+      uint64_t total = 0;
+      for (uint64_t count : histogram)
+        total += count;
+      if (!total)
+        return 0;
+
+      const uint64_t target = std::max<uint64_t>(1, uint64_t(fraction * double(total) + 0.5));
+      uint64_t seen = 0;
+      for (uint32_t i = 0; i < InstrumentHistogramBuckets; i++) {
+        seen += histogram[i];
+        if (seen >= target)
+          return uint64_t(1) << i;
+      }
+      return uint64_t(1) << (InstrumentHistogramBuckets - 1);
+    }
+  };
+
+  struct InstrumentSnapshot {
+    std::array<InstrumentStageStats, InstrumentStageCount> stages{};
+
+    const InstrumentStageStats& operator[](InstrumentStage stage) const { return stages[uint32_t(stage)]; }
+  };
+
+  namespace detail {
+
+    struct TraceEvent {
+      InstrumentStage stage;
+      uint64_t        start;    // ns since the registry was created
+      uint64_t        duration; // ns
+      uint64_t        bytes;
+    };
+
+    // Only written by the owning thread. Other threads read them for
+    // snapshots, hence relaxed atomics instead of plain integers.
+    struct InstrumentCounters {
+      std::atomic<uint64_t> calls{ 0 };
+      std::atomic<uint64_t> bytes{ 0 };
+      std::atomic<uint64_t> nanoseconds{ 0 };
+      std::array<std::atomic<uint64_t>, InstrumentHistogramBuckets> histogram{};
+    };
+
+    inline void addRelaxed(std::atomic<uint64_t>& counter, uint64_t value) {
+      counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    struct InstrumentThreadState {
+      static constexpr size_t MaxTraceEvents = 1 << 20;
+
+      std::array<InstrumentCounters, InstrumentStageCount> stages;
+      uint32_t                id = 0;
+      std::mutex              eventsMutex;
+      std::vector<TraceEvent> events;
+    };
+
+    struct InstrumentRegistry {
+      std::mutex                          mutex;
+      std::vector<InstrumentThreadState*> threads;
+      InstrumentSnapshot                  retired; // Stats of threads that have exited
+      std::vector<std::pair<uint32_t, TraceEvent>> retiredEvents;
+      uint32_t                            nextThreadId = 1;
+      std::atomic<bool>                   tracing{ false };
+      const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    };
+
+    inline InstrumentRegistry& getInstrumentRegistry() {
+      static InstrumentRegistry registry;
+      return registry;
+    }
+
+    inline void addCounters(InstrumentStageStats& stats, const InstrumentCounters& counters) {
+      stats.calls       += counters.calls.load(std::memory_order_relaxed);
+      stats.bytes       += counters.bytes.load(std::memory_order_relaxed);
+      stats.nanoseconds += counters.nanoseconds.load(std::memory_order_relaxed);
+      for (uint32_t i = 0; i < InstrumentHistogramBuckets; i++)
+        stats.histogram[i] += counters.histogram[i].load(std::memory_order_relaxed);
+    }
+
+    // Registers the thread's state on first use and folds it into the
+    // retired totals when the thread exits.
+    class InstrumentThreadHandle {
+    public:
+      InstrumentThreadHandle() {
+        InstrumentRegistry& registry = getInstrumentRegistry();
+        std::lock_guard lock{ registry.mutex };
+        m_state.id = registry.nextThreadId++;
+        registry.threads.push_back(&m_state);
+      }
+
+      ~InstrumentThreadHandle() {
+        InstrumentRegistry& registry = getInstrumentRegistry();
+        std::lock_guard lock{ registry.mutex };
+        for (uint32_t i = 0; i < InstrumentStageCount; i++)
+          addCounters(registry.retired.stages[i], m_state.stages[i]);
+        for (const TraceEvent& event : m_state.events)
+          registry.retiredEvents.emplace_back(m_state.id, event);
+        registry.threads.erase(std::find(registry.threads.begin(), registry.threads.end(), &m_state));
+      }
+
+      InstrumentThreadState& state() { return m_state; }
+
+    private:
+      InstrumentThreadState m_state;
+    };
+
+    inline InstrumentThreadState& getInstrumentThreadState() {
+      thread_local InstrumentThreadHandle handle;
+      return handle.state();
+    }
+
+    inline void recordInstrumentCount(InstrumentStage stage, uint64_t bytes) {
+      InstrumentCounters& counters = getInstrumentThreadState().stages[uint32_t(stage)];
+      addRelaxed(counters.calls, 1);
+      addRelaxed(counters.bytes, bytes);
+    }
+
+    class InstrumentScope {
+    public:
+      InstrumentScope(InstrumentStage stage, uint64_t bytes)
+        : m_stage{ stage }
+        , m_bytes{ bytes }
+        , m_start{ std::chrono::steady_clock::now() } {
+      }
+
+      ~InstrumentScope() {
+        const auto end = std::chrono::steady_clock::now();
+        const uint64_t duration = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count());
+
+        InstrumentThreadState& state = getInstrumentThreadState();
+        InstrumentCounters& counters = state.stages[uint32_t(m_stage)];
+        addRelaxed(counters.calls, 1);
+        addRelaxed(counters.bytes, m_bytes);
+        addRelaxed(counters.nanoseconds, duration);
+        addRelaxed(counters.histogram[std::min<uint32_t>(uint32_t(std::bit_width(duration)), InstrumentHistogramBuckets - 1)], 1);
+
+        InstrumentRegistry& registry = getInstrumentRegistry();
+        if (registry.tracing.load(std::memory_order_relaxed)) {
+          const uint64_t start = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(m_start - registry.epoch).count());
+          std::lock_guard lock{ state.eventsMutex };
+          if (state.events.size() < InstrumentThreadState::MaxTraceEvents)
+            state.events.push_back({ m_stage, start, duration, m_bytes });
+        }
+      }
+
+      InstrumentScope(const InstrumentScope&) = delete;
+      InstrumentScope& operator=(const InstrumentScope&) = delete;
+
+    private:
+      InstrumentStage                       m_stage;
+      uint64_t                              m_bytes;
+      std::chrono::steady_clock::time_point m_start;
+    };
+
+  }
+
+  // Totals of every thread so far, including threads that have exited.
+  inline InstrumentSnapshot getInstrumentSnapshot() {
+    detail::InstrumentRegistry& registry = detail::getInstrumentRegistry();
+    std::lock_guard lock{ registry.mutex };
+
+    InstrumentSnapshot snapshot = registry.retired;
+    for (const detail::InstrumentThreadState* thread : registry.threads) {
+      for (uint32_t i = 0; i < InstrumentStageCount; i++)
+        detail::addCounters(snapshot.stages[i], thread->stages[i]);
+    }
+    return snapshot;
+  }
+
+  // Zeroes all counters. Samples recorded by other threads while this runs
+  // may be lost.
+  inline void resetInstrumentation() {
+    detail::InstrumentRegistry& registry = detail::getInstrumentRegistry();
+    std::lock_guard lock{ registry.mutex };
+
+    registry.retired = {};
+    for (detail::InstrumentThreadState* thread : registry.threads) {
+      for (detail::InstrumentCounters& counters : thread->stages) {
+        counters.calls.store(0, std::memory_order_relaxed);
+        counters.bytes.store(0, std::memory_order_relaxed);
+        counters.nanoseconds.store(0, std::memory_order_relaxed);
+        for (std::atomic<uint64_t>& bucket : counters.histogram)
+          bucket.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Records an event for every timed scope from now on, up to about a
+  // million per thread. Off by default.
+  inline void setTracingEnabled(bool enabled) {
+    detail::getInstrumentRegistry().tracing.store(enabled, std::memory_order_relaxed);
+  }
+
+  inline void clearTrace() {
+    detail::InstrumentRegistry& registry = detail::getInstrumentRegistry();
+    std::lock_guard lock{ registry.mutex };
+
+    registry.retiredEvents.clear();
+    for (detail::InstrumentThreadState* thread : registry.threads) {
+      std::lock_guard eventsLock{ thread->eventsMutex };
+      thread->events.clear();
+    }
+  }
+
+  // Writes the recorded events in the Chrome trace event format, for
+  // chrome://tracing or Perfetto.
+  inline void writeChromeTrace(std::ostream& out) {
+    detail::InstrumentRegistry& registry = detail::getInstrumentRegistry();
+    std::lock_guard lock{ registry.mutex };
+
+    bool first = true;
+    auto writeEvent = [&](uint32_t thread, const detail::TraceEvent& event) {
+      out << (first ? "\n" : ",\n")
+          << "{\"name\":\"" << getInstrumentStageName(event.stage) << "\",\"cat\":\"libvtf\",\"ph\":\"X\""
+          << ",\"ts\":" << double(event.start) / 1000.0
+          << ",\"dur\":" << double(event.duration) / 1000.0
+          << ",\"pid\":1,\"tid\":" << thread
+          << ",\"args\":{\"bytes\":" << event.bytes << "}}";
+      first = false;
+    };
+
+    const std::streamsize precision = out.precision(3);
+    const std::ios_base::fmtflags flags = out.setf(std::ios_base::fixed, std::ios_base::floatfield);
+    out << "{\"traceEvents\":[";
+    for (const auto& [thread, event] : registry.retiredEvents)
+      writeEvent(thread, event);
+    for (detail::InstrumentThreadState* thread : registry.threads) {
+      std::lock_guard eventsLock{ thread->eventsMutex };
+      for (const detail::TraceEvent& event : thread->events)
+        writeEvent(thread->id, event);
+    }
+    out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    out.precision(precision);
+    out.flags(flags);
+  }
+
+}
+
+#define LIBVTF_INSTRUMENT_CONCAT_(a, b) a##b
+#define LIBVTF_INSTRUMENT_CONCAT(a, b) LIBVTF_INSTRUMENT_CONCAT_(a, b)
+#define LIBVTF_INSTRUMENT_SCOPE(stage, bytes) \
+  const ::libvtf::detail::InstrumentScope LIBVTF_INSTRUMENT_CONCAT(libvtfInstrumentScope, __LINE__){ ::libvtf::InstrumentStage::stage, uint64_t(bytes) }
+#define LIBVTF_INSTRUMENT_COUNT(stage, bytes) \
+  ::libvtf::detail::recordInstrumentCount(::libvtf::InstrumentStage::stage, uint64_t(bytes))
+
+#else
+
+#define LIBVTF_INSTRUMENT_SCOPE(stage, bytes) ((void)0)
+#define LIBVTF_INSTRUMENT_COUNT(stage, bytes) ((void)0)
+
+#endif
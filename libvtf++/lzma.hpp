@@ -0,0 +1,351 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <span>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+namespace libvtf {
+
+  namespace meta {
+
+#ifdef _MSC_VER
+#pragma pack(push, 1)
+#endif
+
+    // Valve's header in front of an LZMA stream. Always little endian,
+    // even in console files.
+    PACKED_STRUCT(LZMAHeader) {
+      static constexpr std::array<char, 4> ValidID = { 'L', 'Z', 'M', 'A' };
+
+      std::array<char, 4>    id{};
+      uint32_t               actualSize{};  // Uncompressed size
+      uint32_t               lzmaSize{};    // Compressed size, not including this header
+      std::array<uint8_t, 5> properties{};  // lc/lp/pb byte and dictionary size
+    };
+
+#ifdef _MSC_VER
+#pragma pack(pop)
+#endif
+
+  }
+
+  namespace detail {
+
+    class LZMARangeDecoder {
+    public:
+      static constexpr uint32_t ProbBits = 11;
+      static constexpr uint16_t ProbInit = 1u << (ProbBits - 1);
+
+      void init(std::span<const uint8_t> input) {
+        if (input.size() < 5 || input[0] != 0)
+          throw std::runtime_error("Corrupt LZMA stream.");
+
+        m_input = input.data();
+        m_end   = input.data() + input.size();
+        m_next  = m_input + 5;
+        m_range = 0xFFFFFFFFu;
+        m_code  = uint32_t(input[1]) << 24 | uint32_t(input[2]) << 16 | uint32_t(input[3]) << 8 | input[4];
+      }
+
+      uint32_t decodeBit(uint16_t& prob) {
+        const uint32_t bound = (m_range >> ProbBits) * prob;
+        uint32_t bit;
+        if (m_code < bound) {
+          m_range = bound;
+          prob   += ((1u << ProbBits) - prob) >> 5;
+          bit     = 0;
+        } else {
+          m_range -= bound;
+          m_code  -= bound;
+          prob    -= prob >> 5;
+          bit      = 1;
+        }
+        normalize();
+        return bit;
+      }
+
+      uint32_t decodeDirectBits(uint32_t count) {
+        uint32_t result = 0;
+        for (; count; count--) {
+          m_range >>= 1;
+          const uint32_t bit = m_code >= m_range ? 1u : 0u;
+          m_code -= m_range & (0u - bit);
+          result  = (result << 1) | bit;
+          normalize();
+        }
+        return result;
+      }
+
+      uint32_t decodeBitTree(uint16_t* probs, uint32_t bits) {
+        uint32_t symbol = 1;
+        for (uint32_t i = 0; i < bits; i++)
+          symbol = (symbol << 1) | decodeBit(probs[symbol]);
+        return symbol - (1u << bits);
+      }
+
+      uint32_t decodeReverseBitTree(uint16_t* probs, uint32_t bits) {
+        uint32_t symbol = 1, result = 0;
+        for (uint32_t i = 0; i < bits; i++) {
+          const uint32_t bit = decodeBit(probs[symbol]);
+          symbol  = (symbol << 1) | bit;
+          result |= bit << i;
+        }
+        return result;
+      }
+
+    private:
+      void normalize() {
+        if (m_range >= (1u << 24))
+          return;
+        if (m_next == m_end)
+          throw std::runtime_error("LZMA stream is truncated.");
+        m_range <<= 8;
+        m_code   = (m_code << 8) | *m_next++;
+      }
+
+      const uint8_t* m_input = nullptr;
+      const uint8_t* m_next  = nullptr;
+      const uint8_t* m_end   = nullptr;
+      uint32_t       m_range = 0;
+      uint32_t       m_code  = 0;
+    };
+
+  }
+
+  // Incremental LZMA decoder.
+  //
+  // Output goes to a buffer that holds everything decoded so far, which
+  // doubles as the LZMA dictionary. decodeTo() only inflates as far as
+  // asked, so reading the start of a payload doesn't cost inflating all of
+  // it, and later calls carry on where the last one stopped. The compressed
+  // input may be a prefix of the stream as long as it covers the output
+  // that is asked for. reset() keeps the buffer's memory for the next
+  // stream. After decodeTo() throws the decoder has to be reset.
+  class LZMADecoder {
+  public:
+    LZMADecoder() = default;
+
+    // `stream` starts with a meta::LZMAHeader.
+    explicit LZMADecoder(std::span<const uint8_t> stream, size_t maxSize = SIZE_MAX) {
+      reset(stream, maxSize);
+    }
+
+    // The output buffer is sized from the header up front, streams that
+    // claim more than `maxSize` bytes are rejected before allocating it.
+    void reset(std::span<const uint8_t> stream, size_t maxSize = SIZE_MAX) {
+      if (stream.size() < sizeof(meta::LZMAHeader))
+        throw std::runtime_error("LZMA stream is too small for its header.");
+
+      meta::LZMAHeader header;
+      std::memcpy(&header, stream.data(), sizeof(header));
+      if (header.id != meta::LZMAHeader::ValidID)
+        throw std::runtime_error("Invalid LZMA header.");
+      if (header.actualSize > maxSize)
+        throw std::runtime_error("LZMA stream is larger than expected.");
+
+      reset(header.properties, stream.subspan(sizeof(header), std::min<size_t>(header.lzmaSize, stream.size() - sizeof(header))), header.actualSize);
+    }
+
+    // Raw LZMA stream with separate properties.
+    void reset(std::span<const uint8_t, 5> properties, std::span<const uint8_t> data, uint32_t uncompressedSize) {
+      uint32_t value = properties[0];
+      if (value >= 9 * 5 * 5)
+        throw std::runtime_error("Invalid LZMA properties.");
+      m_lc = value % 9;
+      value /= 9;
+      m_lp = value % 5;
+      m_pb = value / 5;
+
+      m_probs.assign(LiteralProbsOffset + (0x300u << (m_lc + m_lp)), detail::LZMARangeDecoder::ProbInit);
+      m_output.resize(uncompressedSize);
+      m_decoded = 0;
+      m_state   = 0;
+      m_reps    = {};
+      m_rangeDecoder.init(data);
+    }
+
+    size_t totalSize()   const { return m_output.size(); }
+    size_t decodedSize() const { return m_decoded; }
+
+    // Everything decoded so far.
+    std::span<const uint8_t> output() const { return { m_output.data(), m_decoded }; }
+    std::span<uint8_t>       output()       { return { m_output.data(), m_decoded }; }
+
+    // Decodes until at least `size` bytes (clamped to the total) are
+    // available. May decode up to one match past it.
+    void decodeTo(size_t size) {
+      size = std::min(size, m_output.size());
+
+      detail::LZMARangeDecoder rc      = m_rangeDecoder;
+      uint8_t*                 out     = m_output.data();
+      size_t                   pos     = m_decoded;
+      uint32_t                 state   = m_state;
+      std::array<uint32_t, 4>  reps    = m_reps;
+      uint16_t*                probs   = m_probs.data();
+      const uint32_t           pbMask  = (1u << m_pb) - 1;
+      const uint32_t           lpMask  = (1u << m_lp) - 1;
+      const size_t             outSize = m_output.size();
+
+      while (pos < size) {
+        const uint32_t posState = uint32_t(pos) & pbMask;
+
+        if (!rc.decodeBit(probs[IsMatch + (state << PosStatesBitsMax) + posState])) {
+          const uint32_t prevByte = pos ? out[pos - 1] : 0;
+          uint16_t* literal = probs + LiteralProbsOffset + 0x300u * (((uint32_t(pos) & lpMask) << m_lc) + (prevByte >> (8 - m_lc)));
+
+          uint32_t symbol = 1;
+          if (state >= 7) {
+            uint32_t matchByte = out[pos - reps[0] - 1];
+            do {
+              const uint32_t matchBit = (matchByte >> 7) & 1;
+              matchByte <<= 1;
+              const uint32_t bit = rc.decodeBit(literal[((1 + matchBit) << 8) + symbol]);
+              symbol = (symbol << 1) | bit;
+              if (matchBit != bit)
+                break;
+            } while (symbol < 0x100);
+          }
+          while (symbol < 0x100)
+            symbol = (symbol << 1) | rc.decodeBit(literal[symbol]);
+
+          out[pos++] = uint8_t(symbol);
+          state = state < 4 ? 0 : (state < 10 ? state - 3 : state - 6);
+          continue;
+        }
+
+        uint32_t length;
+        if (rc.decodeBit(probs[IsRep + state])) {
+          if (!rc.decodeBit(probs[IsRepG0 + state])) {
+            if (!rc.decodeBit(probs[IsRep0Long + (state << PosStatesBitsMax) + posState])) {
+              // Short rep: a single byte from rep0.
+              if (reps[0] >= pos)
+                throw std::runtime_error("Corrupt LZMA stream.");
+              state = state < 7 ? 9 : 11;
+              out[pos] = out[pos - reps[0] - 1];
+              pos++;
+              continue;
+            }
+          } else {
+            uint32_t distance;
+            if (!rc.decodeBit(probs[IsRepG1 + state])) {
+              distance = reps[1];
+            } else {
+              if (!rc.decodeBit(probs[IsRepG2 + state])) {
+                distance = reps[2];
+              } else {
+                distance = reps[3];
+                reps[3]  = reps[2];
+              }
+              reps[2] = reps[1];
+            }
+            reps[1] = reps[0];
+            reps[0] = distance;
+          }
+          length = decodeLength(rc, probs + RepLenCoder, posState);
+          state  = state < 7 ? 8 : 11;
+        } else {
+          reps[3] = reps[2];
+          reps[2] = reps[1];
+          reps[1] = reps[0];
+          length  = decodeLength(rc, probs + LenCoder, posState);
+          state   = state < 7 ? 7 : 10;
+          reps[0] = decodeDistance(rc, probs, length);
+          if (reps[0] == 0xFFFFFFFFu)
+            break; // End marker
+        }
+
+        length += MatchMinLength;
+        if (reps[0] >= pos || length > outSize - pos)
+          throw std::runtime_error("Corrupt LZMA stream.");
+
+        // Byte by byte, matches may overlap their own output.
+        const uint8_t* src = out + pos - reps[0] - 1;
+        for (uint32_t i = 0; i < length; i++)
+          out[pos + i] = src[i];
+        pos += length;
+      }
+
+      m_rangeDecoder = rc;
+      m_decoded      = pos;
+      m_state        = state;
+      m_reps         = reps;
+      if (pos < size)
+        throw std::runtime_error("LZMA stream ended early.");
+    }
+
+    void decodeAll() {
+      decodeTo(m_output.size());
+    }
+
+  private:
+    static constexpr uint32_t PosStatesBitsMax = 4;
+    static constexpr uint32_t NumStates        = 12;
+    static constexpr uint32_t MatchMinLength   = 2;
+    static constexpr uint32_t EndPosModelIndex = 14;
+    static constexpr uint32_t NumFullDistances = 1u << (EndPosModelIndex >> 1);
+    static constexpr uint32_t NumAlignBits     = 4;
+
+    // Length coder: choice, choice2, low[16][8], mid[16][8], high[256]
+    static constexpr uint32_t LenChoice  = 0;
+    static constexpr uint32_t LenChoice2 = 1;
+    static constexpr uint32_t LenLow     = 2;
+    static constexpr uint32_t LenMid     = LenLow + (16u << 3);
+    static constexpr uint32_t LenHigh    = LenMid + (16u << 3);
+    static constexpr uint32_t LenCoderSize = LenHigh + 256;
+
+    // All probabilities live in one array, literals last.
+    static constexpr uint32_t IsMatch            = 0;
+    static constexpr uint32_t IsRep              = IsMatch + (NumStates << PosStatesBitsMax);
+    static constexpr uint32_t IsRepG0            = IsRep + NumStates;
+    static constexpr uint32_t IsRepG1            = IsRepG0 + NumStates;
+    static constexpr uint32_t IsRepG2            = IsRepG1 + NumStates;
+    static constexpr uint32_t IsRep0Long         = IsRepG2 + NumStates;
+    static constexpr uint32_t PosSlot            = IsRep0Long + (NumStates << PosStatesBitsMax);
+    static constexpr uint32_t SpecPos            = PosSlot + (4u << 6);
+    static constexpr uint32_t Align              = SpecPos + NumFullDistances - EndPosModelIndex;
+    static constexpr uint32_t LenCoder           = Align + (1u << NumAlignBits);
+    static constexpr uint32_t RepLenCoder        = LenCoder + LenCoderSize;
+    static constexpr uint32_t LiteralProbsOffset = RepLenCoder + LenCoderSize;
+
+    // Returns the length minus MatchMinLength.
+    static uint32_t decodeLength(detail::LZMARangeDecoder& rc, uint16_t* probs, uint32_t posState) {
+      if (!rc.decodeBit(probs[LenChoice]))
+        return rc.decodeBitTree(probs + LenLow + (posState << 3), 3);
+      if (!rc.decodeBit(probs[LenChoice2]))
+        return 8 + rc.decodeBitTree(probs + LenMid + (posState << 3), 3);
+      return 16 + rc.decodeBitTree(probs + LenHigh, 8);
+    }
+
+    static uint32_t decodeDistance(detail::LZMARangeDecoder& rc, uint16_t* probs, uint32_t length) {
+      const uint32_t lengthState = std::min<uint32_t>(length, 3);
+      const uint32_t slot        = rc.decodeBitTree(probs + PosSlot + (lengthState << 6), 6);
+      if (slot < 4)
+        return slot;
+
+      const uint32_t directBits = (slot >> 1) - 1;
+      uint32_t distance = (2 | (slot & 1)) << directBits;
+      if (slot < EndPosModelIndex)
+        return distance + rc.decodeReverseBitTree(probs + SpecPos + distance - slot - 1, directBits);
+
+      distance += rc.decodeDirectBits(directBits - NumAlignBits) << NumAlignBits;
+      return distance + rc.decodeReverseBitTree(probs + Align - 1, NumAlignBits);
+    }
+
+    uint32_t                 m_lc = 0;
+    uint32_t                 m_lp = 0;
+    uint32_t                 m_pb = 0;
+    std::vector<uint16_t>    m_probs;
+    std::vector<uint8_t>     m_output;
+    size_t                   m_decoded = 0;
+    uint32_t                 m_state   = 0;
+    std::array<uint32_t, 4>  m_reps{};
+    detail::LZMARangeDecoder m_rangeDecoder;
+  };
+
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+
+#include <filesystem>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+# ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+# endif
+# ifndef NOMINMAX
+#  define NOMINMAX
+# endif
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace libvtf {
+
+  enum class AccessHint {
+    Normal,
+    Sequential,
+    Random,
+    WillNeed,
+    DontNeed,
+  };
+
+  // Read-only memory mapping of a whole file.
+  class MappedFile {
+  public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::filesystem::path& path) {
+      LIBVTF_INSTRUMENT_SCOPE(Read, 0);
+#ifdef _WIN32
+      HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Could not open file: " + path.string());
+
+      LARGE_INTEGER size{};
+      if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw std::runtime_error("Could not stat file: " + path.string());
+      }
+
+      if (size.QuadPart) {
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) {
+          m_data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+          CloseHandle(mapping);
+        }
+        if (!m_data) {
+          CloseHandle(file);
+          throw std::runtime_error("Could not map file: " + path.string());
+        }
+      }
+      CloseHandle(file);
+      m_size = size_t(size.QuadPart);
+#else
+      const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0)
+        throw std::runtime_error("Could not open file: " + path.string());
+
+      struct stat info{};
+      if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Could not stat file: " + path.string());
+      }
+
+      if (info.st_size) {
+        void* data = ::mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+          ::close(fd);
+          throw std::runtime_error("Could not map file: " + path.string());
+        }
+        m_data = static_cast<const uint8_t*>(data);
+      }
+      // The mapping keeps its own reference to the file.
+      ::close(fd);
+      m_size = size_t(info.st_size);
+#endif
+    }
+
+    ~MappedFile() {
+      unmap();
+    }
+
+    MappedFile(MappedFile&& other) noexcept
+      : m_data{ std::exchange(other.m_data, nullptr) }
+      , m_size{ std::exchange(other.m_size, 0) } {
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+      if (this != &other) {
+        unmap();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+      }
+      return *this;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::span<const uint8_t> data() const {
+      return std::span<const uint8_t>{ m_data, m_size };
+    }
+
+    // Hints the kernel about how a byte range of the mapping is about to be
+    // accessed. The range is widened to page boundaries. Best effort only.
+    void advise(size_t offset, size_t size, AccessHint hint) const {
+      if (!m_data || offset >= m_size)
+        return;
+      size = std::min(size, m_size - offset);
+
+#ifdef _WIN32
+      if (hint == AccessHint::WillNeed) {
+        WIN32_MEMORY_RANGE_ENTRY range{ const_cast<uint8_t*>(m_data + offset), size };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+      }
+#else
+      static const size_t pageSize = size_t(::sysconf(_SC_PAGESIZE));
+      const size_t begin = offset & ~(pageSize - 1);
+      const size_t end   = offset + size;
+
+      int advice = MADV_NORMAL;
+      switch (hint) {
+        case AccessHint::Normal:     advice = MADV_NORMAL;     break;
+        case AccessHint::Sequential: advice = MADV_SEQUENTIAL; break;
+        case AccessHint::Random:     advice = MADV_RANDOM;     break;
+        case AccessHint::WillNeed:   advice = MADV_WILLNEED;   break;
+        case AccessHint::DontNeed:   advice = MADV_DONTNEED;   break;
+      }
+      ::madvise(const_cast<uint8_t*>(m_data + begin), end - begin, advice);
+#endif
+    }
+
+    void advise(std::span<const uint8_t> range, AccessHint hint) const {
+      if (range.empty() || range.data() < m_data || range.data() >= m_data + m_size)
+        return;
+      advise(size_t(range.data() - m_data), range.size(), hint);
+    }
+
+  private:
+    void unmap() {
+      if (!m_data)
+        return;
+#ifdef _WIN32
+      UnmapViewOfFile(m_data);
+#else
+      ::munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+      m_data = nullptr;
+      m_size = 0;
+    }
+
+    const uint8_t* m_data = nullptr;
+    size_t         m_size = 0;
+  };
+
+  // A VTF file mapped into memory. The VTFData view points straight into
+  // the mapping, so only the pages that are actually read become resident.
+  class MappedVTF {
+  public:
+    explicit MappedVTF(const std::filesystem::path& path, AccessHint hint = AccessHint::Random)
+      : m_file{ mapWithHint(path, hint) }
+      , m_data{ m_file.data() } {
+    }
+
+    const VTFData& data() const { return m_data; }
+    const meta::VTFHeader& getHeader() const { return m_data.getHeader(); }
+    const MappedFile& file() const { return m_file; }
+
+    void advise(const SubresourceLayout& subresource, AccessHint hint = AccessHint::WillNeed) const {
+      m_file.advise(m_data.imageData(subresource), hint);
+    }
+
+    // Advises the whole of a mip level, all frames, faces and slices.
+    // Mips are stored contiguously so this is a single range.
+    void adviseMip(uint8_t mipLevel, AccessHint hint = AccessHint::WillNeed) const {
+      const std::span<const uint8_t> first = m_data.imageData(0, 0, mipLevel);
+      const size_t size = size_t(m_data.imageMipSize(mipLevel)) * m_data.getHeader().numFrames * m_data.faceCount();
+      m_file.advise(std::span<const uint8_t>{ first.data(), size }, hint);
+    }
+
+    void adviseLowRes(AccessHint hint = AccessHint::WillNeed) const {
+      m_file.advise(m_data.lowResImageData(), hint);
+    }
+
+  private:
+    static MappedFile mapWithHint(const std::filesystem::path& path, AccessHint hint) {
+      MappedFile file{ path };
+      if (hint != AccessHint::Normal)
+        file.advise(0, file.data().size(), hint);
+      return file;
+    }
+
+    MappedFile m_file;
+    VTFData    m_data;
+  };
+
+}
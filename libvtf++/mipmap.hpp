@@ -0,0 +1,484 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "decode.hpp"
+#include "threading.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+
+namespace libvtf {
+
+  enum class MipFilter {
+    Box,
+    Kaiser,
+    Lanczos,
+  };
+
+  struct MipOptions {
+    MipFilter filter = MipFilter::Kaiser;
+  };
+
+  // Number of mip levels of a full chain down to 1x1x1, or 1 with NOMIP.
+  constexpr uint8_t getMipLevelCount(uint16_t width, uint16_t height, uint16_t depth = 1, uint32_t flags = 0) {
+    if (flags & meta::VTFFlags::NOMIP)
+      return 1;
+
+    uint16_t largest = std::max({ width, height, depth });
+    uint8_t levels = 1;
+    while (largest > 1) {
+      largest >>= 1;
+      levels++;
+    }
+    return levels;
+  }
+
+  namespace detail {
+
+    // Pixels are processed as linear RGBA floats in [0, 1].
+    static constexpr uint32_t MipPixelFloats = 4;
+
+    // Pixels per column tile of the vertical pass, keeps the accumulated
+    // output row in L1 while it walks down the filter taps.
+    static constexpr uint32_t MipColumnTile = 256;
+
+    inline float sinc(float x) {
+      if (std::abs(x) < 1e-5f)
+        return 1.0f;
+      x *= 3.14159265358979f;
+      return std::sin(x) / x;
+    }
+
+    inline float besselI0(float x) {
+      float sum = 1.0f, term = 1.0f;
+      for (uint32_t k = 1; k < 32 && term > sum * 1e-8f; k++) {
+        const float half = x / (2.0f * k);
+        term *= half * half;
+        sum  += term;
+      }
+      return sum;
+    }
+
+    inline float getMipFilterRadius(MipFilter filter) {
+      return filter == MipFilter::Box ? 0.5f : 3.0f;
+    }
+
+    inline float evaluateMipFilter(MipFilter filter, float x) {
+      const float radius = getMipFilterRadius(filter);
+      switch (filter) {
+        case MipFilter::Box:
+          return std::abs(x) <= radius ? 1.0f : 0.0f;
+
+        case MipFilter::Kaiser: {
+          static constexpr float Alpha = 4.0f;
+          const float t = x / radius;
+          if (t * t >= 1.0f)
+            return 0.0f;
+          return sinc(x) * besselI0(Alpha * std::sqrt(1.0f - t * t)) / besselI0(Alpha);
+        }
+
+        case MipFilter::Lanczos:
+          return std::abs(x) < radius ? sinc(x) * sinc(x / radius) : 0.0f;
+      }
+      return 0.0f;
+    }
+
+    // Resampling weights from srcSize to dstSize samples along one axis.
+    // Taps that fall off the edge are clamped onto it, so each output
+    // sample reads a dense run of `count` inputs starting at `first`.
+    struct ResampleAxis {
+      struct Sample {
+        uint32_t first;
+        uint32_t count;
+        uint32_t weightOffset;
+      };
+
+      std::vector<Sample> samples;
+      std::vector<float>  weights;
+      uint32_t            maxCount = 0;
+    };
+
+    inline ResampleAxis buildResampleAxis(MipFilter filter, uint32_t srcSize, uint32_t dstSize) {
+      const float scale   = float(srcSize) / float(dstSize);
+      const float support = getMipFilterRadius(filter) * std::max(scale, 1.0f);
+
+      ResampleAxis axis;
+      axis.samples.reserve(dstSize);
+      for (uint32_t i = 0; i < dstSize; i++) {
+        const float   center = (float(i) + 0.5f) * scale - 0.5f;
+        const int32_t lo     = int32_t(std::ceil(center - support));
+        const int32_t hi     = int32_t(std::floor(center + support));
+        const uint32_t first = uint32_t(std::clamp(lo, 0, int32_t(srcSize) - 1));
+        const uint32_t last  = uint32_t(std::clamp(hi, 0, int32_t(srcSize) - 1));
+
+        const uint32_t weightOffset = uint32_t(axis.weights.size());
+        axis.weights.resize(weightOffset + last - first + 1, 0.0f);
+
+        float total = 0.0f;
+        for (int32_t j = lo; j <= hi; j++) {
+          const float weight = evaluateMipFilter(filter, (float(j) - center) / std::max(scale, 1.0f));
+          const uint32_t index = uint32_t(std::clamp(j, 0, int32_t(srcSize) - 1));
+          axis.weights[weightOffset + index - first] += weight;
+          total += weight;
+        }
+        for (uint32_t j = first; j <= last; j++)
+          axis.weights[weightOffset + j - first] /= total;
+
+        axis.samples.push_back(ResampleAxis::Sample{ first, last - first + 1, weightOffset });
+        axis.maxCount = std::max(axis.maxCount, last - first + 1);
+      }
+      return axis;
+    }
+
+    inline void resampleRowHorizontal(const float* src, const ResampleAxis& axis, float* dst) {
+      for (const ResampleAxis::Sample& sample : axis.samples) {
+        const float* weights = &axis.weights[sample.weightOffset];
+        const float* pixels  = src + size_t(sample.first) * MipPixelFloats;
+#ifdef LIBVTF_X86
+        __m128 sum = _mm_setzero_ps();
+        for (uint32_t t = 0; t < sample.count; t++)
+          sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[t]), _mm_loadu_ps(pixels + t * MipPixelFloats)));
+        _mm_storeu_ps(dst, sum);
+#else
+        float sum[MipPixelFloats] = {};
+        for (uint32_t t = 0; t < sample.count; t++) {
+          for (uint32_t c = 0; c < MipPixelFloats; c++)
+            sum[c] += weights[t] * pixels[t * MipPixelFloats + c];
+        }
+        std::memcpy(dst, sum, sizeof(sum));
+#endif
+        dst += MipPixelFloats;
+      }
+    }
+
+    // dst = sum(weights[t] * rows[t]), in column tiles.
+    inline void resampleRowsVertical(const float* const* rows, const float* weights, uint32_t count, uint32_t width, float* dst) {
+      const size_t floats = size_t(width) * MipPixelFloats;
+      for (size_t x0 = 0; x0 < floats; x0 += MipColumnTile * MipPixelFloats) {
+        const size_t x1 = std::min(floats, x0 + MipColumnTile * MipPixelFloats);
+        std::fill(dst + x0, dst + x1, 0.0f);
+        for (uint32_t t = 0; t < count; t++) {
+          const float* row = rows[t];
+#ifdef LIBVTF_X86
+          const __m128 weight = _mm_set1_ps(weights[t]);
+          for (size_t x = x0; x < x1; x += 4)
+            _mm_storeu_ps(dst + x, _mm_add_ps(_mm_loadu_ps(dst + x), _mm_mul_ps(weight, _mm_loadu_ps(row + x))));
+#else
+          for (size_t x = x0; x < x1; x++)
+            dst[x] += weights[t] * row[x];
+#endif
+        }
+      }
+    }
+
+    struct SRGBTables {
+      static constexpr uint32_t EncodeBuckets = 4096;
+
+      float   toLinear[256];
+      float   encodeThresholds[256];        // Linear value at which byte i rounds up to i + 1
+      uint8_t encodeBuckets[EncodeBuckets]; // Encoded value of the bottom of each linear bucket
+    };
+
+    inline float srgbToLinear(float value) {
+      return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    inline const SRGBTables& getSRGBTables() {
+      static const SRGBTables tables = [] {
+        SRGBTables result{};
+        for (uint32_t i = 0; i < 256; i++)
+          result.toLinear[i] = srgbToLinear(float(i) / 255.0f);
+        for (uint32_t i = 0; i < 255; i++)
+          result.encodeThresholds[i] = srgbToLinear((float(i) + 0.5f) / 255.0f);
+        result.encodeThresholds[255] = std::numeric_limits<float>::infinity();
+
+        uint32_t value = 0;
+        for (uint32_t i = 0; i < SRGBTables::EncodeBuckets; i++) {
+          while (result.encodeThresholds[value] <= float(i) / SRGBTables::EncodeBuckets)
+            value++;
+          result.encodeBuckets[i] = uint8_t(value);
+        }
+        return result;
+      }();
+      return tables;
+    }
+
+    inline uint8_t encodeUNorm8(float value) {
+      return uint8_t(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+
+    // Exact round to nearest in sRGB space. A bucket spans at most one
+    // threshold, so the lookup is off by one at most.
+    inline uint8_t encodeSRGB8(const SRGBTables& tables, float value) {
+      value = std::clamp(value, 0.0f, 1.0f);
+      uint32_t encoded = tables.encodeBuckets[std::min(uint32_t(value * SRGBTables::EncodeBuckets), SRGBTables::EncodeBuckets - 1)];
+      while (value >= tables.encodeThresholds[encoded])
+        encoded++;
+      return uint8_t(encoded);
+    }
+
+    struct MipColorSpace {
+      bool srgb;
+      bool normalMap;
+    };
+
+    inline void loadMipRow(const uint8_t* src, uint32_t width, MipColorSpace space, float* dst) {
+      const float* toLinear = space.srgb ? getSRGBTables().toLinear : nullptr;
+      for (uint32_t x = 0; x < width; x++, src += 4, dst += MipPixelFloats) {
+        for (uint32_t c = 0; c < 3; c++)
+          dst[c] = toLinear ? toLinear[src[c]] : float(src[c]) / 255.0f;
+        dst[3] = float(src[3]) / 255.0f;
+      }
+    }
+
+    inline void storeMipRow(const float* src, uint32_t width, MipColorSpace space, uint8_t* dst) {
+      const SRGBTables& tables = getSRGBTables();
+      for (uint32_t x = 0; x < width; x++, src += MipPixelFloats, dst += 4) {
+        if (space.normalMap) {
+          float normal[3] = { src[0] * 2.0f - 1.0f, src[1] * 2.0f - 1.0f, src[2] * 2.0f - 1.0f };
+          const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+          for (uint32_t c = 0; c < 3; c++)
+            dst[c] = encodeUNorm8((length > 1e-6f ? normal[c] / length : normal[c]) * 0.5f + 0.5f);
+        } else {
+          for (uint32_t c = 0; c < 3; c++)
+            dst[c] = space.srgb ? encodeSRGB8(tables, src[c]) : encodeUNorm8(src[c]);
+        }
+        dst[3] = encodeUNorm8(src[3]);
+      }
+    }
+
+    // Streams the rows of a 2D image through every smaller mip level.
+    // Each level keeps a ring of horizontally resampled input rows just
+    // deep enough for its vertical filter and emits an output row as soon
+    // as its last tap arrives, so the whole chain is built in one pass over
+    // the source without reading a level back from memory.
+    //
+    // Levels are resampled from the previous level in float without
+    // clamping or renormalizing, the sink sees the raw filtered rows.
+    class MipRowPyramid {
+    public:
+      MipRowPyramid(MipFilter filter, uint16_t width, uint16_t height, uint8_t levels) {
+        for (uint8_t level = 1; level < levels; level++) {
+          auto [srcWidth, srcHeight, srcDepth] = adjustImageSizeByMip(width, height, 1, level - 1);
+          auto [dstWidth, dstHeight, dstDepth] = adjustImageSizeByMip(width, height, 1, level);
+
+          Stage stage {
+            .dstWidth   = dstWidth,
+            .dstHeight  = dstHeight,
+            .horizontal = buildResampleAxis(filter, srcWidth, dstWidth),
+            .vertical   = buildResampleAxis(filter, srcHeight, dstHeight),
+            .ringRows   = 0,
+            .ring       = {},
+            .output     = {},
+            .taps       = {},
+          };
+          stage.ringRows = stage.vertical.maxCount;
+          stage.ring.resize(size_t(stage.ringRows) * dstWidth * MipPixelFloats);
+          stage.output.resize(size_t(dstWidth) * MipPixelFloats);
+          stage.taps.resize(stage.ringRows);
+          m_stages.push_back(std::move(stage));
+        }
+      }
+
+      // Rows of the top level must be pushed in order, starting at 0.
+      // sink(level, y, row) is called for every row of every level,
+      // including the top one.
+      template <typename Sink>
+      void pushRow(uint32_t y, const float* row, Sink&& sink) {
+        pushRow(0, y, row, sink);
+      }
+
+      void reset() {
+        for (Stage& stage : m_stages)
+          stage.nextOutputRow = 0;
+      }
+
+    private:
+
+      struct Stage {
+        uint32_t                  dstWidth;
+        uint32_t                  dstHeight;
+        ResampleAxis              horizontal;
+        ResampleAxis              vertical;
+        uint32_t                  ringRows = 0;
+        std::vector<float>        ring;
+        std::vector<float>        output;
+        std::vector<const float*> taps;
+        uint32_t                  nextOutputRow = 0;
+      };
+
+      template <typename Sink>
+      void pushRow(uint32_t level, uint32_t y, const float* row, Sink& sink) {
+        sink(level, y, row);
+        if (level == m_stages.size())
+          return;
+
+        Stage& stage = m_stages[level];
+        const size_t rowFloats = size_t(stage.dstWidth) * MipPixelFloats;
+        resampleRowHorizontal(row, stage.horizontal, &stage.ring[(y % stage.ringRows) * rowFloats]);
+
+        while (stage.nextOutputRow < stage.dstHeight) {
+          const ResampleAxis::Sample& sample = stage.vertical.samples[stage.nextOutputRow];
+          if (sample.first + sample.count - 1 > y)
+            break;
+
+          for (uint32_t t = 0; t < sample.count; t++)
+            stage.taps[t] = &stage.ring[((sample.first + t) % stage.ringRows) * rowFloats];
+          resampleRowsVertical(stage.taps.data(), &stage.vertical.weights[sample.weightOffset], sample.count, stage.dstWidth, stage.output.data());
+          pushRow(level + 1, stage.nextOutputRow++, stage.output.data(), sink);
+        }
+      }
+
+      std::vector<Stage> m_stages;
+    };
+
+  }
+
+  // Builds the mip chain of `layout` from its top level. `src` holds the
+  // top level of every frame, face and slice as tightly packed RGBA8, in
+  // that nesting order. `dst` receives every subresource of the layout as
+  // tightly packed RGBA8 in file order (see getDecodedSize), ready for
+  // encodeSubresources.
+  //
+  // SRGB textures are filtered in linear light and NORMAL textures are
+  // renormalized per level. Cubemap faces are filtered independently and
+  // 3D textures are also filtered across slices. Frames and faces are
+  // spread over the thread pool.
+  inline void generateMipmaps(
+    const VTFData&                 layout,
+          std::span<const uint8_t> src,
+          std::span<uint8_t>       dst,
+    const MipOptions&              options         = {},
+    const ParallelOptions&         parallelOptions = {}) {
+    const meta::VTFHeader& header = layout.getHeader();
+    const uint8_t  levels = header.numMipLevels;
+    const uint16_t depth  = std::max<uint16_t>(header.depth, 1);
+    const uint32_t faces  = layout.faceCount();
+
+    if ((header.flags & meta::VTFFlags::NOMIP) && levels > 1)
+      throw std::runtime_error("Texture is flagged NOMIP but has more than one mip level.");
+    if (!levels || !header.width || !header.height)
+      throw std::runtime_error("Texture has no image data to generate mips for.");
+
+    const size_t topSliceSize = size_t(header.width) * header.height * 4;
+    if (src.size() < topSliceSize * depth * faces * header.numFrames)
+      throw std::runtime_error("Source buffer is too small for the top mip level.");
+
+    std::span<const SubresourceLayout> subresources = layout.subresources();
+    std::vector<size_t> dstOffsets;
+    dstOffsets.reserve(subresources.size());
+    size_t dstSize = 0;
+    for (const SubresourceLayout& subresource : subresources) {
+      auto [width, height] = getSubresourceSize(layout, subresource);
+      dstOffsets.push_back(dstSize);
+      dstSize += size_t(width) * height * 4;
+    }
+    if (dst.size() < dstSize)
+      throw std::runtime_error("Destination buffer is too small for the mip chain.");
+
+    auto getDstSlice = [&](uint16_t frame, uint16_t face, uint8_t mipLevel, uint16_t slice) {
+      const SubresourceLayout& subresource = layout.subresource(frame, face, mipLevel, slice);
+      return dst.data() + dstOffsets[&subresource - subresources.data()];
+    };
+
+    const detail::MipColorSpace space {
+      .srgb      = !!(header.flags & meta::VTFFlags::SRGB) && !(header.flags & meta::VTFFlags::NORMAL),
+      .normalMap = !!(header.flags & meta::VTFFlags::NORMAL),
+    };
+
+    // Weights of every top-level slice in each slice of each level, the
+    // product of the per-level filters along z. Filtering along z commutes
+    // with the 2D pyramid, so slices can be streamed one at a time and
+    // accumulated into the smaller levels.
+    std::vector<std::vector<float>> sliceWeights(levels);
+    if (depth > 1) {
+      sliceWeights[0].assign(size_t(depth) * depth, 0.0f);
+      for (uint16_t z = 0; z < depth; z++)
+        sliceWeights[0][size_t(z) * depth + z] = 1.0f;
+
+      for (uint8_t level = 1; level < levels; level++) {
+        const uint16_t srcDepth = std::get<2>(adjustImageSizeByMip(header.width, header.height, depth, level - 1));
+        const uint16_t dstDepth = std::get<2>(adjustImageSizeByMip(header.width, header.height, depth, level));
+        const detail::ResampleAxis axis = detail::buildResampleAxis(options.filter, srcDepth, dstDepth);
+
+        sliceWeights[level].assign(size_t(dstDepth) * depth, 0.0f);
+        for (uint16_t z = 0; z < dstDepth; z++) {
+          const detail::ResampleAxis::Sample& sample = axis.samples[z];
+          for (uint32_t t = 0; t < sample.count; t++) {
+            for (uint16_t s = 0; s < depth; s++)
+              sliceWeights[level][size_t(z) * depth + s] += axis.weights[sample.weightOffset + t] * sliceWeights[level - 1][size_t(sample.first + t) * depth + s];
+          }
+        }
+      }
+    }
+
+    parallelFor(size_t(header.numFrames) * faces, [&](size_t index) {
+      const uint16_t frame = uint16_t(index / faces);
+      const uint16_t face  = uint16_t(index % faces);
+
+      detail::MipRowPyramid pyramid(options.filter, header.width, header.height, levels);
+      std::vector<float> row(size_t(header.width) * detail::MipPixelFloats);
+      const uint8_t* topLevel = src.data() + index * depth * topSliceSize;
+
+      if (depth == 1) {
+        auto sink = [&](uint32_t level, uint32_t y, const float* pixels) {
+          auto [width, height, d] = adjustImageSizeByMip(header.width, header.height, 1, uint8_t(level));
+          detail::storeMipRow(pixels, width, space, getDstSlice(frame, face, uint8_t(level), 0) + size_t(y) * width * 4);
+        };
+        for (uint32_t y = 0; y < header.height; y++) {
+          detail::loadMipRow(topLevel + size_t(y) * header.width * 4, header.width, space, row.data());
+          pyramid.pushRow(y, row.data(), sink);
+        }
+        return;
+      }
+
+      // Levels below the top accumulate every slice's contribution in
+      // float and are stored once all slices have been streamed.
+      std::vector<std::vector<float>> volumes(levels);
+      for (uint8_t level = 1; level < levels; level++) {
+        auto [width, height, d] = adjustImageSizeByMip(header.width, header.height, depth, level);
+        volumes[level].assign(size_t(width) * height * d * detail::MipPixelFloats, 0.0f);
+      }
+
+      for (uint16_t slice = 0; slice < depth; slice++) {
+        auto sink = [&](uint32_t level, uint32_t y, const float* pixels) {
+          auto [width, height, d] = adjustImageSizeByMip(header.width, header.height, depth, uint8_t(level));
+          if (level == 0) {
+            detail::storeMipRow(pixels, width, space, getDstSlice(frame, face, 0, slice) + size_t(y) * width * 4);
+            return;
+          }
+
+          const size_t rowFloats = size_t(width) * detail::MipPixelFloats;
+          for (uint16_t z = 0; z < d; z++) {
+            const float weight = sliceWeights[level][size_t(z) * depth + slice];
+            if (weight == 0.0f)
+              continue;
+            float* accumulator = &volumes[level][(size_t(z) * height + y) * rowFloats];
+            for (size_t i = 0; i < rowFloats; i++)
+              accumulator[i] += weight * pixels[i];
+          }
+        };
+
+        pyramid.reset();
+        const uint8_t* sliceData = topLevel + slice * topSliceSize;
+        for (uint32_t y = 0; y < header.height; y++) {
+          detail::loadMipRow(sliceData + size_t(y) * header.width * 4, header.width, space, row.data());
+          pyramid.pushRow(y, row.data(), sink);
+        }
+      }
+
+      for (uint8_t level = 1; level < levels; level++) {
+        auto [width, height, d] = adjustImageSizeByMip(header.width, header.height, depth, level);
+        const size_t rowFloats = size_t(width) * detail::MipPixelFloats;
+        for (uint16_t z = 0; z < d; z++) {
+          uint8_t* slice = getDstSlice(frame, face, level, z);
+          for (uint32_t y = 0; y < height; y++)
+            detail::storeMipRow(&volumes[level][(size_t(z) * height + y) * rowFloats], width, space, slice + size_t(y) * width * 4);
+        }
+      }
+    }, parallelOptions);
+  }
+
+}
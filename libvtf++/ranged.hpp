@@ -0,0 +1,359 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+# ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+# endif
+# ifndef NOMINMAX
+#  define NOMINMAX
+# endif
+# include <windows.h>
+#else
+# include <cerrno>
+# include <fcntl.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace libvtf {
+
+  // Read-only file handle with positional reads.
+  class FileHandle {
+  public:
+    FileHandle() = default;
+
+    explicit FileHandle(const std::filesystem::path& path) {
+#ifdef _WIN32
+      m_handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+      if (m_handle == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Could not open file: " + path.string());
+
+      LARGE_INTEGER size{};
+      if (!GetFileSizeEx(m_handle, &size)) {
+        close();
+        throw std::runtime_error("Could not stat file: " + path.string());
+      }
+      m_size = uint64_t(size.QuadPart);
+#else
+      m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (m_fd < 0)
+        throw std::runtime_error("Could not open file: " + path.string());
+
+      struct stat info{};
+      if (::fstat(m_fd, &info) != 0) {
+        close();
+        throw std::runtime_error("Could not stat file: " + path.string());
+      }
+      m_size = uint64_t(info.st_size);
+#endif
+    }
+
+    ~FileHandle() {
+      close();
+    }
+
+    FileHandle(FileHandle&& other) noexcept
+#ifdef _WIN32
+      : m_handle{ std::exchange(other.m_handle, INVALID_HANDLE_VALUE) }
+#else
+      : m_fd{ std::exchange(other.m_fd, -1) }
+#endif
+      , m_size{ std::exchange(other.m_size, 0) } {
+    }
+
+    FileHandle& operator=(FileHandle&& other) noexcept {
+      if (this != &other) {
+        close();
+#ifdef _WIN32
+        m_handle = std::exchange(other.m_handle, INVALID_HANDLE_VALUE);
+#else
+        m_fd = std::exchange(other.m_fd, -1);
+#endif
+        m_size = std::exchange(other.m_size, 0);
+      }
+      return *this;
+    }
+
+    FileHandle(const FileHandle&) = delete;
+    FileHandle& operator=(const FileHandle&) = delete;
+
+    uint64_t size() const { return m_size; }
+
+#ifndef _WIN32
+    int fd() const { return m_fd; }
+#endif
+
+    // Reads exactly dst.size() bytes at offset, throws on EOF or error.
+    void readAt(uint64_t offset, std::span<uint8_t> dst) const {
+      LIBVTF_INSTRUMENT_SCOPE(Read, dst.size());
+      while (!dst.empty()) {
+#ifdef _WIN32
+        OVERLAPPED overlapped{};
+        overlapped.Offset     = DWORD(offset);
+        overlapped.OffsetHigh = DWORD(offset >> 32);
+        DWORD bytesRead = 0;
+        const DWORD toRead = DWORD(std::min<size_t>(dst.size(), 1u << 30));
+        if (!ReadFile(m_handle, dst.data(), toRead, &bytesRead, &overlapped))
+          throw std::runtime_error("Could not read file.");
+        const size_t result = bytesRead;
+#else
+        const ssize_t result = ::pread(m_fd, dst.data(), dst.size(), off_t(offset));
+        if (result < 0) {
+          if (errno == EINTR)
+            continue;
+          throw std::runtime_error("Could not read file.");
+        }
+#endif
+        if (result == 0)
+          throw std::runtime_error("Unexpected end of file.");
+
+        offset += uint64_t(result);
+        dst = dst.subspan(size_t(result));
+      }
+    }
+
+  private:
+    void close() {
+#ifdef _WIN32
+      if (m_handle != INVALID_HANDLE_VALUE)
+        CloseHandle(m_handle);
+      m_handle = INVALID_HANDLE_VALUE;
+#else
+      if (m_fd >= 0)
+        ::close(m_fd);
+      m_fd = -1;
+#endif
+    }
+
+#ifdef _WIN32
+    HANDLE   m_handle = INVALID_HANDLE_VALUE;
+#else
+    int      m_fd     = -1;
+#endif
+    uint64_t m_size   = 0;
+  };
+
+  struct ByteRange {
+    uint64_t offset;
+    uint64_t size;
+
+    uint64_t end() const { return offset + size; }
+  };
+
+  // Sorts and merges ranges. Ranges separated by at most maxGap bytes are
+  // merged as well: reading a small gap is cheaper than another round trip.
+  inline std::vector<ByteRange> coalesceRanges(std::vector<ByteRange> ranges, uint64_t maxGap) {
+    std::erase_if(ranges, [](const ByteRange& range) { return range.size == 0; });
+    std::sort(ranges.begin(), ranges.end(), [](const ByteRange& a, const ByteRange& b) { return a.offset < b.offset; });
+
+    std::vector<ByteRange> coalesced;
+    for (const ByteRange& range : ranges) {
+      if (!coalesced.empty() && range.offset <= coalesced.back().end() + maxGap) {
+        ByteRange& last = coalesced.back();
+        last.size = std::max(last.end(), range.end()) - last.offset;
+      } else {
+        coalesced.push_back(range);
+      }
+    }
+    return coalesced;
+  }
+
+  namespace detail {
+
+    struct FreeDeleter {
+      void operator()(uint8_t* pointer) const { std::free(pointer); }
+    };
+
+  }
+
+  // A VTF file of which only some byte ranges have been read.
+  //
+  // The buffer spans the whole file so that every offset in the header and
+  // resource directory stays valid and data() is a regular VTFData, but only
+  // the header and the requested ranges are ever written. The buffer is
+  // zeroed, and large ones come straight from the OS as zero pages, so the
+  // parts that were not read are never committed.
+  //
+  // imageData() and lowResImageData() return an empty span for data that
+  // was not loaded. The image accessors of data() don't know what was
+  // loaded and return zeros for it.
+  class PartialVTF {
+  public:
+    using Buffer = std::unique_ptr<uint8_t[], detail::FreeDeleter>;
+
+    // `buffer` holds `size` bytes from std::calloc or std::malloc.
+    PartialVTF(Buffer buffer, size_t size, std::vector<ByteRange> loadedRanges)
+      : m_buffer{ std::move(buffer) }
+      , m_size{ size }
+      , m_loadedRanges{ std::move(loadedRanges) }
+      , m_data{ std::span<const uint8_t>{ m_buffer.get(), m_size } } {
+    }
+
+    const VTFData& data() const { return m_data; }
+    const meta::VTFHeader& getHeader() const { return m_data.getHeader(); }
+
+    std::span<const ByteRange> loadedRanges() const { return m_loadedRanges; }
+
+    bool contains(std::span<const uint8_t> range) const {
+      if (range.data() < m_buffer.get() || range.data() + range.size() > m_buffer.get() + m_size)
+        return false;
+
+      const uint64_t offset = uint64_t(range.data() - m_buffer.get());
+      for (const ByteRange& loaded : m_loadedRanges) {
+        if (offset >= loaded.offset && offset + range.size() <= loaded.end())
+          return true;
+      }
+      return false;
+    }
+
+    bool contains(const SubresourceLayout& subresource) const {
+      return contains(m_data.imageData(subresource));
+    }
+
+    // Empty if the subresource was not loaded.
+    std::span<const uint8_t> imageData(const SubresourceLayout& subresource) const {
+      const std::span<const uint8_t> data = m_data.imageData(subresource);
+      return contains(data) ? data : std::span<const uint8_t>{};
+    }
+
+    // Empty as well if an index is out of range.
+    std::span<const uint8_t> imageData(uint16_t frame, uint16_t face, uint8_t mipLevel, uint16_t slice = 0) const {
+      const meta::VTFHeader& header = m_data.getHeader();
+      if (frame >= header.numFrames || face >= m_data.faceCount() || mipLevel >= header.numMipLevels ||
+          slice >= std::get<2>(adjustImageSizeByMip(header.width, header.height, header.depth, mipLevel)))
+        return std::span<const uint8_t>{};
+
+      return imageData(m_data.subresource(frame, face, mipLevel, slice));
+    }
+
+    // Empty if the low-res image was not loaded.
+    std::span<const uint8_t> lowResImageData() const {
+      const std::span<const uint8_t> data = m_data.lowResImageData();
+      return contains(data) ? data : std::span<const uint8_t>{};
+    }
+
+  private:
+    Buffer                 m_buffer;
+    size_t                 m_size;
+    std::vector<ByteRange> m_loadedRanges;
+    VTFData                m_data;
+  };
+
+  // Reads only the parts of a VTF file that are needed.
+  //
+  // Construction reads the header and resource directory with a single small
+  // read. load() then fetches the requested subresources and/or the low-res
+  // image, coalescing neighbouring ranges into as few reads as possible.
+  class RangedVTFReader {
+  public:
+    // Large enough for the header plus a typical resource directory.
+    static constexpr size_t InitialReadSize = 1024;
+    static constexpr uint64_t DefaultMaxGap = 4096;
+
+    explicit RangedVTFReader(const std::filesystem::path& path)
+      : RangedVTFReader{ FileHandle{ path } } {
+    }
+
+    explicit RangedVTFReader(FileHandle file)
+      : m_file{ std::move(file) }
+      , m_prefix{ readPrefix(m_file) }
+      , m_metadata{ m_prefix } {
+    }
+
+    // Header, layout and non-image resources only. The image data accessors
+    // of this VTFData must not be used, use load() instead.
+    const VTFData& metadata() const { return m_metadata; }
+    const meta::VTFHeader& getHeader() const { return m_metadata.getHeader(); }
+    uint64_t fileSize() const { return m_file.size(); }
+
+    std::vector<ByteRange> getRanges(std::span<const SubresourceLayout> subresources, bool lowResImage) const {
+      std::vector<ByteRange> ranges;
+      ranges.reserve(subresources.size() + 1);
+
+      if (lowResImage) {
+        if (const std::optional<uint32_t> offset = m_metadata.lowResImageDataOffset())
+          ranges.push_back(ByteRange{ *offset, m_metadata.lowResImageSize() });
+      }
+
+      if (const std::optional<uint32_t> imageOffset = m_metadata.imageDataOffset()) {
+        for (const SubresourceLayout& subresource : subresources)
+          ranges.push_back(ByteRange{ uint64_t(*imageOffset) + subresource.offset, subresource.size });
+      }
+
+      return ranges;
+    }
+
+    PartialVTF load(std::span<const SubresourceLayout> subresources, bool lowResImage = false, uint64_t maxGap = DefaultMaxGap) const {
+      std::vector<ByteRange> ranges = getRanges(subresources, lowResImage);
+      ranges.push_back(ByteRange{ 0, m_prefix.size() });
+      ranges = coalesceRanges(std::move(ranges), maxGap);
+
+      const size_t size = size_t(m_file.size());
+      for (const ByteRange& range : ranges) {
+        if (range.end() > size)
+          throw std::runtime_error("Requested range is past the end of the file.");
+      }
+
+      PartialVTF::Buffer buffer{ static_cast<uint8_t*>(std::calloc(std::max<size_t>(size, 1), 1)) };
+      if (!buffer)
+        throw std::bad_alloc();
+      std::copy(m_prefix.begin(), m_prefix.end(), buffer.get());
+      for (const ByteRange& range : ranges) {
+        // The prefix has already been read.
+        const uint64_t begin = std::max<uint64_t>(range.offset, m_prefix.size());
+        if (begin < range.end())
+          m_file.readAt(begin, std::span<uint8_t>{ buffer.get() + begin, size_t(range.end() - begin) });
+      }
+
+      return PartialVTF{ std::move(buffer), size, std::move(ranges) };
+    }
+
+    PartialVTF loadLowResImage() const {
+      return load({}, true);
+    }
+
+    // Loads every frame, face and slice of mips [firstMip, firstMip + numMips).
+    // The smallest mips come first in the file, so loading the N smallest
+    // mips along with the low-res image is usually one or two reads.
+    PartialVTF loadMips(uint8_t firstMip, uint8_t numMips, bool lowResImage = false) const {
+      std::vector<SubresourceLayout> subresources;
+      for (const SubresourceLayout& subresource : m_metadata.subresources()) {
+        if (subresource.mipLevel >= firstMip && subresource.mipLevel < firstMip + numMips)
+          subresources.push_back(subresource);
+      }
+      return load(subresources, lowResImage);
+    }
+
+  private:
+    static std::vector<uint8_t> readPrefix(const FileHandle& file) {
+      std::vector<uint8_t> prefix(size_t(std::min<uint64_t>(file.size(), InitialReadSize)));
+      file.readAt(0, prefix);
+
+      // Console headers are byte swapped, the same helper as the async
+      // loader finds the end of their directory.
+      const size_t directoryEnd = VTFData::getDirectoryEndOffset(prefix).value_or(0);
+      if (directoryEnd > prefix.size() && directoryEnd <= file.size()) {
+        const size_t initialSize = prefix.size();
+        prefix.resize(directoryEnd);
+        file.readAt(initialSize, std::span<uint8_t>{ prefix }.subspan(initialSize));
+      }
+
+      return prefix;
+    }
+
+    FileHandle           m_file;
+    std::vector<uint8_t> m_prefix;
+    VTFData              m_metadata;
+  };
+
+}
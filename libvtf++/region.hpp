@@ -0,0 +1,97 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <span>
+#include <stdexcept>
+
+namespace libvtf {
+
+  // A rectangle of texels within one 2D image.
+  struct ImageRect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+  };
+
+  // Grows `rect` out to block boundaries, after clamping it to the image.
+  // Aligned rects can be copied with copyImageRect and decoded on their own.
+  constexpr ImageRect alignImageRect(ImageFormat format, ImageRect rect, uint32_t imageWidth, uint32_t imageHeight) {
+    const ImageFormatBlockInfo block = getImageFormatBlockInfo(format);
+    const uint32_t x0 = std::min(rect.x, imageWidth);
+    const uint32_t y0 = std::min(rect.y, imageHeight);
+    const uint32_t x1 = uint32_t(std::min<uint64_t>(uint64_t(rect.x) + rect.width, imageWidth));
+    const uint32_t y1 = uint32_t(std::min<uint64_t>(uint64_t(rect.y) + rect.height, imageHeight));
+
+    const uint32_t alignedX = x0 / block.blockWidth * block.blockWidth;
+    const uint32_t alignedY = y0 / block.blockHeight * block.blockHeight;
+    return ImageRect{
+      .x      = alignedX,
+      .y      = alignedY,
+      .width  = std::min((x1 + block.blockWidth - 1) / block.blockWidth * block.blockWidth, imageWidth) - alignedX,
+      .height = std::min((y1 + block.blockHeight - 1) / block.blockHeight * block.blockHeight, imageHeight) - alignedY,
+    };
+  }
+
+  constexpr bool isImageRectAligned(ImageFormat format, const ImageRect& rect, uint32_t imageWidth, uint32_t imageHeight) {
+    const ImageFormatBlockInfo block = getImageFormatBlockInfo(format);
+    return rect.x % block.blockWidth == 0 && rect.y % block.blockHeight == 0
+        && uint64_t(rect.x) + rect.width <= imageWidth && uint64_t(rect.y) + rect.height <= imageHeight
+        && (rect.width % block.blockWidth == 0 || rect.x + rect.width == imageWidth)
+        && (rect.height % block.blockHeight == 0 || rect.y + rect.height == imageHeight);
+  }
+
+  // Size of an aligned rect copied by copyImageRect, tightly packed.
+  constexpr size_t getImageRectSize(ImageFormat format, const ImageRect& rect) {
+    return getMemoryRequiredForMip(rect.width, rect.height, 1u, format);
+  }
+
+  // Copies an aligned rect of a width x height image into dst, tightly
+  // packed, touching only the block rows it covers. For block compressed
+  // formats the result is a valid image of rect.width x rect.height that
+  // decodeImage can decode without the rest of the image.
+  inline void copyImageRect(
+          ImageFormat              format,
+          std::span<const uint8_t> src,
+          uint32_t                 width,
+          uint32_t                 height,
+    const ImageRect&               rect,
+          std::span<uint8_t>       dst) {
+    if (!isImageRectAligned(format, rect, width, height))
+      throw std::runtime_error("Image rect is not block aligned or is out of bounds.");
+
+    const uint32_t blockHeight = getImageFormatBlockInfo(format).blockHeight;
+    const size_t   srcPitch    = getMemoryRequiredForMip(width, 1u, 1u, format);
+    const size_t   dstPitch    = getMemoryRequiredForMip(rect.width, 1u, 1u, format);
+    const size_t   offsetX     = getMemoryRequiredForMip(rect.x, 1u, 1u, format);
+    const uint32_t rows        = (rect.height + blockHeight - 1) / blockHeight;
+    if (src.size() < getMemoryRequiredForMip(width, height, 1u, format))
+      throw std::runtime_error("Image data is too small for image dimensions.");
+    if (dst.size() < dstPitch * rows)
+      throw std::runtime_error("Output buffer is too small for image rect.");
+
+    const uint8_t* srcRow = src.data() + size_t(rect.y / blockHeight) * srcPitch + offsetX;
+    for (uint32_t row = 0; row < rows; row++, srcRow += srcPitch)
+      std::memcpy(dst.data() + row * dstPitch, srcRow, dstPitch);
+  }
+
+  // Copies an aligned rect of a single 2D slice of a subresource.
+  inline void copyImageRect(
+    const VTFData&            vtf,
+    const SubresourceLayout&  subresource,
+    const ImageRect&          rect,
+          std::span<uint8_t>  dst) {
+    const meta::VTFHeader& header = vtf.getHeader();
+    auto [width, height, depth] = adjustImageSizeByMip(header.width, header.height, header.depth, subresource.mipLevel);
+    const std::span<const uint8_t> data = vtf.imageData(subresource);
+    if (data.empty())
+      throw std::runtime_error("Image data is not available.");
+
+    copyImageRect(header.format, data, width, height, rect, dst);
+  }
+
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "region.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace libvtf {
+
+  // One frame of a sheet sequence: how long it shows and the texture
+  // coordinates of its images (one, or four in version 1 sheets).
+  class SheetFrame {
+  public:
+    SheetFrame(const meta::TextureSheetFrameHeader* header, uint32_t rectsPerFrame)
+      : m_header{ header }
+      , m_rectsPerFrame{ rectsPerFrame } {
+    }
+
+    float duration() const { return m_header->duration; }
+
+    std::span<const meta::TextureSheetRect> rects() const {
+      return { reinterpret_cast<const meta::TextureSheetRect*>(m_header + 1), m_rectsPerFrame };
+    }
+
+    const meta::TextureSheetRect& rect(uint32_t image = 0) const { return rects()[image]; }
+
+  private:
+    const meta::TextureSheetFrameHeader* m_header;
+    uint32_t                             m_rectsPerFrame;
+  };
+
+  class SheetSequence {
+  public:
+    SheetSequence(const meta::TextureSheetSequenceHeader* header, uint32_t rectsPerFrame)
+      : m_header{ header }
+      , m_rectsPerFrame{ rectsPerFrame } {
+    }
+
+    int32_t  number() const { return m_header->sequenceNumber; }
+    uint32_t flags() const { return m_header->flags; }
+    bool     clamp() const { return m_header->flags & meta::TextureSheetFlags::Clamp; }
+    float    totalTime() const { return m_header->totalTime; }
+    uint32_t frameCount() const { return uint32_t(m_header->numFrames); }
+
+    SheetFrame frame(uint32_t index) const {
+      const uint8_t* frames = reinterpret_cast<const uint8_t*>(m_header + 1);
+      return SheetFrame{ reinterpret_cast<const meta::TextureSheetFrameHeader*>(frames + index * frameSize(m_rectsPerFrame)), m_rectsPerFrame };
+    }
+
+    // The frame showing `time` seconds into the sequence. Looping
+    // sequences wrap around, clamped ones stay on the last frame.
+    uint32_t frameIndexAt(float time) const {
+      const uint32_t count = frameCount();
+      if (count <= 1)
+        return 0;
+
+      const float total = totalTime();
+      if (!(total > 0.0f))
+        return 0;
+      time = clamp() ? std::min(time, total) : std::fmod(time, total);
+      if (time < 0.0f)
+        time = clamp() ? 0.0f : time + total;
+
+      for (uint32_t i = 0; i < count; i++) {
+        time -= frame(i).duration();
+        if (time < 0.0f)
+          return i;
+      }
+      return count - 1;
+    }
+
+    static constexpr size_t frameSize(uint32_t rectsPerFrame) {
+      return sizeof(meta::TextureSheetFrameHeader) + rectsPerFrame * sizeof(meta::TextureSheetRect);
+    }
+
+  private:
+    const meta::TextureSheetSequenceHeader* m_header;
+    uint32_t                                m_rectsPerFrame;
+  };
+
+  // The sequences of a sprite sheet resource, read in place. The whole
+  // resource is bounds checked on construction, so the sequences and
+  // frames handed out never read past it.
+  class TextureSheetView {
+  public:
+    // `data` is the resource data, starting with its size.
+    explicit TextureSheetView(std::span<const uint8_t> data) {
+      if (data.size() < sizeof(meta::TextureSheet))
+        throw std::runtime_error("Texture sheet is truncated.");
+
+      m_sheet = reinterpret_cast<const meta::TextureSheet*>(data.data());
+      if (m_sheet->version != 0 && m_sheet->version != 1)
+        throw std::runtime_error("Unsupported texture sheet version.");
+      if (m_sheet->numSequences < 0)
+        throw std::runtime_error("Texture sheet has a negative sequence count.");
+
+      const size_t size = std::min<size_t>(data.size(), size_t(m_sheet->size) + sizeof(m_sheet->size));
+      if (size < sizeof(meta::TextureSheet))
+        throw std::runtime_error("Texture sheet is truncated.");
+
+      m_rectsPerFrame = m_sheet->version ? 4 : 1;
+
+      size_t offset = sizeof(meta::TextureSheet);
+      m_sequenceOffsets.reserve(std::min<size_t>(m_sheet->numSequences, size / sizeof(meta::TextureSheetSequenceHeader)));
+      for (int32_t i = 0; i < m_sheet->numSequences; i++) {
+        if (size - offset < sizeof(meta::TextureSheetSequenceHeader))
+          throw std::runtime_error("Texture sheet is truncated.");
+
+        const auto* sequence = reinterpret_cast<const meta::TextureSheetSequenceHeader*>(data.data() + offset);
+        const size_t framesSize = SheetSequence::frameSize(m_rectsPerFrame);
+        offset += sizeof(meta::TextureSheetSequenceHeader);
+        if (sequence->numFrames < 0 || uint64_t(sequence->numFrames) * framesSize > size - offset)
+          throw std::runtime_error("Texture sheet is truncated.");
+
+        m_sequenceOffsets.push_back(uint32_t(offset - sizeof(meta::TextureSheetSequenceHeader)));
+        offset += size_t(sequence->numFrames) * framesSize;
+      }
+    }
+
+    int32_t  version() const { return m_sheet->version; }
+    uint32_t rectsPerFrame() const { return m_rectsPerFrame; }
+    uint32_t sequenceCount() const { return uint32_t(m_sequenceOffsets.size()); }
+
+    SheetSequence sequence(uint32_t index) const {
+      const uint8_t* base = reinterpret_cast<const uint8_t*>(m_sheet);
+      return SheetSequence{ reinterpret_cast<const meta::TextureSheetSequenceHeader*>(base + m_sequenceOffsets[index]), m_rectsPerFrame };
+    }
+
+    // The sequence with a sequence number, which needn't match its index.
+    std::optional<SheetSequence> findSequence(int32_t number) const {
+      for (uint32_t i = 0; i < sequenceCount(); i++) {
+        const SheetSequence candidate = sequence(i);
+        if (candidate.number() == number)
+          return candidate;
+      }
+      return std::nullopt;
+    }
+
+  private:
+    const meta::TextureSheet* m_sheet = nullptr;
+    uint32_t                  m_rectsPerFrame = 1;
+    std::vector<uint32_t>     m_sequenceOffsets;
+  };
+
+  // The sheet of a VTF, if it has one. The view points into the VTF's
+  // buffer. Throws if the sheet is malformed.
+  inline std::optional<TextureSheetView> getTextureSheet(const VTFData& vtf) {
+    const std::optional<VTFResource> resource = vtf.findResource(meta::TextureSheet::ResourceID);
+    if (!resource || !resource->hasDataChunk())
+      return std::nullopt;
+
+    return TextureSheetView{ resource->data };
+  }
+
+  // The texels a sheet rect covers in a width x height image, rounded
+  // outward and clamped. Pass it through alignImageRect to copy it out.
+  inline ImageRect getSheetRect(const meta::TextureSheetRect& rect, uint32_t width, uint32_t height) {
+    auto toTexel = [](float coord, uint32_t size, bool roundUp) {
+      const float texel = (coord > 0.0f ? std::min(coord, 1.0f) : 0.0f) * float(size);
+      return uint32_t(roundUp ? std::ceil(texel) : std::floor(texel));
+    };
+
+    const uint32_t x0 = toTexel(std::min(rect.u0, rect.u1), width, false);
+    const uint32_t y0 = toTexel(std::min(rect.v0, rect.v1), height, false);
+    const uint32_t x1 = toTexel(std::max(rect.u0, rect.u1), width, true);
+    const uint32_t y1 = toTexel(std::max(rect.v0, rect.v1), height, true);
+    return ImageRect{ .x = x0, .y = y0, .width = x1 - x0, .height = y1 - y0 };
+  }
+
+}
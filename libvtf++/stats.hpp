@@ -0,0 +1,529 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "convert.hpp"
+#include "cpu.hpp"
+#include "decode.hpp"
+#include "threading.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace libvtf {
+
+  enum class AlphaClass : uint8_t {
+    Opaque,   // Every pixel is fully opaque
+    OneBit,   // Alpha is only ever fully transparent or fully opaque
+    EightBit, // Some pixels are partially transparent
+  };
+
+  // The header flags matching an alpha class.
+  constexpr uint32_t getAlphaFlags(AlphaClass alpha) {
+    switch (alpha) {
+      case AlphaClass::OneBit:   return meta::VTFFlags::ONEBITALPHA;
+      case AlphaClass::EightBit: return meta::VTFFlags::EIGHTBITALPHA;
+      default:                   return 0;
+    }
+  }
+
+  // Statistics of the pixels of one or more images.
+  //
+  // Channels are RGBA. Formats with up to 8 bits per channel give values in
+  // [0, 1] and are taken to be gamma 2.2 encoded for the reflectivity, like
+  // vtex does. Wider formats give their raw values and are taken to be
+  // linear.
+  struct ImageStatistics {
+    uint64_t             pixelCount = 0;
+    std::array<float, 4> minimum{};
+    std::array<float, 4> maximum{};
+    std::array<float, 4> average{};
+    // Average color in linear light, what the header's reflectivity holds.
+    std::array<float, 3> reflectivity{};
+    AlphaClass           alpha = AlphaClass::Opaque;
+  };
+
+  namespace detail {
+
+    // Partial statistics of some pixels, merged across work items.
+    struct StatisticsAccumulator {
+      uint64_t count        = 0;
+      double   sum[4]       = {};
+      double   linearSum[3] = {};
+      float    minimum[4]   = { std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity() };
+      float    maximum[4]   = { -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+      bool     transparent  = false; // Some alpha is below opaque
+      bool     translucent  = false; // Some alpha is neither transparent nor opaque
+
+      void merge(const StatisticsAccumulator& other) {
+        count += other.count;
+        for (uint32_t c = 0; c < 4; c++) {
+          sum[c]     += other.sum[c];
+          minimum[c]  = std::min(minimum[c], other.minimum[c]);
+          maximum[c]  = std::max(maximum[c], other.maximum[c]);
+        }
+        for (uint32_t c = 0; c < 3; c++)
+          linearSum[c] += other.linearSum[c];
+        transparent |= other.transparent;
+        translucent |= other.translucent;
+      }
+
+      ImageStatistics finish() const {
+        ImageStatistics statistics;
+        statistics.pixelCount = count;
+        if (!count)
+          return statistics;
+
+        for (uint32_t c = 0; c < 4; c++) {
+          statistics.minimum[c] = minimum[c];
+          statistics.maximum[c] = maximum[c];
+          statistics.average[c] = float(sum[c] / double(count));
+        }
+        for (uint32_t c = 0; c < 3; c++)
+          statistics.reflectivity[c] = float(linearSum[c] / double(count));
+        statistics.alpha = translucent ? AlphaClass::EightBit : transparent ? AlphaClass::OneBit : AlphaClass::Opaque;
+        return statistics;
+      }
+    };
+
+    inline const std::array<float, 256>& getGammaToLinearTable() {
+      static const std::array<float, 256> table = [] {
+        std::array<float, 256> result{};
+        for (uint32_t i = 0; i < 256; i++)
+          result[i] = std::pow(float(i) / 255.0f, 2.2f);
+        return result;
+      }();
+      return table;
+    }
+
+    // Per-channel histogram of RGBA8 pixels, everything else is derived
+    // from it once per work item. Consecutive pixels count into separate
+    // tables so runs of the same value, like a solid alpha channel, don't
+    // serialize on one counter.
+    struct RGBA8Histogram {
+      static constexpr uint32_t Tables = 4;
+
+      uint32_t counts[Tables][4][256];
+
+      void clear() {
+        std::memset(counts, 0, sizeof(counts));
+      }
+
+      void add(const uint8_t* pixels, size_t count) {
+        size_t i = 0;
+        for (; i + Tables <= count; i += Tables, pixels += Tables * 4) {
+          for (uint32_t t = 0; t < Tables; t++) {
+            counts[t][0][pixels[t * 4 + 0]]++;
+            counts[t][1][pixels[t * 4 + 1]]++;
+            counts[t][2][pixels[t * 4 + 2]]++;
+            counts[t][3][pixels[t * 4 + 3]]++;
+          }
+        }
+        for (; i < count; i++, pixels += 4) {
+          for (uint32_t c = 0; c < 4; c++)
+            counts[0][c][pixels[c]]++;
+        }
+      }
+
+      void accumulate(StatisticsAccumulator& accumulator) const {
+        const std::array<float, 256>& toLinear = getGammaToLinearTable();
+        StatisticsAccumulator result;
+
+        for (uint32_t c = 0; c < 4; c++) {
+          uint64_t total = 0, sum = 0;
+          double   linearSum = 0.0;
+          for (uint32_t value = 0; value < 256; value++) {
+            uint64_t n = 0;
+            for (uint32_t t = 0; t < Tables; t++)
+              n += counts[t][c][value];
+            if (!n)
+              continue;
+
+            if (!total)
+              result.minimum[c] = float(value) / 255.0f;
+            result.maximum[c] = float(value) / 255.0f;
+            total     += n;
+            sum       += n * value;
+            linearSum += double(n) * toLinear[value];
+
+            if (c == 3 && value < 255) {
+              result.transparent = true;
+              result.translucent |= value > 0;
+            }
+          }
+
+          result.count  = total;
+          result.sum[c] = double(sum) / 255.0;
+          if (c < 3)
+            result.linearSum[c] = linearSum;
+        }
+
+        accumulator.merge(result);
+      }
+    };
+
+    // Adds RGBA32F pixels. Float channels are linear already.
+    inline void accumulateRGBA32F(const float* pixels, size_t count, StatisticsAccumulator& accumulator) {
+      // Partial sums are flushed to doubles often enough to stay exact-ish
+      // for HDR values.
+      static constexpr size_t ChunkPixels = 256;
+
+      for (size_t begin = 0; begin < count; begin += ChunkPixels) {
+        const size_t end = std::min(count, begin + ChunkPixels);
+        float sum[4];
+#if defined(LIBVTF_X86)
+        __m128 minimum = _mm_loadu_ps(accumulator.minimum);
+        __m128 maximum = _mm_loadu_ps(accumulator.maximum);
+        __m128 total   = _mm_setzero_ps();
+        __m128 transparent = _mm_setzero_ps();
+        __m128 translucent = _mm_setzero_ps();
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one  = _mm_set1_ps(1.0f);
+        for (size_t i = begin; i < end; i++) {
+          const __m128 pixel = _mm_loadu_ps(pixels + i * 4);
+          minimum = _mm_min_ps(minimum, pixel);
+          maximum = _mm_max_ps(maximum, pixel);
+          total   = _mm_add_ps(total, pixel);
+          const __m128 belowOne = _mm_cmplt_ps(pixel, one);
+          transparent = _mm_or_ps(transparent, belowOne);
+          translucent = _mm_or_ps(translucent, _mm_and_ps(belowOne, _mm_cmpgt_ps(pixel, zero)));
+        }
+        _mm_storeu_ps(accumulator.minimum, minimum);
+        _mm_storeu_ps(accumulator.maximum, maximum);
+        _mm_storeu_ps(sum, total);
+        // Only the alpha lane counts.
+        accumulator.transparent |= (_mm_movemask_ps(transparent) & 0x8) != 0;
+        accumulator.translucent |= (_mm_movemask_ps(translucent) & 0x8) != 0;
+#else
+        std::fill(std::begin(sum), std::end(sum), 0.0f);
+        for (size_t i = begin; i < end; i++) {
+          const float* pixel = pixels + i * 4;
+          for (uint32_t c = 0; c < 4; c++) {
+            accumulator.minimum[c] = std::min(accumulator.minimum[c], pixel[c]);
+            accumulator.maximum[c] = std::max(accumulator.maximum[c], pixel[c]);
+            sum[c] += pixel[c];
+          }
+          accumulator.transparent |= pixel[3] < 1.0f;
+          accumulator.translucent |= pixel[3] < 1.0f && pixel[3] > 0.0f;
+        }
+#endif
+        for (uint32_t c = 0; c < 4; c++)
+          accumulator.sum[c] += sum[c];
+        for (uint32_t c = 0; c < 3; c++)
+          accumulator.linearSum[c] += sum[c];
+      }
+      accumulator.count += count;
+    }
+
+    // Rows of one image, several rows per item so every item is roughly
+    // the same amount of work. For block compressed formats `src` and
+    // `height` cover whole block rows.
+    struct StatisticsWorkItem {
+      const uint8_t* src;
+      uint32_t       width;
+      uint32_t       height;
+    };
+
+    inline void addStatisticsWorkItems(ImageFormat format, std::span<const uint8_t> src, uint32_t width, uint32_t height, std::vector<StatisticsWorkItem>& items) {
+      static constexpr uint32_t PixelsPerWorkItem = 16384;
+
+      if (isDecodable(format)) {
+        const uint32_t blocksX      = getBlockCountX(width);
+        const uint32_t blockRowSize = blocksX * getBlockCodecBlockSize(getBlockCodec(format));
+        if (src.size() < size_t(blockRowSize) * getBlockCountY(height))
+          throw std::runtime_error("Source buffer is too small for image dimensions.");
+
+        const uint32_t rowsPerItem = std::max<uint32_t>(1, PixelsPerWorkItem / 16 / blocksX) * 4;
+        for (uint32_t y = 0; y < height; y += rowsPerItem)
+          items.push_back(StatisticsWorkItem{ src.data() + size_t(y / 4) * blockRowSize, width, std::min(rowsPerItem, height - y) });
+        return;
+      }
+
+      const detail::PixelFormatKernels* kernels = getPixelFormatKernels(format);
+      if (!kernels)
+        throw std::runtime_error("Image format has no statistics support.");
+      const size_t pitch = size_t(width) * kernels->pixelSize;
+      if (src.size() < pitch * height)
+        throw std::runtime_error("Source buffer is too small for image dimensions.");
+
+      const uint32_t rowsPerItem = std::max<uint32_t>(1, PixelsPerWorkItem / std::max(width, 1u));
+      for (uint32_t y = 0; y < height; y += rowsPerItem)
+        items.push_back(StatisticsWorkItem{ src.data() + y * pitch, width, std::min(rowsPerItem, height - y) });
+    }
+
+    // Whether pixels of the format are gathered as RGBA8 or RGBA32F.
+    inline bool isStatisticsFloat(ImageFormat format) {
+      if (isDecodable(format))
+        return getDecodedFormat(format) == DecodedFormat::RGBA16F;
+      const detail::PixelFormatKernels* kernels = getPixelFormatKernels(format);
+      return kernels && kernels->pivot == PixelPivot::RGBA32F;
+    }
+
+    inline void accumulateStatisticsWorkItem(ImageFormat format, const StatisticsWorkItem& item, StatisticsAccumulator& accumulator) {
+      const bool     isFloat   = isStatisticsFloat(format);
+      const uint32_t pixelSize = isFloat ? 16 : 4;
+      std::vector<uint8_t> scratch;
+      RGBA8Histogram histogram;
+      if (!isFloat)
+        histogram.clear();
+
+      auto addPixels = [&](const uint8_t* pixels, size_t count) {
+        if (isFloat)
+          accumulateRGBA32F(reinterpret_cast<const float*>(pixels), count, accumulator);
+        else
+          histogram.add(pixels, count);
+      };
+
+      if (isDecodable(format)) {
+        // One block row at a time, BC6H goes on from RGBA16F to RGBA32F.
+        const uint32_t blockRowSize = getBlockCountX(item.width) * getBlockCodecBlockSize(getBlockCodec(format));
+        const uint32_t decodedSize  = getDecodedPixelSize(format);
+        scratch.resize(size_t(item.width) * 4 * (decodedSize + (isFloat ? pixelSize : 0)));
+        uint8_t* decoded = scratch.data();
+        uint8_t* pixels  = isFloat ? scratch.data() + size_t(item.width) * 4 * decodedSize : decoded;
+
+        for (uint32_t y = 0; y < item.height; y += 4) {
+          const uint32_t rows = std::min(4u, item.height - y);
+          decodeImage(format, { item.src + size_t(y / 4) * blockRowSize, blockRowSize }, item.width, rows, { decoded, size_t(item.width) * rows * decodedSize });
+          if (isFloat)
+            convertImage(ImageFormats::RGBA16161616F, { decoded, size_t(item.width) * rows * decodedSize }, ImageFormats::RGBA32323232F, { pixels, size_t(item.width) * rows * pixelSize }, item.width, rows);
+          addPixels(pixels, size_t(item.width) * rows);
+        }
+      } else {
+        const ImageFormat pivotFormat = isFloat ? ImageFormats::RGBA32323232F : ImageFormats::RGBA8888;
+        const PixelConverter converter(format, pivotFormat);
+        const size_t pitch = size_t(item.width) * converter.srcPixelSize();
+
+        if (format == pivotFormat) {
+          addPixels(item.src, size_t(item.width) * item.height);
+        } else {
+          scratch.resize(size_t(item.width) * pixelSize);
+          for (uint32_t y = 0; y < item.height; y++) {
+            converter.convertRow(item.src + y * pitch, scratch.data(), item.width);
+            addPixels(scratch.data(), item.width);
+          }
+        }
+      }
+
+      if (!isFloat)
+        histogram.accumulate(accumulator);
+    }
+
+    inline ImageStatistics computeImageStatistics(ImageFormat format, std::span<const StatisticsWorkItem> items, const ParallelOptions& options) {
+      std::vector<StatisticsAccumulator> accumulators(items.size());
+      parallelFor(items.size(), [&](size_t index) {
+        accumulateStatisticsWorkItem(format, items[index], accumulators[index]);
+      }, options);
+
+      StatisticsAccumulator total;
+      for (const StatisticsAccumulator& accumulator : accumulators)
+        total.merge(accumulator);
+      return total.finish();
+    }
+
+    //
+    // Alpha classification straight from the alpha bits of BC1-3 blocks.
+    // Pixels of edge blocks that are outside of the image are ignored.
+    //
+
+    // Bit i set for each pixel i of a 4x4 block that is inside the image.
+    constexpr uint32_t getBlockPixelMask(uint32_t columns, uint32_t rows) {
+      uint32_t mask = 0;
+      for (uint32_t y = 0; y < rows; y++)
+        mask |= ((1u << columns) - 1) << (4 * y);
+      return mask;
+    }
+
+    // Repeats every bit of a pixel mask `bits` times.
+    constexpr uint64_t spreadBlockPixelMask(uint32_t mask, uint32_t bits) {
+      uint64_t spread = 0;
+      for (uint32_t i = 0; i < 16; i++) {
+        if (mask & (1u << i))
+          spread |= ((uint64_t(1) << bits) - 1) << (i * bits);
+      }
+      return spread;
+    }
+
+    // BC1 blocks with c0 <= c1 make index 3 transparent black.
+    inline AlphaClass classifyBC1AlphaBlock(const uint8_t* block, uint32_t pixelMask) {
+      if (loadU16(block) > loadU16(block + 2))
+        return AlphaClass::Opaque;
+
+      const uint32_t indices = loadU32(block + 4);
+      const uint32_t transparent = indices & (indices >> 1) & 0x55555555u;
+      return transparent & uint32_t(spreadBlockPixelMask(pixelMask, 2)) ? AlphaClass::OneBit : AlphaClass::Opaque;
+    }
+
+    // BC2 alpha is 4 bits per pixel, 0 and 15 are the binary values.
+    inline AlphaClass classifyBC2AlphaBlock(const uint8_t* block, uint32_t pixelMask) {
+      const uint64_t mask  = pixelMask == 0xFFFFu ? ~uint64_t(0) : spreadBlockPixelMask(pixelMask, 4);
+      const uint64_t alpha = loadU64(block);
+      if ((alpha | ~mask) == ~uint64_t(0))
+        return AlphaClass::Opaque;
+
+      // Nibbles with all four bits equal.
+      const uint64_t mixed = (alpha ^ (alpha >> 1)) & 0x7777777777777777ull & mask;
+      return mixed ? AlphaClass::EightBit : AlphaClass::OneBit;
+    }
+
+    // Bits 3i set where the index of pixel i of a BC3 alpha block is `entry`.
+    constexpr uint64_t matchBC3AlphaIndices(uint64_t indices, uint32_t entry) {
+      const uint64_t x = indices ^ (0x249249249249ull * entry);
+      return ~(x | (x >> 1) | (x >> 2)) & 0x249249249249ull;
+    }
+
+    // BC3 alpha is a palette of 8, only the entries some pixel uses count.
+    // Opaque blocks usually have at most one entry that isn't 255, so the
+    // indices are only searched for those.
+    inline AlphaClass classifyBC3AlphaBlock(const uint8_t* block, uint32_t pixelMask) {
+      const uint64_t indices = loadU64(block) >> 16;
+
+      // Entries that aren't 255, and those that aren't 0 either. Both
+      // endpoints at 255 is by far the most common opaque block, only its
+      // explicit 0 entry isn't opaque.
+      uint32_t nonOpaque = 1u << 6, partial = 0;
+      if (block[0] != 255 || block[1] != 255) {
+        const ChannelBlockPalette palette = decodeChannelPalette(block);
+        nonOpaque = 0;
+        for (uint32_t entry = 0; entry < 8; entry++) {
+          nonOpaque |= uint32_t(palette.values[entry] != 255) << entry;
+          partial   |= uint32_t(palette.values[entry] != 255 && palette.values[entry] != 0) << entry;
+        }
+        if (!nonOpaque)
+          return AlphaClass::Opaque;
+      }
+
+      const uint64_t pixels = pixelMask == 0xFFFFu ? 0x249249249249ull : spreadBlockPixelMask(pixelMask, 3) & 0x249249249249ull;
+      AlphaClass result = AlphaClass::Opaque;
+      for (uint32_t entries = nonOpaque; entries; entries &= entries - 1) {
+        const uint32_t entry = uint32_t(std::countr_zero(entries));
+        if (!(matchBC3AlphaIndices(indices, entry) & pixels))
+          continue;
+        if (partial & (1u << entry))
+          return AlphaClass::EightBit;
+        result = AlphaClass::OneBit;
+      }
+      return result;
+    }
+
+  }
+
+  // Classifies the alpha of BC1-5 image data from the alpha bits of its
+  // blocks, without decoding any color. Formats without alpha are opaque.
+  // nullopt for BC6H and BC7, which need a full decode (see
+  // computeImageStatistics), and for uncompressed formats.
+  inline std::optional<AlphaClass> classifyBlockAlpha(ImageFormat format, std::span<const uint8_t> src, uint32_t width, uint32_t height) {
+    using detail::BlockCodec;
+    const BlockCodec codec = detail::getBlockCodec(format);
+
+    AlphaClass (*classifyBlock)(const uint8_t*, uint32_t) = nullptr;
+    switch (codec) {
+      case BlockCodec::BC1: classifyBlock = detail::classifyBC1AlphaBlock; break;
+      case BlockCodec::BC2: classifyBlock = detail::classifyBC2AlphaBlock; break;
+      case BlockCodec::BC3: classifyBlock = detail::classifyBC3AlphaBlock; break;
+      case BlockCodec::BC4:
+      case BlockCodec::BC5:
+      case BlockCodec::ATI2N:
+        return AlphaClass::Opaque;
+      default:
+        return std::nullopt;
+    }
+
+    const uint32_t blockSize = detail::getBlockCodecBlockSize(codec);
+    const uint32_t blocksX   = getBlockCountX(width);
+    const uint32_t blocksY   = getBlockCountY(height);
+    if (src.size() < size_t(blocksX) * blocksY * blockSize)
+      throw std::runtime_error("Source buffer is too small for image dimensions.");
+
+    AlphaClass result = AlphaClass::Opaque;
+    const uint8_t* block = src.data();
+    for (uint32_t by = 0; by < blocksY; by++) {
+      const uint32_t rows = std::min(4u, height - by * 4);
+      for (uint32_t bx = 0; bx < blocksX; bx++, block += blockSize) {
+        const uint32_t columns = std::min(4u, width - bx * 4);
+        const uint32_t pixelMask = rows == 4 && columns == 4 ? 0xFFFFu : detail::getBlockPixelMask(columns, rows);
+        result = std::max(result, classifyBlock(block, pixelMask));
+        // Nothing can raise it any further.
+        if (result == AlphaClass::EightBit || (result == AlphaClass::OneBit && codec == BlockCodec::BC1))
+          return result;
+      }
+    }
+    return result;
+  }
+
+  // Min, max, average, reflectivity and alpha class of a width x height
+  // image in one pass over its pixels. Works on any convertible or block
+  // compressed format. Rows are split into work items spread over the
+  // thread pool.
+  inline ImageStatistics computeImageStatistics(ImageFormat format, std::span<const uint8_t> src, uint32_t width, uint32_t height, const ParallelOptions& options = {}) {
+    std::vector<detail::StatisticsWorkItem> items;
+    detail::addStatisticsWorkItems(format, src, width, height, items);
+    return detail::computeImageStatistics(format, items, options);
+  }
+
+  // Statistics of a single 2D slice of a subresource.
+  inline ImageStatistics computeImageStatistics(const VTFData& vtf, const SubresourceLayout& subresource, const ParallelOptions& options = {}) {
+    const std::span<const uint8_t> src = vtf.imageData(subresource);
+    if (src.empty())
+      throw std::runtime_error("Subresource image data is not available.");
+
+    auto [width, height] = getSubresourceSize(vtf, subresource);
+    return computeImageStatistics(vtf.getHeader().format, src, width, height, options);
+  }
+
+  // Statistics of the top mip of every frame, face and slice together,
+  // which is what the header's reflectivity and alpha flags describe.
+  inline ImageStatistics computeImageStatistics(const VTFData& vtf, const ParallelOptions& options = {}) {
+    const ImageFormat format = vtf.getHeader().format;
+
+    std::vector<detail::StatisticsWorkItem> items;
+    for (const SubresourceLayout& subresource : vtf.subresources()) {
+      if (subresource.mipLevel != 0)
+        continue;
+
+      const std::span<const uint8_t> src = vtf.imageData(subresource);
+      if (src.empty())
+        throw std::runtime_error("Subresource image data is not available.");
+      auto [width, height] = getSubresourceSize(vtf, subresource);
+      detail::addStatisticsWorkItems(format, src, width, height, items);
+    }
+    return detail::computeImageStatistics(format, items, options);
+  }
+
+  // Alpha class of the top mip of every frame, face and slice. Reads the
+  // alpha blocks of BC1-3 directly and falls back to
+  // computeImageStatistics for everything else.
+  inline AlphaClass classifyAlpha(const VTFData& vtf, const ParallelOptions& options = {}) {
+    const ImageFormat format = vtf.getHeader().format;
+
+    AlphaClass result = AlphaClass::Opaque;
+    for (const SubresourceLayout& subresource : vtf.subresources()) {
+      if (subresource.mipLevel != 0)
+        continue;
+
+      const std::span<const uint8_t> src = vtf.imageData(subresource);
+      if (src.empty())
+        throw std::runtime_error("Subresource image data is not available.");
+      auto [width, height] = getSubresourceSize(vtf, subresource);
+      const std::optional<AlphaClass> alpha = classifyBlockAlpha(format, src, width, height);
+      if (!alpha)
+        return computeImageStatistics(vtf, options).alpha;
+      result = std::max(result, *alpha);
+    }
+    return result;
+  }
+
+  // Fills in the reflectivity and alpha flags of a header from the
+  // statistics of its image, eg. before handing it to VTFWriter.
+  inline void applyImageStatistics(meta::VTFHeader& header, const ImageStatistics& statistics) {
+    header.reflectivity = statistics.reflectivity;
+    header.flags &= ~(meta::VTFFlags::ONEBITALPHA | meta::VTFFlags::EIGHTBITALPHA);
+    header.flags |= getAlphaFlags(statistics.alpha);
+  }
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "writer.hpp"
+
+#include <optional>
+#include <vector>
+
+namespace libvtf {
+
+  struct StripOptions {
+    // Number of top mips to drop.
+    uint8_t skipMips = 0;
+    // Frames to keep, in output order. Empty keeps every frame.
+    std::vector<uint16_t> frames;
+    // Keeps only this face of a cube map, which makes it a 2D texture.
+    std::optional<uint16_t> face;
+  };
+
+  // Sets up a writer for a copy of `vtf` without some of its mips, frames
+  // or faces. Nothing is decoded: subresources are copied as stored, the
+  // header dimensions and mip count are adjusted and the resource directory
+  // is rebuilt by the writer. Header bytes the writer doesn't model and
+  // other resources are carried over, the CRC is recomputed if there was
+  // one.
+  //
+  // Write with fileSize() and write(dst) to produce the file in a single
+  // pass into one buffer. The writer refers to `vtf`'s buffer, which must
+  // stay valid until then.
+  inline VTFWriter stripVTF(const VTFData& vtf, const StripOptions& options) {
+    const meta::VTFHeader& source = vtf.getHeader();
+    if (vtf.consoleHeader())
+      throw std::runtime_error("Console VTFs can't be stripped.");
+    if (!vtf.imageData())
+      throw std::runtime_error("Image data is not available.");
+    if (options.skipMips >= source.numMipLevels)
+      throw std::runtime_error("Can't skip every mip.");
+    if (options.face && *options.face >= vtf.faceCount())
+      throw std::runtime_error("Face is out of range.");
+    for (uint16_t frame : options.frames) {
+      if (frame >= source.numFrames)
+        throw std::runtime_error("Frame is out of range.");
+    }
+
+    meta::VTFHeader header = source;
+    auto [width, height, depth] = adjustImageSizeByMip(source.width, source.height, source.depth, options.skipMips);
+    header.width        = width;
+    header.height       = height;
+    header.depth        = depth;
+    header.numMipLevels = uint8_t(source.numMipLevels - options.skipMips);
+    if (!options.frames.empty())
+      header.numFrames = uint16_t(options.frames.size());
+    if (options.face)
+      header.flags &= ~meta::VTFFlags::ENVMAP;
+
+    VTFWriter writer{ header, source.version };
+    writer.setBaseHeader(vtf.buffer());
+    writer.setLowResImage(vtf.lowResImageData());
+
+    for (const SubresourceLayout& subresource : writer.layout().subresources()) {
+      const uint16_t frame = options.frames.empty() ? subresource.frame : options.frames[subresource.frame];
+      const uint16_t face  = options.face ? *options.face : subresource.face;
+      const SubresourceLayout& from = vtf.subresource(frame, face, uint8_t(subresource.mipLevel + options.skipMips), subresource.slice);
+      writer.setImageData(subresource, vtf.imageData(from));
+    }
+
+    for (const VTFResource resource : vtf.resources()) {
+      switch (resource.type) {
+        case meta::TextureLegacyImage::ResourceID:
+        case meta::TextureLegacyLowResImage::ResourceID:
+          break;
+
+        case meta::TextureCRC32::ResourceID:
+          writer.computeCRC32();
+          break;
+
+        default:
+          if (!resource.hasDataChunk()) {
+            uint32_t value;
+            std::memcpy(&value, resource.data.data(), sizeof(value));
+            writer.addInlineResource(resource.type, value);
+          } else {
+            if (resource.data.size() != resource.size || resource.size < sizeof(uint32_t))
+              throw std::runtime_error("Resource data is not available.");
+            writer.addResource(resource.type, resource.data.subspan(sizeof(uint32_t)));
+          }
+          break;
+      }
+    }
+
+    return writer;
+  }
+
+}
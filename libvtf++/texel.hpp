@@ -0,0 +1,270 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "convert.hpp"
+
+#include <algorithm>
+#include <array>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+namespace libvtf {
+
+  // Compile time description of a format's texels. Uncompressed formats
+  // load and store texels as RGBA8 or RGBA32F (whichever the format
+  // converts through), block compressed formats are handled as opaque
+  // blocks.
+  template <ImageFormat Format>
+  struct TexelTraits {
+    static constexpr ImageFormat         format       = Format;
+    static constexpr detail::PixelLayout Layout       = detail::getPixelLayout(Format);
+    static constexpr detail::PixelPivot  Pivot        = detail::getPixelPivot(Layout);
+    static constexpr bool                IsCompressed = getImageFormatInfo(Format)->isCompressed;
+    static constexpr uint32_t            BlockWidth   = IsCompressed ? 4 : 1;
+    static constexpr uint32_t            BlockHeight  = IsCompressed ? 4 : 1;
+    static constexpr uint32_t            BlockSize    = uint32_t(getMemoryRequiredForMip(1, 1, 1, Format)); // Bytes per block or texel
+
+    // Formats TexelView handles: block compressed or convertible.
+    static constexpr bool IsSupported = (IsCompressed && BlockSize) || (!IsCompressed && Pivot != detail::PixelPivot::None);
+
+    using Value = std::conditional_t<Pivot == detail::PixelPivot::RGBA32F, std::array<float, 4>, std::array<uint8_t, 4>>;
+
+    static_assert(sizeof(Value) == 4 * sizeof(typename Value::value_type));
+
+    // Unpacks `count` texels with the format's row kernel.
+    static void loadRow(const uint8_t* src, uint32_t count, Value* dst) requires (!IsCompressed && IsSupported) {
+      uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+      if constexpr (Format == ImageFormats::RGBA8888 || Format == ImageFormats::RGBA32323232F)
+        std::memcpy(out, src, size_t(count) * BlockSize);
+      else if constexpr (Pivot == detail::PixelPivot::RGBA32F)
+        detail::unpackRowRGBA32F<Format>(src, count, out);
+      else
+        detail::unpackRowRGBA8<Format>(src, count, out);
+    }
+
+    static void storeRow(const Value* src, uint32_t count, uint8_t* dst) requires (!IsCompressed && IsSupported) {
+      const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+      if constexpr (Format == ImageFormats::RGBA8888 || Format == ImageFormats::RGBA32323232F)
+        std::memcpy(dst, in, size_t(count) * BlockSize);
+      else if constexpr (Pivot == detail::PixelPivot::RGBA32F)
+        detail::packRowRGBA32F<Format>(in, count, dst);
+      else
+        detail::packRowRGBA8<Format>(in, count, dst);
+    }
+
+    // loadRow or storeRow, or the format's SIMD row kernel when the CPU
+    // has it. Loops pick one up front rather than per texel.
+    static detail::ConvertRowFn getLoadRowKernel() requires (!IsCompressed && IsSupported) {
+      constexpr detail::PixelFormatKernels Kernels = detail::PixelFormatKernelTable[Format];
+      if (Kernels.unpackSIMD && detail::getCPUFeatures().*Kernels.simdFeature)
+        return Kernels.unpackSIMD;
+      return [](const uint8_t* src, uint32_t count, uint8_t* dst) { loadRow(src, count, reinterpret_cast<Value*>(dst)); };
+    }
+
+    static detail::ConvertRowFn getStoreRowKernel() requires (!IsCompressed && IsSupported) {
+      constexpr detail::PixelFormatKernels Kernels = detail::PixelFormatKernelTable[Format];
+      if (Kernels.packSIMD && detail::getCPUFeatures().*Kernels.simdFeature)
+        return Kernels.packSIMD;
+      return [](const uint8_t* src, uint32_t count, uint8_t* dst) { storeRow(reinterpret_cast<const Value*>(src), count, dst); };
+    }
+
+    static Value load(const uint8_t* texel) requires (!IsCompressed && IsSupported) {
+      Value value;
+      loadRow(texel, 1, &value);
+      return value;
+    }
+
+    static void store(uint8_t* texel, const Value& value) requires (!IsCompressed && IsSupported) {
+      storeRow(&value, 1, texel);
+    }
+  };
+
+  // A 2D image of one format, or one slice of a subresource, with the
+  // format fixed at compile time so per-texel code has no format branches.
+  // Rows are rows of blocks for block compressed formats. Byte is uint8_t
+  // for a writable view.
+  template <ImageFormat Format, typename Byte = const uint8_t>
+    requires (TexelTraits<Format>::IsSupported && std::is_same_v<std::remove_const_t<Byte>, uint8_t>)
+  class TexelView {
+  public:
+    using Traits = TexelTraits<Format>;
+    using Value  = typename Traits::Value;
+
+    TexelView(std::span<Byte> data, uint32_t width, uint32_t height)
+      : m_data{ data.data() }
+      , m_width{ width }
+      , m_height{ height }
+      , m_blocksX{ (width + Traits::BlockWidth - 1) / Traits::BlockWidth }
+      , m_blocksY{ (height + Traits::BlockHeight - 1) / Traits::BlockHeight } {
+      if (data.size() < size_t(m_blocksX) * m_blocksY * Traits::BlockSize)
+        throw std::runtime_error("Buffer is too small for image dimensions.");
+    }
+
+    // A read-only view of one subresource (a 2D slice) of `vtf`.
+    TexelView(const VTFData& vtf, const SubresourceLayout& subresource) requires std::is_const_v<Byte>
+      : TexelView{ requireImageData(vtf, subresource), std::get<0>(getMipSize(vtf, subresource)), std::get<1>(getMipSize(vtf, subresource)) } {
+    }
+
+    uint32_t width() const { return m_width; }
+    uint32_t height() const { return m_height; }
+    uint32_t blocksX() const { return m_blocksX; }
+    uint32_t blocksY() const { return m_blocksY; }
+    size_t   rowPitch() const { return size_t(m_blocksX) * Traits::BlockSize; }
+
+    std::span<Byte> data() const { return { m_data, rowPitch() * m_blocksY }; }
+
+    // Row y of texels, or of blocks for block compressed formats.
+    std::span<Byte> row(uint32_t y) const { return { m_data + y * rowPitch(), rowPitch() }; }
+
+    Byte* block(uint32_t bx, uint32_t by) const { return m_data + by * rowPitch() + size_t(bx) * Traits::BlockSize; }
+
+    Value load(uint32_t x, uint32_t y) const requires (!Traits::IsCompressed) {
+      return Traits::load(block(x, y));
+    }
+
+    void store(uint32_t x, uint32_t y, const Value& value) const requires (!Traits::IsCompressed && !std::is_const_v<Byte>) {
+      Traits::store(block(x, y), value);
+    }
+
+    // fn(y, row) for every row, top to bottom.
+    template <typename Fn>
+    void forEachRow(Fn&& fn) const {
+      for (uint32_t y = 0; y < m_blocksY; y++)
+        fn(y, row(y));
+    }
+
+    // fn(bx, by, block pointer) for every block (every texel when
+    // uncompressed), row by row.
+    template <typename Fn>
+    void forEachBlock(Fn&& fn) const {
+      for (uint32_t by = 0; by < m_blocksY; by++) {
+        Byte* src = m_data + by * rowPitch();
+        for (uint32_t bx = 0; bx < m_blocksX; bx++, src += Traits::BlockSize)
+          fn(bx, by, src);
+      }
+    }
+
+    // fn(x, y, value) for every texel. Rows are unpacked a chunk at a
+    // time, so fn's loop runs over plain RGBA values.
+    template <typename Fn>
+    void forEachTexel(Fn&& fn) const requires (!Traits::IsCompressed) {
+      const detail::ConvertRowFn loadRow = Traits::getLoadRowKernel();
+      std::array<Value, ChunkSize> values;
+      for (uint32_t y = 0; y < m_height; y++) {
+        const uint8_t* src = m_data + y * rowPitch();
+        for (uint32_t x = 0; x < m_width; x += ChunkSize) {
+          const uint32_t count = std::min(ChunkSize, m_width - x);
+          loadRow(src + size_t(x) * Traits::BlockSize, count, reinterpret_cast<uint8_t*>(values.data()));
+          for (uint32_t i = 0; i < count; i++)
+            fn(x + i, y, values[i]);
+        }
+      }
+    }
+
+    // Replaces every texel with fn(value).
+    template <typename Fn>
+    void transformTexels(Fn&& fn) const requires (!Traits::IsCompressed && !std::is_const_v<Byte>) {
+      const detail::ConvertRowFn loadRow  = Traits::getLoadRowKernel();
+      const detail::ConvertRowFn storeRow = Traits::getStoreRowKernel();
+      std::array<Value, ChunkSize> values;
+      for (uint32_t y = 0; y < m_height; y++) {
+        uint8_t* dst = m_data + y * rowPitch();
+        for (uint32_t x = 0; x < m_width; x += ChunkSize) {
+          const uint32_t count = std::min(ChunkSize, m_width - x);
+          loadRow(dst + size_t(x) * Traits::BlockSize, count, reinterpret_cast<uint8_t*>(values.data()));
+          for (uint32_t i = 0; i < count; i++)
+            values[i] = fn(values[i]);
+          storeRow(reinterpret_cast<const uint8_t*>(values.data()), count, dst + size_t(x) * Traits::BlockSize);
+        }
+      }
+    }
+
+  private:
+    static constexpr uint32_t ChunkSize = 64;
+
+    static std::tuple<uint32_t, uint32_t> getMipSize(const VTFData& vtf, const SubresourceLayout& subresource) {
+      const meta::VTFHeader& header = vtf.getHeader();
+      auto [width, height, depth] = adjustImageSizeByMip(header.width, header.height, header.depth, subresource.mipLevel);
+      return { width, height };
+    }
+
+    static std::span<const uint8_t> requireImageData(const VTFData& vtf, const SubresourceLayout& subresource) {
+      if (vtf.getHeader().format != Format)
+        throw std::runtime_error("Texel view format does not match the VTF format.");
+      const std::span<const uint8_t> data = vtf.imageData(subresource);
+      if (data.empty())
+        throw std::runtime_error("Image data is not available.");
+      return data;
+    }
+
+    Byte*    m_data;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_blocksX;
+    uint32_t m_blocksY;
+  };
+
+  // fn(slice, view) for every 2D slice of a subresource, one per depth
+  // slice for volume textures.
+  template <ImageFormat Format, typename Fn>
+  void forEachSlice(const VTFData& vtf, uint16_t frame, uint16_t face, uint8_t mipLevel, Fn&& fn) {
+    const meta::VTFHeader& header = vtf.getHeader();
+    const uint16_t depth = std::get<2>(adjustImageSizeByMip(header.width, header.height, header.depth, mipLevel));
+    for (uint16_t slice = 0; slice < depth; slice++)
+      fn(slice, TexelView<Format>{ vtf, vtf.subresource(frame, face, mipLevel, slice) });
+  }
+
+  namespace detail {
+
+    template <ImageFormat Format, typename Fn>
+    decltype(auto) invokeWithTexelTraits(Fn& fn) {
+      return fn(TexelTraits<Format>{});
+    }
+
+    template <typename Fn, size_t... Formats>
+    decltype(auto) dispatchTexelFormat(ImageFormat format, Fn& fn, std::index_sequence<Formats...>) {
+      using Result = decltype(fn(TexelTraits<ImageFormats::RGBA8888>{}));
+      using Thunk  = Result (*)(Fn&);
+
+      // Unsupported formats get a thunk that throws, so fn is only
+      // instantiated for formats it can handle.
+      static constexpr std::array<Thunk, sizeof...(Formats)> Thunks = {
+        [] {
+          if constexpr (TexelTraits<ImageFormat(Formats)>::IsSupported)
+            return Thunk{ &invokeWithTexelTraits<ImageFormat(Formats), Fn> };
+          else
+            return Thunk{ [](Fn&) -> Result { throw std::runtime_error("Image format has no texel view."); } };
+        }()...
+      };
+
+      if (format < 0 || size_t(format) >= Thunks.size())
+        throw std::runtime_error("Image format has no texel view.");
+      return Thunks[size_t(format)](fn);
+    }
+
+  }
+
+  constexpr bool isTexelFormat(ImageFormat format) {
+    if (format < 0 || format > ImageFormats::VITAMIN_FORMAT_LAST)
+      return false;
+    const bool compressed = getImageFormatInfo(format)->isCompressed;
+    return compressed ? getMemoryRequiredForMip(1, 1, 1, format) != 0 : detail::getPixelFormatKernels(format) != nullptr;
+  }
+
+  // Calls fn(TexelTraits<F>{}) for the runtime format F, so the format is
+  // switched on once and fn's loops are compiled for each format. fn must
+  // return the same type for every format, and is only instantiated for
+  // formats with isTexelFormat().
+  //
+  //   dispatchTexelFormat(vtf.getHeader().format, [&](auto traits) {
+  //     using Traits = decltype(traits);
+  //     TexelView<Traits::format> view{ vtf, subresource };
+  //     ...
+  //   });
+  template <typename Fn>
+  decltype(auto) dispatchTexelFormat(ImageFormat format, Fn&& fn) {
+    return detail::dispatchTexelFormat(format, fn, std::make_index_sequence<ImageFormats::VITAMIN_FORMAT_LAST + 1>());
+  }
+
+}
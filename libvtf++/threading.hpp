@@ -0,0 +1,249 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace libvtf {
+
+  // Lets callers plug their own thread pool into libvtf's parallel algorithms.
+  class Executor {
+  public:
+    virtual ~Executor() = default;
+
+    // Schedules a task to run at some point, possibly on another thread.
+    virtual void submit(std::function<void()> task) = 0;
+
+    // Number of tasks the executor can run at the same time.
+    virtual uint32_t concurrency() const = 0;
+  };
+
+  class ThreadPool final : public Executor {
+  public:
+    explicit ThreadPool(uint32_t numThreads = std::max(1u, std::thread::hardware_concurrency())) {
+      m_threads.reserve(numThreads);
+      for (uint32_t i = 0; i < numThreads; i++)
+        m_threads.emplace_back([this] { workerMain(); });
+    }
+
+    ~ThreadPool() {
+      {
+        std::unique_lock lock{ m_mutex };
+        m_stopping = true;
+      }
+      m_condition.notify_all();
+      for (std::thread& thread : m_threads)
+        thread.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task) override {
+      {
+        std::unique_lock lock{ m_mutex };
+        m_tasks.push_back(std::move(task));
+      }
+      m_condition.notify_one();
+    }
+
+    uint32_t concurrency() const override {
+      return uint32_t(m_threads.size());
+    }
+
+  private:
+    void workerMain() {
+      for (;;) {
+        std::function<void()> task;
+        {
+          std::unique_lock lock{ m_mutex };
+          m_condition.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+          if (m_tasks.empty())
+            return;
+          task = std::move(m_tasks.front());
+          m_tasks.pop_front();
+        }
+        task();
+      }
+    }
+
+    std::mutex                        m_mutex;
+    std::condition_variable           m_condition;
+    std::deque<std::function<void()>> m_tasks;
+    bool                              m_stopping = false;
+    std::vector<std::thread>          m_threads;
+  };
+
+  // Process-wide pool used when no executor is given. The calling thread
+  // always participates, so it has one thread less than the core count.
+  inline ThreadPool& getSharedThreadPool() {
+    static ThreadPool pool{ std::max(1u, std::thread::hardware_concurrency()) - 1 };
+    return pool;
+  }
+
+  struct ParallelOptions {
+    Executor* executor   = nullptr; // nullptr = getSharedThreadPool()
+    uint32_t  maxThreads = 0;       // Including the calling thread, 0 = no cap
+  };
+
+  namespace detail {
+
+    // Work-stealing parallel-for. Items are split evenly across the
+    // participants up front; each participant pops from the front of its
+    // own range, and once it runs dry steals the back half of the largest
+    // remaining range. Ranges are packed [begin, end) pairs updated with CAS,
+    // so neither path takes a lock.
+    class ParallelForJob {
+    public:
+      using InvokeFn = void (*)(void* context, size_t index);
+
+      ParallelForJob(size_t count, uint32_t participants, InvokeFn invoke, void* context)
+        : m_ranges{ participants }
+        , m_remaining{ count }
+        , m_invoke{ invoke }
+        , m_context{ context } {
+        for (uint32_t i = 0; i < participants; i++) {
+          const uint32_t begin = uint32_t(count * i / participants);
+          const uint32_t end   = uint32_t(count * (i + 1) / participants);
+          m_ranges[i].value.store(pack(begin, end), std::memory_order_relaxed);
+        }
+      }
+
+      void run(uint32_t participant) {
+        size_t index;
+        while (pop(participant, index) || steal(participant, index)) {
+          if (!m_failed.load(std::memory_order_relaxed)) {
+            try {
+              m_invoke(m_context, index);
+            } catch (...) {
+              std::unique_lock lock{ m_exceptionMutex };
+              if (!m_exception)
+                m_exception = std::current_exception();
+              m_failed.store(true, std::memory_order_relaxed);
+            }
+          }
+
+          if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            m_remaining.notify_all();
+        }
+      }
+
+      void wait() {
+        for (size_t remaining = m_remaining.load(std::memory_order_acquire); remaining; remaining = m_remaining.load(std::memory_order_acquire))
+          m_remaining.wait(remaining, std::memory_order_acquire);
+
+        if (m_exception)
+          std::rethrow_exception(m_exception);
+      }
+
+    private:
+      struct alignas(64) Range {
+        std::atomic<uint64_t> value{ 0 };
+      };
+
+      static constexpr uint64_t pack(uint32_t begin, uint32_t end) { return uint64_t(begin) | (uint64_t(end) << 32); }
+      static constexpr uint32_t rangeBegin(uint64_t range) { return uint32_t(range); }
+      static constexpr uint32_t rangeEnd(uint64_t range) { return uint32_t(range >> 32); }
+
+      bool pop(uint32_t participant, size_t& index) {
+        std::atomic<uint64_t>& slot = m_ranges[participant].value;
+        uint64_t range = slot.load(std::memory_order_acquire);
+        while (rangeBegin(range) < rangeEnd(range)) {
+          if (slot.compare_exchange_weak(range, pack(rangeBegin(range) + 1, rangeEnd(range)), std::memory_order_acq_rel)) {
+            index = rangeBegin(range);
+            return true;
+          }
+        }
+        return false;
+      }
+
+      bool steal(uint32_t participant, size_t& index) {
+        for (;;) {
+          uint32_t victim  = 0;
+          uint32_t largest = 0;
+          for (uint32_t i = 0; i < m_ranges.size(); i++) {
+            const uint64_t range = m_ranges[i].value.load(std::memory_order_acquire);
+            const uint32_t size  = rangeEnd(range) > rangeBegin(range) ? rangeEnd(range) - rangeBegin(range) : 0;
+            if (size > largest) {
+              largest = size;
+              victim  = i;
+            }
+          }
+
+          if (!largest)
+            return false;
+
+          std::atomic<uint64_t>& slot = m_ranges[victim].value;
+          uint64_t range = slot.load(std::memory_order_acquire);
+          const uint32_t begin = rangeBegin(range);
+          const uint32_t end   = rangeEnd(range);
+          if (begin >= end)
+            continue;
+
+          // Leave the front half to the victim, which is likely working on it.
+          const uint32_t middle = begin + (end - begin) / 2;
+          if (!slot.compare_exchange_strong(range, pack(begin, middle), std::memory_order_acq_rel))
+            continue;
+
+          // Only this participant writes a non-empty range into its own slot.
+          m_ranges[participant].value.store(pack(middle + 1, end), std::memory_order_release);
+          index = middle;
+          return true;
+        }
+      }
+
+      std::vector<Range>  m_ranges;
+      std::atomic<size_t> m_remaining;
+      std::atomic<bool>   m_failed{ false };
+      std::mutex          m_exceptionMutex;
+      std::exception_ptr  m_exception;
+      InvokeFn            m_invoke;
+      void*               m_context;
+    };
+
+  }
+
+  // Runs task(i) for every i in [0, count) and returns once all of them have
+  // finished. The calling thread participates, so this never deadlocks even
+  // if the executor is saturated or this is called from one of its threads.
+  // The first exception thrown by a task is rethrown here.
+  template <typename Fn>
+  void parallelFor(size_t count, Fn&& task, const ParallelOptions& options = {}) {
+    if (!count)
+      return;
+
+    Executor& executor = options.executor ? *options.executor : getSharedThreadPool();
+
+    size_t participants = std::min<size_t>(count, size_t(executor.concurrency()) + 1);
+    if (options.maxThreads)
+      participants = std::min<size_t>(participants, options.maxThreads);
+
+    if (participants <= 1 || count > UINT32_MAX) {
+      for (size_t i = 0; i < count; i++)
+        task(i);
+      return;
+    }
+
+    using TaskType = std::remove_reference_t<Fn>;
+    auto job = std::make_shared<detail::ParallelForJob>(count, uint32_t(participants),
+      [](void* context, size_t index) { (*static_cast<TaskType*>(context))(index); },
+      const_cast<void*>(static_cast<const void*>(std::addressof(task))));
+
+    // Helpers that start after all items are done exit without touching
+    // `task`, the shared job state keeps everything else alive.
+    for (uint32_t i = 1; i < participants; i++)
+      executor.submit([job, i] { job->run(i); });
+
+    job->run(0);
+    job->wait();
+  }
+
+}
@@ -0,0 +1,408 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "mapped.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace libvtf {
+
+  namespace meta {
+
+#ifdef _MSC_VER
+#pragma pack(push, 1)
+#endif
+
+    PACKED_STRUCT(VPKHeader_1) {
+      static constexpr uint32_t ValidSignature = 0x55AA1234;
+
+      uint32_t signature{};
+      uint32_t version{};
+      uint32_t treeSize{};  // Size of the directory tree following the header
+    };
+
+    PACKED_STRUCT(VPKHeader_2) : public VPKHeader_1 {
+      uint32_t fileDataSectionSize{};   // Embedded file data following the tree
+      uint32_t archiveMD5SectionSize{};
+      uint32_t otherMD5SectionSize{};
+      uint32_t signatureSectionSize{};
+    };
+
+    // Directory entry following each file name in the tree, then
+    // preloadBytes of the file's data.
+    PACKED_STRUCT(VPKDirectoryEntry) {
+      static constexpr uint16_t Terminator = 0xFFFF;
+
+      uint32_t crc32{};
+      uint16_t preloadBytes{};
+      uint16_t archiveIndex{};
+      uint32_t entryOffset{};
+      uint32_t entryLength{};
+      uint16_t terminator{};
+    };
+
+#ifdef _MSC_VER
+#pragma pack(pop)
+#endif
+
+  }
+
+  // A file in a VPK archive. Its data is the preload bytes from the
+  // directory followed by `length` bytes at `offset` in archive chunk
+  // `archiveIndex`.
+  struct VPKEntry {
+    // Data lives in the directory file, after the tree.
+    static constexpr uint16_t DirectoryArchive = 0x7FFF;
+
+    std::string_view path;          // Lowercase, '/' separated, with extension
+    uint64_t         hash;
+    uint32_t         crc32;
+    uint16_t         archiveIndex;
+    uint16_t         preloadSize;
+    uint32_t         offset;
+    uint32_t         length;
+    const uint8_t*   preloadData;   // In the directory mapping
+
+    uint64_t size() const { return uint64_t(preloadSize) + length; }
+  };
+
+  // A VTF inside a VPK archive. Files stored in one piece are viewed in
+  // place in the archive mapping, files split between preload bytes and a
+  // chunk are joined into an owned buffer.
+  class VPKTexture {
+  public:
+    VPKTexture(VPKTexture&&) = default;
+    VPKTexture& operator=(VPKTexture&&) = default;
+    VPKTexture(const VPKTexture&) = delete;
+    VPKTexture& operator=(const VPKTexture&) = delete;
+
+    const VTFData& data() const { return m_data; }
+    const meta::VTFHeader& getHeader() const { return m_data.getHeader(); }
+
+    // Whether data() points straight into the archive.
+    bool isZeroCopy() const { return m_buffer.empty(); }
+
+  private:
+    friend class VPKArchive;
+
+    VPKTexture(std::span<const uint8_t> view)
+      : m_data{ view } {
+    }
+
+    VPKTexture(std::vector<uint8_t> buffer)
+      : m_buffer{ std::move(buffer) }
+      , m_data{ m_buffer } {
+    }
+
+    // Declared first so it outlives the view into it.
+    std::vector<uint8_t> m_buffer;
+    VTFData              m_data;
+  };
+
+  namespace detail {
+
+    // VPK paths match case insensitively and with either slash.
+    constexpr char normalizeVPKPathChar(char c) {
+      if (c == '\\')
+        return '/';
+      if (c >= 'A' && c <= 'Z')
+        return char(c - 'A' + 'a');
+      return c;
+    }
+
+    // FNV-1a of the normalized path.
+    constexpr uint64_t hashVPKPath(std::string_view path) {
+      uint64_t hash = 0xCBF29CE484222325ull;
+      for (char c : path) {
+        hash ^= uint8_t(normalizeVPKPathChar(c));
+        hash *= 0x100000001B3ull;
+      }
+      return hash;
+    }
+
+    // `entry` is already normalized.
+    constexpr bool matchVPKPath(std::string_view entry, std::string_view path) {
+      if (entry.size() != path.size())
+        return false;
+      for (size_t i = 0; i < path.size(); i++) {
+        if (entry[i] != normalizeVPKPathChar(path[i]))
+          return false;
+      }
+      return true;
+    }
+
+    // Reads the zero terminated strings of the directory tree.
+    class VPKTreeReader {
+    public:
+      VPKTreeReader(std::span<const uint8_t> tree)
+        : m_tree{ tree } {
+      }
+
+      std::string_view readString() {
+        const void* end = m_position < m_tree.size() ? std::memchr(m_tree.data() + m_position, 0, m_tree.size() - m_position) : nullptr;
+        if (!end)
+          throw std::runtime_error("VPK directory tree is truncated.");
+
+        const size_t size = size_t(static_cast<const uint8_t*>(end) - m_tree.data()) - m_position;
+        const std::string_view string{ reinterpret_cast<const char*>(m_tree.data() + m_position), size };
+        m_position += size + 1;
+        return string;
+      }
+
+      const uint8_t* read(size_t size) {
+        if (size > m_tree.size() - m_position)
+          throw std::runtime_error("VPK directory tree is truncated.");
+
+        const uint8_t* data = m_tree.data() + m_position;
+        m_position += size;
+        return data;
+      }
+
+    private:
+      std::span<const uint8_t> m_tree;
+      size_t                   m_position = 0;
+    };
+
+  }
+
+  // Source engine VPK archive (versions 1 and 2), opened from its
+  // directory file (eg. "pak01_dir.vpk"). The directory and every archive
+  // chunk it refers to are mapped up front and the tree is indexed once,
+  // after which lookups and opening textures don't allocate or read
+  // anything but the texture itself. All const members are thread safe.
+  class VPKArchive {
+  public:
+    explicit VPKArchive(const std::filesystem::path& directoryPath, AccessHint hint = AccessHint::Random)
+      : m_directory{ directoryPath } {
+      parseDirectory();
+      mapArchives(directoryPath, hint);
+      buildIndex();
+    }
+
+    VPKArchive(VPKArchive&&) = default;
+    VPKArchive& operator=(VPKArchive&&) = default;
+
+    std::span<const VPKEntry> entries() const { return m_entries; }
+
+    // Finds a file by path, case insensitive and with either slash.
+    const VPKEntry* find(std::string_view path) const {
+      const uint64_t hash = detail::hashVPKPath(path);
+      const size_t   mask = m_index.size() - 1;
+      for (size_t slot = size_t(hash) & mask;; slot = (slot + 1) & mask) {
+        const uint32_t index = m_index[slot];
+        if (index == EmptySlot)
+          return nullptr;
+
+        const VPKEntry& entry = m_entries[index];
+        if (entry.hash == hash && detail::matchVPKPath(entry.path, path))
+          return &entry;
+      }
+    }
+
+    // The data of a file stored in one piece: all in the preload bytes or
+    // all in an archive chunk. Empty for files split between the two.
+    std::span<const uint8_t> contiguousData(const VPKEntry& entry) const {
+      if (!entry.length)
+        return { entry.preloadData, entry.preloadSize };
+      if (entry.preloadSize)
+        return {};
+      return archiveData(entry);
+    }
+
+    // Copies the whole file into `dst`, which must hold entry.size() bytes.
+    void read(const VPKEntry& entry, std::span<uint8_t> dst) const {
+      if (dst.size() < entry.size())
+        throw std::runtime_error("Destination buffer is too small for VPK entry.");
+
+      std::memcpy(dst.data(), entry.preloadData, entry.preloadSize);
+      if (entry.length) {
+        const std::span<const uint8_t> data = archiveData(entry);
+        std::memcpy(dst.data() + entry.preloadSize, data.data(), data.size());
+      }
+    }
+
+    // Opens a VTF in place. Throws if the file isn't a valid VTF.
+    VPKTexture openVTF(const VPKEntry& entry) const {
+      if (const std::span<const uint8_t> data = contiguousData(entry); !data.empty() || !entry.size())
+        return VPKTexture{ data };
+
+      std::vector<uint8_t> buffer(size_t(entry.size()));
+      read(entry, buffer);
+      return VPKTexture{ std::move(buffer) };
+    }
+
+    std::optional<VPKTexture> openVTF(std::string_view path) const {
+      const VPKEntry* entry = find(path);
+      if (!entry)
+        return std::nullopt;
+      return openVTF(*entry);
+    }
+
+    const MappedFile& directory() const { return m_directory; }
+
+    // Mapping of an archive chunk, nullptr if no entry refers to it.
+    const MappedFile* archive(uint16_t archiveIndex) const {
+      if (archiveIndex == VPKEntry::DirectoryArchive)
+        return &m_directory;
+      if (archiveIndex >= m_archives.size() || !m_archives[archiveIndex])
+        return nullptr;
+      return &*m_archives[archiveIndex];
+    }
+
+  private:
+    static constexpr uint32_t EmptySlot = UINT32_MAX;
+
+    std::span<const uint8_t> archiveData(const VPKEntry& entry) const {
+      if (entry.archiveIndex == VPKEntry::DirectoryArchive)
+        return m_directory.data().subspan(m_embeddedDataOffset + entry.offset, entry.length);
+      return m_archives[entry.archiveIndex]->data().subspan(entry.offset, entry.length);
+    }
+
+    void parseDirectory() {
+      const std::span<const uint8_t> file = m_directory.data();
+
+      meta::VPKHeader_2 header{};
+      if (file.size() < sizeof(meta::VPKHeader_1))
+        throw std::runtime_error("VPK directory is truncated.");
+      std::memcpy(static_cast<void*>(&header), file.data(), sizeof(meta::VPKHeader_1));
+      if (header.signature != meta::VPKHeader_1::ValidSignature)
+        throw std::runtime_error("Invalid VPK signature.");
+
+      size_t headerSize = sizeof(meta::VPKHeader_1);
+      if (header.version == 2) {
+        headerSize = sizeof(meta::VPKHeader_2);
+        if (file.size() < headerSize)
+          throw std::runtime_error("VPK directory is truncated.");
+        std::memcpy(&header, file.data(), headerSize);
+      } else if (header.version != 1) {
+        throw std::runtime_error("Unhandled VPK version.");
+      }
+
+      if (header.treeSize > file.size() - headerSize)
+        throw std::runtime_error("VPK directory tree is truncated.");
+      m_embeddedDataOffset = headerSize + header.treeSize;
+
+      // Paths are joined into one buffer sized up front, so the views
+      // into it stay put.
+      detail::VPKTreeReader reader{ file.subspan(headerSize, header.treeSize) };
+      std::vector<std::array<std::string_view, 3>> names;
+      size_t pathsSize = 0;
+
+      for (std::string_view extension = reader.readString(); !extension.empty(); extension = reader.readString()) {
+        for (std::string_view directory = reader.readString(); !directory.empty(); directory = reader.readString()) {
+          for (std::string_view name = reader.readString(); !name.empty(); name = reader.readString()) {
+            meta::VPKDirectoryEntry info;
+            std::memcpy(&info, reader.read(sizeof(info)), sizeof(info));
+            if (info.terminator != meta::VPKDirectoryEntry::Terminator)
+              throw std::runtime_error("Invalid VPK directory entry.");
+
+            const uint8_t* preloadData = reader.read(info.preloadBytes);
+            const std::span<const uint8_t> archive = info.archiveIndex == VPKEntry::DirectoryArchive
+              ? file.subspan(m_embeddedDataOffset)
+              : std::span<const uint8_t>{};
+            if (info.archiveIndex == VPKEntry::DirectoryArchive && (info.entryOffset > archive.size() || info.entryLength > archive.size() - info.entryOffset))
+              throw std::runtime_error("VPK entry is out of bounds.");
+
+            m_entries.push_back(VPKEntry{
+              .path         = {},
+              .hash         = 0,
+              .crc32        = info.crc32,
+              .archiveIndex = info.archiveIndex,
+              .preloadSize  = info.preloadBytes,
+              .offset       = info.entryOffset,
+              .length       = info.entryLength,
+              .preloadData  = preloadData,
+            });
+
+            // A single space stands for no directory or extension.
+            names.push_back({ directory == " " ? std::string_view{} : directory, name, extension == " " ? std::string_view{} : extension });
+            pathsSize += directory.size() + name.size() + extension.size() + 2;
+          }
+        }
+      }
+
+      m_paths.reserve(pathsSize);
+      for (size_t i = 0; i < m_entries.size(); i++) {
+        auto [directory, name, extension] = names[i];
+        const size_t begin = m_paths.size();
+        m_paths.insert(m_paths.end(), directory.begin(), directory.end());
+        if (!directory.empty())
+          m_paths.push_back('/');
+        m_paths.insert(m_paths.end(), name.begin(), name.end());
+        if (!extension.empty()) {
+          m_paths.push_back('.');
+          m_paths.insert(m_paths.end(), extension.begin(), extension.end());
+        }
+
+        for (size_t c = begin; c < m_paths.size(); c++)
+          m_paths[c] = detail::normalizeVPKPathChar(m_paths[c]);
+        m_entries[i].path = std::string_view{ m_paths.data() + begin, m_paths.size() - begin };
+        m_entries[i].hash = detail::hashVPKPath(m_entries[i].path);
+      }
+    }
+
+    // Chunks of "name_dir.vpk" are "name_000.vpk", "name_001.vpk"...
+    void mapArchives(const std::filesystem::path& directoryPath, AccessHint hint) {
+      for (const VPKEntry& entry : m_entries) {
+        if (!entry.length || entry.archiveIndex == VPKEntry::DirectoryArchive)
+          continue;
+
+        if (entry.archiveIndex >= m_archives.size())
+          m_archives.resize(entry.archiveIndex + 1);
+        std::optional<MappedFile>& archive = m_archives[entry.archiveIndex];
+        if (!archive) {
+          const std::string stem = directoryPath.stem().string();
+          if (stem.size() < 4 || stem.compare(stem.size() - 4, 4, "_dir") != 0)
+            throw std::runtime_error("VPK entry refers to an archive chunk but the directory isn't named *_dir.vpk.");
+
+          char suffix[8];
+          std::snprintf(suffix, sizeof(suffix), "_%03u", uint32_t(entry.archiveIndex));
+          std::filesystem::path chunkPath = directoryPath;
+          chunkPath.replace_filename(stem.substr(0, stem.size() - 4) + suffix + directoryPath.extension().string());
+          archive.emplace(chunkPath);
+          if (hint != AccessHint::Normal)
+            archive->advise(0, archive->data().size(), hint);
+        }
+
+        if (entry.offset > archive->data().size() || entry.length > archive->data().size() - entry.offset)
+          throw std::runtime_error("VPK entry is out of bounds.");
+      }
+    }
+
+    // Open addressing with linear probing, at most half full.
+    void buildIndex() {
+      size_t slots = 16;
+      while (slots < m_entries.size() * 2)
+        slots *= 2;
+      m_index.assign(slots, EmptySlot);
+
+      const size_t mask = slots - 1;
+      for (uint32_t i = 0; i < m_entries.size(); i++) {
+        size_t slot = size_t(m_entries[i].hash) & mask;
+        for (; m_index[slot] != EmptySlot; slot = (slot + 1) & mask) {
+          // The first of duplicate paths wins.
+          if (m_entries[m_index[slot]].hash == m_entries[i].hash && m_entries[m_index[slot]].path == m_entries[i].path)
+            break;
+        }
+        if (m_index[slot] == EmptySlot)
+          m_index[slot] = i;
+      }
+    }
+
+    MappedFile                              m_directory;
+    std::vector<std::optional<MappedFile>>  m_archives;
+    size_t                                  m_embeddedDataOffset = 0;
+    std::vector<char>                       m_paths;
+    std::vector<VPKEntry>                   m_entries;
+    std::vector<uint32_t>                   m_index;
+  };
+
+}
@@ -0,0 +1,435 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "crc32.hpp"
+
+#include <algorithm>
+#include <concepts>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace libvtf {
+
+  // Builds a VTF file (7.0 - 7.5) from a header description, a low-res
+  // image and high-res image data.
+  //
+  // The writer does not copy image or resource data, every span passed in
+  // must stay valid until the file has been written. Output is produced in a
+  // single pass, either into a preallocated buffer of fileSize() bytes or
+  // into a streaming sink, so nothing is staged in between.
+  class VTFWriter {
+  public:
+    // Signature, version, headerSize and numResources of `header` are
+    // ignored, they are filled in from `version` and the resources added.
+    explicit VTFWriter(const meta::VTFHeader& header, std::array<int32_t, 2> version = meta::VTFHeader_7_5::Version)
+      : m_version{ validateVersion(version) }
+      , m_layoutBuffer{ serializeHeader(validateHeader(header, version), version, 0) }
+      , m_layout{ m_layoutBuffer }
+      , m_subresourceData(m_layout.subresources().size()) {
+    }
+
+    VTFWriter(VTFWriter&&) = default;
+    VTFWriter& operator=(VTFWriter&&) = default;
+
+    // m_layout points into m_layoutBuffer.
+    VTFWriter(const VTFWriter&) = delete;
+    VTFWriter& operator=(const VTFWriter&) = delete;
+
+    // The layout of the file being written: header, subresources and sizes.
+    // Only the header and layout accessors may be used, there is no data.
+    const VTFData& layout() const { return m_layout; }
+    const meta::VTFHeader& getHeader() const { return m_layout.getHeader(); }
+
+    // Raw header bytes of a file being rewritten. The written header starts
+    // from these and only the fields the writer models are replaced, so
+    // bytes it doesn't know about (the start frame of animated textures in
+    // the padding after numFrames) carry over.
+    void setBaseHeader(std::span<const uint8_t> bytes) {
+      const size_t size = std::min(bytes.size(), getHeaderSize(m_version));
+      m_baseHeader.assign(bytes.begin(), bytes.begin() + ptrdiff_t(size));
+    }
+
+    bool supportsResources() const {
+      return m_version[1] >= meta::VTFHeader_7_3::Version[1];
+    }
+
+    void setLowResImage(std::span<const uint8_t> data) {
+      if (data.size() != m_layout.lowResImageSize())
+        throw std::runtime_error("Low-res image data does not match the low-res image size.");
+
+      m_lowResImage = data;
+    }
+
+    // The whole high-res image in file order (smallest mip first).
+    void setImageData(std::span<const uint8_t> data) {
+      if (data.size() != m_layout.imageTotalSize())
+        throw std::runtime_error("Image data does not match the total image size.");
+
+      m_imageData = data;
+      std::fill(m_subresourceData.begin(), m_subresourceData.end(), std::span<const uint8_t>{});
+    }
+
+    void setImageData(uint16_t frame, uint16_t face, uint8_t mipLevel, uint16_t slice, std::span<const uint8_t> data) {
+      const meta::VTFHeader& header = m_layout.getHeader();
+      if (frame >= header.numFrames || face >= m_layout.faceCount() || mipLevel >= header.numMipLevels)
+        throw std::runtime_error("Subresource is out of range.");
+
+      auto [width, height, depth] = adjustImageSizeByMip(header.width, header.height, header.depth, mipLevel);
+      if (slice >= depth)
+        throw std::runtime_error("Subresource is out of range.");
+
+      const SubresourceLayout& subresource = m_layout.subresource(frame, face, mipLevel, slice);
+      if (data.size() != subresource.size)
+        throw std::runtime_error("Image data does not match the subresource size.");
+
+      if (!m_imageData.empty()) {
+        // Switch to per-subresource data, keeping what was set as a whole.
+        for (const SubresourceLayout& other : m_layout.subresources())
+          m_subresourceData[getSubresourceIndex(other)] = m_imageData.subspan(other.offset, other.size);
+        m_imageData = {};
+      }
+
+      m_subresourceData[getSubresourceIndex(subresource)] = data;
+    }
+
+    void setImageData(const SubresourceLayout& subresource, std::span<const uint8_t> data) {
+      setImageData(subresource.frame, subresource.face, subresource.mipLevel, subresource.slice, data);
+    }
+
+    // Stores a CRC-32 of the high-res image data, computed when writing.
+    void computeCRC32() {
+      requireResources();
+      m_computeCRC32 = true;
+      m_crc32.reset();
+    }
+
+    void setCRC32(uint32_t crc32) {
+      requireResources();
+      m_computeCRC32 = false;
+      m_crc32 = crc32;
+    }
+
+    void setLODControlSettings(const meta::TextureLODControlSettings& settings) {
+      uint32_t value;
+      static_assert(sizeof(settings) == sizeof(value));
+      std::memcpy(&value, &settings, sizeof(value));
+      addInlineResource(meta::TextureLODControlSettings::ResourceID, value);
+    }
+
+    void setSettingsEx(const meta::TextureSettingsEx& settings) {
+      uint32_t value;
+      static_assert(sizeof(settings) == sizeof(value));
+      std::memcpy(&value, &settings, sizeof(value));
+      addInlineResource(meta::TextureSettingsEx::ResourceID, value);
+    }
+
+    // A resource whose 4 bytes of data live in the resource directory.
+    void addInlineResource(uint32_t type, uint32_t value) {
+      addResource(Resource{ type, meta::ResourceEntryTypeFlags::HasNoDataChunk, value, {} });
+    }
+
+    // A resource with a data chunk. The chunk is written as a 32-bit size
+    // followed by the data.
+    void addResource(uint32_t type, std::span<const uint8_t> data) {
+      addResource(Resource{ type, 0, 0, data });
+    }
+
+    size_t fileSize() const {
+      size_t size = getHeaderSize() + m_layout.lowResImageSize() + m_layout.imageTotalSize();
+      for (const Resource& resource : m_resources) {
+        if (!(resource.flags & meta::ResourceEntryTypeFlags::HasNoDataChunk))
+          size += sizeof(uint32_t) + resource.data.size();
+      }
+      return size;
+    }
+
+    // Writes the file into dst, which must hold at least fileSize() bytes.
+    void write(std::span<uint8_t> dst) const {
+      if (dst.size() < fileSize())
+        throw std::runtime_error("Output buffer is too small for the VTF file.");
+
+      uint8_t* cursor = dst.data();
+      write([&cursor](std::span<const uint8_t> data) {
+        std::memcpy(cursor, data.data(), data.size());
+        cursor += data.size();
+      });
+    }
+
+    std::vector<uint8_t> write() const {
+      std::vector<uint8_t> file(fileSize());
+      write(std::span<uint8_t>{ file });
+      return file;
+    }
+
+    // Streams the file front to back through sink(std::span<const uint8_t>).
+    // Everything is validated before the first call to the sink.
+    template <typename Sink>
+      requires std::invocable<Sink&, std::span<const uint8_t>>
+    void write(Sink&& sink) const {
+      validateData();
+
+      if (!supportsResources()) {
+        // Legacy layout: header, low-res image, high-res image.
+        const std::vector<uint8_t> header = serializeHeader(m_layout.getHeader(), m_version, 0, m_baseHeader);
+        sink(std::span<const uint8_t>{ header });
+        if (!m_lowResImage.empty())
+          sink(m_lowResImage);
+        writeImageData(sink);
+        return;
+      }
+
+      std::optional<uint32_t> crc32 = m_crc32;
+      if (m_computeCRC32)
+        crc32 = computeImageCRC32();
+
+      const std::vector<Entry> entries = getEntries(crc32);
+      const std::vector<uint8_t> header = serializeHeader(m_layout.getHeader(), m_version, uint32_t(entries.size()), m_baseHeader);
+      sink(std::span<const uint8_t>{ header });
+
+      std::vector<uint8_t> directory(entries.size() * sizeof(meta::ResourceEntryInfo));
+      for (size_t i = 0; i < entries.size(); i++)
+        std::memcpy(&directory[i * sizeof(meta::ResourceEntryInfo)], &entries[i].info, sizeof(meta::ResourceEntryInfo));
+      sink(std::span<const uint8_t>{ directory });
+
+      for (const Entry& entry : entries) {
+        if (entry.info.flags & meta::ResourceEntryTypeFlags::HasNoDataChunk)
+          continue;
+
+        if (entry.info.type == meta::TextureLegacyLowResImage::ResourceID) {
+          sink(m_lowResImage);
+        } else if (entry.info.type == meta::TextureLegacyImage::ResourceID) {
+          writeImageData(sink);
+        } else {
+          const uint32_t size = uint32_t(entry.resource->data.size());
+          sink(std::span<const uint8_t>{ reinterpret_cast<const uint8_t*>(&size), sizeof(size) });
+          if (size)
+            sink(entry.resource->data);
+        }
+      }
+    }
+
+    void writeFile(const std::filesystem::path& path) const {
+      std::ofstream file{ path, std::ios::out | std::ios::binary | std::ios::trunc };
+      if (!file)
+        throw std::runtime_error("Could not open file for writing: " + path.string());
+
+      write([&file](std::span<const uint8_t> data) {
+        file.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+      });
+
+      if (!file.flush())
+        throw std::runtime_error("Could not write file: " + path.string());
+    }
+
+  private:
+    struct Resource {
+      uint32_t                 type;
+      uint32_t                 flags;
+      uint32_t                 value; // Inline resources only
+      std::span<const uint8_t> data;  // Data chunk resources only
+    };
+
+    struct Entry {
+      meta::ResourceEntryInfo info;
+      const Resource*         resource; // nullptr for the images and the CRC
+    };
+
+    static std::array<int32_t, 2> validateVersion(std::array<int32_t, 2> version) {
+      if (version[0] != 7 || version[1] < 0 || version[1] > meta::VTFHeader_7_5::Version[1])
+        throw std::runtime_error("Unhandled VTF header version.");
+      return version;
+    }
+
+    static const meta::VTFHeader& validateHeader(const meta::VTFHeader& header, std::array<int32_t, 2> version) {
+      validateVersion(version);
+
+      if (!header.width || !header.height || !header.numFrames || !header.numMipLevels)
+        throw std::runtime_error("VTF header has an empty dimension.");
+
+      if (version[1] >= meta::VTFHeader_7_2::Version[1] ? !header.depth : header.depth > 1)
+        throw std::runtime_error("VTF header has an invalid depth.");
+
+      if (!getMemoryRequiredForMip(1, 1, 1, header.format))
+        throw std::runtime_error("Unsupported image format for writing.");
+
+      if (header.lowResImageWidth && header.lowResImageHeight && !getMemoryRequiredForMip(1, 1, 1, header.lowResImageFormat))
+        throw std::runtime_error("Unsupported low-res image format for writing.");
+
+      return header;
+    }
+
+    static size_t getHeaderSize(std::array<int32_t, 2> version) {
+      if (version[1] >= meta::VTFHeader_7_3::Version[1])
+        return sizeof(meta::VTFHeader_7_3);
+      if (version[1] >= meta::VTFHeader_7_2::Version[1])
+        return sizeof(meta::VTFHeader_7_2);
+      return sizeof(meta::VTFHeader_7_1);
+    }
+
+    size_t getHeaderSize() const {
+      size_t size = getHeaderSize(m_version);
+      if (supportsResources())
+        size += getEntryCount() * sizeof(meta::ResourceEntryInfo);
+      return size;
+    }
+
+    // Fields are copied one by one into a zeroed header, or over the base
+    // header's bytes, so that padding and fields past the end of older
+    // versions never carry garbage.
+    static std::vector<uint8_t> serializeHeader(const meta::VTFHeader& header, std::array<int32_t, 2> version, uint32_t numResources,
+                                                std::span<const uint8_t> base = {}) {
+      std::array<uint8_t, sizeof(meta::VTFHeader_7_5)> initial{};
+      if (!base.empty())
+        std::memcpy(initial.data(), base.data(), std::min(base.size(), initial.size()));
+
+      meta::VTFHeader_7_5 out;
+      std::memcpy(&out, initial.data(), sizeof(out));
+      out.signature         = meta::VTFBaseHeader::ValidSignature;
+      out.version           = version;
+      out.width             = header.width;
+      out.height            = header.height;
+      out.flags             = header.flags;
+      out.numFrames         = header.numFrames;
+      out.reflectivity      = header.reflectivity;
+      out.bumpScale         = header.bumpScale;
+      out.format            = header.format;
+      out.numMipLevels      = header.numMipLevels;
+      out.lowResImageFormat = header.lowResImageFormat;
+      out.lowResImageWidth  = header.lowResImageWidth;
+      out.lowResImageHeight = header.lowResImageHeight;
+      out.depth             = version[1] >= meta::VTFHeader_7_2::Version[1] ? header.depth : 0;
+      out.numResources      = version[1] >= meta::VTFHeader_7_3::Version[1] ? numResources : 0;
+
+      const size_t structSize = getHeaderSize(version);
+      out.headerSize = int32_t(structSize + out.numResources * sizeof(meta::ResourceEntryInfo));
+
+      std::vector<uint8_t> bytes(structSize);
+      std::memcpy(bytes.data(), &out, structSize);
+      return bytes;
+    }
+
+    void requireResources() const {
+      if (!supportsResources())
+        throw std::runtime_error("Resources require VTF 7.3 or later.");
+    }
+
+    void addResource(const Resource& resource) {
+      requireResources();
+
+      if (resource.type == meta::TextureLegacyImage::ResourceID ||
+          resource.type == meta::TextureLegacyLowResImage::ResourceID ||
+          resource.type == meta::TextureCRC32::ResourceID)
+        throw std::runtime_error("Resource type is managed by the writer.");
+
+      if (resource.data.size() > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error("Resource data is too large.");
+
+      std::erase_if(m_resources, [&](const Resource& other) { return other.type == resource.type; });
+      m_resources.push_back(resource);
+    }
+
+    size_t getEntryCount() const {
+      return (m_layout.lowResImageSize() ? 1 : 0) + 1 + (m_computeCRC32 || m_crc32 ? 1 : 0) + m_resources.size();
+    }
+
+    // Resource directory sorted by type, data chunks follow in the same order.
+    std::vector<Entry> getEntries(std::optional<uint32_t> crc32) const {
+      std::vector<Entry> entries;
+      entries.reserve(getEntryCount());
+
+      auto addEntry = [&entries](uint32_t type, uint32_t flags, uint32_t value, const Resource* resource) {
+        Entry entry{};
+        entry.info.type   = type;
+        entry.info.flags  = flags;
+        entry.info.offset = value;
+        entry.resource    = resource;
+        entries.push_back(entry);
+      };
+
+      if (m_layout.lowResImageSize())
+        addEntry(meta::TextureLegacyLowResImage::ResourceID, 0, 0, nullptr);
+      addEntry(meta::TextureLegacyImage::ResourceID, 0, 0, nullptr);
+      if (crc32)
+        addEntry(meta::TextureCRC32::ResourceID, meta::ResourceEntryTypeFlags::HasNoDataChunk, *crc32, nullptr);
+      for (const Resource& resource : m_resources)
+        addEntry(resource.type, resource.flags, resource.value, &resource);
+
+      std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.info.type < b.info.type; });
+
+      uint64_t offset = getHeaderSize(m_version) + entries.size() * sizeof(meta::ResourceEntryInfo);
+      for (Entry& entry : entries) {
+        if (entry.info.flags & meta::ResourceEntryTypeFlags::HasNoDataChunk)
+          continue;
+
+        if (offset > std::numeric_limits<uint32_t>::max())
+          throw std::runtime_error("VTF file is too large.");
+        entry.info.offset = uint32_t(offset);
+
+        if (entry.info.type == meta::TextureLegacyLowResImage::ResourceID)
+          offset += m_layout.lowResImageSize();
+        else if (entry.info.type == meta::TextureLegacyImage::ResourceID)
+          offset += m_layout.imageTotalSize();
+        else
+          offset += sizeof(uint32_t) + entry.resource->data.size();
+      }
+
+      return entries;
+    }
+
+    size_t getSubresourceIndex(const SubresourceLayout& subresource) const {
+      return size_t(&m_layout.subresource(subresource.frame, subresource.face, subresource.mipLevel, subresource.slice) - m_layout.subresources().data());
+    }
+
+    void validateData() const {
+      if (m_layout.lowResImageSize() && m_lowResImage.empty())
+        throw std::runtime_error("Missing low-res image data.");
+
+      if (!m_imageData.empty())
+        return;
+
+      for (size_t i = 0; i < m_subresourceData.size(); i++) {
+        if (m_subresourceData[i].empty() && m_layout.subresources()[i].size)
+          throw std::runtime_error("Missing image data for a subresource.");
+      }
+    }
+
+    uint32_t computeImageCRC32() const {
+      if (!m_imageData.empty())
+        return crc32(m_imageData);
+
+      uint32_t crc = 0;
+      for (std::span<const uint8_t> data : m_subresourceData)
+        crc = crc32(data, crc);
+      return crc;
+    }
+
+    template <typename Sink>
+    void writeImageData(Sink& sink) const {
+      if (!m_imageData.empty()) {
+        sink(m_imageData);
+        return;
+      }
+
+      for (std::span<const uint8_t> data : m_subresourceData) {
+        if (!data.empty())
+          sink(data);
+      }
+    }
+
+    std::array<int32_t, 2>                m_version;
+    std::vector<uint8_t>                  m_layoutBuffer;
+    VTFData                               m_layout;
+    std::span<const uint8_t>              m_lowResImage;
+    std::span<const uint8_t>              m_imageData;
+    std::vector<std::span<const uint8_t>> m_subresourceData; // Indexed like m_layout.subresources()
+    std::vector<Resource>                 m_resources;
+    std::vector<uint8_t>                  m_baseHeader;
+    std::optional<uint32_t>               m_crc32;
+    bool                                  m_computeCRC32 = false;
+  };
+
+}
@@ -0,0 +1,96 @@
+#include "../libvtf++.hpp"
+#include "../libvtf++/async.hpp"
+#include "test_vtf.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+// Compares sequential ifstream loading against AsyncVTFLoader on a
+// synthetic corpus. Drop the page cache between runs to measure cold I/O.
+//
+// Usage: async_bench [directory] [file count]
+
+namespace {
+
+  template <typename Fn>
+  double timeSeconds(Fn&& fn) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  void report(const char* name, double seconds, size_t files, uint64_t bytes) {
+    std::cout << name << ": " << seconds * 1000.0 << " ms, "
+              << files / seconds << " files/s, "
+              << bytes / seconds / (1024.0 * 1024.0) << " MiB/s" << std::endl;
+  }
+
+}
+
+int main(int argc, char** argv) {
+  const std::filesystem::path directory = argc > 1 ? argv[1] : "async_bench_corpus";
+  const size_t fileCount = argc > 2 ? std::stoul(argv[2]) : 2000;
+
+  std::filesystem::create_directories(directory);
+  std::vector<std::filesystem::path> paths;
+  std::mt19937 rng{ 1234 };
+  for (size_t i = 0; i < fileCount; i++) {
+    std::filesystem::path path = directory / ("texture_" + std::to_string(i) + ".vtf");
+    if (!std::filesystem::exists(path)) {
+      const uint16_t size = uint16_t(64u << (rng() % 4));
+      const std::vector<uint8_t> file = test::makeTestVTF({
+        .width  = size,
+        .height = size,
+        .format = libvtf::ImageFormats::DXT5,
+        .fill   = [&](std::span<uint8_t> data) { for (uint8_t& byte : data) byte = uint8_t(rng()); },
+      });
+      std::ofstream{ path, std::ios::binary }.write(reinterpret_cast<const char*>(file.data()), std::streamsize(file.size()));
+    }
+    paths.push_back(std::move(path));
+  }
+
+  uint64_t bytes = 0;
+  const double sequential = timeSeconds([&] {
+    for (const std::filesystem::path& path : paths) {
+      std::ifstream file(path, std::ios::in | std::ios::binary);
+      file.seekg(0, std::ios::end);
+      std::vector<uint8_t> buffer(size_t(file.tellg()));
+      file.seekg(0, std::ios::beg);
+      file.read(reinterpret_cast<char*>(buffer.data()), std::streamsize(buffer.size()));
+      libvtf::VTFData data(buffer);
+      bytes += buffer.size();
+    }
+  });
+  report("sequential ifstream", sequential, paths.size(), bytes);
+
+  for (libvtf::AsyncBackend backend : { libvtf::AsyncBackend::IoUring, libvtf::AsyncBackend::ThreadPool }) {
+    libvtf::AsyncLoaderOptions options;
+    options.backend = backend;
+
+    std::optional<libvtf::AsyncVTFLoader> loader;
+    try {
+      loader.emplace(options);
+    } catch (const std::exception& e) {
+      std::cout << e.what() << std::endl;
+      continue;
+    }
+
+    std::atomic<uint64_t> loadedBytes = 0;
+    std::atomic<size_t>   failures    = 0;
+    const double seconds = timeSeconds([&] {
+      loader->loadAll(paths, [&](const libvtf::AsyncLoadResult& result) {
+        if (!result.data)
+          failures++;
+        loadedBytes += result.bytes.size();
+      });
+    });
+    report(backend == libvtf::AsyncBackend::IoUring ? "io_uring" : "thread pool pread", seconds, paths.size(), loadedBytes);
+    if (failures)
+      std::cout << "  " << failures << " files failed to load" << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,365 @@
+#include "../libvtf++.hpp"
+#include "../libvtf++/mapped.hpp"
+#include "../libvtf++/mipmap.hpp"
+#include "../libvtf++/writer.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// Benchmarks parsing, layout, resource lookup and loading over a
+// deterministic synthetic corpus, and prints the results as JSON.
+//
+// The corpus covers every header version from 7.0 to 7.5, compressed and
+// uncompressed formats, plain, cube map, volume, animated and
+// many-resource textures. The same seed always gives the same files, so
+// results are comparable between releases on the same machine.
+//
+// Usage: bench [--corpus DIR] [--seed N] [--min-time SECONDS] [--filter NAME] [--output FILE]
+//
+// Without --corpus the end-to-end loading benchmarks are skipped.
+
+namespace {
+
+  struct Options {
+    std::optional<std::filesystem::path> corpus;
+    uint32_t                             seed    = 1;
+    double                               minTime = 0.25;
+    std::string                          filter;
+    std::optional<std::filesystem::path> output;
+  };
+
+  enum class Shape {
+    Plain,
+    CubeMap,
+    Volume,
+    Animated,
+    ManyResources,
+  };
+
+  const char* getShapeName(Shape shape) {
+    switch (shape) {
+      case Shape::Plain:         return "plain";
+      case Shape::CubeMap:       return "cubemap";
+      case Shape::Volume:        return "volume";
+      case Shape::Animated:      return "animated";
+      case Shape::ManyResources: return "resources";
+    }
+    return "?";
+  }
+
+  struct SyntheticVTF {
+    std::string          name;
+    std::vector<uint8_t> data;
+  };
+
+  // Xorshift, so image contents don't depend on the standard library.
+  void fillDeterministic(std::span<uint8_t> data, uint32_t& state) {
+    for (uint8_t& byte : data) {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      byte = uint8_t(state);
+    }
+  }
+
+  std::optional<SyntheticVTF> makeSyntheticVTF(int32_t minorVersion, libvtf::ImageFormat format, Shape shape, uint32_t& state) {
+    if (shape == Shape::Volume && minorVersion < 2)
+      return std::nullopt;
+    if (shape == Shape::ManyResources && minorVersion < 3)
+      return std::nullopt;
+
+    libvtf::meta::VTFHeader header{};
+    header.width             = 256;
+    header.height            = 128;
+    header.depth             = minorVersion >= 2 ? 1 : 0;
+    header.numFrames         = 1;
+    header.format            = format;
+    header.lowResImageFormat = libvtf::ImageFormats::DXT1;
+    header.lowResImageWidth  = 16;
+    header.lowResImageHeight = 8;
+    header.reflectivity      = { 0.5f, 0.5f, 0.5f };
+    header.bumpScale         = 1.0f;
+    switch (shape) {
+      case Shape::CubeMap:
+        header.width = header.height = 64;
+        header.flags |= libvtf::meta::VTFFlags::ENVMAP;
+        break;
+      case Shape::Volume:
+        header.width = header.height = 32;
+        header.depth = 16;
+        break;
+      case Shape::Animated:
+        header.width = header.height = 64;
+        header.numFrames = 8;
+        break;
+      default:
+        break;
+    }
+    header.numMipLevels = libvtf::getMipLevelCount(header.width, header.height, std::max<uint16_t>(header.depth, 1));
+
+    const std::array<int32_t, 2> version = { 7, minorVersion };
+    libvtf::VTFWriter writer{ header, version };
+    std::vector<uint8_t> lowResImage(writer.layout().lowResImageSize());
+    std::vector<uint8_t> image(writer.layout().imageTotalSize());
+    fillDeterministic(lowResImage, state);
+    fillDeterministic(image, state);
+    writer.setLowResImage(lowResImage);
+    writer.setImageData(image);
+
+    std::vector<std::vector<uint8_t>> resources;
+    if (minorVersion >= 3) {
+      writer.computeCRC32();
+      const uint32_t count = shape == Shape::ManyResources ? 28 : 1;
+      resources.resize(count);
+      for (uint32_t i = 0; i < count; i++) {
+        resources[i].resize(16 + (state % 64));
+        fillDeterministic(resources[i], state);
+        if (i == 0)
+          writer.addResource(libvtf::meta::TextureSheet::ResourceID, resources[i]);
+        else
+          writer.addResource(libvtf::meta::MakeVTFResourceID('X', uint8_t(i), 0), resources[i]);
+      }
+    }
+
+    std::ostringstream name;
+    name << "7." << minorVersion << "_" << libvtf::getImageFormatInfo(format)->name << "_" << getShapeName(shape);
+    return SyntheticVTF{ name.str(), writer.write() };
+  }
+
+  std::vector<SyntheticVTF> makeCorpus(uint32_t seed) {
+    static constexpr libvtf::ImageFormat Formats[] = {
+      libvtf::ImageFormats::DXT1,
+      libvtf::ImageFormats::DXT5,
+      libvtf::ImageFormats::VITAMIN_BC7,
+      libvtf::ImageFormats::BGRA8888,
+      libvtf::ImageFormats::RGB888,
+      libvtf::ImageFormats::RGBA16161616F,
+    };
+    static constexpr Shape Shapes[] = { Shape::Plain, Shape::CubeMap, Shape::Volume, Shape::Animated, Shape::ManyResources };
+
+    std::vector<SyntheticVTF> corpus;
+    uint32_t state = seed ? seed : 1;
+    for (int32_t minorVersion = 0; minorVersion <= libvtf::meta::VTFHeader_7_5::Version[1]; minorVersion++) {
+      for (libvtf::ImageFormat format : Formats) {
+        for (Shape shape : Shapes) {
+          if (std::optional<SyntheticVTF> vtf = makeSyntheticVTF(minorVersion, format, shape, state))
+            corpus.push_back(std::move(*vtf));
+        }
+      }
+    }
+    return corpus;
+  }
+
+  struct Result {
+    std::string name;
+    uint64_t    iterations; // Passes over the corpus
+    uint64_t    operations; // Per pass
+    uint64_t    bytes;      // Per pass, 0 if the data isn't read
+    double      seconds;
+  };
+
+  // Runs fn() (one pass over the corpus) until minTime has passed.
+  template <typename Fn>
+  Result run(const Options& options, std::string name, uint64_t operations, uint64_t bytes, Fn&& fn) {
+    fn(); // Warm up
+
+    Result result{ std::move(name), 0, operations, bytes, 0.0 };
+    const auto start = std::chrono::steady_clock::now();
+    do {
+      fn();
+      result.iterations++;
+      result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (result.seconds < options.minTime);
+    return result;
+  }
+
+  // Keeps results from being optimized away.
+  volatile uint64_t g_sink = 0;
+
+  void writeJSON(std::ostream& out, const Options& options, const std::vector<SyntheticVTF>& corpus, uint64_t corpusBytes, const std::vector<Result>& results) {
+    out << std::setprecision(6);
+    out << "{\n";
+    out << "  \"corpus\": { \"seed\": " << options.seed << ", \"files\": " << corpus.size() << ", \"bytes\": " << corpusBytes << " },\n";
+    out << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result& result = results[i];
+      const double operations = double(result.operations) * double(result.iterations);
+      out << "    { \"name\": \"" << result.name << "\""
+          << ", \"iterations\": " << result.iterations
+          << ", \"operations\": " << uint64_t(operations)
+          << ", \"seconds\": " << result.seconds
+          << ", \"ns_per_op\": " << result.seconds * 1e9 / operations
+          << ", \"ops_per_second\": " << operations / result.seconds;
+      if (result.bytes)
+        out << ", \"bytes_per_second\": " << double(result.bytes) * double(result.iterations) / result.seconds;
+      out << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+  }
+
+  Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+      const std::string_view arg = argv[i];
+      if (i + 1 >= argc)
+        throw std::runtime_error("Missing value for " + std::string{ arg });
+      const char* value = argv[++i];
+      if (arg == "--corpus")
+        options.corpus = value;
+      else if (arg == "--seed")
+        options.seed = uint32_t(std::stoul(value));
+      else if (arg == "--min-time")
+        options.minTime = std::stod(value);
+      else if (arg == "--filter")
+        options.filter = value;
+      else if (arg == "--output")
+        options.output = value;
+      else
+        throw std::runtime_error("Unknown option " + std::string{ arg });
+    }
+    return options;
+  }
+
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  try {
+    options = parseOptions(argc, argv);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\nUsage: bench [--corpus DIR] [--seed N] [--min-time SECONDS] [--filter NAME] [--output FILE]" << std::endl;
+    return 1;
+  }
+
+  const std::vector<SyntheticVTF> corpus = makeCorpus(options.seed);
+  uint64_t corpusBytes = 0;
+  for (const SyntheticVTF& vtf : corpus)
+    corpusBytes += vtf.data.size();
+
+  std::vector<libvtf::VTFData> parsed;
+  uint64_t subresourceCount = 0;
+  for (const SyntheticVTF& vtf : corpus) {
+    parsed.emplace_back(vtf.data);
+    subresourceCount += parsed.back().subresources().size();
+  }
+
+  std::vector<std::filesystem::path> paths;
+  if (options.corpus) {
+    std::filesystem::create_directories(*options.corpus);
+    for (const SyntheticVTF& vtf : corpus) {
+      std::filesystem::path path = *options.corpus / (vtf.name + ".vtf");
+      std::ofstream{ path, std::ios::binary | std::ios::trunc }.write(reinterpret_cast<const char*>(vtf.data.data()), std::streamsize(vtf.data.size()));
+      paths.push_back(std::move(path));
+    }
+  }
+
+  std::vector<Result> results;
+  auto add = [&](std::string name, uint64_t operations, uint64_t bytes, auto&& fn) {
+    if (name.find(options.filter) == std::string::npos)
+      return;
+    results.push_back(run(options, std::move(name), operations, bytes, fn));
+    std::cerr << results.back().name << ": " << results.back().seconds * 1e9 / double(results.back().iterations * operations) << " ns/op" << std::endl;
+  };
+
+  // Header, directory and layout parsing.
+  add("construct", corpus.size(), 0, [&] {
+    for (const SyntheticVTF& vtf : corpus) {
+      const libvtf::VTFData data{ vtf.data };
+      g_sink = g_sink + data.imageTotalSize();
+    }
+  });
+
+  add("create", corpus.size(), 0, [&] {
+    for (const SyntheticVTF& vtf : corpus) {
+      const auto data = libvtf::VTFData::create(vtf.data);
+      g_sink = g_sink + (data ? data->imageTotalSize() : 0);
+    }
+  });
+
+  // Bounds checked access to every subresource of every file.
+  add("image_data", subresourceCount, 0, [&] {
+    uint64_t sum = 0;
+    for (const libvtf::VTFData& data : parsed) {
+      for (const libvtf::SubresourceLayout& subresource : data.subresources())
+        sum += data.imageData(subresource).size();
+    }
+    g_sink = g_sink + sum;
+  });
+
+  add("subresource_lookup", subresourceCount, 0, [&] {
+    uint64_t sum = 0;
+    for (const libvtf::VTFData& data : parsed) {
+      const libvtf::meta::VTFHeader& header = data.getHeader();
+      const uint16_t depth = std::max<uint16_t>(header.depth, 1);
+      for (uint8_t mip = 0; mip < header.numMipLevels; mip++) {
+        const uint16_t slices = std::get<2>(libvtf::adjustImageSizeByMip(header.width, header.height, depth, mip));
+        for (uint16_t frame = 0; frame < header.numFrames; frame++) {
+          for (uint16_t face = 0; face < data.faceCount(); face++) {
+            for (uint16_t slice = 0; slice < slices; slice++)
+              sum += data.subresource(frame, face, mip, slice).offset;
+          }
+        }
+      }
+    }
+    g_sink = g_sink + sum;
+  });
+
+  // The typed lookups plus a scan of the directory for a resource type.
+  add("resource_lookup", corpus.size(), 0, [&] {
+    uint64_t sum = 0;
+    for (const libvtf::VTFData& data : parsed) {
+      sum += data.crc32().value_or(0);
+      sum += data.lodControlSettings() != nullptr;
+      sum += data.settingsEx() != nullptr;
+      for (const libvtf::VTFResource resource : data.resources()) {
+        if (resource.type == libvtf::meta::TextureSheet::ResourceID)
+          sum += resource.size;
+      }
+    }
+    g_sink = g_sink + sum;
+  });
+
+  // End to end from disk: read or map, parse, then touch every subresource.
+  if (!paths.empty()) {
+    auto touch = [](const libvtf::VTFData& data) {
+      uint64_t sum = 0;
+      for (const libvtf::SubresourceLayout& subresource : data.subresources()) {
+        const std::span<const uint8_t> bytes = data.imageData(subresource);
+        sum += bytes.front() + bytes.back();
+      }
+      return sum;
+    };
+
+    add("load_read", corpus.size(), corpusBytes, [&] {
+      uint64_t sum = 0;
+      for (const std::filesystem::path& path : paths) {
+        std::ifstream file{ path, std::ios::in | std::ios::binary };
+        std::vector<uint8_t> buffer(std::filesystem::file_size(path));
+        file.read(reinterpret_cast<char*>(buffer.data()), std::streamsize(buffer.size()));
+        sum += touch(libvtf::VTFData{ buffer });
+      }
+      g_sink = g_sink + sum;
+    });
+
+    add("load_mapped", corpus.size(), corpusBytes, [&] {
+      uint64_t sum = 0;
+      for (const std::filesystem::path& path : paths) {
+        const libvtf::MappedVTF file{ path };
+        sum += touch(file.data());
+      }
+      g_sink = g_sink + sum;
+    });
+  }
+
+  if (options.output) {
+    std::ofstream out{ *options.output, std::ios::trunc };
+    writeJSON(out, options, corpus, corpusBytes, results);
+  } else {
+    writeJSON(std::cout, options, corpus, corpusBytes, results);
+  }
+  return 0;
+}
@@ -0,0 +1,67 @@
+#include "../libvtf++.hpp"
+#include "../libvtf++/cache.hpp"
+#include "test_vtf.hpp"
+
+#include <iostream>
+
+// Checks DecodedTextureCache keeps images larger than a shard's share of
+// the budget, and stays within the budget across shards.
+//
+// Usage: cache_test
+
+namespace {
+
+  int failures = 0;
+
+  void check(bool condition, const char* what) {
+    if (!condition) {
+      std::cerr << "FAILED: " << what << std::endl;
+      failures++;
+    }
+  }
+
+}
+
+int main() {
+  {
+    // A 4096x4096 RGBA8 mip is 64 MB, four times a shard's share of the
+    // default 256 MB budget.
+    const std::vector<uint8_t> file = test::makeTestVTF({ .width = 4096, .height = 4096, .mipmaps = false, .lowResImage = false });
+    const libvtf::VTFData vtf{ file };
+    libvtf::DecodedTextureCache cache;
+
+    const libvtf::DecodedTextureCache::Handle first  = cache.get(1, vtf, vtf.subresource(0, 0, 0));
+    const libvtf::DecodedTextureCache::Handle second = cache.get(1, vtf, vtf.subresource(0, 0, 0));
+    const libvtf::DecodedTextureCacheStats stats = cache.stats();
+    check(first == second, "4K image is returned from the cache on the second get()");
+    check(stats.hits == 1 && stats.misses == 1, "4K image hits on the second get()");
+    check(stats.bytes == first->pixels.size(), "4K image is counted against the budget");
+  }
+
+  {
+    // Eight 1 MB images over a 4 MB budget spread over shards: the total
+    // stays in budget and the most recent images are kept.
+    const std::vector<uint8_t> file = test::makeTestVTF({ .width = 512, .height = 512, .mipmaps = false, .lowResImage = false });
+    const libvtf::VTFData vtf{ file };
+    libvtf::DecodedTextureCache cache{ { .budget = size_t(4) << 20, .shardCount = 4 } };
+
+    for (uint64_t fileId = 0; fileId < 8; fileId++)
+      cache.get(fileId, vtf, vtf.subresource(0, 0, 0));
+    const libvtf::DecodedTextureCacheStats stats = cache.stats();
+    check(stats.bytes <= cache.budget(), "cache stays within budget across shards");
+    check(stats.entries == 4 && stats.evictions == 4, "cache evicts down to the budget");
+
+    cache.get(7, vtf, vtf.subresource(0, 0, 0));
+    check(cache.stats().hits == 1, "most recent image is still cached");
+
+    cache.clear();
+    check(cache.stats().bytes == 0, "clear() empties the cache");
+    cache.get(0, vtf, vtf.subresource(0, 0, 0));
+    check(cache.stats().bytes == size_t(1) << 20, "byte count restarts after clear()");
+  }
+
+  if (failures)
+    return 1;
+  std::cout << "cache_test passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,139 @@
+#include "../libvtf++.hpp"
+#include "../libvtf++/catalog.hpp"
+
+#include <chrono>
+#include <iostream>
+
+// Builds and queries a catalog of the VTF headers under some directories.
+// Rebuilding over an existing catalog only rescans files that changed.
+//
+// Usage: catalog build <catalog> <directory>...
+//        catalog query <catalog> [--format NAME] [--flags HEX] [--without-flags HEX]
+//                                [--min-width N] [--min-height N] [--max-width N]
+//                                [--max-height N] [--frames N] [--version MAJOR.MINOR]
+//                                [--resource HEX] [--count]
+
+namespace {
+
+  double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  std::optional<libvtf::ImageFormat> findImageFormat(std::string_view name) {
+    for (int32_t format = libvtf::ImageFormats::RGBA8888; format <= libvtf::ImageFormats::VITAMIN_FORMAT_LAST; format++) {
+      if (libvtf::getImageFormatInfo(libvtf::ImageFormat(format))->name == name)
+        return libvtf::ImageFormat(format);
+    }
+    return std::nullopt;
+  }
+
+  int build(const std::filesystem::path& output, std::span<char*> directories) {
+    std::vector<std::filesystem::path> files;
+    for (const char* directory : directories) {
+      for (const auto& entry : std::filesystem::recursive_directory_iterator(directory)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".vtf")
+          files.push_back(entry.path());
+      }
+    }
+    std::sort(files.begin(), files.end());
+
+    std::optional<libvtf::Catalog> previous;
+    if (std::filesystem::exists(output)) {
+      try {
+        previous.emplace(output);
+      } catch (const std::exception& e) {
+        std::cerr << "Ignoring previous catalog: " << e.what() << std::endl;
+      }
+    }
+
+    libvtf::CatalogBuildOptions options;
+    options.previous = previous ? &*previous : nullptr;
+
+    const auto start = std::chrono::steady_clock::now();
+    const libvtf::CatalogBuildStats stats = libvtf::buildCatalog(files, output, options);
+    std::cout << files.size() << " files in " << elapsedMs(start) << " ms: "
+              << stats.scanned << " scanned, " << stats.reused << " reused, "
+              << stats.failed << " failed" << std::endl;
+    return 0;
+  }
+
+  int query(const std::filesystem::path& path, std::span<char*> args) {
+    const libvtf::Catalog catalog{ path };
+    libvtf::CatalogQuery query{ catalog };
+    bool countOnly = false;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < args.size(); i++) {
+      const std::string_view arg = args[i];
+      if (arg == "--count") {
+        countOnly = true;
+        continue;
+      }
+      if (i + 1 >= args.size())
+        throw std::runtime_error("Missing value for " + std::string{ arg });
+      const std::string value = args[++i];
+
+      using libvtf::CatalogColumn;
+      using libvtf::CatalogCompare;
+      if (arg == "--format") {
+        const std::optional<libvtf::ImageFormat> format = findImageFormat(value);
+        if (!format)
+          throw std::runtime_error("Unknown format " + value);
+        query.format(*format);
+      } else if (arg == "--flags") {
+        query.hasFlags(uint32_t(std::stoul(value, nullptr, 16)));
+      } else if (arg == "--without-flags") {
+        query.where(CatalogColumn::Flags, CatalogCompare::NoBits, std::stoul(value, nullptr, 16));
+      } else if (arg == "--min-width") {
+        query.where(CatalogColumn::Width, CatalogCompare::AtLeast, std::stoul(value));
+      } else if (arg == "--min-height") {
+        query.where(CatalogColumn::Height, CatalogCompare::AtLeast, std::stoul(value));
+      } else if (arg == "--max-width") {
+        query.where(CatalogColumn::Width, CatalogCompare::AtMost, std::stoul(value));
+      } else if (arg == "--max-height") {
+        query.where(CatalogColumn::Height, CatalogCompare::AtMost, std::stoul(value));
+      } else if (arg == "--frames") {
+        query.where(CatalogColumn::NumFrames, CatalogCompare::Equal, std::stoul(value));
+      } else if (arg == "--version") {
+        const size_t dot = value.find('.');
+        const uint32_t version = (uint32_t(std::stoul(value.substr(0, dot))) << 16) | uint32_t(std::stoul(value.substr(dot + 1)));
+        query.where(CatalogColumn::Version, CatalogCompare::Equal, version);
+      } else if (arg == "--resource") {
+        query.hasResource(uint32_t(std::stoul(value, nullptr, 16)));
+      } else {
+        throw std::runtime_error("Unknown option " + std::string{ arg });
+      }
+    }
+    const double ms = elapsedMs(start);
+
+    if (!countOnly) {
+      query.forEach([&](size_t row) {
+        std::cout << catalog.path(row) << '\n';
+      });
+    }
+    std::cerr << query.count() << " of " << catalog.size() << " textures matched in " << ms << " ms" << std::endl;
+    return 0;
+  }
+
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: catalog build <catalog> <directory>...\n"
+                 "       catalog query <catalog> [filters...]" << std::endl;
+    return 1;
+  }
+
+  try {
+    const std::string_view command = argv[1];
+    const std::span<char*> args{ argv + 3, size_t(argc - 3) };
+    if (command == "build")
+      return build(argv[2], args);
+    if (command == "query")
+      return query(argv[2], args);
+    std::cerr << "Unknown command " << command << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+  }
+  return 1;
+}
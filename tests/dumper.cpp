@@ -1,7 +1,7 @@
 #include "../libvtf++.hpp"
+#include "../libvtf++/mapped.hpp"
 
 #include <iostream>
-#include <fstream>
 #include <cassert>
 
 int main(int argc, char** argv) {
@@ -10,23 +10,15 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  std::ifstream file(argv[1], std::ios::in | std::ios::binary);
-  if (!file || file.bad()) {
-    std::cerr << "Could not open file." << std::endl;
+  std::optional<libvtf::MappedVTF> file;
+  try {
+    file.emplace(argv[1]);
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
     return 1;
   }
 
-  std::vector<uint8_t> buffer;
-  // Resize buffer to file size
-  file.seekg(0, std::ios::end);
-  auto size = file.tellg();
-  buffer.resize(size);
-  file.seekg(0, std::ios::beg);
-
-  // Read file into buffer
-  file.read((char*)&buffer[0], size);
-
-  libvtf::VTFData data(buffer);
+  const libvtf::VTFData& data = file->data();
 
   const auto& header = data.getHeader();
 
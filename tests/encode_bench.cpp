@@ -0,0 +1,138 @@
+#include "../libvtf++.hpp"
+#include "../libvtf++/encode.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+// Reports encode throughput and quality for every BCn format and quality
+// tier on a few synthetic asset classes, to help pick a tier per class.
+//
+// Usage: encode_bench [size]
+
+namespace {
+
+  enum class AssetClass {
+    Diffuse,
+    Alpha,
+    Normal,
+  };
+
+  std::vector<uint8_t> makeSyntheticImage(uint32_t size, AssetClass kind) {
+    std::vector<uint8_t> image(size_t(size) * size * 4);
+    std::mt19937 rng{ 1234 };
+    for (uint32_t y = 0; y < size; y++) {
+      for (uint32_t x = 0; x < size; x++) {
+        uint8_t* pixel = &image[(size_t(y) * size + x) * 4];
+        const float u = float(x) / size, v = float(y) / size;
+        if (kind == AssetClass::Normal) {
+          const float nx = 0.4f * std::sin(u * 25.0f), ny = 0.4f * std::cos(v * 19.0f);
+          const float nz = std::sqrt(std::max(0.0f, 1.0f - nx * nx - ny * ny));
+          pixel[0] = uint8_t(127.5f + 127.5f * nx);
+          pixel[1] = uint8_t(127.5f + 127.5f * ny);
+          pixel[2] = uint8_t(127.5f + 127.5f * nz);
+          pixel[3] = 255;
+          continue;
+        }
+
+        const int noise = int(rng() % 24) - 12;
+        pixel[0] = uint8_t(std::clamp(int(127.0f + 127.0f * std::sin(u * 13.0f + v * 3.0f)) + noise, 0, 255));
+        pixel[1] = uint8_t(std::clamp(int(127.0f + 127.0f * std::cos(v * 9.0f - u * 5.0f)) + noise, 0, 255));
+        pixel[2] = uint8_t(std::clamp(int(255.0f * u * v) + noise, 0, 255));
+        pixel[3] = kind == AssetClass::Alpha ? uint8_t(127.5f + 127.5f * std::sin(u * 20.0f)) : 255;
+      }
+    }
+    return image;
+  }
+
+  // PSNR over the channels the format actually stores.
+  double computePSNR(std::span<const uint8_t> a, std::span<const uint8_t> b, uint32_t channels) {
+    double error = 0.0;
+    for (size_t i = 0; i < a.size(); i += 4) {
+      for (uint32_t c = 0; c < channels; c++) {
+        const double difference = double(a[i + c]) - double(b[i + c]);
+        error += difference * difference;
+      }
+    }
+    error /= double(a.size() / 4 * channels);
+    return error == 0.0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / error);
+  }
+
+  template <typename Fn>
+  double timeSeconds(Fn&& fn) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  const char* getQualityName(libvtf::EncodeQuality quality) {
+    switch (quality) {
+      case libvtf::EncodeQuality::Fast:   return "fast";
+      case libvtf::EncodeQuality::Normal: return "normal";
+      case libvtf::EncodeQuality::Slow:   return "slow";
+    }
+    return "?";
+  }
+
+}
+
+int main(int argc, char** argv) {
+  const uint32_t size = argc > 1 ? uint32_t(std::stoul(argv[1])) : 256;
+
+  struct Case {
+    const char*         name;
+    libvtf::ImageFormat format;
+    AssetClass          kind;
+    uint32_t            channels;
+  };
+  const Case cases[] = {
+    { "DXT1 diffuse",  libvtf::ImageFormats::DXT1,        AssetClass::Diffuse, 3 },
+    { "DXT3 alpha",    libvtf::ImageFormats::DXT3,        AssetClass::Alpha,   4 },
+    { "DXT5 alpha",    libvtf::ImageFormats::DXT5,        AssetClass::Alpha,   4 },
+    { "ATI1N mask",    libvtf::ImageFormats::ATI1N,       AssetClass::Diffuse, 1 },
+    { "ATI2N normal",  libvtf::ImageFormats::ATI2N,       AssetClass::Normal,  2 },
+    { "BC7 diffuse",   libvtf::ImageFormats::VITAMIN_BC7, AssetClass::Diffuse, 3 },
+    { "BC7 alpha",     libvtf::ImageFormats::VITAMIN_BC7, AssetClass::Alpha,   4 },
+  };
+
+  const uint32_t blockRows = libvtf::getBlockCountY(size);
+  std::cout << std::fixed << std::setprecision(2);
+  for (const Case& c : cases) {
+    const std::vector<uint8_t> image = makeSyntheticImage(size, c.kind);
+    std::vector<uint8_t> encoded(libvtf::getEncodedSize(c.format, size, size));
+    std::vector<uint8_t> decoded(image.size());
+
+    // The decoder fills channels the format doesn't store, do the same to
+    // the reference so they don't count as error.
+    std::vector<uint8_t> reference = image;
+    for (size_t i = 0; i < reference.size(); i += 4) {
+      for (uint32_t ch = c.channels; ch < 3; ch++)
+        reference[i + ch] = 0;
+      if (c.channels < 4)
+        reference[i + 3] = 255;
+    }
+
+    for (libvtf::EncodeQuality quality : { libvtf::EncodeQuality::Fast, libvtf::EncodeQuality::Normal, libvtf::EncodeQuality::Slow }) {
+      const libvtf::EncodeOptions options{ quality };
+      const double serial = timeSeconds([&] {
+        libvtf::encodeImage(c.format, image, size, size, encoded, 0, options);
+      });
+      const double parallel = timeSeconds([&] {
+        libvtf::parallelFor(blockRows, [&](size_t row) {
+          libvtf::encodeBlockRows(c.format, image, size, size, uint32_t(row), 1, encoded, 0, options);
+        });
+      });
+
+      libvtf::decodeImage(c.format, encoded, size, size, decoded);
+      const double megapixels = double(size) * size / 1e6;
+      std::cout << std::left << std::setw(14) << c.name << std::setw(8) << getQualityName(quality) << std::right
+                << std::setw(9) << megapixels / serial << " MPix/s, "
+                << std::setw(9) << megapixels / parallel << " MPix/s threaded, "
+                << std::setw(6) << computePSNR(reference, decoded, c.channels) << " dB" << std::endl;
+    }
+  }
+
+  return 0;
+}
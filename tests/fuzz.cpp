@@ -0,0 +1,62 @@
+#include "../libvtf++.hpp"
+#include "../libvtf++/sheet.hpp"
+
+// libFuzzer harness for VTFData::create() and the accessors it makes safe.
+// Everything a validated file points to is touched, so the sanitizers catch
+// any read that validation let through.
+//
+// clang++ -g -O1 -fsanitize=fuzzer,address,undefined --std=c++20 tests/fuzz.cpp -I. -o fuzz
+// ./fuzz corpus_dir
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  const libvtf::Expected<libvtf::VTFData, libvtf::VTFError> result = libvtf::VTFData::create({ data, size });
+  if (!result)
+    return 0;
+
+  const libvtf::VTFData& vtf = *result;
+  volatile uint8_t sink = 0;
+  auto touch = [&sink](std::span<const uint8_t> bytes) {
+    if (!bytes.empty())
+      sink = sink ^ bytes.front() ^ bytes.back();
+  };
+
+  for (const libvtf::SubresourceLayout& subresource : vtf.subresources()) {
+    if (vtf.isImageDataCompressed())
+      break;
+    touch(vtf.imageDataUnchecked(subresource));
+  }
+
+  const libvtf::meta::VTFHeader& header = vtf.getHeader();
+  for (uint16_t frame = 0; frame < header.numFrames && !vtf.isImageDataCompressed(); frame++) {
+    for (uint16_t face = 0; face < vtf.faceCount(); face++) {
+      for (uint8_t mipLevel = 0; mipLevel < header.numMipLevels; mipLevel++)
+        touch(vtf.imageDataUnchecked(frame, face, mipLevel));
+    }
+  }
+
+  for (const libvtf::VTFResource resource : vtf.resources())
+    touch(resource.data);
+
+  touch(vtf.lowResImageData());
+  if (const std::optional<uint32_t> crc32 = vtf.crc32())
+    sink = sink ^ uint8_t(*crc32);
+  if (const libvtf::meta::TextureLODControlSettings* settings = vtf.lodControlSettings())
+    sink = sink ^ settings->resolutionClamp[0];
+  if (const libvtf::meta::TextureSettingsEx* settings = vtf.settingsEx())
+    sink = sink ^ settings->flags[0];
+
+  try {
+    if (const std::optional<libvtf::TextureSheetView> sheet = libvtf::getTextureSheet(vtf)) {
+      for (uint32_t i = 0; i < sheet->sequenceCount(); i++) {
+        const libvtf::SheetSequence sequence = sheet->sequence(i);
+        for (uint32_t frame = 0; frame < sequence.frameCount(); frame++) {
+          for (const libvtf::meta::TextureSheetRect& rect : sequence.frame(frame).rects())
+            sink = sink ^ uint8_t(libvtf::getSheetRect(rect, header.width, header.height).width);
+        }
+      }
+    }
+  } catch (const std::runtime_error&) {
+  }
+
+  return 0;
+}
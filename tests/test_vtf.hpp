@@ -0,0 +1,57 @@
+#pragma once
+
+#include "../libvtf++.hpp"
+#include "../libvtf++/mipmap.hpp"
+#include "../libvtf++/writer.hpp"
+
+#include <functional>
+#include <span>
+#include <vector>
+
+// Synthetic VTF files shared by the test and benchmark programs.
+
+namespace test {
+
+  struct TestVTFOptions {
+    uint16_t            width       = 256;
+    uint16_t            height      = 256;
+    uint16_t            numFrames   = 1;
+    libvtf::ImageFormat format      = libvtf::ImageFormats::DXT1;
+    bool                mipmaps     = true;  // Full chain, or the top mip only
+    bool                lowResImage = true;  // 16x16 DXT1
+    bool                resources   = false; // CRC and an empty sprite sheet
+    // Fills the low-res and then the high-res image data, 0xAA bytes if unset.
+    std::function<void(std::span<uint8_t>)> fill;
+  };
+
+  inline std::vector<uint8_t> makeTestVTF(const TestVTFOptions& options = {}) {
+    libvtf::meta::VTFHeader header{};
+    header.width             = options.width;
+    header.height            = options.height;
+    header.numFrames         = options.numFrames;
+    header.format            = options.format;
+    header.lowResImageFormat = options.lowResImage ? libvtf::ImageFormats::DXT1 : libvtf::ImageFormats::UNKNOWN;
+    header.lowResImageWidth  = options.lowResImage ? 16 : 0;
+    header.lowResImageHeight = options.lowResImage ? 16 : 0;
+    header.numMipLevels      = options.mipmaps ? libvtf::getMipLevelCount(options.width, options.height) : 1;
+
+    libvtf::VTFWriter writer{ header };
+    std::vector<uint8_t> lowResImage(writer.layout().lowResImageSize(), 0x55);
+    std::vector<uint8_t> image(writer.layout().imageTotalSize(), 0xAA);
+    if (options.fill) {
+      options.fill(lowResImage);
+      options.fill(image);
+    }
+
+    static constexpr uint8_t Sheet[64] = {};
+    if (options.lowResImage)
+      writer.setLowResImage(lowResImage);
+    writer.setImageData(image);
+    if (options.resources) {
+      writer.setCRC32(0x12345678);
+      writer.addResource(libvtf::meta::TextureSheet::ResourceID, Sheet);
+    }
+    return writer.write();
+  }
+
+}
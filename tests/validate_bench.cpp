@@ -0,0 +1,104 @@
+#include "../libvtf++.hpp"
+#include "test_vtf.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+// Measures the cost of VTFData::create() validation next to the throwing
+// constructor, over files of increasing size. Validation only looks at the
+// header, directory and layout, so its cost should not grow with the image.
+//
+// Usage: validate_bench [iterations]
+
+namespace {
+
+  // An 80-byte 7.2 header with a 1x1 I8 volume of `depth` slices in
+  // `numFrames` frames, and no image data.
+  std::vector<uint8_t> makeOversizedHeader(uint16_t depth, uint16_t numFrames) {
+    libvtf::meta::VTFHeader_7_2 header{};
+    header.signature         = libvtf::meta::VTFBaseHeader::ValidSignature;
+    header.version           = libvtf::meta::VTFHeader_7_2::Version;
+    header.headerSize        = sizeof(header);
+    header.width             = 1;
+    header.height            = 1;
+    header.depth             = depth;
+    header.numFrames         = numFrames;
+    header.format            = libvtf::ImageFormats::I8;
+    header.lowResImageFormat = libvtf::ImageFormats::UNKNOWN;
+    header.numMipLevels      = 1;
+
+    std::vector<uint8_t> file(sizeof(header));
+    std::memcpy(file.data(), &header, sizeof(header));
+    return file;
+  }
+
+  template <typename Fn>
+  double timeNanoseconds(size_t iterations, Fn&& fn) {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+      fn();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / double(iterations);
+  }
+
+}
+
+int main(int argc, char** argv) {
+  const size_t iterations = argc > 1 ? std::stoul(argv[1]) : 200000;
+
+  // Headers whose layout can't fit in the file are rejected before the
+  // layout is built, instead of allocating it.
+  for (const auto [depth, numFrames] : { std::pair<uint16_t, uint16_t>{ 65535, 65535 }, { 1000, 1000 } }) {
+    if (libvtf::VTFData::create(makeOversizedHeader(depth, numFrames))) {
+      std::cerr << "Oversized " << depth << "x" << numFrames << " header passed validation." << std::endl;
+      return 1;
+    }
+  }
+
+  struct Case {
+    uint16_t size;
+    uint16_t numFrames;
+  };
+  const Case cases[] = { { 64, 1 }, { 256, 1 }, { 1024, 1 }, { 4096, 1 }, { 256, 16 } };
+
+  std::cout << std::fixed << std::setprecision(1);
+  for (const Case& c : cases) {
+    const std::vector<uint8_t> file = test::makeTestVTF({ .width = c.size, .height = c.size, .numFrames = c.numFrames, .resources = true });
+
+    size_t subresources = 0;
+    const double create = timeNanoseconds(iterations, [&] {
+      const auto result = libvtf::VTFData::create(file);
+      if (!result)
+        throw std::runtime_error("Benchmark file failed validation.");
+      subresources += result->subresources().size();
+    });
+    const double construct = timeNanoseconds(iterations, [&] {
+      const libvtf::VTFData data{ file };
+      subresources += data.subresources().size();
+    });
+
+    const libvtf::VTFData data = libvtf::VTFData::create(file).value();
+    uint64_t checksum = 0;
+    const double checked = timeNanoseconds(iterations, [&] {
+      for (const libvtf::SubresourceLayout& subresource : data.subresources())
+        checksum += data.imageData(subresource).size();
+    });
+    const double unchecked = timeNanoseconds(iterations, [&] {
+      for (const libvtf::SubresourceLayout& subresource : data.subresources())
+        checksum += data.imageDataUnchecked(subresource).size();
+    });
+
+    const double perSubresource = 1.0 / double(data.subresources().size());
+    std::cout << std::setw(5) << c.size << "x" << std::setw(2) << c.numFrames << " frames, "
+              << std::setw(9) << file.size() / 1024 << " KiB: "
+              << "create " << std::setw(7) << create << " ns, "
+              << "constructor " << std::setw(7) << construct << " ns, "
+              << "accessors " << std::setw(5) << checked * perSubresource << " / "
+              << std::setw(5) << unchecked * perSubresource << " ns per subresource (checked / unchecked)" << std::endl;
+    if (!subresources || !checksum)
+      return 1;
+  }
+
+  return 0;
+}